@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# Script to be able to run on common Linux and *nix-like OSes (eg macOS)
+# to build and run the C++ micro-benchmarks under the portableBenchmarks directory.
+#
+# Requires a newish g++ (even if a front-end to Clang for example).
+# Does not need gtest.
+#
+# Intended to be run from top-level dir of project.
+# Any arguments are passed to the benchmark executable,
+# eg to write the JSON results to a file and select benchmarks:
+#
+#     sh ./PortableBenchmarksDriver.sh -o bench.json --filter=SecureFrame
+
+# Generates a temporary executable at top level.
+EXENAME=tmpbenchexe
+
+# Project source root.
+PROJSRCROOT=content/OTRadioLink
+# Project source files under test.
+PROJSRCS="`find ${PROJSRCROOT} -name '*.cpp' -type f -print`"
+
+# Benchmark source files dir.
+BENCHSRCDIR=portableBenchmarks
+# Source files.
+BENCHSRCS="`find ${BENCHSRCDIR} -name '*.cpp' -type f -print`"
+
+# Libs.
+OTHERLIBS="-lpthread"
+
+# Source includes (paths).
+INCLUDES="-I${PROJSRCROOT} -I${PROJSRCROOT}/utility"
+
+rm -f ${EXENAME}
+if g++ -o ${EXENAME} -std=c++0x -O2 -Wall ${INCLUDES} ${PROJSRCS} ${BENCHSRCS} ${OTHERLIBS} ; then
+    echo Compiled. 1>&2
+else
+    echo Failed to compile. 1>&2
+    exit 2
+fi
+
+./${EXENAME} "$@"
@@ -27,6 +27,7 @@ Author(s) / Copyright (s): Damon Hart-Davis 2015--2016
 #include "utility/OTRadioLink_FrameType.h"
 #include "utility/OTRadioLink_SecureableFrameType.h"
 #include "utility/OTRadioLink_SecureableFrameType_V0p2Impl.h"
+#include "utility/OTRadioLink_NodeAssociationStore.h"
 
 // Radio Link base class definition.
 #include "utility/OTRadioLink_OTRadioLink.h"
@@ -34,4 +35,7 @@ Author(s) / Copyright (s): Damon Hart-Davis 2015--2016
 // Radio Link Null class definition.
 #include "utility/OTRadioLink_OTNullRadioLink.h"
 
+// Non-blocking AT-command engine for serial modems.
+#include "utility/OTRadioLink_ATCommandEngine.h"
+
 #endif
@@ -83,6 +83,7 @@ Author(s) / Copyright (s): Damon Hart-Davis 2015--2016
 #include "utility/OTV0P2BASE_SensorDS18B20.h"
 #include "utility/OTV0P2BASE_SensorQM1.h"
 #include "utility/OTV0P2BASE_SensorOccupancy.h"
+#include "utility/OTV0P2BASE_SensorScheduler.h"
 
 // Basic immutable GPIO assignments and similar.
 #include "utility/OTV0P2BASE_BasicPinAssignments.h"
@@ -114,6 +115,8 @@ Author(s) / Copyright (s): Damon Hart-Davis 2015--2016
 
 // Support for JSON stats.
 #include "utility/OTV0P2BASE_JSONStats.h"
+// Compact binary alternative to JSON stats, eg for secure frames.
+#include "utility/OTV0P2BASE_CompactStats.h"
 // Simple single-line system stats display (eg to Serial).
 #include "utility/OTV0P2BASE_SystemStatsLine.h"
 // Support for older/simple compact binary stats.
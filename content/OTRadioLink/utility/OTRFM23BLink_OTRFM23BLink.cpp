@@ -77,26 +77,37 @@ if(!isOK) { V0P2BASE_DEBUG_SERIAL_PRINTLN_FLASHSTRING("RFM23 bad"); }
 
 // Configure the radio from a list of register/value pairs in readonly PROGMEM/Flash, terminating with an 0xff register value.
 // NOTE: argument is not a pointer into SRAM, it is into PROGMEM!
+// Each run of adjacent registers is written as one auto-increment burst:
+// the full standard configs collapse from ~90 SPI transactions to ~15.
 void OTRFM23BLinkBase::_registerBlockSetup(const uint8_t registerValues[][2])
     {
     // Lock out interrupts.
     ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
         {
         const bool neededEnable = _upSPI_();
-        for( ; ; )
+        uint8_t reg = pgm_read_byte(&(registerValues[0][0]));
+        while(0xff != reg)
             {
-            const uint8_t reg = pgm_read_byte(&(registerValues[0][0]));
-            const uint8_t val = pgm_read_byte(&(registerValues[0][1]));
-            if(0xff == reg) { break; }
+            // Select RFM23B for duration of burst write.
+            _SELECT_();
+            _wr(reg | 0x80); // Force to write.
+            for( ; ; )
+                {
+                const uint8_t val = pgm_read_byte(&(registerValues[0][1]));
 #if 0 && defined(V0P2BASE_DEBUG)
-            V0P2BASE_DEBUG_SERIAL_PRINT_FLASHSTRING("RFM23 reg 0x");
-            V0P2BASE_DEBUG_SERIAL_PRINTFMT(reg, HEX);
-            V0P2BASE_DEBUG_SERIAL_PRINT_FLASHSTRING(" = 0x");
-            V0P2BASE_DEBUG_SERIAL_PRINTFMT(val, HEX);
-            V0P2BASE_DEBUG_SERIAL_PRINTLN();
+                V0P2BASE_DEBUG_SERIAL_PRINT_FLASHSTRING("RFM23 reg 0x");
+                V0P2BASE_DEBUG_SERIAL_PRINTFMT(reg, HEX);
+                V0P2BASE_DEBUG_SERIAL_PRINT_FLASHSTRING(" = 0x");
+                V0P2BASE_DEBUG_SERIAL_PRINTFMT(val, HEX);
+                V0P2BASE_DEBUG_SERIAL_PRINTLN();
 #endif
-            _writeReg8Bit_(reg, val);
-            ++registerValues;
+                _wr(val);
+                ++registerValues;
+                // Continue the burst while the next register is the one the RFM23B auto-increments to.
+                const uint8_t next = pgm_read_byte(&(registerValues[0][0]));
+                if(next != ++reg) { reg = next; break; }
+                }
+            _DESELECT_();
             }
         if(neededEnable) { _downSPI_(); }
         }
@@ -136,6 +147,32 @@ void OTRFM23BLinkBase::_queueFrameInTXFIFO(const uint8_t *bptr, uint8_t buflen)
         }
     }
 
+// Queue the first loadLen bytes of a frame of frameLen bytes in the TX FIFO,
+// and set the frame length if in packet-handling mode.
+void OTRFM23BLinkBase::_loadTXFIFO(const uint8_t *const buf, const uint8_t loadLen, const uint8_t frameLen)
+    {
+    _queueFrameInTXFIFO(buf, loadLen);
+
+    // If in packet-handling mode then set the frame length.
+    if(_dataAccessControl & RFM23B_ENPACTX)
+        {
+        const bool neededEnable = _upSPI_();
+        _writeReg8Bit_(REG_3E_PACKET_LENGTH, frameLen);
+        if(neededEnable) { _downSPI_(); }
+        }
+    }
+
+// Wait a little before retransmission.
+static void pauseBeforeResend()
+    {
+#ifndef OTV0P2BASE_IDLE_NOT_RECOMMENDED
+    ::OTV0P2BASE::_idleCPU(WDTO_15MS, false); // FIXME: make this a configurable delay.
+#else
+    ::OTV0P2BASE::nap(WDTO_15MS); // FIXME: make this a configurable delay.
+//    ::OTV0P2BASE::delay_ms(15); // FIXME: seems a shame to burn cycles/juice here...
+#endif
+    }
+
 // Transmit contents of on-chip TX FIFO: caller should revert to low-power standby mode (etc) if required.
 // Returns true if packet apparently sent correctly/fully.
 // Does not clear TX FIFO (so possible to re-send immediately).
@@ -150,8 +187,7 @@ bool OTRFM23BLinkBase::_TXFIFO()
     //    _writeReg8Bit_(REG_INT_ENABLE1, 4);
     //    _writeReg8Bit_(REG_INT_ENABLE2, 0);
         // Disable all interrupts (eg to avoid invoking the RX ISR).
-        _writeReg8Bit_(REG_INT_ENABLE1, 0);
-        _writeReg8Bit_(REG_INT_ENABLE2, 0);
+        _writeRegPair(REG_INT_ENABLE1, 0, 0);
         _clearInterrupts_();
         // Enable TX mode and transmit TX FIFO contents.
         _modeTX_();
@@ -199,6 +235,9 @@ bool OTRFM23BLinkBase::sendRaw(const uint8_t *const buf, const uint8_t buflen, c
     {
     // FIXME: currently ignores all hints.
 
+    // Frames longer than the FIFO can only be streamed.
+    if(buflen > MaxTXMsgLen) { return(false); }
+
     // Should not need to lock out interrupts while sending
     // as no poll()/ISR should start until this completes,
     // but will need to stop any RX in process,
@@ -214,28 +253,14 @@ bool OTRFM23BLinkBase::sendRaw(const uint8_t *const buf, const uint8_t buflen, c
 //    _modeStandbyAndClearState_();
 
     // Load the frame into the TX FIFO.
-    _queueFrameInTXFIFO(buf, buflen);
-
-    // If in packet-handling mode then set the frame length.
-    const bool neededEnable = _upSPI_();
-    // Check if packet handling in RFM23B is enabled and set packet length
-    if(_readReg8Bit_(REG_30_DATA_ACCESS_CONTROL) & RFM23B_ENPACTX)
-       { _writeReg8Bit_(REG_3E_PACKET_LENGTH, buflen); }
-    if(neededEnable) { _downSPI_(); }
+    _loadTXFIFO(buf, buflen, buflen);
 
     // Send the frame once.
     bool result = _TXFIFO();
     // For maximum 'power' attempt to resend the frame again after a short delay.
     if(power >= TXmax)
         {
-        // Wait a little before retransmission.
-#ifndef OTV0P2BASE_IDLE_NOT_RECOMMENDED
-        ::OTV0P2BASE::_idleCPU(WDTO_15MS, false); // FIXME: make this a configurable delay.
-#else
-        ::OTV0P2BASE::nap(WDTO_15MS); // FIXME: make this a configurable delay.
-//        ::OTV0P2BASE::delay_ms(15); // FIXME: seems a shame to burn cycles/juice here...
-#endif
-
+        pauseBeforeResend();
         // Resend the frame.
         if(!_TXFIFO()) { result = false; }
         }
@@ -247,10 +272,113 @@ bool OTRFM23BLinkBase::sendRaw(const uint8_t *const buf, const uint8_t buflen, c
     return(result);
     }
 
+// Note TX status register 1 bits and top up the TX FIFO if streaming and almost empty.
+// Called from the streaming _TXFIFO() wait loop or poll()/ISR, whichever reads the status first.
+// Interrupts must be blocked and SPI must already be configured and running.
+void OTRFM23BLinkBase::_serviceTXStream(OTRFM23BLinkStreamState<true> &s, const uint8_t status1)
+    {
+    s.txStatus |= status1;
+    const uint8_t left = s.txLeft;
+    if((0 == left) || !(status1 & (RFM23B_ITXFFAEM >> 8))) { return; }
+    // At most TX_STREAM_THRESHOLD bytes remain in the FIFO, so there is room for a chunk.
+    const uint8_t n = (left > TX_STREAM_CHUNK) ? TX_STREAM_CHUNK : left;
+    _SELECT_();
+    _wr(REG_FIFO | 0x80); // Start burst write to TX FIFO.
+    for(uint8_t i = n; i-- > 0; ) { _wr(*s.txPtr++); }
+    _DESELECT_();
+    s.txLeft = left - n;
+    }
+
+// Transmit contents of on-chip TX FIFO, streaming moreLen further bytes at more into it as it empties.
+// Caller should revert to low-power standby mode (etc) if required.
+// Returns true if packet apparently sent correctly/fully.
+bool OTRFM23BLinkBase::_TXFIFO(OTRFM23BLinkStreamState<true> &s, const uint8_t *const more, const uint8_t moreLen)
+    {
+    const bool neededEnable = _upSPI_();
+
+    // Lock out interrupts while fiddling with interrupts and starting the TX.
+    ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+        {
+        // Interrupt on TX FIFO almost empty, to refill from poll()/ISR as well as below,
+        // and on packet sent so that that is not missed if the ISR reads the status.
+        s.txStatus = 0;
+        s.txPtr = more;
+        s.txLeft = moreLen;
+        s.txStreaming = true;
+        _writeReg8Bit_(REG_TX_FIFO_CTRL2, TX_STREAM_THRESHOLD);
+        _writeRegPair(REG_INT_ENABLE1, RFM23B_ENTXFFAEM | RFM23B_ENPKSENT, 0);
+        _clearInterrupts_();
+        // Enable TX mode and transmit TX FIFO contents.
+        _modeTX_();
+        }
+
+    // As for _TXFIFO(), but topping up the FIFO and noting status as it goes.
+    OTV0P2BASE_busy_spin_delay(1000);
+    bool result = false;
+    for(int i = MAX_TX_ms; --i >= 0; )
+        {
+        OTV0P2BASE_busy_spin_delay(1000);
+        uint8_t status;
+        ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+            {
+            _serviceTXStream(s, _readReg8Bit_(REG_INT_STATUS1));
+            status = s.txStatus;
+            }
+        if(status & (RFM23B_IFFERROR >> 8)) { break; } // FIFO underflow: frame cut short.
+        if(status & 4) { result = true; break; } // Packet sent!
+        }
+
+    ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+        {
+        s.txStreaming = false;
+        s.txLeft = 0;
+        _writeRegPair(REG_INT_ENABLE1, 0, 0);
+        _writeReg8Bit_(REG_TX_FIFO_CTRL2, TX_FIFO_AEM_DEFAULT);
+        }
+
+    if(neededEnable) { _downSPI_(); }
+    return(result);
+    }
+
+// Send a frame longer than the TX FIFO by streaming it, in packet-handling mode only.
+// Otherwise as sendRaw().
+bool OTRFM23BLinkBase::_sendRawStreamed(OTRFM23BLinkStreamState<true> &s, const uint8_t *const buf, const uint8_t buflen, const int8_t channel, const TXpower power)
+    {
+    // Disable all interrupts (eg to avoid invoking the RX handler).
+    _modeStandbyAndClearState_();
+
+    // Transmit on the channel specified.
+    _setChannel(channel);
+
+    // Only the packet handler can be told the frame length up front.
+    bool result = false;
+    if(_dataAccessControl & RFM23B_ENPACTX)
+        {
+        // Load as much as fits into the TX FIFO and stream in the remainder.
+        const uint8_t first = MaxTXMsgLen;
+        _loadTXFIFO(buf, first, buflen);
+        result = _TXFIFO(s, buf + first, buflen - first);
+        // For maximum 'power' attempt to resend the frame again after a short delay.
+        if(power >= TXmax)
+            {
+            pauseBeforeResend();
+            // Resend the frame, reloading the FIFO drained by streaming.
+            _queueFrameInTXFIFO(buf, first);
+            if(!_TXFIFO(s, buf + first, buflen - first)) { result = false; }
+            }
+        }
+
+    // Revert to RX mode if listening, else go to standby to save energy.
+    _dolisten();
+
+    return(result);
+    }
+
 // Switch listening off, or on to specified channel.
 // listenChannel will have been set by time this is called.
 // This always switches to standby mode first, then switches on RX as needed.
-void OTRFM23BLinkBase::_dolisten()
+// If streamRX then in packet-handling mode long frames are drained from the RX FIFO in chunks.
+void OTRFM23BLinkBase::_listen(const bool streamRX)
     {
     // Unconditionally stop listening and go into low-power standby mode.
     _modeStandbyAndClearState_();
@@ -276,26 +404,36 @@ void OTRFM23BLinkBase::_dolisten()
         {
         const bool neededEnable = _upSPI_();
 
-        // Clear RX and TX FIFOs.
-        _writeReg8Bit_(REG_OP_CTRL2, 3); // FFCLRRX | FFCLRTX
-        _writeReg8Bit_(REG_OP_CTRL2, 0);
+        // RX and TX FIFOs were cleared entering standby above,
+        // and nothing since (eg a channel change) can have refilled them.
+
+        const bool packetRX = (0 != (_dataAccessControl & RFM23B_ENPACRX));
+        const bool streaming = streamRX && packetRX;
 
-        // Set FIFO RX almost-full threshold as specified.
-        _writeReg8Bit_(REG_RX_FIFO_CTRL, maxTypicalFrameBytes); // 55 is the default.
+        // Set FIFO RX almost-full threshold as specified,
+        // or to drain each chunk of a long frame when streaming.
+        _writeReg8Bit_(REG_RX_FIFO_CTRL, streaming ? RX_STREAM_CHUNK : maxTypicalFrameBytes); // 55 is the default.
 
         // Enable requested RX-related interrupts.
         // Do this regardless of hardware interrupt support on the board.
         // Check if packet handling in RFM23B is enabled and enable interrupts accordingly.
-        if ( _readReg8Bit_(REG_30_DATA_ACCESS_CONTROL) & RFM23B_ENPACRX )  {
-           _writeReg8Bit_(REG_INT_ENABLE1, RFM23B_ENPKVALID);
-           _writeReg8Bit_(REG_INT_ENABLE2, 0); 
-           if ((_readReg8Bit_(REG_33_HEADER_CONTROL2) & RFM23B_FIXPKLEN ) == RFM23B_FIXPKLEN ) 
-              _writeReg8Bit_(REG_3E_PACKET_LENGTH, maxTypicalFrameBytes);
-        }
-        else {
-           _writeReg8Bit_(REG_INT_ENABLE1, 0x10); // enrxffafull: Enable RX FIFO Almost Full.
-           _writeReg8Bit_(REG_INT_ENABLE2, WAKE_ON_SYNC_RX ? 0x80 : 0); // enswdet: Enable Sync Word Detected.
-        }
+        if(packetRX)
+            {
+            if(streaming)
+                {
+                // Stream long frames: also interrupt each time a chunk is ready to drain,
+                // and on errors so that a partly-streamed frame is abandoned.
+                _writeRegPair(REG_INT_ENABLE1, RFM23B_ENPKVALID | RFM23B_ENRXFFAFUL | RFM23B_ENFFERR | RFM23B_ENCRCERROR, 0);
+                }
+            else { _writeRegPair(REG_INT_ENABLE1, RFM23B_ENPKVALID, 0); }
+            if((_headerControl2 & RFM23B_FIXPKLEN) == RFM23B_FIXPKLEN)
+                { _writeReg8Bit_(REG_3E_PACKET_LENGTH, maxTypicalFrameBytes); }
+            }
+        else
+            {
+            // enrxffafull: Enable RX FIFO Almost Full; enswdet: Enable Sync Word Detected.
+            _writeRegPair(REG_INT_ENABLE1, 0x10, WAKE_ON_SYNC_RX ? 0x80 : 0);
+            }
 
         // Clear any current interrupt/status.
         _clearInterrupts_();
@@ -330,9 +468,7 @@ void OTRFM23BLinkBase::_RXFIFO(uint8_t *buf, const uint8_t bufSize)
         _writeReg8Bit_(REG_OP_CTRL2, 3); // FFCLRRX | FFCLRTX
         _writeReg8Bit_(REG_OP_CTRL2, 0); // Needs both writes to clear.
         // Disable all interrupts.
-        _writeReg8Bit_(REG_INT_ENABLE1, 0);
-        _writeReg8Bit_(REG_INT_ENABLE2, 0); // TODO: possibly combine in burst write with previous...
-    //    _writeReg16Bit0_(REG_INT_ENABLE1);
+        _writeRegPair(REG_INT_ENABLE1, 0, 0);
         // Clear any interrupts already/still pending...
         _clearInterrupts_();
 
@@ -343,14 +479,15 @@ void OTRFM23BLinkBase::_RXFIFO(uint8_t *buf, const uint8_t bufSize)
 // Configure radio for transmission via specified channel < nChannels; non-negative.
 void OTRFM23BLinkBase::_setChannel(const uint8_t channel)
     {
-    // Nothing to do if already on the correct channel.
+    // Nothing to do if already on the correct channel,
+    // which is the usual case when switching between TX and RX.
     if(_currentChannel == channel) { return; }
 
     // Reject out-of-range channel requests.
     if(channel >= nChannels) { return; }
 
     // Set up registers for new config.
-    _registerBlockSetup((regValPair_t *) (channelConfig[channel].config));
+    _loadChannelConfig(channel);
 
 #if 0 && defined(MILENKO_DEBUG)
       V0P2BASE_DEBUG_SERIAL_PRINT("C:");
@@ -358,7 +495,21 @@ void OTRFM23BLinkBase::_setChannel(const uint8_t channel)
       V0P2BASE_DEBUG_SERIAL_PRINTLN();
       //readRegs((uint8_t)0,(uint8_t)0x7e);
 #endif
+    }
 
+// Load the register config for the specified channel < nChannels, and cache the packet-handling registers.
+// Records the channel as current.
+void OTRFM23BLinkBase::_loadChannelConfig(const uint8_t channel)
+    {
+    _registerBlockSetup((regValPair_t *) (channelConfig[channel].config));
+    // Read back once here rather than on every poll and TX/RX switch.
+    ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+        {
+        const bool neededEnable = _upSPI_();
+        _dataAccessControl = _readReg8Bit_(REG_30_DATA_ACCESS_CONTROL);
+        _headerControl2 = _readReg8Bit_(REG_33_HEADER_CONTROL2);
+        if(neededEnable) { _downSPI_(); }
+        }
     // Remember channel now in use.
     _currentChannel = channel;
     }
@@ -426,7 +577,7 @@ bool OTRFM23BLinkBase::begin()
     //if(1 != nChannels) { return(false); } // Can only handle a single channel.
     if(!_checkConnected()) { return(false); }
     // Set registers for default (0) channel.
-    _registerBlockSetup((regValPair_t *) (channelConfig[0].config));
+    _loadChannelConfig(0);
     _modeStandbyAndClearState_();
     return(true);
     }
@@ -40,6 +40,7 @@ Author(s) / Copyright (s): Damon Hart-Davis 2013--2016
 #include <OTV0p2Base.h>
 #include <OTRadioLink.h>
 #include "OTRadioLink_ISRRXQueue.h"
+#include "OTRadioLink_ISRRXQueueStats.h"
 
 
 namespace OTRFM23BLink
@@ -58,6 +59,38 @@ namespace OTRFM23BLink
     // See end for library of common configurations.
 
 #ifdef ARDUINO_ARCH_AVR
+    // State for streaming frames longer than the 64-byte FIFOs.
+    // Empty unless streaming is enabled (maxFrameLen > 64) so that it costs no RAM otherwise,
+    // and the routines that use it are only linked in where they are called with the streaming state.
+    template <bool streaming> struct OTRFM23BLinkStreamState;
+    template <> struct OTRFM23BLinkStreamState<false>
+        {
+        static constexpr bool isTXStreaming() { return(false); }
+        static constexpr uint8_t getRXStreamed() { return(0); }
+        static constexpr volatile uint8_t *getRXStreamBuf() { return(NULL); }
+        void resetRX() { }
+        };
+    template <> struct OTRFM23BLinkStreamState<true>
+        {
+        // State of a long frame being streamed out, shared between sendRaw() and poll()/ISR.
+        // Remainder of the frame not yet in the TX FIFO.
+        const uint8_t *txPtr = NULL;
+        volatile uint8_t txLeft = 0;
+        // True while a streamed TX is in progress.
+        volatile bool txStreaming = false;
+        // Interrupt status register 1 bits seen during the streamed TX.
+        volatile uint8_t txStatus = 0;
+        // Queue buffer that a long frame is being streamed into, and bytes streamed so far.
+        // The buffer is held across ISR calls until the frame completes or is abandoned;
+        // meanwhile the foreground can only remove frames, which never moves it.
+        volatile uint8_t *rxBuf = NULL;
+        uint8_t rxStreamed = 0;
+        bool isTXStreaming() const { return(txStreaming); }
+        uint8_t getRXStreamed() const { return(rxStreamed); }
+        volatile uint8_t *getRXStreamBuf() const { return(rxBuf); }
+        void resetRX() { rxStreamed = 0; }
+        };
+
     // Base class for RFM23B radio link hardware driver.
     // Neither re-entrant nor ISR-safe except where stated.
     // Contains elements that do not depend on template parameters.
@@ -67,14 +100,19 @@ namespace OTRFM23BLink
         protected:
             // Configure the radio from a list of register/value pairs in readonly PROGMEM/Flash, terminating with an 0xff register value.
             // NOTE: argument is not a pointer into SRAM, it is into PROGMEM!
+            // Runs of adjacent registers are written as single auto-increment bursts,
+            // so list registers in ascending order where possible.
             typedef uint8_t regValPair_t[2];
             void _registerBlockSetup(const regValPair_t* registerValues);
 
         public:
-            // Maximum raw RX message size in bytes.
+            // Maximum raw RX message size in bytes without streaming, ie the RX FIFO size.
             static constexpr int MaxRXMsgLen = 64;
-            // Maximum rawTX message size in bytes.
+            // Maximum rawTX message size in bytes without streaming, ie the TX FIFO size.
             static constexpr int MaxTXMsgLen = 64;
+            // Maximum frame size when streaming through the FIFOs in packet-handling mode.
+            // Limited by the 8-bit packet length register.
+            static constexpr uint8_t MaxStreamedMsgLen = 255;
 
             // Maximum allowed TX time, milliseconds.
             // Attempting a longer TX will result in a timeout.
@@ -107,8 +145,16 @@ namespace OTRFM23BLink
             typedef const uint8_t RFM23_Reg_Values_t[][2] PROGMEM;
 
         protected:
-            // Currently configured channel; starts at default 0.
-            uint8_t _currentChannel = 0;
+            // Channel whose config is loaded in the radio registers, or NO_CHANNEL if none is.
+            // Lets _setChannel() skip reloading the same config on every TX/RX switch.
+            static constexpr uint8_t NO_CHANNEL = 0xff;
+            uint8_t _currentChannel = NO_CHANNEL;
+
+            // Copies of the data access control and header control 2 registers for the current channel,
+            // taken when its config is loaded, so that poll/ISR and TX/RX switching need not read them back.
+            // Only _registerBlockSetup() writes these registers.
+            uint8_t _dataAccessControl = 0;
+            uint8_t _headerControl2 = 0;
 
             // RFM23B_REG_03_INTERRUPT_STATUS1
             static constexpr uint16_t RFM23B_IFFERROR   = 0x80<<8;
@@ -188,6 +234,7 @@ namespace OTRFM23BLink
             static constexpr uint8_t REG_47_RECEIVED_HEADER3 = 0x47;
             static constexpr uint8_t REG_4B_RECEIVED_PACKET_LENGTH = 0x4b;
             static constexpr uint8_t REG_TX_POWER = 0x6d; // Transmit power.
+            static constexpr uint8_t REG_TX_FIFO_CTRL2 = 0x7d; // TX FIFO almost-empty threshold.
             static constexpr uint8_t REG_RX_FIFO_CTRL = 0x7e; // RX FIFO control.
             static constexpr uint8_t REG_FIFO = 0x7f; // TX FIFO on write, RX FIFO on read.
             // Allow validation of RFM22/RFM23 device and SPI connection to it.
@@ -197,6 +244,15 @@ namespace OTRFM23BLink
             // Iff true then attempt to wake up as the start of a frame arrives, eg on sync.
             static constexpr bool WAKE_ON_SYNC_RX = false;
 
+            // Streaming of frames longer than the FIFOs.
+            // TX refills when down to TX_STREAM_THRESHOLD bytes (~2ms at 57.6kbps),
+            // which leaves room for TX_STREAM_CHUNK more.
+            // RX drains RX_STREAM_CHUNK bytes each time the RX FIFO holds that many.
+            static constexpr uint8_t TX_FIFO_AEM_DEFAULT = 4; // RFM23B default and standard configs.
+            static constexpr uint8_t TX_STREAM_THRESHOLD = 16;
+            static constexpr uint8_t TX_STREAM_CHUNK = MaxTXMsgLen - TX_STREAM_THRESHOLD;
+            static constexpr uint8_t RX_STREAM_CHUNK = 32;
+
             // Last RX error, as 1-deep queue; 0 if no error.
             // Marked as volatile for ISR-/thread- safe (sometimes lock-free) access.
             volatile uint8_t lastRXErr = 0;
@@ -223,6 +279,33 @@ namespace OTRFM23BLink
             // At lowest SPI clock prescale (x2) this is likely to spin for ~16 CPU cycles (8 bits each taking 2 cycles).
             inline void _wr(const uint8_t data) { SPDR = data; while (!(SPSR & _BV(SPIF))) { } }
 
+            // Write n consecutive registers starting at addr as a single auto-increment burst.
+            // One SPI select/deselect for the lot, rather than one per register.
+            // SPI must already be configured and running.
+            void _writeRegBurst(const uint8_t addr, const uint8_t *vals, uint8_t n)
+                {
+                _SELECT_();
+                _wr(addr | 0x80); // Force to write.
+                while(n-- > 0) { _wr(*vals++); }
+                _DESELECT_();
+                }
+            // Burst read n bytes from the RX FIFO, leaving the radio mode alone.
+            // SPI must already be configured and running.
+            void _readFIFOBurst(uint8_t *buf, uint8_t n) const
+                {
+                _SELECT_();
+                _io(REG_FIFO & 0x7f); // Force to read.
+                while(n-- > 0) { *buf++ = _io(0); }
+                _DESELECT_();
+                }
+            // Write two consecutive registers as a burst, eg both interrupt enables.
+            // SPI must already be configured and running.
+            void _writeRegPair(const uint8_t addr, const uint8_t v0, const uint8_t v1)
+                {
+                const uint8_t vals[2] = { v0, v1 };
+                _writeRegBurst(addr, vals, 2);
+                }
+
             // Internal routines to enable/disable RFM23B on the the SPI bus.
             // Versions accessible to the base class...
             virtual void _SELECT_() const = 0;
@@ -268,11 +351,29 @@ namespace OTRFM23BLink
             // This uses an efficient burst write.
             void _queueFrameInTXFIFO(const uint8_t *bptr, uint8_t buflen);
 
+            // Queue the first loadLen bytes of a frame of frameLen bytes in the TX FIFO,
+            // and set the frame length if in packet-handling mode.
+            void _loadTXFIFO(const uint8_t *buf, uint8_t loadLen, uint8_t frameLen);
+
             // Transmit contents of on-chip TX FIFO: caller should revert to low-power standby mode (etc) if required.
             // Returns true if packet apparently sent correctly/fully.
             // Does not clear TX FIFO (so possible to re-send immediately).
             bool _TXFIFO();
 
+            // As _TXFIFO() but streaming moreLen further bytes at more into the FIFO as it empties.
+            // Leaves the TX FIFO drained.
+            bool _TXFIFO(OTRFM23BLinkStreamState<true> &s, const uint8_t *more, uint8_t moreLen);
+
+            // Note TX status register 1 bits and top up the TX FIFO if streaming and almost empty.
+            // Interrupts must be blocked and SPI must already be configured and running.
+            void _serviceTXStream(OTRFM23BLinkStreamState<true> &s, uint8_t status1);
+            void _serviceTXStream(OTRFM23BLinkStreamState<false> &, uint8_t) { }
+
+            // Send a frame longer than the TX FIFO by streaming it, in packet-handling mode only.
+            // Otherwise as sendRaw().
+            bool _sendRawStreamed(OTRFM23BLinkStreamState<true> &s, const uint8_t *buf, uint8_t buflen, int8_t channel, TXpower power);
+            bool _sendRawStreamed(OTRFM23BLinkStreamState<false> &, const uint8_t *, uint8_t, int8_t, TXpower) { return(false); }
+
             // Put RFM23 into standby, attempt to read bytes from FIFO into supplied buffer.
             // Leaves RFM23 in low-power standby mode.
             // Trailing bytes (more than were actually sent) undefined.
@@ -280,10 +381,15 @@ namespace OTRFM23BLink
 
             // Switch listening off, on to selected channel.
             // listenChannel will have been set by time this is called.
-            virtual void _dolisten();
+            // If streamRX then in packet-handling mode long frames are drained from the RX FIFO in chunks.
+            void _listen(bool streamRX);
 
             // Configure radio for transmission via specified channel < nChannels; non-negative.
             void _setChannel(uint8_t channel);
+
+            // Load the register config for the specified channel < nChannels, and cache the packet-handling registers.
+            // Records the channel as current.
+            void _loadChannelConfig(uint8_t channel);
    
 #if 1 && defined(MILENKO_DEBUG)
             // Compact register dump
@@ -324,6 +430,7 @@ namespace OTRFM23BLink
             //
             // Implementation specifics:
             //   * at TXmax will do double TX with 15ms sleep/IDLE mode between.
+            //   * frames longer than the TX FIFO are rejected unless streaming.
             virtual bool sendRaw(const uint8_t *buf, uint8_t buflen, int8_t channel = 0, TXpower power = TXnormal, bool listenAfter = false) override;
 
             // End access to this radio link if applicable and not already ended.
@@ -355,10 +462,22 @@ namespace OTRFM23BLink
     // With allowRX == false as much as possible of the receive side is disabled.
 #define OTRFM23BLink_DEFINED
     static constexpr uint8_t DEFAULT_RFM23B_RX_QUEUE_CAPACITY = 3;
-    template <uint8_t SPI_nSS_DigitalPin, int8_t RFM_nIRQ_DigitalPin = -1, uint8_t targetISRRXMinQueueCapacity = 3, bool allowRX = true>
-    class OTRFM23BLink final : public OTRFM23BLinkBase
+    // With instrumentRX == true the RX queue collects ISRRXQueueStats, see getRXQueueStats().
+    // With maxFrameLen in [65,255] frames longer than the 64-byte FIFOs are streamed
+    // in packet-handling mode, which needs RFM_nIRQ_DigitalPin serviced by interrupt for RX;
+    // each queued RX frame then takes up to maxFrameLen+1 bytes of the (max 256-byte) RX queue.
+    template <uint8_t SPI_nSS_DigitalPin, int8_t RFM_nIRQ_DigitalPin = -1, uint8_t targetISRRXMinQueueCapacity = 3, bool allowRX = true, bool instrumentRX = false, uint8_t maxFrameLen = OTRFM23BLinkBase::MaxRXMsgLen>
+    class OTRFM23BLink final : public OTRFM23BLinkBase, private OTRFM23BLinkStreamState<(maxFrameLen > OTRFM23BLinkBase::MaxRXMsgLen)>
         {
         private:
+            static_assert(maxFrameLen >= MaxRXMsgLen, "maxFrameLen must be at least the FIFO size");
+            // True if frames longer than the FIFO are to be streamed.
+            static constexpr bool streaming = (maxFrameLen > MaxRXMsgLen);
+            // True if RX frames longer than the FIFO are to be streamed.
+            static constexpr bool streamRX = allowRX && streaming;
+            typedef OTRFM23BLinkStreamState<streaming> streamState_t;
+            streamState_t &stream() { return(*static_cast<streamState_t *>(this)); }
+
             // Use some template meta-programming
             // to replace the RX queue with a dummy if RX is not allowed/required.
             // Eg see https://en.wikibooks.org/wiki/C%2B%2B_Programming/Templates/Template_Meta-Programming#Compile-time_programming
@@ -368,7 +487,38 @@ namespace OTRFM23BLink
               struct typeIf<true, TypeTrue, TypeFalse> { typedef TypeTrue t; };
             template <typename TypeTrue, typename TypeFalse>
               struct typeIf<false, TypeTrue, TypeFalse> { typedef TypeFalse t; };
-            typename typeIf<allowRX, ::OTRadioLink::ISRRXQueueVarLenMsg<MaxRXMsgLen, targetISRRXMinQueueCapacity>, ::OTRadioLink::ISRRXQueueNULL>::t queueRX;
+            typedef ::OTRadioLink::ISRRXQueueVarLenMsg<maxFrameLen, targetISRRXMinQueueCapacity> rxQueue_t;
+            typedef typename typeIf<instrumentRX, ::OTRadioLink::ISRRXQueueInstrumented<rxQueue_t, ::OTV0P2BASE::getSubCycleTime>, rxQueue_t>::t rxQueueMaybeInstrumented_t;
+            typename typeIf<allowRX, rxQueueMaybeInstrumented_t, ::OTRadioLink::ISRRXQueueNULL>::t queueRX;
+
+            // Abandon any partly-streamed RX frame and switch listening off or on.
+            virtual void _dolisten() override { stream().resetRX(); _listen(streamRX); }
+
+            // Drain a chunk of a long frame part way through arriving, to make room for the rest.
+            void _drainRXStream(OTRFM23BLinkStreamState<false> &) { }
+            void _drainRXStream(OTRFM23BLinkStreamState<true> &s)
+                {
+                if(0 == s.rxStreamed) { s.rxBuf = queueRX._getRXBufForInbound(); }
+                if((NULL == s.rxBuf) || (s.rxStreamed > maxFrameLen - RX_STREAM_CHUNK))
+                    {
+                    // DISCARD/drop frame that there is no room to RX.
+                    ++droppedRXedMessageCountRecent;
+                    lastRXErr = RXErr_DroppedFrame;
+                    _dolisten();
+                    return;
+                    }
+                const bool neededEnable = _upSPI();
+                _readFIFOBurst((uint8_t *)s.rxBuf + s.rxStreamed, RX_STREAM_CHUNK);
+                if(neededEnable) { _downSPI(); }
+                s.rxStreamed += RX_STREAM_CHUNK;
+                }
+
+            // Count a frame rejected by the RX filter, if instrumented.
+            inline void _noteFiltered(quickFrameFilter_t *const f)
+                {
+                ::OTRadioLink::ISRRXQueueStats *const s = ::OTRadioLink::getISRRXQueueStats(queueRX);
+                if(NULL != s) { s->noteFiltered(f); }
+                }
 
             // Internal routines to enable/disable RFM23B on the the SPI bus.
             // These depend only on the (constant) SPI_nSS_DigitalPin template parameter
@@ -550,6 +700,8 @@ V0P2BASE_DEBUG_SERIAL_PRINTLN_FLASHSTRING("RFM23 reset...");
                 _writeReg8Bit(REG_OP_CTRL1, REG_OP_CTRL1_SWRES);
                 _modeStandby();
                 if(neededEnable) { _downSPI(); }
+                // The reset reverted all registers to their defaults.
+                _currentChannel = NO_CHANNEL;
                 }
 
             // Common handling of polling and ISR code.
@@ -561,6 +713,15 @@ V0P2BASE_DEBUG_SERIAL_PRINTLN_FLASHSTRING("RFM23 reset...");
             // Ensures radio is in RX mode at exit if listening is enabled.
             void _poll()
                 {
+                // Top up the TX FIFO while streaming out a long frame.
+                if(stream().isTXStreaming())
+                    {
+                    const bool neededEnable = _upSPI();
+                    _serviceTXStream(stream(), uint8_t(_readReg16Bit(REG_INT_STATUS1) >> 8));
+                    if(neededEnable) { _downSPI(); }
+                    return;
+                    }
+
                 // Nothing to do if RX is not allowed.
                 if(!allowRX) { return; }
  
@@ -572,36 +733,45 @@ V0P2BASE_DEBUG_SERIAL_PRINTLN_FLASHSTRING("RFM23 reset...");
 
                 // We need to check if RFM23B is in packet mode and based on that 
                 // we select interrupt routine.
-                const bool neededEnable = _upSPI_();
-                const uint8_t rxMode = _readReg8Bit_(REG_30_DATA_ACCESS_CONTROL);
-                if(neededEnable) { _downSPI_(); }
-                if(rxMode & RFM23B_ENPACRX)
+                if(_dataAccessControl & RFM23B_ENPACRX)
                   {
                   // Packet-handling mode...
+                    if(streamRX && (status & (RFM23B_IFFERROR | RFM23B_ICRCERROR)))
+                        {
+                        // Long frame lost or mangled: give up on it and reset.
+                        if(status & RFM23B_IFFERROR) { lastRXErr = RXErr_RXOverrun; }
+                        _dolisten();
+                        return;
+                        }
                     if(status & RFM23B_IPKVALID) // Packet received OK
                         {
                         const bool neededEnable = _upSPI();
                         // Extract packet/frame length...
                         uint8_t lengthRX; 
                         // Number of bytes to read depends whether fixed of variable packet length
-                        if ((_readReg8Bit_(REG_33_HEADER_CONTROL2) & RFM23B_FIXPKLEN ) == RFM23B_FIXPKLEN ) 
+                        if ((_headerControl2 & RFM23B_FIXPKLEN ) == RFM23B_FIXPKLEN ) 
                            lengthRX = _readReg8Bit(REG_3E_PACKET_LENGTH);
                         else
                            lengthRX = _readReg8Bit(REG_4B_RECEIVED_PACKET_LENGTH);
                         if(neededEnable) { _downSPI(); }
-                        // Received frame.
+                        // Received frame, possibly the tail of one being streamed in.
                         // If there is space in the queue then read in the frame, else discard it.
-                        volatile uint8_t *const bufferRX = (lengthRX > MaxRXMsgLen) ? NULL :
-                            queueRX._getRXBufForInbound();
+                        // When streaming read only what is left of the frame, which must fit the FIFO.
+                        const uint8_t streamed = stream().getRXStreamed();
+                        const bool fits = (lengthRX <= maxFrameLen) && (lengthRX >= streamed) &&
+                            (uint8_t(lengthRX - streamed) <= MaxRXMsgLen);
+                        volatile uint8_t *const bufferRX = !fits ? NULL :
+                            ((0 != streamed) ? stream().getRXStreamBuf() : queueRX._getRXBufForInbound());
                         if(NULL != bufferRX)
                             {
-                            // Attempt to read the entire frame.
-                            _RXFIFO((uint8_t *)bufferRX, MaxRXMsgLen);
+                            // Attempt to read the entire (rest of the) frame.
+                            _RXFIFO((uint8_t *)bufferRX + streamed, streamRX ? uint8_t(lengthRX - streamed) : uint8_t(MaxRXMsgLen));
                             // If an RX filter is present then apply it.
                             quickFrameFilter_t *const f = filterRXISR;
                             if((NULL != f) && !f(bufferRX, lengthRX))
                                 {
                                 ++filteredRXedMessageCountRecent; // Drop the frame: filter didn't like it.
+                                _noteFiltered(f);
                                 queueRX._loadedBuf(0); // Don't queue this frame...
                                 }
                             else
@@ -621,6 +791,12 @@ V0P2BASE_DEBUG_SERIAL_PRINTLN_FLASHSTRING("RFM23 reset...");
                         _dolisten();
                         //return;
                         }
+                    else if(streamRX && (status & RFM23B_IRXFFAFULL))
+                        {
+                        // Part way through a long frame.
+                        _drainRXStream(stream());
+                        return;
+                        }
 #if 0 && defined(MILENKO_DEBUG)
                     // Preamble received
                     if(status & RFM23B_IPREAVAL)
@@ -662,6 +838,7 @@ V0P2BASE_DEBUG_SERIAL_PRINTLN_FLASHSTRING("RFM23 reset...");
                             if((NULL != f) && !f(bufferRX, lengthRX))
                                 {
                                 ++filteredRXedMessageCountRecent; // Drop the frame: filter didn't like it.
+                                _noteFiltered(f);
                                 queueRX._loadedBuf(0); // Don't queue this frame...
                                 }
                             else
@@ -731,7 +908,7 @@ V0P2BASE_DEBUG_SERIAL_PRINTLN_FLASHSTRING("RFM23 reset...");
             // Initiating interrupt assumed blocked until this returns.
             virtual bool handleInterruptSimple() override
                 {
-                if(!allowRX) { return(false); }
+                if(!allowRX && !stream().isTXStreaming()) { return(false); }
                 if(interruptLineIsEnabledAndInactive()) { return(false); }
                 _poll();
                 return(true);
@@ -774,10 +951,20 @@ V0P2BASE_DEBUG_SERIAL_PRINTLN_FLASHSTRING("RFM23 reset...");
                 }
 
             // Fetches the current inbound RX minimum queue capacity and maximum RX (and TX) raw message size.
+            // Frames longer than the TX FIFO can only be sent with the current channel in packet-handling mode.
             virtual void getCapacity(uint8_t &queueRXMsgsMin, uint8_t &maxRXMsgLen, uint8_t &maxTXMsgLen) const override
                 {
                 queueRX.getRXCapacity(queueRXMsgsMin, maxRXMsgLen);
-                maxTXMsgLen = MaxTXMsgLen;
+                maxTXMsgLen = (streaming && (_dataAccessControl & RFM23B_ENPACTX)) ? maxFrameLen : uint8_t(MaxTXMsgLen);
+                }
+
+            // Send/TX a raw frame on the specified (default first/0) channel; see OTRFM23BLinkBase::sendRaw().
+            // Frames longer than the TX FIFO are streamed if maxFrameLen allows.
+            virtual bool sendRaw(const uint8_t *buf, uint8_t buflen, int8_t channel = 0, TXpower power = TXnormal, bool listenAfter = false) override
+                {
+                if(!streaming || (buflen <= MaxTXMsgLen)) { return(OTRFM23BLinkBase::sendRaw(buf, buflen, channel, power, listenAfter)); }
+                if(buflen > maxFrameLen) { return(false); }
+                return(_sendRawStreamed(stream(), buf, buflen, channel, power));
                 }
 
             // Fetches the current count of queued messages for RX.
@@ -803,6 +990,13 @@ V0P2BASE_DEBUG_SERIAL_PRINTLN_FLASHSTRING("RFM23 reset...");
             // Not intended to be called from an ISR.
             virtual void removeRXMsg() override { queueRX.removeRXMsg(); }
 
+            // Get the RX queue statistics if instrumentRX, else NULL.
+            // The stats may be reset and exported (eg with putStats()) by the caller.
+            // Non-virtual so that uninstrumented builds pay nothing for it;
+            // callers must use this concrete link type.
+            ::OTRadioLink::ISRRXQueueStats *getRXQueueStats() const
+                { return(::OTRadioLink::getISRRXQueueStats(queueRX)); }
+
 #if 0 // Defining the virtual destructor uses ~800+ bytes of Flash by forcing use of malloc()/free().
             // Ensure safe instance destruction when derived from.
             // by default attempts to shut down the sensor and otherwise free resources when done.
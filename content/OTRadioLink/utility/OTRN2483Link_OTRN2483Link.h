@@ -20,7 +20,7 @@ Author(s) / Copyright (s): Deniz Erbilgin 2016
 /*
  * OpenTRV RN2483 LoRA Radio Link base class.
  *
- * Currently V0p2/AVR ONLY.
+ * Talks to the RN2483 over a Stream (OTSoftSerial2 on V0p2/AVR).
  */
 
 //Collection of useful links:
@@ -33,9 +33,9 @@ Author(s) / Copyright (s): Deniz Erbilgin 2016
 
 
 /**
- * @brief   Set dev addr on line 215 of OTRN2483Link_OTRN2483Link.cpp
- *          Set data rate on line 57 of OTRN2483Link_OTRN2483Link.cpp
- *          Set adaptive data rate by uncommmenting #define RN2483_ENABLE_ADR below and setting limits on line 55 of #define RN2483_ENABLE_ADR
+ * @brief   Set dev addr in startConfig() in OTRN2483Link_OTRN2483Link.h
+ *          Set data rate in startConfig() in OTRN2483Link_OTRN2483Link.h
+ *          Set adaptive data rate by uncommmenting #define RN2483_ENABLE_ADR below and setting limits in startConfig()
  * @todo    - Add config functionality
  *          - Move commands to progmem
  *          - Add intelligent way of utilising device eeprom (w/ mac save)
@@ -66,12 +66,12 @@ Author(s) / Copyright (s): Deniz Erbilgin 2016
 #include <OTV0p2Base.h>
 #include <string.h>
 #include <stdint.h>
+#include "OTRadioLink_ATCommandEngine.h"
 
 namespace OTRN2483Link
 {
 
 
-#ifdef ARDUINO_ARCH_AVR
 /**
  * @struct  OTRN2483LinkConfig
  * @brief   Structure containing config data for OTRN2483LinkConfig
@@ -84,7 +84,7 @@ typedef struct OTRN2483LinkConfig {
     const void * const UDP_Address;
     const void * const UDP_Port;
 
-    OTRN2483LinkConfig(bool e, const void */*p*/, const void */*a*/, const void *ua, const void *up)
+    constexpr OTRN2483LinkConfig(bool e, const void */*p*/, const void */*a*/, const void *ua, const void *up)
       : bEEPROM(e), UDP_Address(ua), UDP_Port(up) { }
     /**
      * @brief    Copies radio config data from EEPROM to an array
@@ -97,6 +97,7 @@ typedef struct OTRN2483LinkConfig {
      * @retval    length of data copied to buffer
      */
     char get(const uint8_t *src) const{
+#ifdef ARDUINO_ARCH_AVR
         char c = 0;
         switch (bEEPROM) {
         case true:
@@ -107,108 +108,680 @@ typedef struct OTRN2483LinkConfig {
             break;
         }
         return c;
+#else
+        return char(*src);
+#endif // ARDUINO_ARCH_AVR
     }
 } OTRN2483LinkConfig_t;
 
 
+/**
+ * @brief   Enum containing major states of the RN2483 link.
+ */
+enum OTRN2483LinkState : uint8_t
+    {
+    INIT = 0,       // Not started: begin() not called, or end() called.
+    CONFIGURE,      // Sending LoRaWAN settings, one command at a time.
+    JOIN,           // Waiting for 'ok' to 'mac join abp'.
+    JOIN_RESULT,    // Waiting for 'accepted' or 'denied'.
+    IDLE,           // Joined, waiting for frames to send and for the duty cycle to allow it.
+    SENDING,        // Waiting for 'ok' to 'mac tx'.
+    SEND_RESULT,    // Waiting for 'mac_tx_ok', 'mac_rx' or 'mac_err' after the uplink.
+    GET_DR          // Waiting for the data rate in use, which ADR may change.
+    };
+
+// Includes string constants.
+class OTRN2483LinkBase : public OTRadioLink::OTRadioLink
+    {
+    public:
+        // Baud rate to talk to the RN2483 at; it autobauds from the 'U' sent after a break.
+        static constexpr uint16_t RN2483_baud = 2400;
+        // Max length of a TX frame: the LoRaWAN EU863-870 payload limit at the slowest data rates.
+        static constexpr uint8_t MAX_TX_FRAME_LEN = 51;
+        // LoRaWAN port for uplinks of a single frame as is.
+        static constexpr uint8_t TX_PORT_FRAME = 1;
+        // LoRaWAN port for uplinks of several frames, each preceded by its length.
+        static constexpr uint8_t TX_PORT_BATCH = 2;
+
+        // EU863-870 sub-bands (ETSI EN 300 220), each with its own duty-cycle limit.
+        enum SubBand : uint8_t
+            {
+            SUBBAND_G,      // 865.0--868.0MHz, 1%.
+            SUBBAND_G1,     // 868.0--868.6MHz, 1%; the three default LoRaWAN channels.
+            SUBBAND_G2,     // 868.7--869.2MHz, 0.1%.
+            SUBBAND_G3,     // 869.4--869.65MHz, 10%.
+            SUBBAND_COUNT
+            };
+        // Sub-band of the channels uplinks are sent on (the defaults, 0 to 2).
+        static constexpr SubBand txSubBand = SUBBAND_G1;
+
+        // Time on air in microseconds of an uplink with appPayloadLen bytes of application payload,
+        // at the given EU863-870 data rate [0,5] (SF12 to SF7 at 125kHz; higher taken as 5).
+        // Counts the 13 bytes of LoRaWAN framing, an 8-symbol preamble, explicit header, CRC and coding rate 4/5.
+        static uint32_t getAirtimeUs(uint8_t dataRate, uint8_t appPayloadLen);
+        // Max application payload in bytes at the given EU863-870 data rate (no MAC options).
+        static uint8_t getMaxPayload(uint8_t dataRate);
+        // Whole seconds from the start of airtimeUs of transmission until band may be used again,
+        // within its duty cycle.
+        static uint16_t getOffTimeS(SubBand band, uint32_t airtimeUs);
+
+        /**
+         * @brief   Unused. For compatibility with OTRadioLink.
+         */
+        virtual void getCapacity(uint8_t &queueRXMsgsMin, uint8_t &maxRXMsgLen, uint8_t &maxTXMsgLen) const override
+            {
+            queueRXMsgsMin = 0;
+            maxRXMsgLen = 0;
+            maxTXMsgLen = MAX_TX_FRAME_LEN;
+            }
+        virtual uint8_t getRXMsgsQueued() const override { return(0); }
+        virtual const volatile uint8_t *peekRXMsg() const override { return(NULL); }
+        virtual void removeRXMsg() override { }
+
+    protected:
+        typedef ::OTRadioLink::ATCommandEngine ATCommandEngine;
+
+        // Seconds to wait for the outcome of a join or an uplink (including the RX windows).
+        static constexpr uint8_t joinTimeOut = 5;
+        static constexpr uint8_t txTimeOut = 15;
+        // Seconds to wait after a failed command before starting over.
+        static constexpr uint8_t retryLockOutDuration = 10;
+
+        static const char SYS_START[5];   // Beginning of "sys" command set
+        static const char SYS_SLEEP[7];   // Sleep mode
+        static const char SYS_RESET[6]; // todo this can be removed on board with working reset line
+
+        static const char MAC_START[5];   // Beginning of "mac" command set
+#ifndef RN2483_CONFIG_IN_EEPROM
+        static const char MAC_DEVADDR[9]; // device address (required for ABP)
+        static const char MAC_APPSKEY[9]; // Application session key (required for ABP)
+        static const char MAC_NWKSKEY[9]; // Network session key (required for ABP)
+        static const char MAC_ADR[7];     // Set Adaptive Datarate "on"
+        static const char MAC_SET_DR[4];   // Set data rate.
+        static const char MAC_SET_CH[4];  // Channel stuff
+        static const char MAC_SET_DRRANGE[9]; // Set data rate range
+        static const char MAC_POWER[9]; // Set Tx power
+#endif // RN2483_CONFIG_IN_EEPROM
+        static const char MAC_JOINABP[9]; // Join LoRaWAN network by ABP (activation by personalisation)
+        static const char MAC_STATUS[7];
+        static const char MAC_SEND[10];     // Sends an unconfirmed packet, on the port that follows.
+        static const char MAC_DR[3];        // Data rate.
+        static const char MAC_SAVE[5];
+
+        static const char RN2483_SET[5];  // Set command
+        static const char RN2483_GET[5];  // Get command
+        static const char RN2483_END[3];  // End of command (CR LF)
+
+        // Reply tokens.
+        static const char RN2483_OK[3];         // Command accepted.
+        static const char RN2483_INVALID[14];   // Command rejected.
+        static const char RN2483_ACCEPTED[9];   // Join succeeded.
+        static const char RN2483_DENIED[7];     // Join failed.
+        static const char RN2483_EOL[2];        // End of any reply line.
+        static const char RN2483_MAC_[5];       // Start of any uplink outcome.
+        static const char RN2483_MAC_ERR[8];    // Uplink failed.
+        static const char RN2483_NO_FREE_CH[11]; // Uplink refused by the RN2483's own duty-cycle check.
+        static const char RN2483_NOT_JOINED[11]; // Uplink refused as not joined.
+
+        // Seconds to wait after the RN2483 reports no free channel.
+        static constexpr uint8_t noFreeChannelLockOut = 10;
+        // Inverse of the duty-cycle limit of each sub-band, eg 100 for 1%.
+        static const uint16_t subBandDutyCycleInverse[SUBBAND_COUNT];
+
+        // Hex digit for the bottom 4 bits of v; the RN2483 takes payloads in hex.
+        static inline char hexDigit(const uint8_t v)
+            {
+            const uint8_t n = v & 0xf;
+            return(char((n <= 9) ? ('0' + n) : ('A' - 10 + n)));
+            }
+
+        /**
+         * @brief   Unused. For compatibility with OTRadioLink.
+         */
+        virtual void _dolisten() override { }
+    };
+
+
 /**
  * @brief   This is a class that extends OTRadioLink to communicate via LoRaWAN
  *          using the RN2483 radio module.
+ * @note    begin() only starts the link:
+ *          configuration, join and sends are all done a step at a time by poll(),
+ *          which uses an OTRadioLink::ATCommandEngine.
+ *          With a buffered or interrupt-driven ser_t that does not block,
+ *          so that the main loop and radio RX keep running while the RN2483 replies;
+ *          with an unbuffered ser_t (eg the default OTSoftSerial2) replies must be read as they arrive,
+ *          so poll() blocks for them as before.
+ * @note    Up to txQueueFrames frames are held for TX;
+ *          when full the oldest queued frame is dropped in favour of the newest.
+ *          Each uplink carries as many of the oldest queued frames as fit
+ *          in the max payload of the current data rate:
+ *          a single frame is sent as is on port TX_PORT_FRAME,
+ *          several are sent on port TX_PORT_BATCH, each preceded by its length.
+ *          The default of 1 keeps the RAM footprint small for AVR leaf nodes;
+ *          hubs with RAM to spare can opt in to batching with a larger queue.
+ * @note    Time on air is tracked against the duty-cycle limit of the sub-band sent on,
+ *          and nothing is sent until that allows.
+ *          As the fixed cost of each uplink (preamble and framing) is large,
+ *          frames may also be held back for up to setMaxBatchDelay() seconds
+ *          to fill an uplink, delivering more bytes per unit of airtime.
+ * @note    poll() must be called at least once every 59s, eg every 2s major cycle,
+ *          to track elapsed time from getCurrentSeconds().
  */
 #define OTRN2483Link_DEFINED
-class OTRN2483Link final : public OTRadioLink::OTRadioLink
+template<uint8_t nRstPin, uint8_t rxPin, uint8_t txPin,
+uint_fast8_t (*const getCurrentSeconds)(), // Fetches clock time in seconds; never NULL
+class ser_t
+#ifdef OTSoftSerial2_DEFINED
+    = OTV0P2BASE::OTSoftSerial2<rxPin, txPin, OTRN2483LinkBase::RN2483_baud>
+#endif
+, uint8_t txQueueFrames = 1 // Max frames queued for TX; strictly positive.
+>
+class OTRN2483Link final : public OTRN2483LinkBase
 {
+    static_assert(txQueueFrames > 0, "must be able to queue at least one TX frame");
+
 public:
-	// Public interface
-    OTRN2483Link(uint8_t _nRstPin, uint8_t rxPin, uint8_t txPin);
+    // Public interface
+    constexpr OTRN2483Link() { }
 
-    void preinit(const void */*preconfig*/) {};
-    bool begin();
-    bool end();
+    /**
+     * @brief   Start the link: configuration and join follow in poll().
+     */
+    virtual bool begin() override
+        {
+#ifdef ARDUINO_ARCH_AVR
+        // Wait for RN2483 to boot properly to avoid autobauding issues
+        OTV0P2BASE::nap(WDTO_30MS);
+        // init resetPin
+        pinMode(nRstPin, INPUT);    // TODO This is shorting on my board
+#endif // ARDUINO_ARCH_AVR
+        ser.begin(RN2483_baud);
+        lastSeconds = uint8_t(getCurrentSeconds());
+        restart();
+        return(true);
+        }
 
-    bool sendRaw(const uint8_t *buf, uint8_t buflen, int8_t channel = 0, TXpower power = TXnormal, bool listenAfter = false);
-//    bool queueToSend(const uint8_t *buf, uint8_t buflen, int8_t channel = 0, TXpower power = TXnormal);
-    inline bool isAvailable(){ return bAvailable; };     // checks radio is there independant of power state
-    bool handleInterruptSimple() { return true;};
+    /**
+     * @brief   End LoRaWAN connection
+     */
+    virtual bool end() override
+        {
+        at.clear();
+        txSendFrames = 0;
+        state = INIT;
+        return(true);
+        }
 
     /**
-     * @brief   Unused. For compatibility with OTRadioLink.
+     * @brief   Sends a raw frame as is, blocking until the uplink outcome is known.
+     * @param   buf Send buffer.
+     * @retval  True if the RN2483 reports the frame sent.
+     * @note    Unlike queueToSend() and poll() this blocks, for up to txTimeOut seconds.
+     *          Returns false at once unless joined, idle and within the duty cycle.
      */
-    void poll();
-    void getCapacity(uint8_t &queueRXMsgsMin, uint8_t &maxRXMsgLen, uint8_t &maxTXMsgLen) const;
-    uint8_t getRXMsgsQueued() const;
-    const volatile uint8_t *peekRXMsg() const;
-    void removeRXMsg() {};
+    virtual bool sendRaw(const uint8_t *buf, uint8_t buflen,
+            int8_t /*channel*/ = 0, TXpower /*power*/ = TXnormal, bool /*listenAfter*/ = false) override
+        {
+        if((IDLE != state) || at.isBusy() || (buflen > MAX_TX_FRAME_LEN)) { return(false); }
+        updateClock();
+        if(0 != getSubBandAvailableInS(txSubBand)) { return(false); }
+        startTX(TX_PORT_FRAME);
+        printHex(buf, buflen);
+        print(RN2483_END);
+        bool sent = false;
+        if(isOKLine(waitAT()))
+            {
+            chargeAirtime(buflen);
+            startTXResult();
+            sent = isTXResultOK(waitAT());
+            }
+        at.clear();
+        return(sent);
+        }
 
+    /**
+     * @brief   Queue a frame to be sent by poll().
+     * @note    If the queue is full the oldest frame is dropped,
+     *          unless it is being sent right now in which case the new frame is refused.
+     * @retval  False if empty or too long, or refused.
+     */
+    virtual bool queueToSend(const uint8_t *buf, uint8_t buflen,
+            int8_t /*channel*/ = 0, TXpower /*power*/ = TXnormal) override
+        {
+        if((NULL == buf) || (0 == buflen) || (buflen > MAX_TX_FRAME_LEN)) { return(false); }
+        if(txMessageQueue >= txQueueFrames)
+            {
+            if(0 != txSendFrames) { return(false); }
+            popTXQueue();
+            }
+        const uint8_t slot = getTXQueueSlot(txMessageQueue);
+        memcpy(txQueue[slot], buf, buflen);
+        txMsgLen[slot] = buflen;
+        txQueuedAt[slot] = elapsedS;
+        ++txMessageQueue;
+        return(true);
+        }
+    // Number of frames queued for TX, including any being sent.
+    uint8_t getTXMsgsQueued() const { return(txMessageQueue); }
+
+    // Set the max seconds to hold a frame back to fill an uplink; 0 (the default) to send as soon as allowed.
+    void setMaxBatchDelay(const uint16_t seconds) { maxBatchDelayS = seconds; }
+    // Data rate [0,5] last reported by the RN2483, which ADR may change.
+    uint8_t getDataRate() const { return(dataRate); }
+    // Seconds until band may be sent on again within its duty cycle; 0 if now.
+    uint16_t getSubBandAvailableInS(const SubBand band) const
+        {
+        const int32_t wait = int32_t(subBandAvailableAtS[band] - elapsedS);
+        return((wait > 0) ? uint16_t(wait) : 0);
+        }
+
+    // Current state, for tests.
+    OTRN2483LinkState _getState() const { return(state); }
+
+    // Checks radio is there independent of power state.
+    virtual bool isAvailable() const override { return(bAvailable); }
+    virtual bool handleInterruptSimple() override { return(true); }
+
+    /**
+     * @brief   Run configuration, join and sends a step at a time; never blocks waiting for the RN2483.
+     */
+    virtual void poll() override
+        {
+        updateClock();
+        const uint8_t now = lastSeconds;
+        if(retryTimer >= 0)
+            {
+            if(OTV0P2BASE::getElapsedSecondsLT(uint8_t(retryTimer), now) <= retryLockOutDuration) { return; }
+            retryTimer = -1;
+            restart();
+            }
+        switch(state)
+            {
+            case INIT: break;
+            case CONFIGURE:
+                {
+                const ATCommandEngine::Status s = at.poll(now);
+                if(ATCommandEngine::AT_PENDING == s) { break; }
+                if(ATCommandEngine::AT_OK != s) { setRetryLock(); break; }
+                bAvailable = true;
+                if(startConfig(++configStep)) { break; }
+                startJoin();
+                state = JOIN;
+                break;
+                }
+            case JOIN:
+                {
+                const ATCommandEngine::Status s = at.poll(now);
+                if(ATCommandEngine::AT_PENDING == s) { break; }
+                if(!isOKLine(s)) { setRetryLock(); break; }
+                at.next(RN2483_ACCEPTED, RN2483_DENIED, NULL, now, joinTimeOut, true);
+                state = JOIN_RESULT;
+                break;
+                }
+            case JOIN_RESULT:
+                {
+                const ATCommandEngine::Status s = at.poll(now);
+                if(ATCommandEngine::AT_PENDING == s) { break; }
+                if(ATCommandEngine::AT_OK != s) { setRetryLock(); break; }
+                startGetDataRate();
+                break;
+                }
+            case IDLE:
+                if(isTimeToSend()) { startBatch(); }
+                break;
+            case SENDING:
+                {
+                const ATCommandEngine::Status s = at.poll(now);
+                if(ATCommandEngine::AT_PENDING == s) { break; }
+                if(isOKLine(s))
+                    {
+                    chargeAirtime(txSendLen);
+                    startTXResult();
+                    state = SEND_RESULT;
+                    break;
+                    }
+                // Keep the frames if the RN2483 refused the uplink for now.
+                const bool noFreeCh = (NULL != strstr(at.getReply(), RN2483_NO_FREE_CH));
+                const bool notJoined = (NULL != strstr(at.getReply(), RN2483_NOT_JOINED));
+                if(noFreeCh || notJoined) { txSendFrames = 0; }
+                else { finishTX(); }
+                state = IDLE;
+                if(noFreeCh) { subBandAvailableAtS[txSubBand] = elapsedS + noFreeChannelLockOut; }
+                if(notJoined) { setRetryLock(); }
+                break;
+                }
+            case SEND_RESULT:
+                {
+                const ATCommandEngine::Status s = at.poll(now);
+                if(ATCommandEngine::AT_PENDING == s) { break; }
+                isTXResultOK(s);
+                finishTX();
+                startGetDataRate();
+                break;
+                }
+            case GET_DR:
+                {
+                const ATCommandEngine::Status s = at.poll(now);
+                if(ATCommandEngine::AT_PENDING == s) { break; }
+                const char c = at.getReply()[0];
+                if((ATCommandEngine::AT_OK == s) && (c >= '0') && (c <= '7')) { dataRate = uint8_t(c - '0'); }
+                state = IDLE;
+#ifdef RN2483_ALLOW_SLEEP
+                OTV0P2BASE::nap(WDTO_120MS, true);
+                print(SYS_START);
+                print(SYS_SLEEP);
+                print("300000"); // FIXME sleeps for 4 mins
+                print(RN2483_END);
+#endif // RN2483_ALLOW_SLEEP
+                break;
+                }
+            default: break;
+            }
+        }
+
+#ifndef OTRN2483LINK_DEBUG // This is included to ease unit testing.
+private:
+#endif // OTRN2483LINK_DEBUG
+    // Software serial: for V0p2 boards (eg REV14) expected to be of type:
+    //     OTV0P2BASE::OTSoftSerial2<rxPin, txPin, baud>
+    ser_t ser;
+    // Runs one command at a time over ser,
+    // without blocking unless ser is unbuffered (eg OTSoftSerial2).
+    ATCommandEngine at{ser, getCurrentSeconds};
+    OTRN2483LinkState state = INIT;
+    // Index of the configuration command in progress in CONFIGURE.
+    uint8_t configStep = 0;
+    // Time of the last failure, or -1 if not locked out.
+    int8_t retryTimer = -1;
+    bool bAvailable = false;
+    // Data rate in use; assume SF11, the slowest configured, until told otherwise.
+    uint8_t dataRate = 1;
+    // Seconds since begin(), advanced by poll() from getCurrentSeconds().
+    uint32_t elapsedS = 0;
+    uint8_t lastSeconds = 0;
+    // Value of elapsedS from which each sub-band may be sent on again.
+    uint32_t subBandAvailableAtS[SUBBAND_COUNT] = { };
+    // Max seconds to hold a frame back to fill an uplink.
+    uint16_t maxBatchDelayS = 0;
+    // Frames from the TX queue in the uplink being sent, and its payload length; 0 frames if none.
+    uint8_t txSendFrames = 0;
+    uint8_t txSendLen = 0;
+    // TX queue: ring of txQueueFrames slots, oldest at txQueueHead, txMessageQueue in use.
+    uint8_t txQueueHead = 0;
+    uint8_t txMessageQueue = 0;
+    uint8_t txMsgLen[txQueueFrames]; // Length of the frame in each slot.
+    uint32_t txQueuedAt[txQueueFrames]; // Value of elapsedS when each frame was queued.
+    // Putting this last in the structure.
+    uint8_t txQueue[txQueueFrames][MAX_TX_FRAME_LEN];
 
 private:
-// Private methods
     // Serial
-    uint8_t read();
-    uint8_t timedBlockingRead(char *data, uint8_t length);
-    void write(const char *data, uint8_t length);
-    void print(const char data);
-    void print(const uint8_t value);	// todo change this so it prints in hex?
-    void print(const char *string);
-    void print(const void *src);
-
-    // Commands
-    void factoryReset();
-    void reset();
-    void setBaud();
-    void setDevAddr(const uint8_t *address);
-    void setKeys(const uint8_t *appKey, const uint8_t *networkKey);
-    void joinABP();
-    bool getStatus();
-    void save();
-    void setDataRate(uint8_t dataRate);
-    void setAdaptiveDataRate(uint8_t minRate, uint8_t maxRate);
-    void setTxPower(uint8_t power);
+    void print(const char data) { ser.print(data); }
+    void print(const char *string) { ser.print(string); }
+    // Print buf in hex, as the RN2483 takes payloads.
+    void printHex(const uint8_t *buf, const uint8_t len)
+        {
+        for(uint8_t i = 0; i < len; ++i)
+            {
+            print(hexDigit(buf[i] >> 4));
+            print(hexDigit(buf[i]));
+            }
+        }
 
-    // Setup
-    bool _doconfig() { return true; };
+    // Advance elapsedS by the seconds since the last call.
+    void updateClock()
+        {
+        const uint8_t now = uint8_t(getCurrentSeconds());
+        elapsedS += OTV0P2BASE::getElapsedSecondsLT(lastSeconds, now);
+        lastSeconds = now;
+        }
 
-    // misc
-    bool getHex(const uint8_t *string, uint8_t *output, uint8_t outputLen);
+    /**
+     * @brief   Sends a break then the sync char for the RN2483 to autobaud from.
+     */
+    void setBaud()
+        {
+#ifdef ARDUINO_ARCH_AVR
+        ser.sendBreak();
+        print('U'); // send syncro character
+#endif // ARDUINO_ARCH_AVR
+        }
 
-// Private consts and variables
-    const OTRN2483LinkConfig *config;  // Pointer to radio config
-    OTV0P2BASE::OTSoftSerial ser;
-    static const uint16_t baud = 2400;	 // OTSoftSer baud rate. todo switch to template to allow higher speed
-    bool bAvailable;
-    const uint8_t nRstPin;
+    // Start (again) from the first configuration command.
+    void restart()
+        {
+        at.clear();
+        txSendFrames = 0;
+        setBaud();
+        configStep = 0;
+        if(startConfig(configStep)) { state = CONFIGURE; }
+        else { startJoin(); state = JOIN; }
+        }
 
+    // Lock out after a failure; poll() then starts over.
+    void setRetryLock()
+        {
+        at.clear();
+        retryTimer = int8_t(getCurrentSeconds());
+        }
 
-    static const char SYS_START[5];	  // Beginning of "sys" command set
-    static const char SYS_SLEEP[7];   // Sleep mode
-    static const char SYS_RESET[6]; // todo this can be removed on board with working reset line
+    // Start a command expecting 'ok' or 'invalid_param' as its reply.
+    void beginSetCommand()
+        { at.begin(RN2483_OK, RN2483_INVALID, NULL, uint8_t(getCurrentSeconds()), 0, true); }
+    // Start a command whose first reply line is 'ok' if accepted, else an error.
+    void beginLineCommand()
+        { at.begin(RN2483_EOL, NULL, NULL, uint8_t(getCurrentSeconds()), 0); }
+    // True if the line reply just completed is 'ok'.
+    bool isOKLine(const ATCommandEngine::Status s) const
+        { return((ATCommandEngine::AT_OK == s) && (0 == strncmp(at.getReply(), RN2483_OK, 2))); }
 
-    static const char MAC_START[5];   // Beginning of "mac" command set
-#ifndef RN2483_CONFIG_IN_EEPROM
-    static const char MAC_DEVADDR[9]; // device address (required for ABP)
-    static const char MAC_APPSKEY[9]; // Application session key (required for ABP)
-    static const char MAC_NWKSKEY[9]; // Network session key (required for ABP)
-    static const char MAC_ADR[7];     // Set Adaptive Datarate "on"
-    static const char MAC_SET_DR[4];   // Set data rate.
-    static const char MAC_SET_CH[4];  // Channel stuff
-    static const char MAC_SET_DRRANGE[9]; // Set data rate range
-    static const char MAC_POWER[9]; // Set Tx power
+    /**
+     * @brief   Start configuration command number step.
+     * @retval  False if there is no such step, ie configuration is complete.
+     * @note    OpenTRV has temporarily reserved the device address block 02:01:11:xx
+     *          and is using addresses 00-04 (as of 2016-01-29).
+     * @note    The application key is specific to the OpenTRV server and should be kept secret;
+     *          the network key is the Thing Network key and can be made public.
+     *          The RN2483 takes both as HEX values.
+     * @note    Adaptive data rate sends between SF11 and SF7 on the 3 default channels;
+     *          otherwise the rate is fixed at SF11, the slowest that allows 240s send intervals.
+     */
+    bool startConfig(const uint8_t step)
+        {
+#ifdef RN2483_CONFIG_IN_EEPROM
+        (void)step;
+        return(false);
+#else
+        const uint8_t nDRSteps =
+#ifdef RN2483_ENABLE_ADR
+            4;
+#else
+            1;
+#endif // RN2483_ENABLE_ADR
+        if(step >= 3 + nDRSteps) { return(false); }
+        beginSetCommand();
+        print(MAC_START);
+        print(RN2483_SET);
+        switch(step)
+            {
+            case 0:
+                print(MAC_DEVADDR);
+                print("02011123"); // TODO this will be stored as number in config
+                break;
+            case 1:
+                print(MAC_APPSKEY);
+                print("2B7E151628AED2A6ABF7158809CF4F3C"); // TODO this will be stored as number in config
+                break;
+            case 2:
+                print(MAC_NWKSKEY);
+                print("2B7E151628AED2A6ABF7158809CF4F3C"); // TODO this will be stored as number in config
+                break;
+#ifdef RN2483_ENABLE_ADR
+            case 3: case 4: case 5:
+                // set channel data rate range
+                print(MAC_SET_CH);
+                print(MAC_SET_DRRANGE);
+                print(char('0' + step - 3));
+                print(" 1 5");
+                break;
+            default:
+                // set ADR on
+                print(MAC_ADR); // Adaptive data rate
+                break;
+#else
+            default:
+                print(MAC_SET_DR);
+                print('1'); // SF11
+                break;
+#endif // RN2483_ENABLE_ADR
+            }
+        print(RN2483_END);
+        return(true);
 #endif // RN2483_CONFIG_IN_EEPROM
-    static const char MAC_JOINABP[9]; // Join LoRaWAN network by ABP (activation by personalisation)
-    static const char MAC_STATUS[7];
-    static const char MAC_SEND[12];		// Sends an unconfirmed packet on channel 1
-    static const char MAC_SAVE[5];
+        }
 
-    static const char RN2483_SET[5];  // Set command
-    static const char RN2483_GET[5];  // Get command
-    static const char RN2483_END[3];  // End of command (CR LF)
+    // Join by ABP (activation by personalisation).
+    void startJoin()
+        {
+        beginLineCommand();
+        print(MAC_START);
+        print(MAC_JOINABP);
+        print(RN2483_END);
+        }
+
+    // Ask for the data rate in use; the reply is a single digit line.
+    void startGetDataRate()
+        {
+        beginLineCommand();
+        print(MAC_START);
+        print(RN2483_GET);
+        print(MAC_DR);
+        print(RN2483_END);
+        state = GET_DR;
+        }
+
+    // Slot index of the i-th oldest queued TX frame.
+    inline uint8_t getTXQueueSlot(const uint8_t i) const
+        {
+        const uint_fast16_t s = uint_fast16_t(txQueueHead) + i;
+        return(uint8_t((s >= txQueueFrames) ? (s - txQueueFrames) : s));
+        }
+    // Discard the oldest queued TX frame; queue must not be empty.
+    inline void popTXQueue()
+        {
+        txQueueHead = getTXQueueSlot(1);
+        --txMessageQueue;
+        }
 
     /**
-     * @brief   Unused. For compatibility with OTRadioLink.
+     * @brief   Choose the oldest queued frames to send in one uplink.
+     * @param   len:    set to the application payload length of the uplink.
+     * @retval  Number of frames; if 1 the frame is sent as is, else batched with lengths.
      */
-    void _dolisten() {};
-};
+    uint8_t selectBatch(uint8_t &len) const
+        {
+        const uint8_t maxPayload = getMaxPayload(dataRate);
+        uint8_t nFrames = 0;
+        uint16_t batchLen = 0;
+        while(nFrames < txMessageQueue)
+            {
+            const uint16_t nextLen = batchLen + 1 + txMsgLen[getTXQueueSlot(nFrames)];
+            if(nextLen > maxPayload) { break; }
+            batchLen = nextLen;
+            ++nFrames;
+            }
+        if(nFrames <= 1) { len = txMsgLen[txQueueHead]; return(1); }
+        len = uint8_t(batchLen);
+        return(nFrames);
+        }
+
+    /**
+     * @brief   True if frames should be sent now.
+     * @note    Only when the duty cycle allows, and then
+     *          if the queue is full, the next uplink is full,
+     *          or the oldest frame has waited maxBatchDelayS.
+     */
+    bool isTimeToSend() const
+        {
+        if(0 == txMessageQueue) { return(false); }
+        if(0 != getSubBandAvailableInS(txSubBand)) { return(false); }
+        if(txMessageQueue >= txQueueFrames) { return(true); }
+        if((elapsedS - txQueuedAt[txQueueHead]) >= maxBatchDelayS) { return(true); }
+        uint8_t len;
+        return(selectBatch(len) < txMessageQueue);
+        }
+
+    // Start an unconfirmed uplink on port; the caller writes the payload in hex then RN2483_END.
+    void startTX(const uint8_t port)
+        {
+#ifdef RN2483_ALLOW_SLEEP
+        setBaud();
+        OTV0P2BASE::nap(WDTO_15MS, true);
+#endif // RN2483_ALLOW_SLEEP
+        beginLineCommand();
+        print(MAC_START);
+        print(MAC_SEND);
+        print(char('0' + port));
+        print(' ');
+        }
+    // Start sending the oldest queued frames in one uplink.
+    void startBatch()
+        {
+        txSendFrames = selectBatch(txSendLen);
+        const bool batch = (txSendFrames > 1);
+        startTX(batch ? TX_PORT_BATCH : TX_PORT_FRAME);
+        for(uint8_t i = 0; i < txSendFrames; ++i)
+            {
+            const uint8_t slot = getTXQueueSlot(i);
+            if(batch) { printHex(txMsgLen + slot, 1); }
+            printHex(txQueue[slot], txMsgLen[slot]);
+            }
+        print(RN2483_END);
+        state = SENDING;
+        }
+    // Account for the airtime of an uplink of len bytes just started.
+    void chargeAirtime(const uint8_t len)
+        { subBandAvailableAtS[txSubBand] = elapsedS + getOffTimeS(txSubBand, getAirtimeUs(dataRate, len)); }
+    // Wait for the uplink outcome, after the RX windows.
+    void startTXResult()
+        { at.next(RN2483_MAC_, NULL, NULL, uint8_t(getCurrentSeconds()), txTimeOut, true); }
+    // True if the uplink outcome just completed is success ('mac_tx_ok' or 'mac_rx ...').
+    bool isTXResultOK(const ATCommandEngine::Status s) const
+        { return((ATCommandEngine::AT_OK == s) && (NULL == strstr(at.getReply(), RN2483_MAC_ERR))); }
+    // Drop the frames of the uplink just sent (or failed).
+    void finishTX()
+        {
+        while(txSendFrames > 0) { popTXQueue(); --txSendFrames; }
+        }
+
+    /**
+     * @brief   Blocks until the command in progress completes.
+     * @note    Off AVR gives up if nothing arrives and time does not move, as in tests.
+     */
+    ATCommandEngine::Status waitAT()
+        {
+        for( ; ; )
+            {
+            const uint8_t now = uint8_t(getCurrentSeconds());
+#ifndef ARDUINO_ARCH_AVR
+            const uint8_t replyLen = at.getReplyLen();
+#endif // ARDUINO_ARCH_AVR
+            const ATCommandEngine::Status s = at.poll(now);
+            if(ATCommandEngine::AT_PENDING != s) { return(s); }
+#ifndef ARDUINO_ARCH_AVR
+            if((replyLen == at.getReplyLen()) && (now == uint8_t(getCurrentSeconds())))
+                {
+                at.clear();
+                return(ATCommandEngine::AT_TIMEOUT);
+                }
 #endif // ARDUINO_ARCH_AVR
+            }
+        }
+
+    // Setup
+    virtual bool _doconfig() override { return true; };
+};
 
 
 } // namespace OTRN2483Link
@@ -186,4 +186,40 @@ namespace OTRadValve
 //   }
 
 
+// Set thresholds for per-value and minimum-aggregate percentages to fire the boiler.
+void OnOffBoilerCallForHeat::setThresholds(const uint8_t minIndividual, const uint8_t minAggregate)
+  {
+  minIndividualPC = OTV0P2BASE::fnconstrain(minIndividual, uint8_t(1), uint8_t(100));
+  minAggregatePC = OTV0P2BASE::fnconstrain(minAggregate, minIndividualPC, uint8_t(100));
+  }
+
+// Update the call for heat given the current positions of all n valves.
+bool OnOffBoilerCallForHeat::tick(const uint8_t *const valvePCs, const size_t n)
+  {
+  // Set true if at least one valve has met/passed the individual % threshold to be considered calling for heat.
+  bool atLeastOneValveCallingForHeat = false;
+  // Partial cumulative percent open (stops accumulating once threshold has been passed).
+  uint8_t partialCumulativePC = 0;
+  for(size_t i = 0; i < n; ++i)
+    {
+    const uint8_t pc = valvePCs[i];
+    if(pc >= minIndividualPC) { atLeastOneValveCallingForHeat = true; }
+    if(partialCumulativePC < minAggregatePC) { partialCumulativePC = uint8_t(OTV0P2BASE::fnmin(100, partialCumulativePC + pc)); }
+    }
+  // Boiler should be on if both individual and aggregate limits are met.
+  const bool desiredBoilerState = atLeastOneValveCallingForHeat && (partialCumulativePC >= minAggregatePC);
+
+  // Note passage of a tick in current state.
+  if(ticksInCurrentState < 0xff) { ++ticksInCurrentState; }
+
+  // Change state only if needed and if enough ticks have passed, resetting the counter.
+  if((desiredBoilerState != callForHeat) && (ticksInCurrentState >= minTicksInEitherState))
+    {
+    callForHeat = desiredBoilerState;
+    ticksInCurrentState = 0;
+    }
+  return(callForHeat);
+  }
+
+
     }
@@ -179,6 +179,53 @@ namespace OTRadValve
 //  };
 
 
+// Simple on/off boiler call-for-heat logic, fully testable,
+// for when the positions of all the valves are directly visible each tick,
+// eg in a whole-house simulation.
+// Uses the same individual/aggregate thresholds and anti-short-cycling rule
+// as OnOffBoilerDriverLogic above, but without IDs, radio signals or expiry.
+// The tick length is up to the caller.
+class OnOffBoilerCallForHeat final
+  {
+  private:
+    // True to call for heat from the boiler.
+    bool callForHeat = false;
+
+    // Number of ticks that boiler has been in current state, on or off, to avoid short-cycling.
+    // This value does not roll back round to zero, ie will stop at maximum until reset.
+    uint8_t ticksInCurrentState = 0;
+
+    // Ticks minimum for boiler to stay in each state to avoid short-cycling.
+    uint8_t minTicksInEitherState = 0;
+
+    // Minimum individual valve percentage to be considered open [1,100].
+    uint8_t minIndividualPC = DEFAULT_VALVE_PC_MIN_REALLY_OPEN;
+
+    // Minimum aggregate valve percentage to be considered open, no lower than minIndividualPC; [1,100].
+    uint8_t minAggregatePC = DEFAULT_VALVE_PC_MODERATELY_OPEN;
+
+  public:
+    // Set thresholds for per-value and minimum-aggregate percentages to fire the boiler.
+    // Coerces values to be valid:
+    // minIndividual in range [1,100] and minAggregate in range [minIndividual,100].
+    void setThresholds(uint8_t minIndividual, uint8_t minAggregate);
+
+    // Set minimum ticks for boiler to stay in each state to avoid short-cycling.
+    // Typically the equivalent of 2--10 minutes (eg ~2+ for gas, ~8 for oil).
+    void setMinTicksInEitherState(const uint8_t minTicks) { minTicksInEitherState = minTicks; }
+
+    // Iff true then call for heat from the boiler.
+    bool isCallingForHeat() const { return(callForHeat); }
+
+    // Update the call for heat once per tick given the current positions of all n valves.
+    // The boiler should be on if at least one valve is at least minIndividual open
+    // and all the valves together are at least minAggregate open,
+    // though a change of state is delayed until minTicksInEitherState have passed.
+    // Returns the new value of isCallingForHeat().
+    bool tick(const uint8_t *valvePCs, size_t n);
+  };
+
+
     }
 
 #endif
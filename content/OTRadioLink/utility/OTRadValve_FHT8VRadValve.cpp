@@ -362,6 +362,213 @@ uint8_t const * FHT8VRadValveUtil::FHT8VDecodeBitStream(uint8_t const *bitStream
   return(state.bitStream + 1);
   }
 
+
+#if !defined(ARDUINO)
+// Tables for the byte-at-a-time encoder and decoder, built once on first use.
+// In the encoded stream each logical 0 is 1100 and each logical 1 is 111000,
+// ie each is a sequence of bit pairs (11 00 or 11 10 00) starting at an even bit position.
+namespace
+  {
+  struct FHT8VTables final
+    {
+    // Encoding of each byte value plus its even parity bit:
+    // bits msbit first in the low bits of pattern.
+    struct Enc final { uint64_t pattern; uint8_t bits; };
+    Enc enc[256];
+
+    // Decoding of one input byte (4 bit pairs) given how many pairs of the current symbol
+    // have already been read (the state, 0 to 2):
+    //   * symbols  number of symbols completed in this byte, 0 to 2
+    //   * values  decoded values of those symbols, last in bit 0
+    //   * ends  number of pairs of this byte used once each symbol is complete,
+    //     1 to 4, first in the low nibble
+    //   * next  state after this byte, or badState if a malformed pair
+    //     follows the completed symbols
+    struct Dec final { uint8_t symbols; uint8_t values; uint8_t ends; uint8_t next; };
+    static constexpr uint8_t badState = 0xff;
+    Dec dec[3][256];
+
+    FHT8VTables()
+      {
+      for(int b = 0; b < 256; ++b)
+        {
+        uint64_t pattern = 0;
+        uint8_t bits = 0;
+        const uint16_t withParity = uint16_t((b << 1) | FHT8VRadValveUtil::xor_parity_even_bit(uint8_t(b)));
+        for(int i = 8; i >= 0; --i)
+          {
+          if(0 != (withParity & (1 << i))) { pattern = (pattern << 6) | 0x38; bits += 6; }
+          else { pattern = (pattern << 4) | 0xc; bits += 4; }
+          }
+        enc[b].pattern = pattern;
+        enc[b].bits = bits;
+        }
+      for(uint8_t s = 0; s < 3; ++s)
+        {
+        for(int b = 0; b < 256; ++b)
+          {
+          Dec d = { 0, 0, 0, 0 };
+          uint8_t state = s;
+          for(uint8_t i = 0; i < 4; ++i)
+            {
+            const uint8_t pair = uint8_t((b >> (6 - 2*i)) & 3);
+            int value = -1; // Set to the symbol value when one completes.
+            switch(state)
+              {
+              case 0: if(3 == pair) { state = 1; } else { state = badState; } break; // Leading 11.
+              case 1: if(0 == pair) { value = 0; } else if(2 == pair) { state = 2; } else { state = badState; } break;
+              case 2: if(0 == pair) { value = 1; } else { state = badState; } break; // Trailing 00 of a 1.
+              }
+            if(badState == state) { break; }
+            if(value >= 0)
+              {
+              d.values = uint8_t((d.values << 1) | value);
+              d.ends |= uint8_t((i + 1) << (4 * d.symbols));
+              ++d.symbols;
+              state = 0;
+              }
+            }
+          d.next = state;
+          dec[s][b] = d;
+          }
+        }
+      }
+    };
+
+  const FHT8VTables &getFHT8VTables()
+    {
+    static const FHT8VTables t;
+    return(t);
+    }
+
+  // Accumulates encoded bits msbit first, writing out each completed byte.
+  struct FHT8VBitWriter final
+    {
+    uint8_t *bptr;
+    uint64_t acc;
+    uint8_t bits; // Bits not yet written, in the low bits of acc; fewer than 8 between calls.
+    // Append up to 56 bits.
+    void append(const uint64_t pattern, const uint8_t n)
+      {
+      acc = (acc << n) | pattern;
+      bits = uint8_t(bits + n);
+      while(bits >= 8) { bits -= 8; *bptr++ = uint8_t(acc >> bits); }
+      }
+    };
+
+  // Parse the 55 bits following the leading 1 of a frame (the body, checksum and trailing 0),
+  // oldest in the msbits, into command.
+  // Returns false if any parity, checksum or the trailing 0 is wrong.
+  bool parseFHT8VFrameBits(const uint64_t frame, FHT8VRadValveUtil::fht8v_msg_t *const command)
+    {
+    if(0 != (frame & 1)) { return(false); } // Trailing 0.
+    uint8_t b[6];
+    for(uint8_t i = 0; i < 6; ++i)
+      {
+      const uint16_t withParity = uint16_t((frame >> (1 + 9 * (5 - i))) & 0x1ff);
+      b[i] = uint8_t(withParity >> 1);
+      if((withParity & 1) != FHT8VRadValveUtil::xor_parity_even_bit(b[i])) { return(false); }
+      }
+    command->hc1 = b[0];
+    command->hc2 = b[1];
+#ifdef OTV0P2BASE_FHT8V_ADR_USED
+    command->address = b[2];
+#endif
+    command->command = b[3];
+    command->extension = b[4];
+    const uint8_t checksum = uint8_t(0xc + b[0] + b[1] + b[2] + b[3] + b[4]);
+    return(checksum == b[5]);
+    }
+
+  // Incremental state of the byte-at-a-time decoder for one stream.
+  struct FHT8VDecoder final
+    {
+    uint8_t state = 0; // Pairs of the current symbol already read, or FHT8VTables::badState.
+    bool started = false; // True once the leading 1 has been read.
+    uint8_t n = 0; // Bits of the frame read after the leading 1.
+    uint64_t frame = 0;
+
+    // Decode byte p of the stream.
+    // Returns 1 if the frame is complete and valid (with *end set as FHT8VDecodeBitStream() would return),
+    // -1 if the decode has failed, else 0 if more bytes are needed.
+    int step(const FHT8VTables &t, const uint8_t *const p, FHT8VRadValveUtil::fht8v_msg_t *const command, uint8_t const **const end)
+      {
+      const FHT8VTables::Dec &d = t.dec[state][*p];
+      if(started && (n + d.symbols < 55))
+        {
+        // Fast path: all of this byte's symbols are within the frame body.
+        frame = (frame << d.symbols) | d.values;
+        n = uint8_t(n + d.symbols);
+        }
+      else for(uint8_t i = 0; i < d.symbols; ++i)
+        {
+        const uint8_t v = (d.values >> (d.symbols - 1 - i)) & 1;
+        if(!started) { started = (0 != v); continue; }
+        frame = (frame << 1) | v;
+        if(55 != ++n) { continue; }
+        if(!parseFHT8VFrameBits(frame, command)) { return(-1); } // ERROR
+        // Point after the byte holding the next unread pair.
+        *end = p + ((4 == ((d.ends >> (4 * i)) & 0xf)) ? 2 : 1);
+        return(1);
+        }
+      state = d.next;
+      return((FHT8VTables::badState == state) ? -1 : 0);
+      }
+    };
+  }
+
+// Table-driven, byte-at-a-time version of FHT8VCreate200usBitStreamBptr() with identical output.
+uint8_t *FHT8VRadValveUtil::FHT8VCreate200usBitStreamBptrFast(uint8_t *bptr, const FHT8VRadValveUtil::fht8v_msg_t *command)
+  {
+  const FHT8VTables &t = getFHT8VTables();
+  // First 12 x 0 bits of preamble, pre-encoded as 6 x 0xcc bytes.
+  for(uint8_t i = 0; i < 6; ++i) { *bptr++ = 0xcc; }
+  // Remaining 1 of preamble.
+  FHT8VBitWriter w = { bptr, 0x38, 6 };
+#ifdef OTV0P2BASE_FHT8V_ADR_USED
+  const uint8_t address = command->address;
+#else
+  const uint8_t address = 0;
+#endif
+  const uint8_t body[6] = { command->hc1, command->hc2, address, command->command, command->extension,
+      uint8_t(0xc + command->hc1 + command->hc2 + address + command->command + command->extension) };
+  for(uint8_t i = 0; i < 6; ++i) { w.append(t.enc[body[i]].pattern, t.enc[body[i]].bits); }
+  // Trailing 0 plus two more to flush out the final bits; any partial byte is dropped.
+  w.append(0xccc, 12);
+  *w.bptr = 0xff; // Terminate TX bytes.
+  return(w.bptr);
+  }
+
+// Table-driven, byte-at-a-time version of FHT8VDecodeBitStream() with identical results.
+uint8_t const *FHT8VRadValveUtil::FHT8VDecodeBitStreamFast(uint8_t const *bitStream, uint8_t const *lastByte, FHT8VRadValveUtil::fht8v_msg_t *command)
+  {
+  const FHT8VTables &t = getFHT8VTables();
+  FHT8VDecoder d;
+  uint8_t const *end = NULL;
+  for(uint8_t const *p = bitStream; p <= lastByte; ++p)
+    {
+    const int r = d.step(t, p, command, &end);
+    if(0 != r) { return((r > 0) ? end : NULL); }
+    }
+  return(NULL); // ERROR: ran off the end.
+  }
+
+// Decode a batch of captured bit streams.
+size_t FHT8VRadValveUtil::FHT8VDecodeBitStreams(const uint8_t *const streams, const size_t stride, const size_t streamLen, const size_t n,
+                                                FHT8VRadValveUtil::fht8v_msg_t *const commands, uint8_t *const decoded)
+  {
+  size_t count = 0;
+  for(size_t i = 0; i < n; ++i)
+    {
+    const uint8_t *const s = streams + i * stride;
+    const bool ok = (0 != streamLen) && (NULL != FHT8VDecodeBitStreamFast(s, s + streamLen - 1, commands + i));
+    decoded[i] = ok ? 1 : 0;
+    if(ok) { ++count; }
+    }
+  return(count);
+  }
+#endif // !defined(ARDUINO)
+
 #endif // FHT8VRadValveUtil_DEFINED
 
 
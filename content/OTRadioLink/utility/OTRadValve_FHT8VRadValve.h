@@ -116,6 +116,23 @@ class FHT8VRadValveUtil
     // Returns NULL on failure, else pointer to next full byte after last decoded.
     static uint8_t const *FHT8VDecodeBitStream(uint8_t const *bitStream, uint8_t const *lastByte, fht8v_msg_t *command);
 
+#if !defined(ARDUINO)
+    // Host-side (eg hub) table-driven versions of the encoder and decoder above,
+    // working a byte at a time rather than a bit (pair) at a time,
+    // with output and return values identical to the originals.
+    // The tables are built on first use (thread-safely) and take a few kB.
+    // On failure the content of command is unspecified, as for the originals.
+    static uint8_t *FHT8VCreate200usBitStreamBptrFast(uint8_t *bptr, const fht8v_msg_t *command);
+    static uint8_t const *FHT8VDecodeBitStreamFast(uint8_t const *bitStream, uint8_t const *lastByte, fht8v_msg_t *command);
+
+    // Decode a batch of n captured bit streams with FHT8VDecodeBitStreamFast(),
+    // stream i being the streamLen bytes at streams + i*stride,
+    // into commands[i], setting decoded[i] to 1 if successful else 0.
+    // Returns the number of streams successfully decoded.
+    static size_t FHT8VDecodeBitStreams(const uint8_t *streams, size_t stride, size_t streamLen, size_t n,
+                                        fht8v_msg_t *commands, uint8_t *decoded);
+#endif
+
     // Approximate maximum transmission (TX) time for bare FHT8V command frame in ms; strictly positive.
     // This ignores any prefix needed for particular radios such as the RFM23B.
     // ~80ms upwards.
@@ -26,27 +26,10 @@ namespace OTRadValve
     {
 
 
-// Simple mean filter.
-// Find mean of group of ints where sum can be computed in an int without loss.
-// TODO: needs a unit test or three.
-template<size_t N> int_fast16_t smallIntMean(const int_fast16_t data[N])
-  {
-  // Extract mean.
-  // Assume values and sum will be nowhere near the limits.
-  int_fast16_t sum = 0;
-  for(int8_t i = N; --i >= 0; ) { sum += data[i]; }
-  // Compute rounded-up mean.
-  // Avoid accidental computation as unsigned...
-  return((sum + (int_fast16_t)(N/2)) / (int_fast16_t)N);
-  }
-
-// Get smoothed raw/unadjusted temperature from the most recent samples.
-int_fast16_t ModelledRadValveState::getSmoothedRecent() const
-  { return(smallIntMean<filterLength>(prevRawTempC16)); }
-
 // Construct an instance, with sensible defaults, and current (room) temperature from the input state.
 // Does its initialisation with room temperature immediately.
-ModelledRadValveState::ModelledRadValveState(const ModelledRadValveInputState &inputState, const bool _alwaysGlacial) :
+template<uint8_t filterLengthTicks>
+ModelledRadValveStateT<filterLengthTicks>::ModelledRadValveStateT(const ModelledRadValveInputState &inputState, const bool _alwaysGlacial) :
   alwaysGlacial(_alwaysGlacial),
   initialised(true)
   {
@@ -66,7 +49,8 @@ ModelledRadValveState::ModelledRadValveState(const ModelledRadValveInputState &i
 // If the physical device is provided then its target will be updated
 // and its actual value will be monitored for cumulative movement,
 // else if not provided the movement in valvePCOpenRef will be monitored.
-void ModelledRadValveState::tick(volatile uint8_t &valvePCOpenRef,
+template<uint8_t filterLengthTicks>
+void ModelledRadValveStateT<filterLengthTicks>::tick(volatile uint8_t &valvePCOpenRef,
                                  const ModelledRadValveInputState &inputState,
                                  AbstractRadValve *const physicalDeviceOpt)
   {
@@ -91,8 +75,7 @@ void ModelledRadValveState::tick(volatile uint8_t &valvePCOpenRef,
     }
 
   // Shift in the latest (raw) temperature.
-  for(int_fast8_t i = filterLength; --i > 0; ) { prevRawTempC16[i] = prevRawTempC16[i-1]; }
-  prevRawTempC16[0] = rawTempC16;
+  rawTempHistory.push(rawTempC16);
 
   // Disable/enable filtering.
   static constexpr uint8_t filter_minimum_ON =
@@ -130,10 +113,9 @@ void ModelledRadValveState::tick(volatile uint8_t &valvePCOpenRef,
   if(FILTER_DETECT_JITTER && !isFiltering)
     {
     // Force filtering (back) on if adjacent readings are wildly different.
-    // Slow/expensive test if temperature readings are jittery.
+    // The history keeps count of such pairs as samples are added.
     // It is not clear how often this will be the case with good sensors.
-    for(size_t i = 1; i < filterLength; ++i)
-      { if(OTV0P2BASE::fnabsdiff(prevRawTempC16[i], prevRawTempC16[i-1]) > MAX_TEMP_JUMP_C16) { isFiltering = filter_minimum_ON; break; } }
+    if(rawTempHistory.hasBigStep()) { isFiltering = filter_minimum_ON; }
     }
 
   // Count down timers.
@@ -237,7 +219,8 @@ void ModelledRadValveState::tick(volatile uint8_t &valvePCOpenRef,
 //     and to reduce battery drain and valve wear/sticking,
 //     the algorithm is biased towards fully opening but not fully closing.
 //
-uint8_t ModelledRadValveState::computeRequiredTRVPercentOpen(
+template<uint8_t filterLengthTicks>
+uint8_t ModelledRadValveStateT<filterLengthTicks>::computeRequiredTRVPercentOpen(
     const uint8_t valvePCOpen,
     const ModelledRadValveInputState &inputState) const
   {
@@ -1042,6 +1025,18 @@ uint8_t ModelledRadValveState::computeRequiredTRVPercentOpen(
 //    return(targetPO);
 //    }
 
+// Out-of-line definition of the constant, needed (pre C++17) where it is ODR-used.
+template<uint8_t filterLengthTicks>
+constexpr size_t ModelledRadValveStateT<filterLengthTicks>::filterLength;
+
+// Instantiate the supported filter lengths:
+// the default, and a longer one for host-side simulations.
+template struct ModelledRadValveStateT<16>;
+#if !defined(ARDUINO)
+template struct ModelledRadValveStateT<32>;
+#endif
+
+
 
 #ifdef ModelledRadValve_DEFINED
 
@@ -118,6 +118,82 @@ struct ModelledRadValveInputState final
   };
 
 
+// Fixed-length history of raw temperatures (C*16) for the ModelledRadValveState filter.
+// Held as a ring (newest first) with a running sum,
+// so that adding a sample and the mean and delta queries
+// each take constant time whatever the length.
+//   * length  number of samples held; in range [2,63]
+//   * maxStepC16  if non-zero, adjacent samples differing by more than this
+//     are tracked for hasBigStep(), else that is always false
+template<uint8_t length, uint8_t maxStepC16 = 0>
+class RawTempFilterHistory final
+  {
+  static_assert((length >= 2) && (length <= 63), "length out of range");
+  private:
+    int_fast16_t buf[length];
+    // Index of the newest sample.
+    uint8_t head = 0;
+    // Sum of all samples held; wide enough for any C16 temperatures.
+    int_fast32_t sum = 0;
+    // Number of adjacent pairs of samples differing by more than maxStepC16.
+    uint8_t bigSteps = 0;
+
+    // Index of the sample n ticks back from the newest; n in [0,length-1].
+    inline uint8_t index(const uint8_t n) const
+      { const uint8_t i = uint8_t(head + n); return((i >= length) ? uint8_t(i - length) : i); }
+    // True if a and b are adjacent samples to be counted in bigSteps.
+    static inline bool isBigStep(const int_fast16_t a, const int_fast16_t b)
+      { return((0 != maxStepC16) && (OTV0P2BASE::fnabsdiff(a, b) > int_fast16_t(maxStepC16))); }
+
+  public:
+    RawTempFilterHistory() { fill(0); }
+
+    // Set all samples to t.
+    void fill(const int_fast16_t t)
+      {
+      for(uint8_t i = 0; i < length; ++i) { buf[i] = t; }
+      head = 0;
+      sum = int_fast32_t(t) * length;
+      bigSteps = 0;
+      }
+
+    // Add t as the newest sample, discarding the oldest.
+    void push(const int_fast16_t t)
+      {
+      const uint8_t oldest = index(length - 1);
+      const int_fast16_t o = buf[oldest];
+      if(isBigStep(o, buf[index(length - 2)])) { --bigSteps; }
+      if(isBigStep(t, buf[head])) { ++bigSteps; }
+      sum += t - o;
+      head = oldest;
+      buf[head] = t;
+      }
+
+    // Get the sample from n ticks ago, 0 being the newest; n in [0,length-1].
+    inline int_fast16_t get(const uint8_t n) const { return(buf[index(n)]); }
+
+    // Get the mean of all samples, rounded as (sum + length/2) / length.
+    inline int_fast16_t getMean() const
+      { return(int_fast16_t((sum + int_fast32_t(length/2)) / int_fast32_t(length))); }
+
+    // True if any adjacent samples differ by more than maxStepC16 (if non-zero).
+    inline bool hasBigStep() const { return(0 != bigSteps); }
+
+    // Add delta to the sample from n ticks ago; n in [0,length-1].
+    // Not intended for general use, but for testing filter behaviour.
+    void _adjust(const uint8_t n, const int_fast16_t delta)
+      {
+      const uint8_t i = index(n);
+      const bool hasNewer = (0 != n), hasOlder = (n < length - 1);
+      if(hasNewer && isBigStep(buf[i], buf[index(n - 1)])) { --bigSteps; }
+      if(hasOlder && isBigStep(buf[i], buf[index(n + 1)])) { --bigSteps; }
+      buf[i] += delta;
+      sum += delta;
+      if(hasNewer && isBigStep(buf[i], buf[index(n - 1)])) { ++bigSteps; }
+      if(hasOlder && isBigStep(buf[i], buf[index(n + 1)])) { ++bigSteps; }
+      }
+  };
+
 // All retained state for computing valve movement, eg time-based state.
 // Exposed to allow easier unit testing.
 // All initial values set by the constructor are sane.
@@ -125,7 +201,14 @@ struct ModelledRadValveInputState final
 // This uses int_fast16_t for C16 temperatures (ie Celsius * 16)
 // to be able to efficiently process signed values with sufficient range
 // for room temperatures.
-struct ModelledRadValveState final
+//
+// The filter length in ticks is a template parameter;
+// per-tick filter work does not grow with it.
+// Must be at least 11, and at most 63.
+// Only lengths explicitly instantiated in OTRadValve_ModelledRadValve.cpp
+// (the default 16 and, for host simulations, 32) can be used.
+template<uint8_t filterLengthTicks = 16>
+struct ModelledRadValveStateT final
   {
   // If true then support a minimal/binary valve implementation.
   static constexpr bool MINIMAL_BINARY_IMPL = false;
@@ -177,15 +260,15 @@ struct ModelledRadValveState final
 
   // Construct an instance, with sensible defaults, but no (room) temperature.
   // Defers its initialisation with room temperature until first tick().
-  ModelledRadValveState() { }
+  ModelledRadValveStateT() { }
 
   // Construct an instance, with sensible defaults, but no (room) temperature.
   // Defers its initialisation with room temperature until first tick().
-  ModelledRadValveState(bool _alwaysGlacial) : alwaysGlacial(_alwaysGlacial) { }
+  ModelledRadValveStateT(bool _alwaysGlacial) : alwaysGlacial(_alwaysGlacial) { }
 
   // Construct an instance, with sensible defaults, and current (room) temperature from the input state.
   // Does its initialisation with room temperature immediately.
-  ModelledRadValveState(const ModelledRadValveInputState &inputState, bool _alwaysGlacial = false);
+  ModelledRadValveStateT(const ModelledRadValveInputState &inputState, bool _alwaysGlacial = false);
 
   // Perform per-minute tasks such as counter and filter updates then recompute valve position.
   // The input state must be complete including target/reference temperatures
@@ -315,30 +398,29 @@ struct ModelledRadValveState final
   uint8_t prevValvePC = 0;
 
   // Length of filter memory in ticks; strictly positive.
-  // Must be at least 4, and may be more efficient at a power of 2.
-  static constexpr size_t filterLength = 16;
+  static constexpr size_t filterLength = filterLengthTicks;
+
+  // If true, detect jitter between adjacent samples to turn filter on.
+  // Whether or not true, other detection mechanisms may be used.
+  static constexpr bool FILTER_DETECT_JITTER = false;
 
   // Previous unadjusted temperatures, 0 being the newest, and following ones successively older.
   // These values have any target bias removed.
   // Half the filter size times the tick() interval gives an approximate time constant.
   // Note that full response time of a typical mechanical wax-based TRV is ~20mins.
-  int_fast16_t prevRawTempC16[filterLength];
-
-  // If true, detect jitter between adjacent samples to turn filter on.
-  // Whether or not true, other detection mechanisms may be used.
-  static constexpr bool FILTER_DETECT_JITTER = false;
+  RawTempFilterHistory<filterLengthTicks, (FILTER_DETECT_JITTER ? MAX_TEMP_JUMP_C16 : 0)> rawTempHistory;
 
   // Get smoothed raw/unadjusted temperature from the most recent samples.
-  int_fast16_t getSmoothedRecent() const;
+  int_fast16_t getSmoothedRecent() const { return(rawTempHistory.getMean()); }
 
   // Get last change in temperature (C*16, signed); +ve means rising.
-  int_fast16_t getRawDelta() const { return(prevRawTempC16[0] - prevRawTempC16[1]); }
+  int_fast16_t getRawDelta() const { return(rawTempHistory.get(0) - rawTempHistory.get(1)); }
 
   // Get last change in temperature (C*16, signed) from n ticks ago capped to filter length; +ve means rising.
-  int_fast16_t getRawDelta(uint8_t n) const { return(prevRawTempC16[0] - prevRawTempC16[OTV0P2BASE::fnmin((size_t)n, filterLength-1)]); }
+  int_fast16_t getRawDelta(uint8_t n) const { return(rawTempHistory.get(0) - rawTempHistory.get(OTV0P2BASE::fnmin(n, uint8_t(filterLength-1)))); }
 
   // Get previous change in temperature (C*16, signed); +ve means was rising.
-  int_fast16_t getPrevRawDelta() const { return(prevRawTempC16[1] - prevRawTempC16[2]); }
+  int_fast16_t getPrevRawDelta() const { return(rawTempHistory.get(1) - rawTempHistory.get(2)); }
 
 //  // Compute an estimate of rate/velocity of temperature change in C/16 per minute/tick.
 //  // A positive value indicates that temperature is rising.
@@ -360,7 +442,7 @@ struct ModelledRadValveState final
   // Not intended for general use.
   // Can be used when testing to avoid filtering being triggered with rapid simulated temperature swings.
   inline void _backfillTemperatures(const int_fast16_t rawTempC16)
-    { for(int_fast8_t i = filterLength; --i >= 0; ) { prevRawTempC16[i] = rawTempC16; } }
+    { rawTempHistory.fill(rawTempC16); }
 
   // Compute the adjusted temperature as used within the class calculation, filter, etc.
   static int_fast16_t computeRawTemp16(const ModelledRadValveInputState& inputState)
@@ -368,6 +450,9 @@ struct ModelledRadValveState final
 
   };
 
+// Retained valve state with the default filter length.
+typedef ModelledRadValveStateT<> ModelledRadValveState;
+
 // Sensor, control and stats inputs for computations.
 // Read access to all necessary underlying devices.
 struct ModelledRadValveSensorCtrlStats final
@@ -477,45 +562,41 @@ class ModelledRadValveComputeTargetTempBase
         const bool glacial) const = 0;
   };
 
-// Basic/simple stateless implementation of computation of target temperature.
-// Templated with all input instances for maximum speed and minimum code size.
-//
-// TODO: incorporate condensation protection by keeping above the dew point:
-//
-//     Td = T - ((100 - RH)/5.)
-//
-// taken from: https://iridl.ldeo.columbia.edu/dochelp/QA/Basic/dewpoint.html
-//
-// where T and RH are the current temperature and relative humidity.
+// Decision logic of ModelledRadValveComputeTargetTempBasic with its inputs passed in at run time.
+// Shared by ModelledRadValveComputeTargetTempBasic (inputs bound at compile time)
+// and ModelledRadValveComputeTargetTempBasicRuntime (inputs bound at construction)
+// so that both make identical decisions.
+// Always inlined, so that with compile-time inputs
+// the code is as if written directly in ModelledRadValveComputeTargetTempBasic.
+// Not intended for direct use.
 template<
   class valveControlParameters,
-  const ValveMode *const valveMode,
-  class TemperatureC16Base,                     const TemperatureC16Base *const temperatureC16,
-  class TempControlBase,                        const TempControlBase *const tempControl,
-  class PseudoSensorOccupancyTracker,           const PseudoSensorOccupancyTracker *const occupancy,
-  class SensorAmbientLightBase,                 const SensorAmbientLightBase *const ambLight,
-  class ActuatorPhysicalUIBase,                 const ActuatorPhysicalUIBase *const physicalUI,
-  class SimpleValveScheduleBase,                const SimpleValveScheduleBase *const schedule,
-  class NVByHourByteStatsBase,                  const NVByHourByteStatsBase *const byHourStats,
-  class rh_t = OTV0P2BASE::HumiditySensorBase,  const rh_t *const relHumidityOpt = static_cast<const rh_t *>(NULL),
-  bool (*const setbackLockout)() = ((bool(*)())NULL)
+  class TemperatureC16Base,
+  class TempControlBase,
+  class PseudoSensorOccupancyTracker,
+  class SensorAmbientLightBase,
+  class ActuatorPhysicalUIBase,
+  class SimpleValveScheduleBase,
+  class NVByHourByteStatsBase,
+  class rh_t
   >
-class ModelledRadValveComputeTargetTempBasic final : public ModelledRadValveComputeTargetTempBase
+struct ModelledRadValveComputeTargetTempBasicLogic final
   {
-  public:
-//    constexpr ModelledRadValveComputeTargetTempBasic()
-//        {
-//        // Validate (non-optional) args.  Doesn't work with g++ 4.9.2 in Arduino IDE.
-//        static_assert(!!valveMode, "non-optional parameter must not be NULL");
-//        static_assert(!!temperatureC16, "non-optional parameter must not be NULL");
-//        static_assert(!!tempControl, "non-optional parameter must not be NULL");
-//        static_assert(!!occupancy, "non-optional parameter must not be NULL");
-//        static_assert(!!ambLight, "non-optional parameter must not be NULL");
-//        static_assert(!!physicalUI, "non-optional parameter must not be NULL");
-//        static_assert(!!schedule, "non-optional parameter must not be NULL");
-//        static_assert(!!byHourStats, "non-optional parameter must not be NULL");
-//        }
-    virtual uint8_t computeTargetTemp() const override
+    // Inputs, as for ModelledRadValveSensorCtrlStats;
+    // relHumidityOpt and setbackLockout may be NULL.
+    const ValveMode *const valveMode;
+    const TemperatureC16Base *const temperatureC16;
+    const TempControlBase *const tempControl;
+    const PseudoSensorOccupancyTracker *const occupancy;
+    const SensorAmbientLightBase *const ambLight;
+    const ActuatorPhysicalUIBase *const physicalUI;
+    const SimpleValveScheduleBase *const schedule;
+    const NVByHourByteStatsBase *const byHourStats;
+    const rh_t *const relHumidityOpt;
+    bool (*const setbackLockout)();
+
+    // As for ModelledRadValveComputeTargetTempBase::computeTargetTemp().
+    inline uint8_t computeTargetTemp() const __attribute__((always_inline))
         {
         // In FROST mode.
         if(!valveMode->inWarmMode())
@@ -692,11 +773,11 @@ class ModelledRadValveComputeTargetTempBasic final : public ModelledRadValveComp
     // Set all fields of inputState from the target temperature etc.
     // Usually target temp will just have been computed by computeTargetTemp().
     // This should not second-guess computeTargetTemp() in terms of setbacks.
-    virtual void setupInputState(ModelledRadValveInputState &inputState,
+    inline void setupInputState(ModelledRadValveInputState &inputState,
         const bool /*isFiltering*/,
         const uint8_t newTargetC,
         const uint8_t /*minPCOpen*/, const uint8_t maxPCOpen,
-        const bool glacial) const override
+        const bool glacial) const __attribute__((always_inline))
         {
         // Set up state for computeRequiredTRVPercentOpen().
         inputState.targetTempC = newTargetC;
@@ -743,6 +824,124 @@ class ModelledRadValveComputeTargetTempBasic final : public ModelledRadValveComp
         }
   };
 
+// Basic/simple stateless implementation of computation of target temperature.
+// Templated with all input instances for maximum speed and minimum code size.
+//
+// TODO: incorporate condensation protection by keeping above the dew point:
+//
+//     Td = T - ((100 - RH)/5.)
+//
+// taken from: https://iridl.ldeo.columbia.edu/dochelp/QA/Basic/dewpoint.html
+//
+// where T and RH are the current temperature and relative humidity.
+template<
+  class valveControlParameters,
+  const ValveMode *const valveMode,
+  class TemperatureC16Base,                     const TemperatureC16Base *const temperatureC16,
+  class TempControlBase,                        const TempControlBase *const tempControl,
+  class PseudoSensorOccupancyTracker,           const PseudoSensorOccupancyTracker *const occupancy,
+  class SensorAmbientLightBase,                 const SensorAmbientLightBase *const ambLight,
+  class ActuatorPhysicalUIBase,                 const ActuatorPhysicalUIBase *const physicalUI,
+  class SimpleValveScheduleBase,                const SimpleValveScheduleBase *const schedule,
+  class NVByHourByteStatsBase,                  const NVByHourByteStatsBase *const byHourStats,
+  class rh_t = OTV0P2BASE::HumiditySensorBase,  const rh_t *const relHumidityOpt = static_cast<const rh_t *>(NULL),
+  bool (*const setbackLockout)() = ((bool(*)())NULL)
+  >
+class ModelledRadValveComputeTargetTempBasic final : public ModelledRadValveComputeTargetTempBase
+  {
+  private:
+    typedef ModelledRadValveComputeTargetTempBasicLogic<
+        valveControlParameters,
+        TemperatureC16Base,
+        TempControlBase,
+        PseudoSensorOccupancyTracker,
+        SensorAmbientLightBase,
+        ActuatorPhysicalUIBase,
+        SimpleValveScheduleBase,
+        NVByHourByteStatsBase,
+        rh_t
+        > logic_t;
+    // The decision logic bound to the compile-time inputs.
+    static constexpr logic_t logic()
+        {
+        return(logic_t{valveMode, temperatureC16, tempControl, occupancy, ambLight,
+                       physicalUI, schedule, byHourStats, relHumidityOpt, setbackLockout});
+        }
+
+  public:
+//    constexpr ModelledRadValveComputeTargetTempBasic()
+//        {
+//        // Validate (non-optional) args.  Doesn't work with g++ 4.9.2 in Arduino IDE.
+//        static_assert(!!valveMode, "non-optional parameter must not be NULL");
+//        static_assert(!!temperatureC16, "non-optional parameter must not be NULL");
+//        static_assert(!!tempControl, "non-optional parameter must not be NULL");
+//        static_assert(!!occupancy, "non-optional parameter must not be NULL");
+//        static_assert(!!ambLight, "non-optional parameter must not be NULL");
+//        static_assert(!!physicalUI, "non-optional parameter must not be NULL");
+//        static_assert(!!schedule, "non-optional parameter must not be NULL");
+//        static_assert(!!byHourStats, "non-optional parameter must not be NULL");
+//        }
+    virtual uint8_t computeTargetTemp() const override
+        { return(logic().computeTargetTemp()); }
+
+    // Set all fields of inputState from the target temperature etc.
+    // Usually target temp will just have been computed by computeTargetTemp().
+    // This should not second-guess computeTargetTemp() in terms of setbacks.
+    virtual void setupInputState(ModelledRadValveInputState &inputState,
+        const bool isFiltering,
+        const uint8_t newTargetC,
+        const uint8_t minPCOpen, const uint8_t maxPCOpen,
+        const bool glacial) const override
+        { logic().setupInputState(inputState, isFiltering, newTargetC, minPCOpen, maxPCOpen, glacial); }
+  };
+
+// Basic/simple stateless computation of target temperature
+// with the inputs bound at construction rather than as template arguments,
+// so that many independent instances, eg thousands of simulated valves,
+// can be created at run time from one instantiation.
+// Makes identical decisions to ModelledRadValveComputeTargetTempBasic given the same inputs,
+// at the cost of virtual calls to the inputs.
+template<class valveControlParameters, class rh_t = OTV0P2BASE::HumiditySensorBase>
+class ModelledRadValveComputeTargetTempBasicRuntime final : public ModelledRadValveComputeTargetTempBase
+  {
+  private:
+    typedef ModelledRadValveComputeTargetTempBasicLogic<
+        valveControlParameters,
+        OTV0P2BASE::TemperatureC16Base,
+        TempControlBase,
+        OTV0P2BASE::PseudoSensorOccupancyTracker,
+        OTV0P2BASE::SensorAmbientLightBase,
+        ActuatorPhysicalUIBase,
+        SimpleValveScheduleBase,
+        OTV0P2BASE::NVByHourByteStatsBase,
+        rh_t
+        > logic_t;
+    const logic_t logic;
+
+  public:
+    // Bind to the inputs in s, all non-NULL,
+    // with optional relative humidity sensor and setback lockout (each NULL if none).
+    constexpr ModelledRadValveComputeTargetTempBasicRuntime(const ModelledRadValveSensorCtrlStats &s,
+            const rh_t *const relHumidityOpt = NULL,
+            bool (*const setbackLockout)() = NULL)
+      : logic{s.valveMode, s.temperatureC16, s.tempControl, s.occupancy, s.ambLight,
+              s.physicalUI, s.schedule, s.byHourStats, relHumidityOpt, setbackLockout}
+      { }
+
+    virtual uint8_t computeTargetTemp() const override
+        { return(logic.computeTargetTemp()); }
+
+    // Set all fields of inputState from the target temperature etc.
+    // Usually target temp will just have been computed by computeTargetTemp().
+    // This should not second-guess computeTargetTemp() in terms of setbacks.
+    virtual void setupInputState(ModelledRadValveInputState &inputState,
+        const bool isFiltering,
+        const uint8_t newTargetC,
+        const uint8_t minPCOpen, const uint8_t maxPCOpen,
+        const bool glacial) const override
+        { logic.setupInputState(inputState, isFiltering, newTargetC, minPCOpen, maxPCOpen, glacial); }
+  };
+
 // Pre-2017 stateless implementation of computation of target temperature.
 // Templated with all the input instances for maximum speed and minimum code size.
 template<
@@ -939,7 +1138,7 @@ class ModelledRadValve final : public AbstractRadValve
     // All input state for deciding where to set the radiator valve in normal operation.
     struct ModelledRadValveInputState inputState;
     // All retained state for deciding where to set the radiator valve in normal operation.
-    struct ModelledRadValveState retainedState;
+    ModelledRadValveState retainedState;
 
     // Read-only access to temperature control; never NULL.
     const TempControlBase *const tempControl;
@@ -0,0 +1,293 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ Host-side parallel multi-room thermal simulation.
+ */
+
+#include "OTRadValve_ThermalSim.h"
+
+#ifdef ThermalSim_DEFINED
+
+#include <math.h>
+#include <mutex>
+#include <thread>
+
+
+namespace OTRadValve
+    {
+
+
+constexpr char ThermalSim::binaryMagic[5];
+constexpr uint8_t ThermalSim::binaryVersion;
+
+WorkStealingPool::WorkStealingPool(const unsigned nThreads)
+  : threads((0 != nThreads) ? nThreads : OTV0P2BASE::fnmax(1U, std::thread::hardware_concurrency()))
+  { }
+
+void WorkStealingPool::run(const size_t n, const std::function<void(size_t)> &task) const
+  {
+  const size_t nw = OTV0P2BASE::fnmin(size_t(threads), n);
+  if(nw <= 1)
+    {
+    for(size_t i = 0; i < n; ++i) { task(i); }
+    return;
+    }
+  // Each worker's remaining block of task indices [begin,end).
+  struct Block final
+    {
+    std::mutex m;
+    size_t begin, end;
+    };
+  std::vector<Block> blocks(nw);
+  for(size_t w = 0; w < nw; ++w) { blocks[w].begin = (n * w) / nw; blocks[w].end = (n * (w+1)) / nw; }
+  auto worker = [&](const size_t w)
+    {
+    Block &own = blocks[w];
+    for( ; ; )
+      {
+      size_t i = n;
+      { std::lock_guard<std::mutex> l(own.m); if(own.begin < own.end) { i = own.begin++; } }
+      if(i < n) { task(i); continue; }
+      // Own block empty: steal the back half of the first non-empty block found.
+      // Tasks are never added, so if none is found there is nothing left to start.
+      bool stolen = false;
+      for(size_t v = (w + 1) % nw; (v != w) && !stolen; v = (v + 1) % nw)
+        {
+        size_t b, e;
+        {
+        std::lock_guard<std::mutex> l(blocks[v].m);
+        const size_t left = blocks[v].end - blocks[v].begin;
+        if(0 == left) { continue; }
+        e = blocks[v].end;
+        b = e - (left + 1) / 2;
+        blocks[v].end = b;
+        }
+        std::lock_guard<std::mutex> l(own.m);
+        own.begin = b;
+        own.end = e;
+        stolen = true;
+        }
+      if(!stolen) { return; }
+      }
+    };
+  std::vector<std::thread> t;
+  for(size_t w = 1; w < nw; ++w) { t.emplace_back(worker, w); }
+  worker(0);
+  for(std::thread &th : t) { th.join(); }
+  }
+
+size_t ThermalSim::addHouse(const uint8_t minTicksInEitherState)
+  {
+  boilers.emplace_back();
+  boilers.back().setMinTicksInEitherState(minTicksInEitherState);
+  boilerOnTicks.push_back(0);
+  boilerStarts.push_back(0);
+  houseFirstRoom.push_back(valves.size());
+  return(boilers.size() - 1);
+  }
+
+size_t ThermalSim::addRoom(const RoomParams &room, const ControlParams &ctrl)
+  {
+  if(boilers.empty()) { addHouse(); }
+  airTempC.push_back(room.startTempC);
+  storedHeatJ.push_back(room.startTempC * room.storageCapacitance);
+  radTempC.push_back(room.startTempC);
+  outsideTempC.push_back(room.outsideTempC);
+  outsideSwingC.push_back(room.outsideSwingC);
+  radiatorConductance.push_back(room.radiatorConductance);
+  radiatorTimeConstantS.push_back(room.radiatorTimeConstantS);
+  wallConductance.push_back(room.wallConductance);
+  storageCapacitance.push_back(room.storageCapacitance);
+  storageConductance.push_back(room.storageConductance);
+  airCapacitance.push_back(room.airCapacitance);
+  valves.emplace_back(ctrl.glacial);
+  valvePC.push_back(0);
+  control.push_back(ctrl);
+  energyJ.push_back(0);
+  coldCMinutes.push_back(0);
+  valveTravelPC.push_back(0);
+  // The current house now ends after this room.
+  houseFirstRoom.back() = valves.size();
+  return(valves.size() - 1);
+  }
+
+bool ThermalSim::run(const uint32_t ticks, const WorkStealingPool &pool, const uint8_t stepsPerTick, const uint16_t sampleIntervalTicks)
+  {
+  if(valves.empty() || (0 == stepsPerTick)) { return(false); } // ERROR
+  traceIntervalTicks = sampleIntervalTicks;
+  traceFirstMinute = minutesElapsed;
+  traceSamples = (0 == sampleIntervalTicks) ? 0 : ((ticks + sampleIntervalTicks - 1) / sampleIntervalTicks);
+  trace.assign(valves.size() * traceSamples, Sample());
+  pool.run(boilers.size(), [&](const size_t h) { runHouse(h, ticks, stepsPerTick); });
+  minutesElapsed += ticks;
+  return(true);
+  }
+
+// Only the rooms and house entries for house h are touched,
+// so houses can be run concurrently.
+void ThermalSim::runHouse(const size_t h, const uint32_t ticks, const uint8_t stepsPerTick)
+  {
+  const size_t first = houseFirstRoom[h];
+  const size_t end = houseFirstRoom[h+1];
+  const float dt = 60.0f / stepsPerTick;
+  OnOffBoilerCallForHeat &boiler = boilers[h];
+  ModelledRadValveInputState inputState;
+  for(uint32_t t = 0; t < ticks; ++t)
+    {
+    const uint32_t minute = minutesElapsed + t;
+    const uint16_t minuteOfDay = uint16_t(minute % 1440);
+    // Outside temperature follows a daily cycle, coldest at 04:00.
+    const float dailyCycle = -cosf(float(2 * M_PI / 1440) * float(int(minuteOfDay) - 4 * 60));
+    // Boiler responds to the valve positions at the start of the tick.
+    const bool wasOn = boiler.isCallingForHeat();
+    const bool boilerOn = boiler.tick(valvePC.data() + first, end - first);
+    if(boilerOn) { ++boilerOnTicks[h]; if(!wasOn) { ++boilerStarts[h]; } }
+    const bool sampling = (0 != traceIntervalTicks) && (0 == (t % traceIntervalTicks));
+    for(size_t r = first; r < end; ++r)
+      {
+      // Room physics, as for ThermalModelBase with a time step of dt seconds.
+      float air = airTempC[r];
+      float stored = storedHeatJ[r];
+      float rad = radTempC[r];
+      const float outside = outsideTempC[r] + outsideSwingC[r] * dailyCycle;
+      // While the boiler is on the radiator heads for a temperature set by the valve (as ThermalModelBase),
+      // else it cools towards the room.
+      const float radOnTarget = 2.0f * valvePC[r] - 80.0f;
+      const float radAlpha = (radiatorTimeConstantS[r] <= dt) ? 1.0f : (dt / radiatorTimeConstantS[r]);
+      const float radCond = radiatorConductance[r] * dt;
+      const float wallCond = wallConductance[r] * dt;
+      const float invStorageCap = 1.0f / storageCapacitance[r];
+      const float storageCond = storageConductance[r] * dt;
+      const float invAirCap = 1.0f / airCapacitance[r];
+      double energy = 0;
+      for(uint8_t s = 0; s < stepsPerTick; ++s)
+        {
+        // Radiator moves towards its target but cannot be below the air temperature.
+        rad += ((boilerOn ? radOnTarget : air) - rad) * radAlpha;
+        if(rad < air) { rad = air; }
+        const float deltaStored = ((stored * invStorageCap) - air) * storageCond;
+        stored -= deltaStored;
+        const float heatRad = (rad - air) * radCond;
+        energy += heatRad;
+        air += (heatRad + (outside - air) * wallCond + deltaStored) * invAirCap;
+        }
+      airTempC[r] = air;
+      storedHeatJ[r] = stored;
+      radTempC[r] = rad;
+      energyJ[r] += energy;
+
+      // Valve control.
+      const ControlParams &c = control[r];
+      const bool scheduledWarm = (c.warmStartM <= c.warmEndM) ?
+          ((minuteOfDay >= c.warmStartM) && (minuteOfDay < c.warmEndM)) :
+          ((minuteOfDay >= c.warmStartM) || (minuteOfDay < c.warmEndM));
+      const uint8_t target = scheduledWarm ? c.warmC :
+          uint8_t(OTV0P2BASE::fnmax(int(MIN_TARGET_C), int(c.warmC) - int(c.setbackC)));
+      const int_fast16_t airC16 = int_fast16_t(lrintf(air * 16));
+      inputState.targetTempC = target;
+      inputState.setReferenceTemperatures(airC16);
+      const uint8_t oldPC = valvePC[r];
+      volatile uint8_t pc = oldPC;
+      valves[r].tick(pc, inputState, NULL);
+      valvePC[r] = pc;
+      valveTravelPC[r] += uint32_t(OTV0P2BASE::fnmax(int(pc) - int(oldPC), int(oldPC) - int(pc)));
+      if(scheduledWarm && (air < c.warmC)) { coldCMinutes[r] += c.warmC - air; }
+
+      if(sampling)
+        {
+        Sample &sample = trace[r * traceSamples + t / traceIntervalTicks];
+        sample.airTempC16 = int16_t(airC16);
+        sample.valvePC = pc;
+        sample.targetTempC = target;
+        sample.boilerOn = boilerOn;
+        }
+      }
+    }
+  }
+
+bool ThermalSim::writeTraceCSV(FILE *const f) const
+  {
+  if(fputs("minute,house,room,airC,valvePC,targetC,boiler\n", f) < 0) { return(false); } // ERROR
+  for(uint32_t s = 0; s < traceSamples; ++s)
+    {
+    const uint32_t minute = traceFirstMinute + s * traceIntervalTicks;
+    for(size_t h = 0; h < boilers.size(); ++h)
+      {
+      for(size_t r = houseFirstRoom[h]; r < houseFirstRoom[h+1]; ++r)
+        {
+        const Sample &sample = getSample(r, s);
+        if(fprintf(f, "%u,%u,%u,%.4f,%u,%u,%u\n", unsigned(minute), unsigned(h), unsigned(r),
+            sample.airTempC16 / 16.0, sample.valvePC, sample.targetTempC, sample.boilerOn) < 0) { return(false); } // ERROR
+        }
+      }
+    }
+  return(0 == ferror(f));
+  }
+
+// Append the n low bytes of v little-endian.
+static void putLE(std::vector<uint8_t> &b, const uint32_t v, const uint8_t n)
+  {
+  for(uint8_t i = 0; i < n; ++i) { b.push_back(uint8_t(v >> (8 * i))); }
+  }
+
+bool ThermalSim::writeTraceBinary(FILE *const f) const
+  {
+  std::vector<uint8_t> b(binaryMagic, binaryMagic + 4);
+  b.push_back(binaryVersion);
+  putLE(b, uint32_t(valves.size()), 4);
+  putLE(b, traceSamples, 4);
+  putLE(b, traceFirstMinute, 4);
+  putLE(b, traceIntervalTicks, 2);
+  if(b.size() != fwrite(b.data(), 1, b.size(), f)) { return(false); } // ERROR
+  // One room at a time to bound the buffer size.
+  for(size_t r = 0; r < valves.size(); ++r)
+    {
+    b.clear();
+    for(uint32_t s = 0; s < traceSamples; ++s)
+      {
+      const Sample &sample = getSample(r, s);
+      putLE(b, uint16_t(sample.airTempC16), 2);
+      b.push_back(sample.valvePC);
+      b.push_back(sample.targetTempC);
+      b.push_back(sample.boilerOn);
+      }
+    if(b.size() != fwrite(b.data(), 1, b.size(), f)) { return(false); } // ERROR
+    }
+  return(true);
+  }
+
+bool ThermalSim::writeSummaryCSV(FILE *const f) const
+  {
+  if(fputs("house,room,energyJ,coldCMinutes,valveTravelPC,boilerOnMinutes,boilerStarts\n", f) < 0) { return(false); } // ERROR
+  for(size_t h = 0; h < boilers.size(); ++h)
+    {
+    for(size_t r = houseFirstRoom[h]; r < houseFirstRoom[h+1]; ++r)
+      {
+      if(fprintf(f, "%u,%u,%.0f,%.1f,%u,%u,%u\n", unsigned(h), unsigned(r),
+          energyJ[r], coldCMinutes[r], unsigned(valveTravelPC[r]),
+          unsigned(boilerOnTicks[h]), unsigned(boilerStarts[h])) < 0) { return(false); } // ERROR
+      }
+    }
+  return(0 == ferror(f));
+  }
+
+
+    }
+
+#endif // ThermalSim_DEFINED
@@ -0,0 +1,252 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ Host-side (non-Arduino) parallel simulation of many rooms
+ each with a radiator controlled by a ModelledRadValveState,
+ grouped into houses each with an on/off boiler,
+ eg to sweep control parameters across many room profiles over simulated weeks.
+
+ The room physics is that of ThermalModelBase in the unit tests
+ (and of model/room_model/room_model2.py):
+ lumped air and storage heat capacities, wall losses to outside,
+ and a radiator whose temperature follows the valve position,
+ here only while the house boiler is firing.
+
+ Keywords: thermal model simulation room radiator boiler parameter sweep
+ */
+
+#ifndef ARDUINO_LIB_OTRADVALVE_THERMALSIM_H
+#define ARDUINO_LIB_OTRADVALVE_THERMALSIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(ARDUINO)
+#include <stdio.h>
+#include <functional>
+#include <vector>
+#endif
+
+#include "OTRadValve_BoilerDriver.h"
+#include "OTRadValve_ModelledRadValve.h"
+
+
+// Use namespaces to help avoid collisions.
+namespace OTRadValve
+    {
+
+
+#if !defined(ARDUINO)
+#define ThermalSim_DEFINED
+
+// Minimal work-stealing pool for a fixed batch of independent tasks.
+// Tasks are initially split into contiguous blocks, one per worker.
+// Each worker takes tasks from the front of its own block,
+// and when that is empty steals the back half of another worker's block,
+// so that uneven task costs still balance across the threads.
+// Threads are started per run(),
+// which is cheap compared with the intended tasks (eg a house for a week).
+class WorkStealingPool final
+  {
+  private:
+    const unsigned threads;
+
+  public:
+    // Use the given number of threads, or 0 for one per hardware thread.
+    explicit WorkStealingPool(unsigned nThreads = 0);
+
+    // Number of threads used by run(); strictly positive.
+    unsigned getThreads() const { return(threads); }
+
+    // Call task(i) once for each i in [0,n), returning when all are done.
+    // task must be safe to call concurrently for different i.
+    void run(size_t n, const std::function<void(size_t)> &task) const;
+  };
+
+// Simulation of many rooms, each with a radiator and a ModelledRadValveState,
+// grouped into houses, each with one boiler (OnOffBoilerCallForHeat)
+// that heats every radiator in the house while firing.
+//
+// State is held as structure-of-arrays indexed by room
+// (the rooms of each house being contiguous)
+// and advanced one valve tick (one simulated minute) at a time,
+// with the room physics sub-stepped within each tick.
+// Houses are independent so are simulated in parallel, one task each;
+// results do not depend on the number of threads.
+//
+// Per-room and per-house totals are kept,
+// plus an optional trace sampled every few ticks,
+// which can be written as CSV or as a compact binary stream.
+class ThermalSim final
+  {
+  public:
+    // Physical parameters of a room; defaults as for the basic ThermalModelBase test.
+    struct RoomParams final
+      {
+      float startTempC = 20; // [C]
+      float outsideTempC = 0; // Mean outside temperature [C].
+      float outsideSwingC = 0; // Daily swing about the mean, coldest at 04:00 [C].
+      float radiatorConductance = 25; // [W/K]
+      float radiatorTimeConstantS = 0; // Radiator warm-up/cool-down time constant; 0 for instant [s].
+      float wallConductance = 38.4f; // [W/K]
+      float storageCapacitance = 1000000; // [J/K]
+      float storageConductance = 1; // [W/K]
+      float airCapacitance = 41780.3625f; // [J/K]
+      };
+
+    // Control parameters of a room's valve.
+    // The target is warmC between warmStartM and warmEndM (minutes after midnight)
+    // and setbackC lower at other times.
+    struct ControlParams final
+      {
+      uint8_t warmC = DEFAULT_ValveControlParameters::WARM;
+      uint8_t setbackC = DEFAULT_ValveControlParameters::SETBACK_DEFAULT;
+      uint16_t warmStartM = 7 * 60;
+      uint16_t warmEndM = 22 * 60;
+      bool glacial = false;
+      };
+
+    // One traced sample of a room.
+    struct Sample final
+      {
+      int16_t airTempC16;
+      uint8_t valvePC;
+      uint8_t targetTempC;
+      uint8_t boilerOn;
+      };
+
+    // Binary trace stream header magic and version.
+    static constexpr char binaryMagic[5] = "OTTS";
+    static constexpr uint8_t binaryVersion = 1;
+
+  private:
+    // Per-room physical state and parameters.
+    std::vector<float> airTempC;
+    std::vector<float> storedHeatJ;
+    std::vector<float> radTempC;
+    std::vector<float> outsideTempC;
+    std::vector<float> outsideSwingC;
+    std::vector<float> radiatorConductance;
+    std::vector<float> radiatorTimeConstantS;
+    std::vector<float> wallConductance;
+    std::vector<float> storageCapacitance;
+    std::vector<float> storageConductance;
+    std::vector<float> airCapacitance;
+
+    // Per-room control state and parameters.
+    std::vector<ModelledRadValveState> valves;
+    std::vector<uint8_t> valvePC;
+    std::vector<ControlParams> control;
+
+    // Per-room totals.
+    std::vector<double> energyJ;
+    std::vector<double> coldCMinutes;
+    std::vector<uint32_t> valveTravelPC;
+
+    // Per-house state: first room (plus end marker) and boiler.
+    std::vector<size_t> houseFirstRoom;
+    std::vector<OnOffBoilerCallForHeat> boilers;
+    std::vector<uint32_t> boilerOnTicks;
+    std::vector<uint32_t> boilerStarts;
+
+    // Trace of the last run(), room-major.
+    std::vector<Sample> trace;
+    uint32_t traceSamples = 0;
+    uint32_t traceFirstMinute = 0;
+    uint16_t traceIntervalTicks = 0;
+
+    // Ticks (minutes) simulated so far.
+    uint32_t minutesElapsed = 0;
+
+    // Advance house h by the given number of ticks.
+    void runHouse(size_t h, uint32_t ticks, uint8_t stepsPerTick);
+
+  public:
+    ThermalSim() : houseFirstRoom(1, 0) { }
+
+    // Add a house, returning its index.
+    // Rooms added after this belong to it.
+    // Its boiler stays on or off for at least minTicksInEitherState minutes.
+    size_t addHouse(uint8_t minTicksInEitherState = 5);
+
+    // Add a room to the most recently added house, returning its index.
+    // Adds a house with default parameters if there is none yet.
+    size_t addRoom(const RoomParams &room, const ControlParams &ctrl);
+
+    size_t getRooms() const { return(valves.size()); }
+    size_t getHouses() const { return(boilers.size()); }
+    uint32_t getMinutesElapsed() const { return(minutesElapsed); }
+
+    // Advance all rooms by the given number of one-minute ticks, continuing from any previous run,
+    // using the pool's threads and stepsPerTick physics steps per tick.
+    // If sampleIntervalTicks is non-zero then a trace of every room is kept
+    // at the start of the run and every sampleIntervalTicks after,
+    // replacing any earlier trace.
+    // Returns false if there are no rooms or stepsPerTick is 0.
+    bool run(uint32_t ticks, const WorkStealingPool &pool, uint8_t stepsPerTick = 60, uint16_t sampleIntervalTicks = 0);
+
+    // Current state of room r.
+    float getAirTempC(const size_t r) const { return(airTempC[r]); }
+    uint8_t getValvePC(const size_t r) const { return(valvePC[r]); }
+    const ModelledRadValveState &getValve(const size_t r) const { return(valves[r]); }
+    bool isBoilerOn(const size_t h) const { return(boilers[h].isCallingForHeat()); }
+
+    // Totals for room r:
+    // heat delivered by the radiator,
+    // degree-minutes below warmC while scheduled warm,
+    // and total valve movement.
+    double getEnergyJ(const size_t r) const { return(energyJ[r]); }
+    double getColdCMinutes(const size_t r) const { return(coldCMinutes[r]); }
+    uint32_t getValveTravelPC(const size_t r) const { return(valveTravelPC[r]); }
+    // Totals for house h: minutes with the boiler on, and times it was turned on.
+    uint32_t getBoilerOnTicks(const size_t h) const { return(boilerOnTicks[h]); }
+    uint32_t getBoilerStarts(const size_t h) const { return(boilerStarts[h]); }
+
+    // Trace of the last run; sample s of room r.
+    uint32_t getTraceSamples() const { return(traceSamples); }
+    const Sample &getSample(const size_t r, const uint32_t s) const { return(trace[r * traceSamples + s]); }
+
+    // Write the trace as CSV with a header line,
+    // one line per room per sample, in time order:
+    //     minute,house,room,airC,valvePC,targetC,boiler
+    // Returns false on a write error.
+    bool writeTraceCSV(FILE *f) const;
+
+    // Write the trace as a compact binary stream, all values little-endian:
+    //   * header: binaryMagic (4 bytes), binaryVersion (1 byte),
+    //     rooms (4 bytes), samples per room (4 bytes),
+    //     minute of first sample (4 bytes), sample interval in minutes (2 bytes)
+    //   * then for each room in order its samples in time order, 5 bytes each:
+    //     airTempC16 (2 bytes signed), valvePC, targetTempC, boilerOn
+    // Returns false on a write error.
+    bool writeTraceBinary(FILE *f) const;
+
+    // Write the per-room totals as CSV with a header line,
+    // one line per room:
+    //     house,room,energyJ,coldCMinutes,valveTravelPC,boilerOnMinutes,boilerStarts
+    // Returns false on a write error.
+    bool writeSummaryCSV(FILE *f) const;
+  };
+
+#endif // !defined(ARDUINO)
+
+
+    }
+
+#endif
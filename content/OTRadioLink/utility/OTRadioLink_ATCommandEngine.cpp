@@ -0,0 +1,137 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+#include "OTRadioLink_ATCommandEngine.h"
+
+
+// Use namespaces to help avoid collisions.
+namespace OTRadioLink
+    {
+
+
+// Start a transaction at nowS, before the command is written.
+void ATCommandEngine::begin(const char *const okToken, const char *const errToken, const char *const err2Token,
+                            const uint8_t nowS, const uint8_t timeoutS, const bool _untilEOL)
+    {
+    // Discard anything left over from earlier, where the stream can say so without blocking.
+    for(int n = ser.available(); n > 0; --n) { ser.read(); }
+    next(okToken, errToken, err2Token, nowS, timeoutS, _untilEOL);
+    }
+
+// Start a transaction for a further reply to the same command, keeping any input not yet consumed.
+void ATCommandEngine::next(const char *const okToken, const char *const errToken, const char *const err2Token,
+                           const uint8_t nowS, const uint8_t timeoutS, const bool _untilEOL)
+    {
+    okMatch.reset(okToken);
+    errMatch.reset(errToken);
+    err2Match.reset(err2Token);
+    untilEOL = _untilEOL;
+    statusAtEOL = AT_PENDING;
+    lastTime = nowS;
+    elapsed = 0;
+    timeout = timeoutS;
+    replyLen = 0;
+    reply[0] = '\0';
+    status = AT_PENDING;
+    }
+
+// Handle one reply char; returns true if the transaction completed.
+bool ATCommandEngine::consume(const char c)
+    {
+    if(replyLen < MAX_REPLY_CHARS - 1) { reply[replyLen++] = c; reply[replyLen] = '\0'; }
+    if(AT_PENDING != statusAtEOL)
+        {
+        if('\n' != c) { return(false); }
+        status = statusAtEOL;
+        return(true);
+        }
+    Status s = AT_PENDING;
+    // Feed every matcher so that none falls behind.
+    const bool ok = okMatch.next(c);
+    const bool err = errMatch.next(c);
+    const bool err2 = err2Match.next(c);
+    if(err || err2) { s = AT_ERROR; }
+    else if(ok) { s = AT_OK; }
+    else { return(false); }
+    if(untilEOL) { statusAtEOL = s; return(false); }
+    status = s;
+    return(true);
+    }
+
+// Advance the time elapsed to nowS.
+void ATCommandEngine::advance(const uint8_t nowS)
+    {
+    const uint8_t e = uint8_t(elapsed + OTV0P2BASE::getElapsedSecondsLT(lastTime, nowS));
+    elapsed = (e < elapsed) ? 255 : e;
+    lastTime = nowS;
+    }
+
+// Blocking poll() for an unbuffered stream, on which a reply not read as it arrives is lost.
+ATCommandEngine::Status ATCommandEngine::pollUnbuffered(const uint8_t nowS)
+    {
+    advance(nowS);
+    for( ; ; )
+        {
+        const int c = ser.read();
+        if(c >= 0)
+            {
+            if(consume(char(c))) { return(status); }
+            continue;
+            }
+        // The stream has gone quiet: for an immediate reply that is the end of it.
+        if(0 == timeout)
+            {
+            status = (AT_PENDING != statusAtEOL) ? statusAtEOL : AT_TIMEOUT;
+            return(status);
+            }
+        // Without a clock cannot wait any longer than read() just did.
+        if(NULL == getSecondsLT) { break; }
+#ifndef ARDUINO_ARCH_AVR
+        const uint8_t t = lastTime;
+#endif // ARDUINO_ARCH_AVR
+        advance(uint8_t(getSecondsLT()));
+        if(elapsed > timeout) { break; }
+#ifndef ARDUINO_ARCH_AVR
+        // Off AVR read() does not wait, so do not spin while time stands still (eg virtual time in tests).
+        if(t == lastTime) { return(status); }
+#endif // ARDUINO_ARCH_AVR
+        }
+    if(elapsed > timeout) { status = AT_TIMEOUT; }
+    return(status);
+    }
+
+// Consume available reply bytes (at most maxBytes) and return the status.
+ATCommandEngine::Status ATCommandEngine::poll(const uint8_t nowS, uint8_t maxBytes)
+    {
+    if(AT_PENDING != status) { return(status); }
+    const int avail = ser.available();
+    if(avail < 0) { return(pollUnbuffered(nowS)); }
+    // Compare before narrowing so that more than 255 bytes waiting is not taken as few.
+    if(avail < maxBytes) { maxBytes = uint8_t(avail); }
+    while(maxBytes-- > 0)
+        {
+        const int c = ser.read();
+        if(c < 0) { break; }
+        if(consume(char(c))) { return(status); }
+        }
+    advance(nowS);
+    if(elapsed > timeout) { status = AT_TIMEOUT; }
+    return(status);
+    }
+
+    }
@@ -0,0 +1,155 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * Incremental AT-command transaction engine for serial modems
+ * (eg SIM900 GSM and RN2483 LoRaWAN).
+ *
+ * One transaction at a time: the caller begin()s it with the reply tokens
+ * that end it, writes the command, then calls poll() (eg once per main-loop poll)
+ * which consumes whatever reply bytes are available and reports completion.
+ * So the main loop and radio RX keep running while waiting for a slow modem.
+ */
+
+#ifndef ARDUINO_LIB_OTRADIOLINK_ATCOMMANDENGINE_H
+#define ARDUINO_LIB_OTRADIOLINK_ATCOMMANDENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#include <OTV0p2Base.h>
+
+
+// Use namespaces to help avoid collisions.
+namespace OTRadioLink
+    {
+
+
+    // Matches a \0-terminated token against a stream of chars, one char at a time.
+    // Restarts simply on mismatch, so tokens should not start with a repeat of their own start,
+    // (eg "SEND OK" and "ERROR" are fine, "abab" is not).
+    struct ATTokenMatcher final
+        {
+        const char *token = NULL; // NULL to never match.
+        uint8_t matched = 0;
+        // Set the token to match, or NULL for none.
+        void reset(const char *const t) { token = t; matched = 0; }
+        // Consume one char; returns true once the whole token has been seen.
+        bool next(const char c)
+            {
+            if(NULL == token) { return(false); }
+            matched = (c == token[matched]) ? (matched + 1) : ((c == token[0]) ? 1 : 0);
+            if('\0' != token[matched]) { return(false); }
+            matched = 0;
+            return(true);
+            }
+        };
+
+    // Non-blocking AT-command transaction over a Stream.
+    //
+    // A transaction completes OK when okToken is seen,
+    // ERROR when either error token is seen,
+    // or TIMEOUT when timeoutS whole seconds have elapsed first.
+    // With untilEOL the rest of the line after the token is also collected before completion,
+    // eg to capture "STATE: CONNECT OK" in full.
+    //
+    // Only a buffered or interrupt-driven Stream lets poll() return while waiting:
+    // one reporting available() < 0 is taken to be unbuffered
+    // (eg OTSoftSerial2, whose read() waits briefly for a char),
+    // so that any reply arriving between polls would be lost.
+    // For those poll() blocks, reading until the transaction completes,
+    // as the old blocking reads did, timing out against getSecondsLT()
+    // (or if that is NULL it waits only as long as a quiet read() does).
+    // A timeoutS of 0 then completes the transaction (as TIMEOUT if no token was seen)
+    // as soon as a read() finds nothing more, for commands whose replies are immediate.
+    // For buffered streams a timeoutS of 0 allows up to a second.
+    //
+    // Times are seconds within the minute [0,59] as from OTV0P2BASE::getSecondsLT();
+    // the time elapsed is accumulated at each poll(),
+    // so timeouts may be up to 254s provided that poll() is called at least every 59s.
+    class ATCommandEngine final
+        {
+        public:
+            enum Status : uint8_t { AT_IDLE, AT_PENDING, AT_OK, AT_ERROR, AT_TIMEOUT };
+            // Max reply chars captured, including the terminating '\0'.
+            static constexpr uint8_t MAX_REPLY_CHARS = 64;
+
+        private:
+            Stream &ser;
+            // Clock for blocking reads from an unbuffered stream; may be NULL.
+            uint_fast8_t (*const getSecondsLT)();
+            ATTokenMatcher okMatch;
+            ATTokenMatcher errMatch;
+            ATTokenMatcher err2Match;
+            Status status = AT_IDLE;
+            // Status once the rest of the line has been collected, if untilEOL; else AT_PENDING.
+            Status statusAtEOL = AT_PENDING;
+            bool untilEOL = false;
+            // Time at the last poll(), and whole seconds elapsed since begin() (saturating at 255).
+            uint8_t lastTime = 0;
+            uint8_t elapsed = 0;
+            uint8_t timeout = 0;
+            uint8_t replyLen = 0;
+            char reply[MAX_REPLY_CHARS];
+
+            // Handle one reply char; returns true if the transaction completed.
+            bool consume(char c);
+            // Advance the time elapsed to nowS.
+            void advance(uint8_t nowS);
+            // Blocking poll() for an unbuffered stream.
+            Status pollUnbuffered(uint8_t nowS);
+
+        public:
+            // Optional getSecondsLT lets poll() block on an unbuffered stream until the timeout.
+            explicit ATCommandEngine(Stream &s, uint_fast8_t (*const _getSecondsLT)() = NULL)
+                : ser(s), getSecondsLT(_getSecondsLT) { reply[0] = '\0'; }
+
+            // Start a transaction at nowS, before the command is written.
+            // okToken must be non-NULL; errToken and err2Token may be NULL.
+            // Token strings must remain valid until the transaction completes.
+            void begin(const char *okToken, const char *errToken, const char *err2Token,
+                       uint8_t nowS, uint8_t timeoutS, bool untilEOL = false);
+            // Start a transaction for a further reply to the same command,
+            // eg 'accepted' after 'ok', keeping any input not yet consumed.
+            void next(const char *okToken, const char *errToken, const char *err2Token,
+                      uint8_t nowS, uint8_t timeoutS, bool untilEOL = false);
+
+            // Consume available reply bytes (at most maxBytes) and return the status.
+            // Returns AT_PENDING until complete, then the result until the next begin() or clear().
+            // For an unbuffered stream blocks until complete and maxBytes is ignored.
+            Status poll(uint8_t nowS, uint8_t maxBytes = 255);
+
+            // Abandon any transaction and return to AT_IDLE.
+            void clear() { status = AT_IDLE; }
+
+            Status getStatus() const { return(status); }
+            bool isBusy() const { return(AT_PENDING == status); }
+
+            // Reply collected so far, '\0'-terminated, truncated to MAX_REPLY_CHARS-1 chars.
+            const char *getReply() const { return(reply); }
+            uint8_t getReplyLen() const { return(replyLen); }
+        };
+
+
+    }
+
+#endif
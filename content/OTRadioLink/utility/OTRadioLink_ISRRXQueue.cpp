@@ -70,7 +70,7 @@ bool ISRRXQueueVarLenMsgBase::validate(Print *p, uint8_t &n, uint8_t &o, uint8_t
     c = queuedRXedMessageCount;
     bp = b;
     s = 1 + (int)bsm1;
-    p->print("*** queuedRXedMessageCount="); p->print(queuedRXedMessageCount);
+    p->print("*** queuedRXedMessageCount="); p->print(c);
     p->print(" next="); p->print(next);
     p->print(" oldest="); p->print(oldest);
     p->println();
@@ -33,6 +33,7 @@ Author(s) / Copyright (s): Damon Hart-Davis 2015
 #endif
 
 #include "OTV0P2BASE_Util.h"
+#include "OTV0P2BASE_Concurrency.h"
 
 // Use namespaces to help avoid collisions.
 namespace OTRadioLink
@@ -49,8 +50,13 @@ namespace OTRadioLink
         {
         protected:
             // Current count of received messages queued.
-            // Marked volatile for ISR-/thread- safe access without a lock.
+            // Marked volatile for ISR-/thread- safe access without a lock;
+            // atomic where available since host queues (eg ISRRXQueueMP) may be shared between threads.
+#ifdef OTV0P2BASE_PLATFORM_HAS_atomic
+            std::atomic<uint8_t> queuedRXedMessageCount;
+#else
             volatile uint8_t queuedRXedMessageCount;
+#endif
 
             // Initialise state and only allow deriving classes to instantiate.
             constexpr ISRRXQueue() : queuedRXedMessageCount(0) { }
@@ -176,7 +182,8 @@ namespace OTRadioLink
                 {
                 // If something already queued, so no space for a new message, return NULL.
                 if(0 != queuedRXedMessageCount) { return(NULL); }
-                return(fullBuf + 1);
+                // The buffer is writable by the ISR even though this accessor is const.
+                return(const_cast<volatile uint8_t *>(fullBuf + 1));
                 }
 
             // Call after loading an RXed frame into the buffer indicated by _getRXBufForInbound().
@@ -211,6 +218,22 @@ namespace OTRadioLink
                 return(fullBuf + 1);
                 }
 
+            // Peek at first (oldest) queued RX message as for peekRXMsg(), but writable.
+            // Allows the single consumer to transform the message in place,
+            // eg to decrypt it with decodeSecureSmallFrameRawInPlace(),
+            // without copying it out of the queue first.
+            // Only the message bytes (not the length byte before them) may be altered,
+            // and the message should then be removed with removeRXMsg().
+            // The ISR does not touch a queued message until it is removed,
+            // so it can be accessed as ordinary (non-volatile) memory.
+            // Non-virtual, for speed.
+            // Not intended to be called from an ISR.
+            uint8_t *peekRXMsgMutable()
+                {
+                if(0 == queuedRXedMessageCount) { return(NULL); }
+                return(const_cast<uint8_t *>(fullBuf + 1));
+                }
+
             // Remove the first (oldest) queued RX message.
             // Typically used after peekRXMessage().
             // Does nothing if the queue is empty.
@@ -333,6 +356,22 @@ namespace OTRadioLink
                 return(b + oldest + 1);
                 }
 
+            // Peek at first (oldest) queued RX message as for peekRXMsg(), but writable.
+            // Allows the single consumer to transform the message in place,
+            // eg to decrypt it with decodeSecureSmallFrameRawInPlace(),
+            // without copying it out of the queue first.
+            // Only the message bytes (not the length byte before them) may be altered,
+            // and the message should then be removed with removeRXMsg().
+            // The ISR does not touch a queued message until it is removed,
+            // so it can be accessed as ordinary (non-volatile) memory.
+            // Non-virtual, for speed.
+            // Not intended to be called from an ISR.
+            uint8_t *peekRXMsgMutable()
+                {
+                if(isEmpty()) { return(NULL); }
+                return(const_cast<uint8_t *>(b + oldest + 1));
+                }
+
             // Remove the first (oldest) queued RX message.
             // Typically used after peekRXMessage().
             // Does nothing if the queue is empty.
@@ -0,0 +1,181 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+#include "OTRadioLink_ISRRXQueueMP.h"
+
+
+// Use namespaces to help avoid collisions.
+namespace OTRadioLink
+    {
+
+
+#ifdef ISRRXQueueMP_DEFINED
+// Each producer thread's in-progress upload slots, one per queue,
+// for a small number of queues being loaded concurrently by the same thread.
+static constexpr uint8_t maxReservationsPerThread = 4;
+struct Reservation final
+    {
+    const ISRRXQueueMPBase *q;
+    uint16_t pos;
+    };
+static thread_local Reservation reservations[maxReservationsPerThread];
+
+ISRRXQueueMPBase::ISRRXQueueMPBase(const uint8_t maxFrame, std::atomic<uint16_t> *const seqp, volatile uint8_t *const bp, const uint16_t slots)
+    : seq(seqp), b(bp), nSlots(slots), mf(maxFrame), enqueuePos(0), dequeuePos(0), count(0)
+    {
+    // Every slot starts free for the first lap.
+    for(uint16_t i = 0; i < slots; ++i) { seq[i].store(i, std::memory_order_relaxed); }
+    }
+
+// Adjust count by delta and bring queuedRXedMessageCount into line with it.
+// Both are atomic on the host, so producers and the consumer may race here safely;
+// re-checks after each store so that the last thread to touch the count leaves it correct.
+void ISRRXQueueMPBase::adjustCount(const int delta)
+    {
+    count.fetch_add(uint16_t(delta));
+    uint16_t c;
+    do  {
+        c = count.load();
+        queuedRXedMessageCount = (c > 255) ? 255 : uint8_t(c);
+        } while(c != count.load());
+    }
+
+// Find (claiming if necessary) this thread's in-progress slot position; false if none available.
+bool ISRRXQueueMPBase::getReservation(uint16_t &pos, const bool claim) const
+    {
+    Reservation *freeEntry = NULL;
+    for(uint8_t i = 0; i < maxReservationsPerThread; ++i)
+        {
+        Reservation &r = reservations[i];
+        if(this == r.q) { pos = r.pos; return(true); }
+        if((NULL == r.q) && (NULL == freeEntry)) { freeEntry = &r; }
+        }
+    if(!claim) { return(false); }
+    if(NULL == freeEntry) { return(false); } // ERROR: too many concurrent uploads from this thread.
+    // Claim the slot at enqueuePos if it is free for this lap.
+    uint16_t p = enqueuePos.load(std::memory_order_relaxed);
+    for( ; ; )
+        {
+        const int16_t diff = int16_t(uint16_t(slotSeq(p).load(std::memory_order_acquire) - p));
+        if(0 == diff)
+            {
+            if(enqueuePos.compare_exchange_weak(p, uint16_t(p + 1), std::memory_order_relaxed)) { break; }
+            }
+        else if(diff < 0) { return(false); } // Full: the slot has not been released from the previous lap.
+        else { p = enqueuePos.load(std::memory_order_relaxed); } // Another producer claimed it.
+        }
+    freeEntry->q = this;
+    freeEntry->pos = p;
+    pos = p;
+    return(true);
+    }
+
+// Forget this thread's in-progress slot, if any.
+void ISRRXQueueMPBase::clearReservation() const
+    {
+    for(uint8_t i = 0; i < maxReservationsPerThread; ++i)
+        { if(this == reservations[i].q) { reservations[i].q = NULL; return; } }
+    }
+
+// True if no slot is free for a new upload.
+uint8_t ISRRXQueueMPBase::isFull() const
+    {
+    const uint16_t p = enqueuePos.load(std::memory_order_relaxed);
+    return(int16_t(uint16_t(slotSeq(p).load(std::memory_order_acquire) - p)) < 0);
+    }
+
+// Get pointer for inbound/RX frame able to accommodate max frame size; NULL if no space.
+volatile uint8_t *ISRRXQueueMPBase::_getRXBufForInbound() const
+    {
+    uint16_t pos;
+    if(!getReservation(pos, true)) { return(NULL); }
+    return(slotBuf(pos) + 1);
+    }
+
+// Call after loading an RXed frame into the buffer indicated by _getRXBufForInbound().
+// An abandoned upload still has to pass through the queue as an empty slot,
+// which the consumer skips.
+void ISRRXQueueMPBase::_loadedBuf(uint8_t frameLen)
+    {
+    uint16_t pos;
+    if(!getReservation(pos, false)) { return; } // No upload in progress.
+    clearReservation();
+    if(frameLen > mf) { frameLen = mf; } // Be safe...
+    slotBuf(pos)[0] = frameLen;
+    // Count the frame before the consumer can see (and remove) it.
+    if(0 != frameLen) { adjustCount(+1); }
+    // Publish the frame to the consumer.
+    slotSeq(pos).store(uint16_t(pos + 1), std::memory_order_release);
+    }
+
+// Discard any abandoned (zero-length) loaded frames at the head of the queue.
+bool ISRRXQueueMPBase::skipEmpty(uint16_t &pos) const
+    {
+    for( ; ; )
+        {
+        pos = dequeuePos;
+        if(uint16_t(pos + 1) != slotSeq(pos).load(std::memory_order_acquire)) { return(false); }
+        if(0 != slotBuf(pos)[0]) { return(true); }
+        // Release the empty slot for the next lap.
+        slotSeq(pos).store(uint16_t(pos + nSlots), std::memory_order_release);
+        ++dequeuePos;
+        }
+    }
+
+// Peek at first (oldest) queued RX message, returning a pointer or NULL if no message waiting.
+const volatile uint8_t *ISRRXQueueMPBase::peekRXMsg() const
+    {
+    uint16_t pos;
+    if(!skipEmpty(pos)) { return(NULL); }
+    return(slotBuf(pos) + 1);
+    }
+
+// Peek at up to maxFrames of the oldest queued RX messages in order.
+uint8_t ISRRXQueueMPBase::peekRXMsgs(const volatile uint8_t **const frames, const uint8_t maxFrames) const
+    {
+    if((NULL == frames) || (0 == maxFrames)) { return(0); }
+    uint16_t pos;
+    if(!skipEmpty(pos)) { return(0); }
+    uint8_t n = 0;
+    for(uint16_t i = 0; (i < nSlots) && (n < maxFrames); ++i, ++pos)
+        {
+        if(uint16_t(pos + 1) != slotSeq(pos).load(std::memory_order_acquire)) { break; }
+        volatile uint8_t *const s = slotBuf(pos);
+        if(0 != s[0]) { frames[n++] = s + 1; }
+        }
+    return(n);
+    }
+
+// Remove up to n of the oldest queued RX messages.
+uint8_t ISRRXQueueMPBase::removeRXMsgs(const uint8_t n)
+    {
+    uint8_t removed = 0;
+    uint16_t pos;
+    while((removed < n) && skipEmpty(pos))
+        {
+        slotSeq(pos).store(uint16_t(pos + nSlots), std::memory_order_release);
+        ++dequeuePos;
+        ++removed;
+        }
+    if(0 != removed) { adjustCount(-int(removed)); }
+    return(removed);
+    }
+#endif // ISRRXQueueMP_DEFINED
+
+
+    }
@@ -0,0 +1,185 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * Host-side (non-Arduino) lock-free multi-producer RX queue,
+ * eg for a Linux-based hub multiplexing several radios into one processing loop.
+ *
+ * Keywords: C++ lock-free multi-producer radio RX receive queue ring buffer low-copy
+ */
+
+#ifndef ARDUINO_LIB_OTRADIOLINK_ISRRXQUEUEMP_H
+#define ARDUINO_LIB_OTRADIOLINK_ISRRXQUEUEMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "OTRadioLink_ISRRXQueue.h"
+
+#if !defined(ARDUINO)
+#include <atomic>
+#endif
+
+
+// Use namespaces to help avoid collisions.
+namespace OTRadioLink
+    {
+
+
+#if !defined(ARDUINO)
+    // Multi-producer single-consumer queue of fixed-size slots
+    // each holding one frame of up to maxRXBytes preceded by its length,
+    // as for the other ISRRXQueue implementations.
+    //
+    // Several threads may load frames concurrently
+    // using the usual _getRXBufForInbound() / _loadedBuf() pair,
+    // so radio drivers written against ISRRXQueue can be used unchanged;
+    // each thread may hold one in-progress upload per queue
+    // (repeated _getRXBufForInbound() calls return the same buffer until _loadedBuf()).
+    // Only one thread may dequeue (peek/remove) at a time.
+    //
+    // Slot claim and release are lock-free, using a per-slot 16-bit sequence number
+    // so that the total buffer size is not limited to 256 bytes.
+    // Frames are dequeued in the order that their slots were claimed,
+    // so a slow producer delays (but never loses) frames loaded after it.
+    //
+    // getRXMsgsQueued() and isEmpty() are exact once producers are idle
+    // but may briefly include a frame still being published;
+    // peekRXMsg() is always authoritative.
+#define ISRRXQueueMP_DEFINED
+    class ISRRXQueueMPBase : public ISRRXQueue
+        {
+        protected:
+            // Per-slot sequence numbers; slot i is free for the producer at position p when seq == p,
+            // and holds a loaded frame for the consumer at position p when seq == p+1.
+            std::atomic<uint16_t> *const seq;
+            // Shadow of buf; slot i starts at b + i*(1+mf) with the frame length.
+            volatile uint8_t *const b;
+            // Number of slots; a power of two no larger than 0x4000.
+            const uint16_t nSlots;
+            // Maximum allowed single frame in the queue.
+            const uint8_t mf;
+            // Next position to be claimed by a producer.
+            mutable std::atomic<uint16_t> enqueuePos;
+            // Next position to be dequeued; only touched by the consumer.
+            mutable uint16_t dequeuePos;
+            // Exact count of non-empty frames loaded and not yet removed.
+            std::atomic<uint16_t> count;
+
+            // Construct an instance over the derived class's storage.
+            ISRRXQueueMPBase(uint8_t maxFrame, std::atomic<uint16_t> *seqp, volatile uint8_t *bp, uint16_t slots);
+
+            // Pointer to the length byte of the slot for position pos.
+            inline volatile uint8_t *slotBuf(const uint16_t pos) const
+                { return(b + size_t(pos & (nSlots - 1)) * (1U + mf)); }
+            // Sequence number for the slot for position pos.
+            inline std::atomic<uint16_t> &slotSeq(const uint16_t pos) const
+                { return(seq[pos & (nSlots - 1)]); }
+
+            // Adjust count by delta and bring (atomic) queuedRXedMessageCount into line with it.
+            void adjustCount(int delta);
+
+            // Find (claiming if necessary) this thread's in-progress slot position; false if none available.
+            bool getReservation(uint16_t &pos, bool claim) const;
+            // Forget this thread's in-progress slot, if any.
+            void clearReservation() const;
+
+            // Discard any abandoned (zero-length) loaded frames at the head of the queue.
+            // Returns the position of the oldest frame, and true if it is loaded and non-empty.
+            bool skipEmpty(uint16_t &pos) const;
+
+        public:
+            // Fetches the current inbound RX minimum queue capacity and maximum RX raw message size.
+            // The capacity is capped at 255.
+            virtual void getRXCapacity(uint8_t &queueRXMsgsMin, uint8_t &maxRXMsgLen) const override
+                { queueRXMsgsMin = (nSlots > 255) ? 255 : uint8_t(nSlots); maxRXMsgLen = mf; }
+
+            // Number of queued frames, not capped at 255.
+            // Thread-safe.
+            inline uint16_t getRXMsgsQueued16() const { return(count.load()); }
+
+            // True if no slot is free for a new upload, eg if _getRXBufForInbound() would return NULL
+            // for a thread without an upload already in progress.
+            // Thread-safe.
+            virtual uint8_t isFull() const override;
+
+            // Get pointer for inbound/RX frame able to accommodate max frame size; NULL if no space.
+            // After uploading the frame call _loadedBuf() from the same thread to queue the new frame
+            // or with 0 to abandon the upload.
+            // Until then further calls from the same thread return the same buffer.
+            // Thread-safe.
+            virtual volatile uint8_t *_getRXBufForInbound() const override;
+
+            // Call after loading an RXed frame into the buffer indicated by _getRXBufForInbound().
+            // The argument is the size of the frame loaded into the buffer to be queued.
+            // The frame can be no larger than maxRXBytes bytes.
+            // Call with 0 to abandon an upload.
+            // Must be called from the same thread as _getRXBufForInbound().
+            // Thread-safe.
+            virtual void _loadedBuf(uint8_t frameLen) override;
+
+            // Peek at first (oldest) queued RX message, returning a pointer or NULL if no message waiting.
+            // The length is in the byte before the start of the frame.
+            // The returned pointer and length are valid until the next removeRXMsg() or removeRXMsgs().
+            // The buffer pointed to MUST NOT be altered.
+            // Consumer thread only.
+            virtual const volatile uint8_t *peekRXMsg() const override;
+
+            // Remove the first (oldest) queued RX message.
+            // Does nothing if the queue is empty.
+            // Consumer thread only.
+            virtual void removeRXMsg() override { removeRXMsgs(1); }
+
+            // Peek at up to maxFrames of the oldest queued RX messages in order,
+            // filling in frames[] as for peekRXMsg(), and returning the number found.
+            // Stops at the first slot not yet loaded.
+            // The pointers are valid until the next removeRXMsg() or removeRXMsgs().
+            // Consumer thread only.
+            uint8_t peekRXMsgs(const volatile uint8_t **frames, uint8_t maxFrames) const;
+
+            // Remove up to n of the oldest queued RX messages, eg after peekRXMsgs().
+            // Returns the number removed.
+            // Consumer thread only.
+            uint8_t removeRXMsgs(uint8_t n);
+        };
+
+    // Multi-producer RX queue.
+    //   * maxRXBytes  a frame to be queued can be up to maxRXBytes bytes long; in the range [1,255]
+    //   * queueSlots  number of frames that can be queued; a power of two in the range [2,16384]
+    // Total buffer size is queueSlots*(maxRXBytes+1) bytes, which can exceed 256.
+    template<uint8_t maxRXBytes, uint16_t queueSlots = 16>
+    class ISRRXQueueMP final : public ISRRXQueueMPBase
+        {
+        static_assert((maxRXBytes > 0), "maxRXBytes must be at least 1");
+        // With one slot a loaded slot (seq == p+1) would look free for position p+1.
+        static_assert((queueSlots >= 2) && (queueSlots <= 0x4000) && (0 == (queueSlots & (queueSlots - 1))),
+                      "queueSlots must be a power of two in the range [2,16384]");
+        private:
+            std::atomic<uint16_t> seqs[queueSlots];
+            volatile uint8_t buf[queueSlots * (1 + (size_t)maxRXBytes)];
+        public:
+            ISRRXQueueMP() : ISRRXQueueMPBase(maxRXBytes, seqs, buf, queueSlots) { }
+            // Guaranteed number of (full-length) messages that can be queued.
+            static constexpr uint16_t QueueCapacityMsgs = queueSlots;
+        };
+#endif // !defined(ARDUINO)
+
+
+    }
+
+#endif
@@ -0,0 +1,98 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+#include "OTRadioLink_ISRRXQueueStats.h"
+
+
+// Use namespaces to help avoid collisions.
+namespace OTRadioLink
+    {
+
+
+// Clear all stats.
+void ISRRXQueueStats::reset()
+    {
+    highWater = 0;
+    for(uint8_t i = 0; i < depthBuckets; ++i) { depthAtEnqueue[i] = 0; }
+    dropped = 0;
+    latencyCount = 0;
+    latencyTotal = 0;
+    latencyMax = 0;
+    for(uint8_t i = 0; i < maxFilters; ++i) { filters[i] = NULL; filtered[i] = 0; }
+    }
+
+// Note a frame queued with depthBefore frames already queued.
+void ISRRXQueueStats::noteEnqueued(const uint8_t depthBefore)
+    {
+    const uint8_t depthAfter = (0xff == depthBefore) ? 0xff : (depthBefore + 1);
+    if(depthAfter > highWater) { highWater = depthAfter; }
+    volatile uint16_t &bucket = depthAtEnqueue[(depthBefore >= depthBuckets) ? (depthBuckets - 1) : depthBefore];
+    if(0xffff != bucket) { ++bucket; }
+    }
+
+// Note a frame dequeued after the given number of ticks.
+void ISRRXQueueStats::noteLatency(const uint8_t ticks)
+    {
+    if(0xffff == latencyCount) { return; } // Keep the mean consistent once saturated.
+    ++latencyCount;
+    latencyTotal = latencyTotal + ticks;
+    if(ticks > latencyMax) { latencyMax = ticks; }
+    }
+
+// Note a frame rejected by the given RX filter.
+void ISRRXQueueStats::noteFiltered(quickFrameFilter_t *const f)
+    {
+    for(uint8_t i = 0; i < maxFilters; ++i)
+        {
+        if(NULL == filters[i]) { filters[i] = f; }
+        else if(f != filters[i]) { continue; }
+        if(0xffff != filtered[i]) { ++filtered[i]; }
+        return;
+        }
+    }
+
+// Mean enqueue-to-dequeue latency in ticks, rounded down; 0 if none measured.
+uint8_t ISRRXQueueStats::getMeanLatency() const
+    {
+    const uint16_t n = latencyCount;
+    if(0 == n) { return(0); }
+    return(uint8_t(latencyTotal / n));
+    }
+
+// Cap a count at the largest JSON stats value.
+static inline int16_t capStat(const uint16_t v) { return((v > 0x7fff) ? 0x7fff : int16_t(v)); }
+
+// Put the stats to ss as low-priority items.
+bool ISRRXQueueStats::putStats(OTV0P2BASE::SimpleStatsRotationBase &ss) const
+    {
+    static const OTV0P2BASE::MSG_JSON_SimpleStatsKey_t depthKeys[depthBuckets] =
+        { V0p2_SENSOR_TAG_F("RXq0"), V0p2_SENSOR_TAG_F("RXq1"), V0p2_SENSOR_TAG_F("RXq2"), V0p2_SENSOR_TAG_F("RXq3") };
+    static const OTV0P2BASE::MSG_JSON_SimpleStatsKey_t filterKeys[maxFilters] =
+        { V0p2_SENSOR_TAG_F("RXf0"), V0p2_SENSOR_TAG_F("RXf1"), V0p2_SENSOR_TAG_F("RXf2"), V0p2_SENSOR_TAG_F("RXf3") };
+    bool ok = true;
+    ok &= ss.put(V0p2_SENSOR_TAG_F("RXhw"), highWater, true);
+    ok &= ss.put(V0p2_SENSOR_TAG_F("RXdrop"), capStat(dropped), true);
+    for(uint8_t i = 0; i < depthBuckets; ++i) { ok &= ss.put(depthKeys[i], capStat(depthAtEnqueue[i]), true); }
+    ok &= ss.put(V0p2_SENSOR_TAG_F("RXl|st"), getMeanLatency(), true);
+    ok &= ss.put(V0p2_SENSOR_TAG_F("RXlx|st"), latencyMax, true);
+    for(uint8_t i = 0; (i < maxFilters) && (NULL != filters[i]); ++i) { ok &= ss.put(filterKeys[i], capStat(filtered[i]), true); }
+    return(ok);
+    }
+
+
+    }
@@ -0,0 +1,193 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * Optional RX queue instrumentation:
+ * occupancy, drops, enqueue-to-dequeue latency and RX filter rejections,
+ * exportable as JSON stats.
+ *
+ * Only compiled in where an ISRRXQueueInstrumented queue is selected,
+ * eg with the instrumentRX template parameter of OTRFM23BLink,
+ * so costs nothing otherwise.
+ */
+
+#ifndef ARDUINO_LIB_OTRADIOLINK_ISRRXQUEUESTATS_H
+#define ARDUINO_LIB_OTRADIOLINK_ISRRXQUEUESTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ARDUINO_ARCH_AVR
+#include <util/atomic.h>
+#endif
+
+#include <OTV0p2Base.h>
+
+#include "OTRadioLink_ISRRXQueue.h"
+#include "OTRadioLink_OTRadioLink.h"
+
+
+// Use namespaces to help avoid collisions.
+namespace OTRadioLink
+    {
+
+
+    // RX queue statistics, updated from the RX ISR and the main loop.
+    // All counts saturate rather than wrap; reset() to start a new interval.
+    // Marked volatile for ISR-/thread- safe access without a lock;
+    // multi-byte values may be momentarily inconsistent when read outside an ISR.
+    struct ISRRXQueueStats final
+        {
+        // Number of queue depth histogram buckets; the last includes all deeper queues.
+        static constexpr uint8_t depthBuckets = 4;
+        // Maximum number of distinct RX filters whose rejections are counted separately.
+        static constexpr uint8_t maxFilters = 4;
+
+        // Maximum number of frames queued at once.
+        volatile uint8_t highWater;
+        // Count of frames queued by the number of frames already queued ahead of them.
+        volatile uint16_t depthAtEnqueue[depthBuckets];
+        // Count of frames dropped for lack of queue space.
+        volatile uint16_t dropped;
+        // Count, total and maximum of enqueue-to-dequeue latencies in ticks, eg sub-cycle ticks.
+        volatile uint16_t latencyCount;
+        volatile uint32_t latencyTotal;
+        volatile uint8_t latencyMax;
+        // RX filters seen (in order of first rejection) and their rejection counts.
+        quickFrameFilter_t *volatile filters[maxFilters];
+        volatile uint16_t filtered[maxFilters];
+
+        ISRRXQueueStats() { reset(); }
+
+        // Clear all stats.
+        void reset();
+
+        // Note a frame queued with depthBefore frames already queued.
+        // ISR-safe.
+        void noteEnqueued(uint8_t depthBefore);
+        // Note a frame dropped for lack of queue space.
+        // ISR-safe.
+        inline void noteDropped() { if(0xffff != dropped) { ++dropped; } }
+        // Note a frame dequeued after the given number of ticks.
+        void noteLatency(uint8_t ticks);
+        // Note a frame rejected by the given RX filter;
+        // rejections by filters beyond the first maxFilters are not counted.
+        // ISR-safe.
+        void noteFiltered(quickFrameFilter_t *f);
+
+        // Mean enqueue-to-dequeue latency in ticks, rounded down; 0 if none measured.
+        uint8_t getMeanLatency() const;
+
+        // Put the stats to ss as low-priority items with keys:
+        //   * RXhw  high-water mark (frames)
+        //   * RXdrop  frames dropped for lack of queue space
+        //   * RXq0 .. RXq3  frames queued with 0, 1, 2, 3+ frames already queued
+        //   * RXl|st, RXlx|st  mean and maximum enqueue-to-dequeue latency in sub-cycle ticks
+        //   * RXf0 .. RXf3  rejections by each RX filter seen, in order
+        // Values are capped at the largest JSON stats value.
+        // True if all the stats were put successfully.
+        bool putStats(OTV0P2BASE::SimpleStatsRotationBase &ss) const;
+        };
+
+    // Wraps an ISRRXQueue to collect ISRRXQueueStats.
+    // Same interface and (single-producer) ISR/thread usage rules as the wrapped queue.
+    //   * Q  the wrapped queue type, default constructible
+    //   * getTicks  fast ISR-safe time source with an 8-bit wrapping tick,
+    //     eg OTV0P2BASE::getSubCycleTime; latencies of more than 255 ticks are under-reported
+    //   * timestampSlots  number of queued frames whose enqueue time is recorded, a power of two [1,128];
+    //     frames queued beyond this are not included in latency stats
+    template<class Q, uint8_t (*getTicks)(), uint8_t timestampSlots = 4>
+    class ISRRXQueueInstrumented final : public ISRRXQueue
+        {
+        static_assert((timestampSlots > 0) && (timestampSlots <= 128) && (0 == (timestampSlots & (timestampSlots - 1))),
+                      "timestampSlots must be a power of two no larger than 128");
+        private:
+            Q q;
+            // Enqueue times of the oldest queued frames,
+            // in a ring indexed by free-running in/out counts.
+            // Frames are only timed while all frames ahead of them are,
+            // so the timed frames are always at the head of the queue.
+            volatile uint8_t enqueueTicks[timestampSlots];
+            volatile uint8_t tsIn, tsOut;
+
+        public:
+            // Statistics collected; may be read, reset() and exported by the caller.
+            mutable ISRRXQueueStats stats;
+
+            ISRRXQueueInstrumented() : tsIn(0), tsOut(0) { }
+
+            virtual void getRXCapacity(uint8_t &queueRXMsgsMin, uint8_t &maxRXMsgLen) const override
+                { q.getRXCapacity(queueRXMsgsMin, maxRXMsgLen); }
+            virtual uint8_t isFull() const override { return(q.isFull()); }
+
+            // Counts a drop if there is no space.
+            virtual volatile uint8_t *_getRXBufForInbound() const override
+                {
+                volatile uint8_t *const b = q._getRXBufForInbound();
+                if(NULL == b) { stats.noteDropped(); }
+                return(b);
+                }
+
+            // Records depth, high-water and the enqueue time for each frame actually queued.
+            virtual void _loadedBuf(const uint8_t frameLen) override
+                {
+                const uint8_t depthBefore = q.getRXMsgsQueued();
+                q._loadedBuf(frameLen);
+                const uint8_t depthAfter = q.getRXMsgsQueued();
+                queuedRXedMessageCount = depthAfter;
+                if(depthAfter == depthBefore) { return; } // Nothing queued.
+                stats.noteEnqueued(depthBefore);
+                const uint8_t timed = uint8_t(tsIn - tsOut);
+                if((timed == depthBefore) && (timed < timestampSlots))
+                    {
+                    enqueueTicks[tsIn % timestampSlots] = getTicks();
+                    ++tsIn;
+                    }
+                }
+
+            virtual const volatile uint8_t *peekRXMsg() const override { return(q.peekRXMsg()); }
+
+            // Records the latency of the frame removed if it was timed.
+            virtual void removeRXMsg() override
+                {
+                if(q.isEmpty()) { return; }
+#ifdef ARDUINO_ARCH_AVR
+                ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#endif
+                    {
+                    if(tsIn != tsOut)
+                        {
+                        stats.noteLatency(uint8_t(getTicks() - enqueueTicks[tsOut % timestampSlots]));
+                        ++tsOut;
+                        }
+                    q.removeRXMsg();
+                    queuedRXedMessageCount = q.getRXMsgsQueued();
+                    }
+                }
+        };
+
+    // Get the stats for an RX queue, or NULL if it is not instrumented.
+    // Resolved at compile time so that non-instrumented code compiles away.
+    inline ISRRXQueueStats *getISRRXQueueStats(const ISRRXQueue &) { return(NULL); }
+    template<class Q, uint8_t (*getTicks)(), uint8_t timestampSlots>
+    inline ISRRXQueueStats *getISRRXQueueStats(const ISRRXQueueInstrumented<Q, getTicks, timestampSlots> &q) { return(&q.stats); }
+
+
+    }
+
+#endif
@@ -0,0 +1,274 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * Host-side (non-Arduino) node association and RX message counter store
+ * for secure frame RX, scaling to thousands of nodes.
+ */
+
+#include <string.h>
+
+#include "OTRadioLink_NodeAssociationStore.h"
+
+#include "OTV0P2BASE_CRC.h"
+
+
+namespace OTRadioLink
+    {
+
+
+#ifdef NodeAssociationStoreHashed_DEFINED
+
+// Log record types.
+static const uint8_t logRecordAssociate = 'A';
+static const uint8_t logRecordCounter = 'C';
+
+// Minimum hash table size (power of 2).
+static const size_t minSlots = 16;
+
+// Create store, RAM-only if logFileName is NULL,
+// else replaying and then appending to the named log file.
+NodeAssociationStoreHashed::NodeAssociationStoreHashed(const char *const _logFileName)
+  : slots(minSlots, 0), logFileName(_logFileName), log(NULL), ok(true)
+    {
+    if(NULL == logFileName) { return; }
+    bool complete;
+    ok = replayLog(complete);
+    if(ok) { ok = (NULL != (log = fopen(logFileName, "ab"))); }
+    // Drop any torn/corrupt tail so that new records are not appended after it
+    // (where the next replay would never reach them).
+    if(ok && !complete) { ok = compact(); }
+    }
+
+NodeAssociationStoreHashed::~NodeAssociationStoreHashed()
+    { if(NULL != log) { fclose(log); } }
+
+// Slot at which to start probing for the given ID/prefix.
+size_t NodeAssociationStoreHashed::startSlot(const uint8_t *const id) const
+    {
+    // Multiplicative (Fibonacci) hash of the leading ID bytes.
+    uint32_t k = 0;
+    for(uint8_t i = 0; i < hashedPrefixBytes; ++i) { k = (k << 8) | id[i]; }
+    return(size_t((k * 2654435761U) >> 16) & (slots.size() - 1));
+    }
+
+// Insert entry index into hash table (which must have a free slot).
+void NodeAssociationStoreHashed::insertSlot(const uint16_t index)
+    {
+    const size_t mask = slots.size() - 1;
+    size_t s = startSlot(entries[index].id);
+    while(0 != slots[s]) { s = (s + 1) & mask; }
+    slots[s] = uint16_t(index + 1);
+    }
+
+// Grow (and rebuild) hash table if needed to keep load factor <= 1/2.
+void NodeAssociationStoreHashed::ensureSlotCapacity()
+    {
+    if(2 * (entries.size() + 1) <= slots.size()) { return; }
+    slots.assign(2 * slots.size(), 0);
+    for(size_t i = 0; i < entries.size(); ++i) { insertSlot(uint16_t(i)); }
+    }
+
+// Find entry with exactly the given full ID, else -1.
+int32_t NodeAssociationStoreHashed::findExact(const uint8_t *const id) const
+    {
+    const size_t mask = slots.size() - 1;
+    for(size_t s = startSlot(id); 0 != slots[s]; s = (s + 1) & mask)
+        {
+        const uint16_t index = uint16_t(slots[s] - 1);
+        if(0 == memcmp(entries[index].id, id, OTV0P2BASE::OpenTRV_Node_ID_Bytes)) { return(index); }
+        }
+    return(-1);
+    }
+
+// Add association to RAM state only; returns index or -1.
+int16_t NodeAssociationStoreHashed::addInRAM(const uint8_t *const nodeID)
+    {
+    const int32_t existing = findExact(nodeID);
+    if(existing >= 0) { return(int16_t(existing)); }
+    if(entries.size() >= maxAssociations) { return(-1); }
+    ensureSlotCapacity();
+    Entry e;
+    memcpy(e.id, nodeID, sizeof(e.id));
+    memset(e.counter, 0, sizeof(e.counter));
+    entries.push_back(e);
+    const uint16_t index = uint16_t(entries.size() - 1);
+    insertSlot(index);
+    return(int16_t(index));
+    }
+
+// Append one record to the log (if any) and flush; returns false on failure.
+bool NodeAssociationStoreHashed::appendLogRecord(const uint8_t type, const uint8_t *const id, const uint8_t *const counter)
+    {
+    if(NULL == logFileName) { return(true); } // RAM only.
+    if(NULL == log) { return(false); }
+    uint8_t rec[logRecordBytes];
+    rec[0] = type;
+    memcpy(rec + 1, id, OTV0P2BASE::OpenTRV_Node_ID_Bytes);
+    if(NULL == counter) { memset(rec + 1 + OTV0P2BASE::OpenTRV_Node_ID_Bytes, 0, SimpleSecureFrame32or0BodyBase::fullMessageCounterBytes); }
+    else { memcpy(rec + 1 + OTV0P2BASE::OpenTRV_Node_ID_Bytes, counter, SimpleSecureFrame32or0BodyBase::fullMessageCounterBytes); }
+    rec[logRecordBytes - 1] = OTV0P2BASE::crc7_5B_update_buf(0, rec, logRecordBytes - 1);
+    return((1 == fwrite(rec, sizeof(rec), 1, log)) && (0 == fflush(log)));
+    }
+
+// Replay the log into RAM state; returns false on I/O failure.
+// A missing log is treated as empty.
+// Stops at the first short or corrupt record, as from an interrupted write,
+// setting complete false if any bytes were left unread.
+bool NodeAssociationStoreHashed::replayLog(bool &complete)
+    {
+    complete = true;
+    FILE *const f = fopen(logFileName, "rb");
+    if(NULL == f) { return(true); } // Nothing to replay.
+    uint8_t rec[logRecordBytes];
+    for( ; ; )
+        {
+        const size_t n = fread(rec, 1, sizeof(rec), f);
+        if(sizeof(rec) != n) { complete = (0 == n); break; }
+        complete = false;
+        if(OTV0P2BASE::crc7_5B_update_buf(0, rec, logRecordBytes - 1) != rec[logRecordBytes - 1]) { break; }
+        const uint8_t *const id = rec + 1;
+        const uint8_t *const counter = rec + 1 + OTV0P2BASE::OpenTRV_Node_ID_Bytes;
+        if(logRecordAssociate == rec[0]) { if(addInRAM(id) < 0) { break; } }
+        else if(logRecordCounter == rec[0])
+            {
+            // Only ever move a counter forwards.
+            const int32_t index = findExact(id);
+            if((index >= 0) && (SimpleSecureFrame32or0BodyBase::msgcountercmp(counter, entries[index].counter) > 0))
+                { memcpy(entries[index].counter, counter, SimpleSecureFrame32or0BodyBase::fullMessageCounterBytes); }
+            }
+        else { break; }
+        complete = true;
+        }
+    const bool readOK = !ferror(f);
+    fclose(f);
+    return(readOK);
+    }
+
+// Add an association with a zero RX message counter; returns its index or -1 on failure.
+// If already associated returns the existing index and leaves the counter unchanged.
+int16_t NodeAssociationStoreHashed::addNodeAssociation(const uint8_t *const nodeID)
+    {
+    if(NULL == nodeID) { return(-1); }
+    const int32_t existing = findExact(nodeID);
+    if(existing >= 0) { return(int16_t(existing)); }
+    if(entries.size() >= maxAssociations) { return(-1); }
+    if(!appendLogRecord(logRecordAssociate, nodeID, NULL)) { return(-1); }
+    return(addInRAM(nodeID));
+    }
+
+// Remove all associations (and truncate any log); returns false on failure.
+bool NodeAssociationStoreHashed::clearAllNodeAssociations()
+    {
+    entries.clear();
+    slots.assign(minSlots, 0);
+    if(NULL == logFileName) { return(true); }
+    if(NULL != log) { fclose(log); }
+    log = fopen(logFileName, "wb");
+    ok = (NULL != log);
+    return(ok);
+    }
+
+// Rewrite the log with one association and one counter record per node; returns false on failure.
+// Writes to a temporary file then renames it over the log so that the old log remains usable on failure.
+bool NodeAssociationStoreHashed::compact()
+    {
+    if(NULL == logFileName) { return(true); }
+    if(NULL == log) { return(false); }
+    static const char suffix[] = ".tmp";
+    std::vector<char> tmpName(strlen(logFileName) + sizeof(suffix));
+    strcpy(tmpName.data(), logFileName);
+    strcat(tmpName.data(), suffix);
+    FILE *const oldLog = log;
+    log = fopen(tmpName.data(), "wb");
+    bool good = (NULL != log);
+    for(size_t i = 0; good && (i < entries.size()); ++i)
+        {
+        good = appendLogRecord(logRecordAssociate, entries[i].id, NULL) &&
+               appendLogRecord(logRecordCounter, entries[i].id, entries[i].counter);
+        }
+    if(NULL != log) { good = (0 == fclose(log)) && good; }
+    if(good) { good = (0 == rename(tmpName.data(), logFileName)); }
+    if(!good)
+        {
+        remove(tmpName.data());
+        log = oldLog;
+        return(false);
+        }
+    fclose(oldLog);
+    log = fopen(logFileName, "ab");
+    ok = (NULL != log);
+    return(ok);
+    }
+
+// Returns the lowest association index >= startIndex whose ID matches the prefix, else -1.
+int16_t NodeAssociationStoreHashed::getNextMatchingNodeID(const uint16_t startIndex, const uint8_t *const prefix, const uint8_t prefixLen, uint8_t *const nodeID) const
+    {
+    if(prefixLen > OTV0P2BASE::OpenTRV_Node_ID_Bytes) { return(-1); }
+    if((NULL == prefix) && (0 != prefixLen)) { return(-1); }
+    int32_t best = -1;
+    if(prefixLen < hashedPrefixBytes)
+        {
+        // Short/anonymous prefix: linear scan in index order.
+        for(size_t i = startIndex; i < entries.size(); ++i)
+            { if((0 == prefixLen) || (0 == memcmp(entries[i].id, prefix, prefixLen))) { best = int32_t(i); break; } }
+        }
+    else
+        {
+        // Probe the hash chain, keeping the lowest matching index.
+        const size_t mask = slots.size() - 1;
+        for(size_t s = startSlot(prefix); 0 != slots[s]; s = (s + 1) & mask)
+            {
+            const uint16_t index = uint16_t(slots[s] - 1);
+            if((index < startIndex) || ((best >= 0) && (index >= best))) { continue; }
+            if(0 == memcmp(entries[index].id, prefix, prefixLen)) { best = index; }
+            }
+        }
+    if(best < 0) { return(-1); }
+    if(NULL != nodeID) { memcpy(nodeID, entries[best].id, OTV0P2BASE::OpenTRV_Node_ID_Bytes); }
+    return(int16_t(best));
+    }
+
+// Read current (last-authenticated) RX message count for specified node, or return false if failed.
+bool NodeAssociationStoreHashed::getLastRXMessageCounter(const uint8_t *const ID, uint8_t *const counter) const
+    {
+    if((NULL == ID) || (NULL == counter)) { return(false); }
+    const int32_t index = findExact(ID);
+    if(index < 0) { return(false); }
+    memcpy(counter, entries[index].counter, SimpleSecureFrame32or0BodyBase::fullMessageCounterBytes);
+    return(true);
+    }
+
+// Persist new message counter for an associated node; returns false on failure.
+// Refuses a value that is not higher than the current one.
+bool NodeAssociationStoreHashed::updateRXMessageCount(const uint8_t *const ID, const uint8_t *const newCounterValue)
+    {
+    if((NULL == ID) || (NULL == newCounterValue)) { return(false); }
+    const int32_t index = findExact(ID);
+    if(index < 0) { return(false); }
+    if(SimpleSecureFrame32or0BodyBase::msgcountercmp(newCounterValue, entries[index].counter) <= 0) { return(false); }
+    // Persist first so that a restart can never see a lower value than was acted upon.
+    if(!appendLogRecord(logRecordCounter, ID, newCounterValue)) { return(false); }
+    memcpy(entries[index].counter, newCounterValue, SimpleSecureFrame32or0BodyBase::fullMessageCounterBytes);
+    return(true);
+    }
+
+#endif // NodeAssociationStoreHashed_DEFINED
+
+
+    }
@@ -0,0 +1,143 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * Host-side (non-Arduino) node association and RX message counter store
+ * for secure frame RX, scaling to thousands of nodes,
+ * eg for a Linux-based concentrator.
+ */
+
+#ifndef ARDUINO_LIB_OTRADIOLINK_NODEASSOCIATIONSTORE_H
+#define ARDUINO_LIB_OTRADIOLINK_NODEASSOCIATIONSTORE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <OTV0p2Base.h>
+
+#include "OTRadioLink_SecureableFrameType.h"
+
+#if !defined(ARDUINO)
+#include <vector>
+#endif
+
+
+namespace OTRadioLink
+    {
+
+
+#if !defined(ARDUINO)
+    // Host-side node association and RX message counter store.
+    //
+    // Associations are held in RAM with an open-addressed hash table
+    // keyed on the leading hashedPrefixBytes of the node ID,
+    // so that look-ups by a frame header ID prefix at least that long
+    // and counter reads/updates are O(1) (expected) however many nodes are associated.
+    // Shorter prefixes (eg anonymous frames) fall back to a linear scan.
+    //
+    // Optionally backed by an append-only log file
+    // of fixed-size CRC-protected records (association and counter updates)
+    // that is replayed on construction;
+    // a torn/corrupt trailing record (eg from power failure mid-write) is ignored
+    // and the log is then compacted to drop it before anything more is appended.
+    // Each update is appended (and flushed) before the RAM state is changed,
+    // so a replay can never see a counter lower than one acted upon.
+    // Use compact() occasionally to bound the log size.
+    //
+    // Not thread-safe.
+#define NodeAssociationStoreHashed_DEFINED
+    class NodeAssociationStoreHashed final : public NodeAssociationStoreBase
+        {
+        public:
+            // Number of leading ID bytes used as the hash key.
+            static constexpr uint8_t hashedPrefixBytes = 2;
+            // Maximum number of associations (so that indexes fit the int16_t look-up result).
+            static constexpr uint16_t maxAssociations = 0x7fff;
+            // Size of each log file record: type, ID, counter, CRC.
+            static constexpr uint8_t logRecordBytes = 1 + OTV0P2BASE::OpenTRV_Node_ID_Bytes + SimpleSecureFrame32or0BodyBase::fullMessageCounterBytes + 1;
+
+        private:
+            struct Entry final
+                {
+                uint8_t id[OTV0P2BASE::OpenTRV_Node_ID_Bytes];
+                uint8_t counter[SimpleSecureFrame32or0BodyBase::fullMessageCounterBytes];
+                };
+
+            // Associations in index order.
+            std::vector<Entry> entries;
+            // Hash table of (entry index + 1), 0 for an empty slot; size is a power of 2.
+            std::vector<uint16_t> slots;
+
+            // Log file name, or NULL if RAM only.
+            const char * const logFileName;
+            // Open log file for append, or NULL.
+            FILE *log;
+            // True if the log was read and opened without error.
+            bool ok;
+
+            // Slot at which to start probing for the given ID/prefix.
+            size_t startSlot(const uint8_t *id) const;
+            // Insert entry index into hash table (which must have a free slot).
+            void insertSlot(uint16_t index);
+            // Grow (and rebuild) hash table if needed to keep load factor low.
+            void ensureSlotCapacity();
+            // Find entry with exactly the given full ID, else -1.
+            int32_t findExact(const uint8_t *id) const;
+            // Add association to RAM state only; returns index or -1.
+            int16_t addInRAM(const uint8_t *nodeID);
+            // Append one record to the log (if any) and flush; returns false on failure.
+            bool appendLogRecord(uint8_t type, const uint8_t *id, const uint8_t *counter);
+            // Replay the log into RAM state; returns false on I/O failure.
+            // Sets complete false if replay stopped before the end of the log.
+            bool replayLog(bool &complete);
+
+            // Not copyable.
+            NodeAssociationStoreHashed(const NodeAssociationStoreHashed &) = delete;
+            NodeAssociationStoreHashed &operator=(const NodeAssociationStoreHashed &) = delete;
+
+        public:
+            // Create store, RAM-only if logFileName is NULL,
+            // else replaying and then appending to the named log file.
+            // The lifetime of the file name string must exceed that of this instance.
+            explicit NodeAssociationStoreHashed(const char *logFileName = NULL);
+            ~NodeAssociationStoreHashed();
+
+            // True if the store was loaded and (if file-backed) is writable.
+            bool isOK() const { return(ok); }
+
+            // Number of associations.
+            uint16_t countNodeAssociations() const { return(uint16_t(entries.size())); }
+            // Add an association with a zero RX message counter; returns its index or -1 on failure.
+            // If already associated returns the existing index and leaves the counter unchanged.
+            int16_t addNodeAssociation(const uint8_t *nodeID);
+            // Remove all associations (and truncate any log); returns false on failure.
+            bool clearAllNodeAssociations();
+            // Rewrite the log with one association and one counter record per node; returns false on failure.
+            bool compact();
+
+            // NodeAssociationStoreBase.
+            virtual int16_t getNextMatchingNodeID(uint16_t startIndex, const uint8_t *prefix, uint8_t prefixLen, uint8_t *nodeID) const override;
+            virtual bool getLastRXMessageCounter(const uint8_t *ID, uint8_t *counter) const override;
+            virtual bool updateRXMessageCount(const uint8_t *ID, const uint8_t *newCounterValue) override;
+        };
+#endif // !defined(ARDUINO)
+
+
+    }
+
+
+#endif
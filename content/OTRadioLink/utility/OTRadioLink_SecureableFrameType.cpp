@@ -31,6 +31,7 @@ Author(s) / Copyright (s): Damon Hart-Davis 2015--2016
 #include <string.h>
 
 #include "OTRadioLink_SecureableFrameType.h"
+#include "OTRadioLink_ISRRXQueue.h"
 
 #include "OTV0P2BASE_CRC.h"
 #include "OTV0P2BASE_EEPROM.h"
@@ -248,10 +249,8 @@ uint8_t SecurableFrameHeader::computeNonSecureFrameCRC(const uint8_t *const buf,
     // Check that buffer is at least large enough for all but the CRC byte itself.
     if(buflen < fl) { return(0); } // ERROR
     // Initialise CRC with 0x7f;
-    uint8_t crc = 0x7f;
-    const uint8_t *p = buf;
-    // Include in calc all bytes up to but not including the trailer/CRC byte.
-    for(uint8_t i = fl; i > 0; --i) { crc = OTV0P2BASE::crc7_5B_update(crc, *p++); }
+    // include in calc all bytes up to but not including the trailer/CRC byte.
+    uint8_t crc = OTV0P2BASE::crc7_5B_update_buf(0x7f, buf, fl);
     // Ensure 0x00 result is converted to avoid forbidden value.
     if(0 == crc) { crc = 0x80; }
     return(crc);
@@ -355,41 +354,21 @@ bool SimpleSecureFrame32or0BodyBase::msgcounteradd(uint8_t *const counter, const
     return(true);
     }
 
-// Encode entire secure small frame from header params and body and crypto support.
-// This is a raw/partial impl that requires the IV/nonce to be supplied.
-// This uses fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t style encryption/authentication.
-// The matching decryption function should be used for decoding/verifying.
-// The crypto method may need to vary based on frame type,
-// and on negotiations between the participants in the communications.
-// Returns the total number of bytes written out for the frame
-// (including, and with a value one higher than the first 'fl' bytes).
-// Returns zero in case of error.
-// The supplied buffer may have to be up to 64 bytes long.
-//
-// Note that the sequence number is taken from the 4 least significant bits
-// of the message counter (at byte 6 in the nonce).
-//
-// Parameters:
-//  * buf  buffer to which is written the entire frame including trailer; never NULL
-//  * buflen  available length in buf; if too small then this routine will fail (return 0)
-//  * fType_  frame type (without secure bit) in range ]FTS_NONE,FTS_INVALID_HIGH[ ie exclusive
-//  * id_ / il_  ID bytes (and length) to go in the header; NULL means take ID from EEPROM
-//  * body / bl_  body data (and length), before padding/encryption, no larger than ENC_BODY_SMALL_FIXED_PTEXT_MAX_SIZE
-//  * iv  12-byte initialisation vector / nonce; never NULL
-//  * e  encryption function; never NULL
-//  * state  pointer to state for e, if required, else NULL
-//  * key  secret key; never NULL
-uint8_t SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(
+// Shared implementation of both encodeSecureSmallFrameRaw() variants,
+// so that they cannot drift apart.
+// Exactly one of e (with state and key) and ek (with keyContext) is used:
+// ek if it is non-NULL, else e; the caller checks that those used are non-NULL.
+static uint8_t encodeSecureSmallFrameRawCommon(
                                 uint8_t *const buf, const uint8_t buflen,
                                 const FrameType_Secureable fType_,
                                 const uint8_t *const id_, const uint8_t il_,
                                 const uint8_t *const body, const uint8_t bl_,
                                 const uint8_t *const iv,
-                                const fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t e,
-                                void *const state, const uint8_t *const key)
+                                const SimpleSecureFrame32or0BodyTXBase::fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t e,
+                                void *const state, const uint8_t *const key,
+                                const SimpleSecureFrame32or0BodyTXBase::fixed32BTextSize12BNonce16BTagSimpleEncWithKeyContext_ptr_t ek,
+                                const void *const keyContext)
     {
-    if((NULL == e) || (NULL == key)) { return(0); } // ERROR
-
     // Capture possible (near) peak of stack usage, eg when called from ISR.
     OTV0P2BASE::MemoryChecks::recordIfMinSP();
 
@@ -399,7 +378,7 @@ uint8_t SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(
     // Let checkAndEncodeSmallFrameHeader() validate buf and id_.
     // If necessary (bl_ > 0) body is validated below.
     const uint8_t seqNum_ = iv[11] & 0xf;
-    OTRadioLink::SecurableFrameHeader sfh;
+    SecurableFrameHeader sfh;
     const uint8_t hl = sfh.checkAndEncodeSmallFrameHeader(buf, buflen,
                                                true, fType_,
                                                seqNum_,
@@ -417,11 +396,13 @@ uint8_t SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(
         {
         if(NULL == body) { return(0); } // ERROR
         memcpy(paddingBuf, body, bl_);
-        if(0 == addPaddingTo32BTrailing0sAndPadCount(paddingBuf, bl_)) { return(0); } // ERROR
+        if(0 == SimpleSecureFrame32or0BodyTXBase::addPaddingTo32BTrailing0sAndPadCount(paddingBuf, bl_)) { return(0); } // ERROR
         }
     // Encrypt body (if any) from the padding buffer to the output buffer.
     // Insert the tag directly into the buffer (before the final byte).
-    if(!e(state, key, iv, buf, hl, (0 == bl_) ? NULL : paddingBuf, buf + hl, buf + fl - 16)) { return(0); } // ERROR
+    const uint8_t *const ptext = (0 == bl_) ? NULL : paddingBuf;
+    if(!((NULL != ek) ? ek(keyContext, iv, buf, hl, ptext, buf + hl, buf + fl - 16) :
+                        e(state, key, iv, buf, hl, ptext, buf + hl, buf + fl - 16))) { return(0); } // ERROR
     // Copy the counters part (last 6 bytes of) the nonce/IV into the trailer...
     memcpy(buf + fl - 22, iv + 6, 6);
     // Set final trailer byte to indicate encryption type and format.
@@ -430,6 +411,60 @@ uint8_t SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(
     return(fl + 1);
     }
 
+// Encode entire secure small frame from header params and body and crypto support.
+// This is a raw/partial impl that requires the IV/nonce to be supplied.
+// This uses fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t style encryption/authentication.
+// The matching decryption function should be used for decoding/verifying.
+// The crypto method may need to vary based on frame type,
+// and on negotiations between the participants in the communications.
+// Returns the total number of bytes written out for the frame
+// (including, and with a value one higher than the first 'fl' bytes).
+// Returns zero in case of error.
+// The supplied buffer may have to be up to 64 bytes long.
+//
+// Note that the sequence number is taken from the 4 least significant bits
+// of the message counter (at byte 6 in the nonce).
+//
+// Parameters:
+//  * buf  buffer to which is written the entire frame including trailer; never NULL
+//  * buflen  available length in buf; if too small then this routine will fail (return 0)
+//  * fType_  frame type (without secure bit) in range ]FTS_NONE,FTS_INVALID_HIGH[ ie exclusive
+//  * id_ / il_  ID bytes (and length) to go in the header; NULL means take ID from EEPROM
+//  * body / bl_  body data (and length), before padding/encryption, no larger than ENC_BODY_SMALL_FIXED_PTEXT_MAX_SIZE
+//  * iv  12-byte initialisation vector / nonce; never NULL
+//  * e  encryption function; never NULL
+//  * state  pointer to state for e, if required, else NULL
+//  * key  secret key; never NULL
+uint8_t SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(
+                                uint8_t *const buf, const uint8_t buflen,
+                                const FrameType_Secureable fType_,
+                                const uint8_t *const id_, const uint8_t il_,
+                                const uint8_t *const body, const uint8_t bl_,
+                                const uint8_t *const iv,
+                                const fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t e,
+                                void *const state, const uint8_t *const key)
+    {
+    if((NULL == e) || (NULL == key)) { return(0); } // ERROR
+    return(encodeSecureSmallFrameRawCommon(buf, buflen, fType_, id_, il_, body, bl_, iv, e, state, key, NULL, NULL));
+    }
+
+// As for encodeSecureSmallFrameRaw() with a fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t function
+// but using a pre-expanded key context to avoid repeating the key expansion for each frame.
+//  * e  encryption function; never NULL
+//  * keyContext  key context for e built by its matching key-setup function; never NULL
+uint8_t SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(
+                                uint8_t *const buf, const uint8_t buflen,
+                                const FrameType_Secureable fType_,
+                                const uint8_t *const id_, const uint8_t il_,
+                                const uint8_t *const body, const uint8_t bl_,
+                                const uint8_t *const iv,
+                                const fixed32BTextSize12BNonce16BTagSimpleEncWithKeyContext_ptr_t e,
+                                const void *const keyContext)
+    {
+    if((NULL == e) || (NULL == keyContext)) { return(0); } // ERROR
+    return(encodeSecureSmallFrameRawCommon(buf, buflen, fType_, id_, il_, body, bl_, iv, NULL, NULL, NULL, e, keyContext));
+    }
+
 // Encode entire secure small frame from header params and body and crypto support.
 // Buffer for body must be large enough to allow padding to be applied IN PLACE.
 // This is a raw/partial impl that requires the IV/nonce to be supplied.
@@ -511,6 +546,57 @@ uint8_t SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRawPadInPlace(
     return(fl + 1);
     }
 
+// Shared implementation of both decodeSecureSmallFrameRaw() variants,
+// so that they cannot drift apart.
+// Exactly one of d (with state and key) and dk (with keyContext) is used:
+// dk if it is non-NULL, else d; the caller checks that those used are non-NULL.
+static uint8_t decodeSecureSmallFrameRawCommon(const SecurableFrameHeader *const sfh,
+                                const uint8_t *const buf, const uint8_t buflen,
+                                const SimpleSecureFrame32or0BodyRXBase::fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t d,
+                                void *const state, const uint8_t *const key,
+                                const SimpleSecureFrame32or0BodyRXBase::fixed32BTextSize12BNonce16BTagSimpleDecWithKeyContext_ptr_t dk,
+                                const void *const keyContext, const uint8_t *const iv,
+                                uint8_t *const decryptedBodyOut, const uint8_t decryptedBodyOutBuflen, uint8_t &decryptedBodyOutSize)
+    {
+    if((NULL == sfh) || (NULL == buf) || (NULL == iv)) { return(0); } // ERROR
+
+    // Capture possible (near) peak of stack usage, eg when called from ISR.
+    OTV0P2BASE::MemoryChecks::recordIfMinSP();
+
+    // Abort if header was not decoded properly.
+    if(sfh->isInvalid()) { return(0); } // ERROR
+    // Abort if expected constraints for simple fixed-size secure frame are not met.
+    const uint8_t fl = sfh->fl;
+    if(fl >= buflen) { return(0); } // ERROR
+    if(23 != sfh->getTl()) { return(0); } // ERROR
+    if(0x80 != buf[fl]) { return(0); } // ERROR
+    const uint8_t bl = sfh->bl;
+    if((0 != bl) && (ENC_BODY_SMALL_FIXED_CTEXT_SIZE != bl)) { return(0); } // ERROR
+    // Check that header sequence number lsbs match nonce counter 4 lsbs.
+    if(sfh->getSeq() != (iv[11] & 0xf)) { return(0); } // ERROR
+    // Note if plaintext is actually wanted/expected.
+    const bool plaintextWanted = (NULL != decryptedBodyOut);
+    // Attempt to authenticate and decrypt.
+    uint8_t decryptBuf[ENC_BODY_SMALL_FIXED_CTEXT_SIZE];
+    const uint8_t *const ctext = (0 == bl) ? NULL : buf + sfh->getBodyOffset();
+    if(!((NULL != dk) ? dk(keyContext, iv, buf, sfh->getHl(), ctext, buf + fl - 16, decryptBuf) :
+                        d(state, key, iv, buf, sfh->getHl(), ctext, buf + fl - 16, decryptBuf))) { return(0); } // ERROR
+    if(plaintextWanted && (0 != bl))
+        {
+        // Unpad the decrypted text in place.
+        const uint8_t upbl = SimpleSecureFrame32or0BodyRXBase::removePaddingTo32BTrailing0sAndPadCount(decryptBuf);
+        if(upbl > ENC_BODY_SMALL_FIXED_PTEXT_MAX_SIZE) { return(0); } // ERROR
+        if(upbl > decryptedBodyOutBuflen) { return(0); } // ERROR
+        memcpy(decryptedBodyOut, decryptBuf, upbl);
+        decryptedBodyOutSize = upbl;
+        // TODO: optimise later if plaintext not required but ciphertext present.
+        }
+    // Ensure that decryptedBodyOutSize is not left initialised even if no frame body RXed/wanted.
+    else { decryptedBodyOutSize = 0; }
+    // Done.
+    return(fl + 1);
+    }
+
 // Decode entire secure small frame from raw frame bytes and crypto support.
 // This is a raw/partial impl that requires the IV/nonce to be supplied.
 // This uses fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t style encryption/authentication.
@@ -557,6 +643,42 @@ uint8_t SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRaw(const Secura
                                 void *const state, const uint8_t *const key, const uint8_t *const iv,
                                 uint8_t *const decryptedBodyOut, const uint8_t decryptedBodyOutBuflen, uint8_t &decryptedBodyOutSize)
     {
+    if((NULL == d) || (NULL == key)) { return(0); } // ERROR
+    return(decodeSecureSmallFrameRawCommon(sfh, buf, buflen, d, state, key, NULL, NULL, iv,
+                                           decryptedBodyOut, decryptedBodyOutBuflen, decryptedBodyOutSize));
+    }
+
+// Decode entire secure small frame from raw frame bytes and crypto support,
+// decrypting the body IN PLACE over the ciphertext in the frame buffer.
+// Otherwise as for decodeSecureSmallFrameRaw().
+// Returns the total number of bytes read for the frame
+// (including, and with a value one higher than the first 'fl' bytes).
+// Returns zero in case of error, eg because authentication failed.
+//
+// On success decryptedBodyOut points to the unpadded plaintext body within buf
+// and decryptedBodyOutSize is its length, or NULL and 0 if the frame has no body.
+// On failure the body region of buf may have been altered (and is zeroed where possible).
+//
+// Parameters:
+//  * buf  buffer containing the entire frame including header and trailer; never NULL
+//  * buflen  available length in buf; if too small then this routine will fail (return 0)
+//  * sfh  decoded frame header; never NULL
+//  * d  decryption function, which must allow plaintextOut to be the same as ciphertext; never NULL
+//  * scratch  workspace for d
+//  * key  secret key; never NULL
+//  * iv  12-byte initialisation vector / nonce; never NULL
+//  * decryptedBodyOut  set to point at the plaintext body in buf
+//  * decryptedBodyOutSize  set to the size of the plaintext body
+uint8_t SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRawInPlace(const SecurableFrameHeader *const sfh,
+                                uint8_t *const buf, const uint8_t buflen,
+                                const fixed32BTextSize12BNonce16BTagSimpleDecWithWorkspace_ptr_t d,
+                                const OTV0P2BASE::ScratchSpace &scratch, const uint8_t *const key, const uint8_t *const iv,
+                                const uint8_t *&decryptedBodyOut, uint8_t &decryptedBodyOutSize)
+    {
+    // Ensure that outputs are not left uninitialised in case of error.
+    decryptedBodyOut = NULL;
+    decryptedBodyOutSize = 0;
+
     if((NULL == sfh) || (NULL == buf) || (NULL == d) ||
         (NULL == key) || (NULL == iv)) { return(0); } // ERROR
 
@@ -574,29 +696,44 @@ uint8_t SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRaw(const Secura
     if((0 != bl) && (ENC_BODY_SMALL_FIXED_CTEXT_SIZE != bl)) { return(0); } // ERROR
     // Check that header sequence number lsbs match nonce counter 4 lsbs.
     if(sfh->getSeq() != (iv[11] & 0xf)) { return(0); } // ERROR
-    // Note if plaintext is actually wanted/expected.
-    const bool plaintextWanted = (NULL != decryptedBodyOut);
-    // Attempt to authenticate and decrypt.
-    uint8_t decryptBuf[ENC_BODY_SMALL_FIXED_CTEXT_SIZE];
-    if(!d(state, key, iv, buf, sfh->getHl(),
-                (0 == bl) ? NULL : buf + sfh->getBodyOffset(), buf + fl - 16,
-                decryptBuf)) { return(0); } // ERROR
-    if(plaintextWanted && (0 != bl))
+    // Attempt to authenticate and decrypt in place.
+    // With no ciphertext nothing is written, but plaintextOut must still be non-NULL.
+    uint8_t *const body = (0 == bl) ? NULL : buf + sfh->getBodyOffset();
+    if(!d(scratch.buf, scratch.bufsize, key, iv, buf, sfh->getHl(),
+                body, buf + fl - 16,
+                buf + sfh->getBodyOffset()))
         {
-        // Unpad the decrypted text in place.
-        const uint8_t upbl = removePaddingTo32BTrailing0sAndPadCount(decryptBuf);
+        // Do not leave possibly-unauthenticated plaintext behind.
+        if(NULL != body) { memset(body, 0, ENC_BODY_SMALL_FIXED_CTEXT_SIZE); }
+        return(0); // ERROR
+        }
+    if(0 != bl)
+        {
+        // Unpad the decrypted text, which stays where it is.
+        const uint8_t upbl = removePaddingTo32BTrailing0sAndPadCount(body);
         if(upbl > ENC_BODY_SMALL_FIXED_PTEXT_MAX_SIZE) { return(0); } // ERROR
-        if(upbl > decryptedBodyOutBuflen) { return(0); } // ERROR
-        memcpy(decryptedBodyOut, decryptBuf, upbl);
+        decryptedBodyOut = body;
         decryptedBodyOutSize = upbl;
-        // TODO: optimise later if plaintext not required but ciphertext present.
         }
-    // Ensure that decryptedBodyOutSize is not left initialised even if no frame body RXed/wanted.
-    else { decryptedBodyOutSize = 0; }
     // Done.
     return(fl + 1);
     }
 
+// As for decodeSecureSmallFrameRaw() with a fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t function
+// but using a pre-expanded key context to avoid repeating the key expansion for each frame.
+//  * d  decryption function; never NULL
+//  * keyContext  key context for d built by its matching key-setup function; never NULL
+uint8_t SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRaw(const SecurableFrameHeader *const sfh,
+                                const uint8_t *const buf, const uint8_t buflen,
+                                const fixed32BTextSize12BNonce16BTagSimpleDecWithKeyContext_ptr_t d,
+                                const void *const keyContext, const uint8_t *const iv,
+                                uint8_t *const decryptedBodyOut, const uint8_t decryptedBodyOutBuflen, uint8_t &decryptedBodyOutSize)
+    {
+    if((NULL == d) || (NULL == keyContext)) { return(0); } // ERROR
+    return(decodeSecureSmallFrameRawCommon(sfh, buf, buflen, NULL, NULL, NULL, d, keyContext, iv,
+                                           decryptedBodyOut, decryptedBodyOutBuflen, decryptedBodyOutSize));
+    }
+
 // Pads plain-text in place prior to encryption with 32-byte fixed length padded output.
 // Simple method that allows unpadding at receiver, does padding in place.
 // Padded size is (ENC_BODY_SMALL_FIXED_CTEXT_SIZE) 32, maximum unpadded size is 31.
@@ -647,6 +784,212 @@ bool SimpleSecureFrame32or0BodyRXBase::validateRXMessageCount(const uint8_t *ID,
     return(msgcountercmp(counter, currentCounter) > 0);
     }
 
+// As for decodeSecureSmallFrameRaw() but passed a candidate node/counterparty ID
+// derived from the frame ID in the incoming header.
+// Constructs the IV from the (possibly adjusted) ID and the counter at the start of the trailer.
+uint8_t SimpleSecureFrame32or0BodyRXWithStore::_decodeSecureSmallFrameFromID(const SecurableFrameHeader *const sfh,
+                                const uint8_t *const buf, const uint8_t buflen,
+                                const fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t d,
+                                const uint8_t *const adjID, const uint8_t adjIDLen,
+                                void *const state, const uint8_t *const key,
+                                uint8_t *const decryptedBodyOut, const uint8_t decryptedBodyOutBuflen, uint8_t &decryptedBodyOutSize)
+    {
+    // Rely on decodeSecureSmallFrameRaw() for validation of items not directly needed here.
+    if((NULL == sfh) || (NULL == buf) || (NULL == adjID)) { return(0); } // ERROR
+    if(adjIDLen < 6) { return(0); } // ERROR
+    // Abort if header was not decoded properly.
+    if(sfh->isInvalid()) { return(0); } // ERROR
+    // Abort if expected constraints for simple fixed-size secure frame are not met.
+    if(23 != sfh->getTl()) { return(0); } // ERROR
+    if(sfh->getTrailerOffset() + 6 > buflen) { return(0); } // ERROR
+    // Construct IV from supplied (possibly adjusted) ID + counters from (start of) trailer.
+    uint8_t iv[12];
+    memcpy(iv, adjID, 6);
+    memcpy(iv + 6, buf + sfh->getTrailerOffset(), fullMessageCounterBytes);
+    // Now do actual decrypt/auth.
+    return(decodeSecureSmallFrameRaw(sfh,
+                                buf, buflen,
+                                d,
+                                state, key, iv,
+                                decryptedBodyOut, decryptedBodyOutBuflen, decryptedBodyOutSize));
+    }
+
+// From a structurally correct secure frame, looks up the ID, checks the message counter, decodes, and updates the counter if successful.
+// If firstIDMatchOnly is false then every association matching the header ID prefix
+// is tried in turn until one authenticates the frame.
+uint8_t SimpleSecureFrame32or0BodyRXWithStore::decodeSecureSmallFrameSafely(const SecurableFrameHeader *const sfh,
+                                const uint8_t *const buf, const uint8_t buflen,
+                                const fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t d,
+                                void *const state, const uint8_t *const key,
+                                uint8_t *const decryptedBodyOut, const uint8_t decryptedBodyOutBuflen, uint8_t &decryptedBodyOutSize,
+                                uint8_t *const ID,
+                                const bool firstIDMatchOnly)
+    {
+    // Rely on _decodeSecureSmallFrameFromID() for validation of items not directly needed here.
+    if((NULL == sfh) || (NULL == buf)) { return(0); } // ERROR
+    // Abort if header was not decoded properly.
+    if(sfh->isInvalid()) { return(0); } // ERROR
+    // Abort if trailer not large enough to extract message counter from safely (and not expected size/flavour).
+    if(23 != sfh->getTl()) { return(0); } // ERROR
+    if(sfh->getTrailerOffset() + fullMessageCounterBytes > buflen) { return(0); } // ERROR
+    // Assume counter positioning as for 0x80 type trailer, ie 6 bytes at start of trailer.
+    uint8_t messageCounter[fullMessageCounterBytes];
+    memcpy(messageCounter, buf + sfh->getTrailerOffset(), fullMessageCounterBytes);
+    // Try each candidate sender whose ID matches the header ID prefix.
+    uint8_t senderNodeID[OTV0P2BASE::OpenTRV_Node_ID_Bytes];
+    for(int16_t index = store.getNextMatchingNodeID(0, sfh->id, sfh->getIl(), senderNodeID);
+        index >= 0;
+        index = firstIDMatchOnly ? -1 : store.getNextMatchingNodeID(uint16_t(index + 1), sfh->id, sfh->getIl(), senderNodeID))
+        {
+        // Validate the message counter (that it is higher than previously seen) before the expensive decrypt.
+        if(!validateRXMessageCount(senderNodeID, messageCounter)) { continue; }
+        const uint8_t decodeResult = _decodeSecureSmallFrameFromID(sfh,
+                                                        buf, buflen,
+                                                        d,
+                                                        senderNodeID, OTV0P2BASE::OpenTRV_Node_ID_Bytes,
+                                                        state, key,
+                                                        decryptedBodyOut, decryptedBodyOutBuflen, decryptedBodyOutSize);
+        if(0 == decodeResult) { continue; }
+        // Successfully decoded: update the RX message counter to avoid duplicates/replays.
+        if(!store.updateRXMessageCount(senderNodeID, messageCounter)) { return(0); } // ERROR
+        // Success: copy sender ID to output buffer (if non-NULL) as last action.
+        if(ID != NULL) { memcpy(ID, senderNodeID, OTV0P2BASE::OpenTRV_Node_ID_Bytes); }
+        return(decodeResult);
+        }
+    return(0); // ERROR: no matching sender authenticated the frame.
+    }
+
+// True if the two decoded headers carry the same (possibly partial) sender ID.
+static bool sameHeaderID(const SecurableFrameHeader &a, const SecurableFrameHeader &b)
+    { return((a.getIl() == b.getIl()) && (0 == memcmp(a.id, b.id, a.getIl()))); }
+
+// Remove up to maxFrames frames from the queue and decode those that are secure.
+// Fills results[0..n-1] in queue order, returning n, the number of frames removed.
+// Frames are grouped by header ID so that the association and counter look-up is done once per sender,
+// and the highest authenticated counter for each sender is persisted once.
+uint8_t SimpleSecureFrame32or0BodyRXWithStore::decodeSecureSmallFramesBatch(ISRRXQueue &queue, const uint8_t maxFrames,
+                                const fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t d,
+                                void *const state, const uint8_t *const key,
+                                BatchRXResult *const results)
+    {
+    if(NULL == results) { return(0); } // ERROR
+    // Take frames from the queue, copying each out before it is released, and decode its header.
+    uint8_t n = 0;
+    while(n < maxFrames)
+        {
+        const volatile uint8_t *const pb = queue.peekRXMsg();
+        if(NULL == pb) { break; }
+        BatchRXResult &r = results[n++];
+        const uint8_t len = pb[-1];
+        r.frameLen = (len <= sizeof(r.frame)) ? len : 0;
+        for(uint8_t i = 0; i < r.frameLen; ++i) { r.frame[i] = pb[i]; }
+        queue.removeRXMsg();
+        r.decodeResult = 0;
+        r.bodyLen = 0;
+        r.sfh.checkAndDecodeSmallFrameHeader(r.frame, r.frameLen);
+        }
+    // Bitmap of frames already dealt with: non-secure, malformed, or processed with an earlier sender group.
+    uint8_t done[32];
+    memset(done, 0, sizeof(done));
+    for(uint8_t i = 0; i < n; ++i)
+        {
+        const SecurableFrameHeader &sfh = results[i].sfh;
+        if(sfh.isInvalid() || !sfh.isSecure() || (23 != sfh.getTl())) { done[i >> 3] |= uint8_t(1U << (i & 7)); }
+        }
+    // Each not-yet-done frame starts a new group of frames from the same sender.
+    for(uint8_t i = 0; i < n; ++i)
+        {
+        if(0 != (done[i >> 3] & (1U << (i & 7)))) { continue; }
+        const SecurableFrameHeader &leader = results[i].sfh;
+        // One association and counter look-up for the whole group.
+        uint8_t senderNodeID[OTV0P2BASE::OpenTRV_Node_ID_Bytes];
+        uint8_t lastCounter[fullMessageCounterBytes];
+        const bool known = (store.getNextMatchingNodeID(0, leader.id, leader.getIl(), senderNodeID) >= 0) &&
+                           store.getLastRXMessageCounter(senderNodeID, lastCounter);
+        // Decrypt the group's frames back-to-back in queue order, tracking the counter locally.
+        bool anyOK = false;
+        for(uint8_t j = i; j < n; ++j)
+            {
+            if(0 != (done[j >> 3] & (1U << (j & 7)))) { continue; }
+            BatchRXResult &r = results[j];
+            if(!sameHeaderID(leader, r.sfh)) { continue; }
+            done[j >> 3] |= uint8_t(1U << (j & 7));
+            if(!known) { continue; }
+            if(r.sfh.getTrailerOffset() + fullMessageCounterBytes > r.frameLen) { continue; }
+            const uint8_t *const messageCounter = r.frame + r.sfh.getTrailerOffset();
+            if(msgcountercmp(messageCounter, lastCounter) <= 0) { continue; } // Replay or out of order.
+            r.decodeResult = _decodeSecureSmallFrameFromID(&r.sfh,
+                                                        r.frame, r.frameLen,
+                                                        d,
+                                                        senderNodeID, OTV0P2BASE::OpenTRV_Node_ID_Bytes,
+                                                        state, key,
+                                                        r.body, sizeof(r.body), r.bodyLen);
+            if(0 == r.decodeResult) { continue; }
+            memcpy(lastCounter, messageCounter, fullMessageCounterBytes);
+            memcpy(r.senderID, senderNodeID, OTV0P2BASE::OpenTRV_Node_ID_Bytes);
+            anyOK = true;
+            }
+        // Persist the highest authenticated counter once; on failure none of the group's frames may be acted on.
+        if(anyOK && !store.updateRXMessageCount(senderNodeID, lastCounter))
+            {
+            for(uint8_t j = i; j < n; ++j)
+                { if(sameHeaderID(leader, results[j].sfh)) { results[j].decodeResult = 0; } } // ERROR
+            }
+        }
+    return(n);
+    }
+
+// Get key context for the given key, building it only if not already cached; NULL on failure.
+// Compares the whole key each time (without early exit) to avoid leaking key material by timing.
+const void *SimpleSecureFrame32or0KeyContextCacheBase::getKeyContext(const uint8_t *const key)
+    {
+    if((NULL == key) || (NULL == setup)) { return(NULL); } // ERROR
+    if(valid)
+        {
+        uint8_t diff = 0;
+        for(uint8_t i = 0; i < SimpleSecureFrame32or0BodyBase::keyBytes; ++i) { diff |= uint8_t(key[i] ^ cachedKey[i]); }
+        if(0 == diff) { return(keyContext); }
+        }
+    // Rebuild for the new key, leaving nothing usable behind on failure.
+    invalidate();
+    if(!setup(keyContext, keyContextSize, key)) { invalidate(); return(NULL); } // ERROR
+    memcpy(cachedKey, key, SimpleSecureFrame32or0BodyBase::keyBytes);
+    valid = true;
+    return(keyContext);
+    }
+
+// Discard (and wipe) any cached key and key context.
+void SimpleSecureFrame32or0KeyContextCacheBase::invalidate()
+    {
+    valid = false;
+#ifdef ARDUINO_ARCH_AVR
+    fromPrimaryKey = false;
+#endif
+    memset(cachedKey, 0, sizeof(cachedKey));
+    memset(keyContext, 0, keyContextSize);
+    }
+
+#ifdef ARDUINO_ARCH_AVR
+// Get key context for the primary building key; NULL on failure, eg if no key is set.
+// The key is only re-read from EEPROM (and the context maybe rebuilt)
+// when setPrimaryBuilding16ByteSecretKey() has been called since the last call.
+const void *SimpleSecureFrame32or0KeyContextCacheBase::getPrimaryBuildingKeyContext()
+    {
+    const uint8_t generation = OTV0P2BASE::getPrimaryBuilding16ByteSecretKeyGeneration();
+    if(valid && fromPrimaryKey && (generation == primaryKeyGeneration)) { return(keyContext); }
+    uint8_t key[SimpleSecureFrame32or0BodyBase::keyBytes];
+    const void *result = NULL;
+    if(OTV0P2BASE::getPrimaryBuilding16ByteSecretKey(key)) { result = getKeyContext(key); }
+    else { invalidate(); }
+    // Wipe the temporary copy of the key.
+    memset(key, 0, sizeof(key));
+    if(NULL == result) { return(NULL); } // ERROR
+    fromPrimaryKey = true;
+    primaryKeyGeneration = generation;
+    return(result);
+    }
+#endif // ARDUINO_ARCH_AVR
+
 // NULL basic fixed-size text 'encryption' function.
 // DOES NOT ENCRYPT OR AUTHENTICATE SO DO NOT USE IN PRODUCTION SYSTEMS.
 // Emulates some aspects of the process to test real implementations against,
@@ -695,8 +1038,8 @@ bool fixed32BTextSize12BNonce16BTagSimpleDec_NULL_IMPL(void *const /*state*/,
        (NULL == plaintextOut)) { return(false); } // ERROR
     // Verify that the first and last bytes of the tag look correct.
     if((tag[0] != iv[0]) || (0 != tag[15])) { return(false); } // ERROR
-    // Copy the ciphertext to the plaintext.
-    if(NULL != ciphertext) { memcpy(plaintextOut, ciphertext, 32); }
+    // Copy the ciphertext to the plaintext (unless decrypting in place).
+    if((NULL != ciphertext) && (ciphertext != plaintextOut)) { memcpy(plaintextOut, ciphertext, 32); }
     // Done.
     return(true);
     }
@@ -843,4 +1186,64 @@ uint8_t SimpleSecureFrame32or0BodyTXBase::generateSecureOFrameRawForTX(uint8_t *
 return(false); // FIXME
     }
 
+// Create simple 'O' (FTS_BasicSensorOrValve) frame with a compact binary stats section for transmission.
+// As the JSON stats version, but with body flag 0x20 and the compact stats copied as-is.
+//  * statsCompact  compact binary stats, or NULL if none
+//  * statsCompactLen  length of statsCompact; at most MSG_COMPACT_STATS_MAX_LENGTH_SECURE
+// NOTE: THIS API IS LIABLE TO CHANGE
+uint8_t SimpleSecureFrame32or0BodyTXBase::generateSecureOFrameRawForTX(uint8_t *const buf, const uint8_t buflen,
+                                const uint8_t il_,
+                                const uint8_t valvePC,
+                                const uint8_t *const statsCompact, const uint8_t statsCompactLen,
+                                const fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t e,
+                                void *const state, const uint8_t *const key)
+    {
+    static_assert(OTV0P2BASE::MSG_COMPACT_STATS_MAX_LENGTH_SECURE + 2 == ENC_BODY_SMALL_FIXED_PTEXT_MAX_SIZE, "compact stats size wrong");
+    uint8_t iv[12];
+    if(!compute12ByteIDAndCounterIVForTX(iv)) { return(0); }
+    const bool hasStats = (NULL != statsCompact) && (0 != statsCompactLen);
+    if(hasStats && (statsCompactLen > OTV0P2BASE::MSG_COMPACT_STATS_MAX_LENGTH_SECURE)) { return(0); } // ERROR
+    uint8_t bbuf[ENC_BODY_SMALL_FIXED_PTEXT_MAX_SIZE];
+    bbuf[0] = (valvePC <= 100) ? valvePC : 0x7f;
+    bbuf[1] = hasStats ? 0x20 : 0; // Indicate presence of compact stats.
+    if(hasStats) { memcpy(bbuf + 2, statsCompact, statsCompactLen); }
+    const uint8_t *ID = iv; // First 6 bytes of IV is the ID.
+    if(il_ > 6) { return(0); } // ERROR: cannot supply that much of ID easily.
+    return(encodeSecureSmallFrameRaw(buf, buflen,
+                                    OTRadioLink::FTS_BasicSensorOrValve,
+                                    ID, il_,
+                                    bbuf, (hasStats ? 2+statsCompactLen : 2),
+                                    iv, e, state, key));
+    }
+
+// Create simple 'O' (FTS_BasicSensorOrValve) frame with a compact binary stats section for transmission.
+// As the JSON stats version, but with body flag 0x20 and the compact stats copied as-is.
+// NOTE: THIS API IS LIABLE TO CHANGE
+uint8_t SimpleSecureFrame32or0BodyTXBase::generateSecureOFrameRawForTX(uint8_t *const buf, const uint8_t buflen,
+                                const uint8_t il_,
+                                const uint8_t valvePC,
+                                const uint8_t *const statsCompact, const uint8_t statsCompactLen,
+                                const fixed32BTextSize12BNonce16BTagSimpleEncWithWorkspace_ptr_t e,
+                                const OTV0P2BASE::ScratchSpace &scratch, const uint8_t *const key)
+    {
+    constexpr uint8_t IV_size = 12;
+    if(scratch.bufsize < generateSecureOFrameRawForTX_total_scratch_usage_OTAESGCM_2p0) { return(0); } // ERROR
+    uint8_t *const iv = scratch.buf; // uint8_t iv[IV_size];
+    if(!compute12ByteIDAndCounterIVForTX(iv)) { return(0); }
+    const bool hasStats = (NULL != statsCompact) && (0 != statsCompactLen);
+    if(hasStats && (statsCompactLen > OTV0P2BASE::MSG_COMPACT_STATS_MAX_LENGTH_SECURE)) { return(0); } // ERROR
+    uint8_t *const bbuf = scratch.buf + IV_size; // uint8_t bbuf[ENC_BODY_SMALL_FIXED_PTEXT_MAX_SIZE];
+    bbuf[0] = (valvePC <= 100) ? valvePC : 0x7f;
+    bbuf[1] = hasStats ? 0x20 : 0; // Indicate presence of compact stats.
+    if(hasStats) { memcpy(bbuf + 2, statsCompact, statsCompactLen); }
+    const OTV0P2BASE::ScratchSpace subscratch(scratch, generateSecureOFrameRawForTX_scratch_usage);
+    const uint8_t *ID = iv; // First 6 bytes of IV is the ID.
+    if(il_ > 6) { return(0); } // ERROR: cannot supply that much of ID easily.
+    return(encodeSecureSmallFrameRawPadInPlace(buf, buflen,
+                                    OTRadioLink::FTS_BasicSensorOrValve,
+                                    ID, il_,
+                                    bbuf, (hasStats ? 2+statsCompactLen : 2), // Note: callee will pad beyond this.
+                                    iv, e, subscratch, key));
+    }
+
 }
@@ -35,6 +35,8 @@ namespace OTRadioLink
     {
 
 
+    class ISRRXQueue;
+
     // Secureable (V0p2) messages.
     //
     // Based on 2015Q4 spec and successors:
@@ -358,6 +360,20 @@ namespace OTRadioLink
             // Add specified small unsigned value to supplied counter value in place; false if failed.
             // This will fail (returning false) if the counter would overflow, leaving it unchanged.
             static bool msgcounteradd(uint8_t *counter, uint8_t delta);
+
+            // Size of secret key for the fixed32BTextSize12BNonce16BTag enc/dec functions.
+            static constexpr uint8_t keyBytes = 16;
+
+            // Signature of pointer to function that pre-expands a secret key into an opaque key context
+            // for the fixed32BTextSize12BNonce16BTagSimple...WithKeyContext enc/dec functions.
+            // For AES-128-GCM the context might hold the round keys and the GHASH subkey and tables,
+            // so that that work is done once per key rather than once per frame.
+            // The context holds key material and should be wiped when no longer needed.
+            // This routine will fail (safely, returning false) if keyContextSize is too small.
+            // Returns true on success, false on failure.
+            typedef bool (*fixed32BTextSize12BNonce16BTagSimpleKeySetup_ptr_t)(
+                    void *keyContext, uint16_t keyContextSize,
+                    const uint8_t *key);
         };
 
     // TX Base class for simple implementations that supports 0 or 32 byte encrypted body sections.
@@ -464,6 +480,32 @@ namespace OTRadioLink
                                             fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t e,
                                             void *state, const uint8_t *key);
 
+            // Signature of pointer to basic fixed-size text encryption/authentication function
+            // using a key context pre-expanded by a fixed32BTextSize12BNonce16BTagSimpleKeySetup_ptr_t function.
+            // Otherwise as for fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t.
+            // Returns true on success, false on failure.
+            typedef bool (*fixed32BTextSize12BNonce16BTagSimpleEncWithKeyContext_ptr_t)(
+                    const void *keyContext,
+                    const uint8_t *iv,
+                    const uint8_t *authtext, uint8_t authtextSize,
+                    const uint8_t *plaintext,
+                    uint8_t *ciphertextOut, uint8_t *tagOut);
+
+            // As for encodeSecureSmallFrameRaw() with a fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t function
+            // but using a pre-expanded key context, eg from SimpleSecureFrame32or0KeyContextCache,
+            // to avoid repeating the key expansion for each frame.
+            //
+            // Parameters (others as for encodeSecureSmallFrameRaw()):
+            //  * e  encryption function; never NULL
+            //  * keyContext  key context for e built by its matching key-setup function; never NULL
+            static uint8_t encodeSecureSmallFrameRaw(uint8_t *buf, uint8_t buflen,
+                                            FrameType_Secureable fType_,
+                                            const uint8_t *id_, uint8_t il_,
+                                            const uint8_t *body, uint8_t bl_,
+                                            const uint8_t *iv,
+                                            fixed32BTextSize12BNonce16BTagSimpleEncWithKeyContext_ptr_t e,
+                                            const void *keyContext);
+
             // Encode entire secure small frame from header params and body and crypto support.
             // Buffer for body must be large enough to allow padding to be applied IN PLACE.
             // This is a raw/partial impl that requires the IV/nonce to be supplied.
@@ -649,6 +691,26 @@ namespace OTRadioLink
                                             const char *statsJSON,
                                             fixed32BTextSize12BNonce16BTagSimpleEncWithWorkspace_ptr_t e,
                                             const OTV0P2BASE::ScratchSpace &scratch, const uint8_t *key);
+
+            // Create simple 'O' (FTS_BasicSensorOrValve) frame with a compact binary stats section for transmission.
+            // As generateSecureOFrameRawForTX() with JSON stats,
+            // but the body flag byte is 0x20 (rather than 0x10) and is followed by the stats
+            // as from SimpleStatsRotationBase::writeCompact(), which can carry more stats in the same space.
+            //  * statsCompact  compact binary stats, or NULL if none
+            //  * statsCompactLen  length of statsCompact; at most MSG_COMPACT_STATS_MAX_LENGTH_SECURE
+            // NOTE: THIS API IS LIABLE TO CHANGE
+            uint8_t generateSecureOFrameRawForTX(uint8_t *buf, uint8_t buflen,
+                                            uint8_t il_,
+                                            uint8_t valvePC,
+                                            const uint8_t *statsCompact, uint8_t statsCompactLen,
+                                            fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t e,
+                                            void *state, const uint8_t *key);
+            uint8_t generateSecureOFrameRawForTX(uint8_t *buf, uint8_t buflen,
+                                            uint8_t il_,
+                                            uint8_t valvePC,
+                                            const uint8_t *statsCompact, uint8_t statsCompactLen,
+                                            fixed32BTextSize12BNonce16BTagSimpleEncWithWorkspace_ptr_t e,
+                                            const OTV0P2BASE::ScratchSpace &scratch, const uint8_t *key);
         };
 
     // RX Base class for simple implementations that supports 0 or 32 byte encrypted body sections.
@@ -768,6 +830,67 @@ namespace OTRadioLink
                                             void *state, const uint8_t *key, const uint8_t *iv,
                                             uint8_t *decryptedBodyOut, uint8_t decryptedBodyOutBuflen, uint8_t &decryptedBodyOutSize);
 
+            // Decode entire secure small frame from raw frame bytes and crypto support,
+            // decrypting the body IN PLACE over the ciphertext in the frame buffer.
+            // Avoids a separate plaintext output buffer and the internal 32-byte decryption buffer.
+            // The frame may be decoded directly in its RX queue slot, eg via ISRRXQueue1Deep::peekRXMsgMutable(),
+            // so that it need not be copied out of the queue first.
+            // Otherwise as for decodeSecureSmallFrameRaw().
+            // Returns the total number of bytes read for the frame
+            // (including, and with a value one higher than the first 'fl' bytes).
+            // Returns zero in case of error, eg because authentication failed.
+            //
+            // On success decryptedBodyOut points to the unpadded plaintext body within buf
+            // (at the header's getBodyOffset()) and decryptedBodyOutSize is its length,
+            // or NULL and 0 if the frame has no body.
+            // On failure the body region of buf may have been altered (and is zeroed where possible),
+            // so the frame must not be decoded again or otherwise used.
+            // The header and trailer (including the tag) are not altered.
+            //
+            // Parameters:
+            //  * buf  buffer containing the entire frame including header and trailer; never NULL
+            //  * buflen  available length in buf; if too small then this routine will fail (return 0)
+            //  * sfh  decoded frame header; never NULL
+            //  * d  decryption function, which must allow plaintextOut to be the same as ciphertext; never NULL
+            //  * scratch  workspace for d
+            //  * key  secret key; never NULL
+            //  * iv  12-byte initialisation vector / nonce; never NULL
+            //  * decryptedBodyOut  set to point at the plaintext body in buf
+            //  * decryptedBodyOutSize  set to the size of the plaintext body
+            static constexpr uint8_t decodeSecureSmallFrameRawInPlace_scratch_usage = 0;
+            static constexpr uint8_t decodeSecureSmallFrameRawInPlace_total_scratch_usage_OTAESGCM_2p0 =
+                    workspaceRequred_GCM32B16BWithWorkspace_OTAESGCM_2p0
+                    + decodeSecureSmallFrameRawInPlace_scratch_usage;
+            static uint8_t decodeSecureSmallFrameRawInPlace(const SecurableFrameHeader *sfh,
+                                            uint8_t *buf, uint8_t buflen,
+                                            fixed32BTextSize12BNonce16BTagSimpleDecWithWorkspace_ptr_t d,
+                                            const OTV0P2BASE::ScratchSpace &scratch, const uint8_t *key, const uint8_t *iv,
+                                            const uint8_t *&decryptedBodyOut, uint8_t &decryptedBodyOutSize);
+
+            // Signature of pointer to basic fixed-size text decryption/authentication function
+            // using a key context pre-expanded by a fixed32BTextSize12BNonce16BTagSimpleKeySetup_ptr_t function.
+            // Otherwise as for fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t.
+            // Returns true on success, false on failure.
+            typedef bool (*fixed32BTextSize12BNonce16BTagSimpleDecWithKeyContext_ptr_t)(
+                    const void *keyContext,
+                    const uint8_t *iv,
+                    const uint8_t *authtext, uint8_t authtextSize,
+                    const uint8_t *ciphertext, const uint8_t *tag,
+                    uint8_t *plaintextOut);
+
+            // As for decodeSecureSmallFrameRaw() with a fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t function
+            // but using a pre-expanded key context, eg from SimpleSecureFrame32or0KeyContextCache,
+            // to avoid repeating the key expansion for each frame.
+            //
+            // Parameters (others as for decodeSecureSmallFrameRaw()):
+            //  * d  decryption function; never NULL
+            //  * keyContext  key context for d built by its matching key-setup function; never NULL
+            static uint8_t decodeSecureSmallFrameRaw(const SecurableFrameHeader *sfh,
+                                            const uint8_t *buf, uint8_t buflen,
+                                            fixed32BTextSize12BNonce16BTagSimpleDecWithKeyContext_ptr_t d,
+                                            const void *keyContext, const uint8_t *iv,
+                                            uint8_t *decryptedBodyOut, uint8_t decryptedBodyOutBuflen, uint8_t &decryptedBodyOutSize);
+
             // Design notes on use of message counters vs non-volatile storage life, eg for ATMega328P.
             //
             // Note that the message counter is designed to:
@@ -861,6 +984,192 @@ namespace OTRadioLink
                                             bool firstIDMatchOnly = true) = 0;
         };
 
+    // Cache of a pre-expanded key context for the ...WithKeyContext enc/dec functions,
+    // so that key expansion is done once per key rather than once per frame,
+    // eg on a hub where all frames use the primary building key.
+    // Keeps a copy of the key from which the context was built,
+    // and rebuilds the context whenever a different key is supplied.
+    // The cached key and context are wiped by invalidate().
+    // Not thread-/ISR- safe.
+    class SimpleSecureFrame32or0KeyContextCacheBase
+        {
+        private:
+            // Key context buffer and its size.
+            void * const keyContext;
+            const uint16_t keyContextSize;
+            // Function to build the key context from a key; never NULL.
+            const SimpleSecureFrame32or0BodyBase::fixed32BTextSize12BNonce16BTagSimpleKeySetup_ptr_t setup;
+            // Key from which keyContext was built; valid iff valid is true.
+            uint8_t cachedKey[SimpleSecureFrame32or0BodyBase::keyBytes];
+            // True if keyContext and cachedKey are valid.
+            bool valid;
+#ifdef ARDUINO_ARCH_AVR
+            // True if built from the primary building key, at generation primaryKeyGeneration.
+            bool fromPrimaryKey;
+            uint8_t primaryKeyGeneration;
+#endif
+
+        protected:
+            SimpleSecureFrame32or0KeyContextCacheBase(void *const _keyContext, const uint16_t _keyContextSize,
+                    const SimpleSecureFrame32or0BodyBase::fixed32BTextSize12BNonce16BTagSimpleKeySetup_ptr_t _setup)
+              : keyContext(_keyContext), keyContextSize(_keyContextSize), setup(_setup), valid(false)
+#ifdef ARDUINO_ARCH_AVR
+                , fromPrimaryKey(false), primaryKeyGeneration(0)
+#endif
+                { }
+
+        public:
+            // Get key context for the given key, building it only if not already cached; NULL on failure.
+            // Compares the whole key each time (without early exit) to avoid leaking key material by timing.
+            // The result is valid until the next call to any method of this instance.
+            const void *getKeyContext(const uint8_t *key);
+
+            // Discard (and wipe) any cached key and key context.
+            void invalidate();
+
+#ifdef ARDUINO_ARCH_AVR
+            // Get key context for the primary building key; NULL on failure, eg if no key is set.
+            // The key is only re-read from EEPROM (and the context maybe rebuilt)
+            // when setPrimaryBuilding16ByteSecretKey() has been called since the last call.
+            // The result is valid until the next call to any method of this instance.
+            const void *getPrimaryBuildingKeyContext();
+#endif
+        };
+
+    // Cache with space for a key context of up to KeyContextSize bytes,
+    // as required by the enc/dec functions in use.
+    template<uint16_t KeyContextSize>
+    class SimpleSecureFrame32or0KeyContextCache final : public SimpleSecureFrame32or0KeyContextCacheBase
+        {
+        private:
+            // Aligned to allow implementations to use wider types internally.
+            alignas(8) uint8_t kc[KeyContextSize];
+        public:
+            explicit SimpleSecureFrame32or0KeyContextCache(const SimpleSecureFrame32or0BodyBase::fixed32BTextSize12BNonce16BTagSimpleKeySetup_ptr_t _setup)
+              : SimpleSecureFrame32or0KeyContextCacheBase(kc, KeyContextSize, _setup) { }
+        };
+
+    // Store of node associations and their last-authenticated RX message counters
+    // for the secure RX path.
+    // Abstracts the backing store so that the number of nodes
+    // that can be securely received from is not fixed by
+    // the V0p2 EEPROM table (V0P2BASE_EE_NODE_ASSOCIATIONS_MAX_SETS),
+    // eg so that a more powerful concentrator can serve thousands of leaves.
+    // Association indexes are dense starting from 0, in order of association.
+    //
+    // With all of these routines it is important to check and act on error codes,
+    // usually aborting immediately if an error value is returned.
+    // MUDDLING ON WITHOUT CHECKING FOR ERRORS MAY SEVERELY DAMAGE SYSTEM SECURITY.
+    class NodeAssociationStoreBase
+        {
+        public:
+            // Returns the lowest association index >= startIndex whose ID matches the prefix, else -1.
+            // As for OTV0P2BASE::getNextMatchingNodeID() but allowing more associations.
+            //   * prefix  prefix to match; can be NULL iff prefixLen == 0
+            //   * prefixLen  length of prefix, [0,8] bytes
+            //   * nodeID  if not NULL filled with the full matching ID; NOT PRESERVED WHEN RETURNING -1
+            virtual int16_t getNextMatchingNodeID(uint16_t startIndex, const uint8_t *prefix, uint8_t prefixLen, uint8_t *nodeID) const = 0;
+            // Read current (last-authenticated) RX message count for specified node, or return false if failed.
+            // Will fail for invalid (eg unassociated) node ID or for unrecoverable memory corruption.
+            // Both args must be non-NULL, with counter pointing to enough space to copy the message counter value to.
+            virtual bool getLastRXMessageCounter(const uint8_t *ID, uint8_t *counter) const = 0;
+            // Persist new message counter for an associated node; returns false on failure.
+            // ID is full (8-byte) node ID; counter is full (6-byte) counter.
+            // Must refuse (return false) if the new value is not higher than the current one.
+            // Must only be called once the RXed message has passed authentication.
+            virtual bool updateRXMessageCount(const uint8_t *ID, const uint8_t *newCounterValue) = 0;
+        };
+
+    // Portable RX implementation for 0 or 32 byte encrypted body sections
+    // that keeps node associations and RX message counters in a supplied store.
+    // The store must outlive this instance.
+    //
+    // With all of these routines it is important to check and act on error codes,
+    // usually aborting immediately if an error value is returned.
+    // MUDDLING ON WITHOUT CHECKING FOR ERRORS MAY SEVERELY DAMAGE SYSTEM SECURITY.
+    class SimpleSecureFrame32or0BodyRXWithStore final : public SimpleSecureFrame32or0BodyRXBase
+        {
+        private:
+            // Association and counter store; never NULL.
+            NodeAssociationStoreBase &store;
+
+        public:
+            explicit SimpleSecureFrame32or0BodyRXWithStore(NodeAssociationStoreBase &_store) : store(_store) { }
+
+            // Read current (last-authenticated) RX message count for specified node, or return false if failed.
+            virtual bool getLastRXMessageCounter(const uint8_t * const ID, uint8_t *counter) const override
+                { return((NULL != ID) && store.getLastRXMessageCounter(ID, counter)); }
+            // Update persistent message counter for received frame AFTER successful authentication.
+            // Returns false on failure, eg if message counter is not higher than the previous value for this node.
+            virtual bool updateRXMessageCountAfterAuthentication(const uint8_t *ID, const uint8_t *newCounterValue) override
+                { return(validateRXMessageCount(ID, newCounterValue) && store.updateRXMessageCount(ID, newCounterValue)); }
+
+            // As for decodeSecureSmallFrameRaw() but passed a candidate node/counterparty ID
+            // derived from the frame ID in the incoming header.
+            // See SimpleSecureFrame32or0BodyRXBase.
+            virtual uint8_t _decodeSecureSmallFrameFromID(const SecurableFrameHeader *sfh,
+                                            const uint8_t *buf, uint8_t buflen,
+                                            fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t d,
+                                            const uint8_t *adjID, uint8_t adjIDLen,
+                                            void *state, const uint8_t *key,
+                                            uint8_t *decryptedBodyOut, uint8_t decryptedBodyOutBuflen, uint8_t &decryptedBodyOutSize) override;
+
+            // From a structurally correct secure frame, looks up the ID, checks the message counter, decodes, and updates the counter if successful.
+            // See SimpleSecureFrame32or0BodyRXBase.
+            // If firstIDMatchOnly is false then every association matching the header ID prefix
+            // is tried in turn until one authenticates the frame.
+            virtual uint8_t decodeSecureSmallFrameSafely(const SecurableFrameHeader *sfh,
+                                            const uint8_t *buf, uint8_t buflen,
+                                            fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t d,
+                                            void *state, const uint8_t *key,
+                                            uint8_t *decryptedBodyOut, uint8_t decryptedBodyOutBuflen, uint8_t &decryptedBodyOutSize,
+                                            uint8_t *ID,
+                                            bool firstIDMatchOnly = true) override;
+
+            // Per-frame result of decodeSecureSmallFramesBatch(), in queue order.
+            struct BatchRXResult final
+                {
+                // Copy of the raw frame as taken from the queue, starting with the fl byte.
+                uint8_t frame[SecurableFrameHeader::maxSmallFrameSize + 1];
+                // Length of the raw frame as queued; 0 if absent/empty or too long to copy.
+                uint8_t frameLen;
+                // Decoded header; invalid if frame is not a structurally-valid small frame.
+                SecurableFrameHeader sfh;
+                // As returned by decodeSecureSmallFrameSafely(): frame bytes decoded, or 0 on failure.
+                uint8_t decodeResult;
+                // Decrypted body and its length; valid only if decodeResult is non-zero.
+                uint8_t body[ENC_BODY_SMALL_FIXED_PTEXT_MAX_SIZE];
+                uint8_t bodyLen;
+                // Full ID of the authenticated sender; valid only if decodeResult is non-zero.
+                uint8_t senderID[OTV0P2BASE::OpenTRV_Node_ID_Bytes];
+                };
+
+            // Remove up to maxFrames frames from the queue and decode those that are secure.
+            // Fills results[0..n-1] in queue order, returning n, the number of frames removed.
+            // Works as for decodeSecureSmallFrameSafely() with firstIDMatchOnly true
+            // applied to each frame, but with all headers decoded first,
+            // frames grouped by header ID so that the association and counter look-up
+            // is done once per sender, and the decryption calls run back-to-back.
+            // Within each sender frames are processed in queue order,
+            // so a replay or out-of-order (lower) counter in the batch is rejected as usual.
+            // The highest authenticated counter for each sender is persisted once per sender;
+            // if that fails then all that sender's frames in the batch are marked as failed.
+            // Non-secure and malformed frames are removed and returned with decodeResult 0,
+            // so the caller may handle them by other means from the copied frame.
+            //
+            // Parameters:
+            //  * queue  RX queue to take frames from
+            //  * maxFrames  maximum number of frames to take; results must have at least this many entries
+            //  * d  decryption function; never NULL
+            //  * state  pointer to state for d, if required, else NULL
+            //  * key  secret key; never NULL
+            //  * results  per-frame results; never NULL
+            uint8_t decodeSecureSmallFramesBatch(ISRRXQueue &queue, uint8_t maxFrames,
+                                            fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t d,
+                                            void *state, const uint8_t *key,
+                                            BatchRXResult *results);
+        };
+
 
     // NULL basic fixed-size text 'encryption' function FOR TEST ONLY.
     // DOES NOT ENCRYPT OR AUTHENTICATE SO DO NOT USE IN PRODUCTION SYSTEMS.
@@ -887,6 +1196,7 @@ namespace OTRadioLink
     // Does not use state so that pointer may be NULL but all others must be non-NULL except ciphertext.
     // Undoes/checks fixed32BTextSize12BNonce16BTagSimpleEnc_NULL_IMPL().
     // Copies the ciphertext to the plaintext, unless ciphertext is NULL.
+    // The plaintext may be the same buffer as the ciphertext, ie for in-place decryption.
     // Verifies that the tag seems to have been constructed appropriately.
     bool fixed32BTextSize12BNonce16BTagSimpleDec_NULL_IMPL(void *state,
             const uint8_t *key, const uint8_t *iv,
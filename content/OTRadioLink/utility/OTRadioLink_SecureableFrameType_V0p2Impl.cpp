@@ -59,6 +59,14 @@ SimpleSecureFrame32or0BodyRXV0p2 &SimpleSecureFrame32or0BodyRXV0p2::getInstance(
     return(instance);
     }
 
+// Factory method to get singleton EEPROM-backed node association store.
+NodeAssociationStoreV0p2EEPROM &NodeAssociationStoreV0p2EEPROM::getInstance()
+    {
+    // Lazily create/initialise singleton on first use, NOT statically.
+    static NodeAssociationStoreV0p2EEPROM instance;
+    return(instance);
+    }
+
 // Load the raw form of the persistent reboot/restart message counter from EEPROM into the supplied array.
 // Deals with inversion, but does not interpret the data or check CRCs etc.
 // Separates the EEPROM access from the data interpretation to simplify unit testing.
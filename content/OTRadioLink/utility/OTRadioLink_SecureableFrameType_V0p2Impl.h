@@ -331,6 +331,32 @@ namespace OTRadioLink
                                             bool firstIDMatchOnly = true);
         };
 
+    // V0p2 node association store backed by the EEPROM association table,
+    // for use with SimpleSecureFrame32or0BodyRXWithStore.
+    // Limited to V0P2BASE_EE_NODE_ASSOCIATIONS_MAX_SETS associations.
+    // Uses the same storage and counter format as SimpleSecureFrame32or0BodyRXV0p2.
+#define NodeAssociationStoreV0p2EEPROM_DEFINED
+    class NodeAssociationStoreV0p2EEPROM final : public NodeAssociationStoreBase
+        {
+        private:
+            // Constructor is private to force use of factory method to return singleton.
+            constexpr NodeAssociationStoreV0p2EEPROM() { }
+
+        public:
+            // Factory method to get singleton instance.
+            static NodeAssociationStoreV0p2EEPROM &getInstance();
+
+            virtual int16_t getNextMatchingNodeID(const uint16_t startIndex, const uint8_t *const prefix, const uint8_t prefixLen, uint8_t *const nodeID) const override
+                {
+                if(startIndex >= OTV0P2BASE::V0P2BASE_EE_NODE_ASSOCIATIONS_MAX_SETS) { return(-1); }
+                return(OTV0P2BASE::getNextMatchingNodeID(uint8_t(startIndex), prefix, prefixLen, nodeID));
+                }
+            virtual bool getLastRXMessageCounter(const uint8_t *const ID, uint8_t *const counter) const override
+                { return(SimpleSecureFrame32or0BodyRXV0p2::getInstance().getLastRXMessageCounter(ID, counter)); }
+            virtual bool updateRXMessageCount(const uint8_t *const ID, const uint8_t *const newCounterValue) override
+                { return(SimpleSecureFrame32or0BodyRXV0p2::getInstance().updateRXMessageCountAfterAuthentication(ID, newCounterValue)); }
+        };
+
 #endif // ARDUINO_ARCH_AVR
 
 
@@ -47,5 +47,13 @@ V0p2_SIM900_AT_DEFN(AT_CLOSE_UDP, "+CIPCLOSE");
 V0p2_SIM900_AT_DEFN(AT_SHUT_GPRS, "+CIPSHUT");
 V0p2_SIM900_AT_DEFN(AT_VERBOSE_ERRORS, "+CMEE");
 
+const char OTSIM900LinkBase::ATR_OK[] = "OK";
+const char OTSIM900LinkBase::ATR_ERROR[] = "ERROR";
+const char OTSIM900LinkBase::ATR_FAIL[] = "FAIL";
+const char OTSIM900LinkBase::ATR_IP[] = "."; // In the IP address.
+const char OTSIM900LinkBase::ATR_STATE[] = "STATE: ";
+const char OTSIM900LinkBase::ATR_PROMPT[] = ">";
+const char OTSIM900LinkBase::ATR_SEND_OK[] = "SEND OK";
+
 
 } // OTSIM900Link
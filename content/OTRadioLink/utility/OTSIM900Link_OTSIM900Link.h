@@ -38,6 +38,7 @@
 
 #include <OTRadioLink.h>
 #include <OTV0p2Base.h>
+#include "OTRadioLink_ATCommandEngine.h"
 #include <string.h>
 #include <stdint.h>
 
@@ -198,6 +199,16 @@ typedef const char *AT_t;
             static AT_t AT_SHUT_GPRS;
             static AT_t AT_VERBOSE_ERRORS;
 
+            typedef ::OTRadioLink::ATCommandEngine ATCommandEngine;
+            // Reply tokens, in RAM for ATCommandEngine.
+            static const char ATR_OK[];
+            static const char ATR_ERROR[];
+            static const char ATR_FAIL[];
+            static const char ATR_IP[];
+            static const char ATR_STATE[];
+            static const char ATR_PROMPT[];
+            static const char ATR_SEND_OK[];
+
             // Single characters.
             const char ATc_GET_MODULE = 'I';
             const char ATc_SET = '=';
@@ -206,10 +217,49 @@ typedef const char *AT_t;
         public:
             // Max reliable baud to talk to SIM900 over OTSoftSerial2.
             constexpr static const uint16_t SIM900_MAX_baud = 9600;
+            // Max bytes sent in one UDP datagram (AT+CIPSEND); conservative for the SIM900.
+            constexpr static const uint16_t SIM900_MAX_UDP_SEND = 1024;
+            // Max length of a single queued TX frame.
+            constexpr static const uint8_t MAX_TX_FRAME_LEN = 64;
+            // Default max bytes written as datagram payload per poll() when coalescing.
+            // About 130ms at SIM900_MAX_baud.
+            constexpr static const uint16_t DEFAULT_TX_BUDGET_PER_POLL = 128;
+            // Max time in ms for writing one datagram, so that a send started
+            // near the start of the major cycle does not overrun into the rest of it.
+            constexpr static const uint16_t MAX_TX_WRITE_ms = 200;
+            // Upper limit for setTXBudget(): what SIM900_MAX_baud (10 bits per byte) can write in MAX_TX_WRITE_ms.
+            constexpr static const uint16_t MAX_TX_BUDGET_PER_POLL = uint16_t((uint32_t(SIM900_MAX_baud) / 10 * MAX_TX_WRITE_ms) / 1000);
+            static_assert(MAX_TX_BUDGET_PER_POLL > MAX_TX_FRAME_LEN, "must be able to send one maximum-length frame and its length");
+            static_assert(MAX_TX_BUDGET_PER_POLL >= DEFAULT_TX_BUDGET_PER_POLL, "default TX budget too long");
+            static_assert(MAX_TX_BUDGET_PER_POLL <= SIM900_MAX_UDP_SEND, "TX budget limit too big for one datagram");
         };
 
     /**
      * @note    To enable serial debug define 'OTSIM900LINK_DEBUG'
+     * @note    Up to txQueueFrames frames are held for TX;
+     *          when full the oldest queued frame is dropped in favour of the newest.
+     *          The default of 1 keeps only the freshest frame.
+     * @note    With coalescing enabled (setTXCoalescing())
+     *          each datagram carries as many of the oldest queued frames as fit
+     *          within the per-poll TX budget (setTXBudget()),
+     *          each frame preceded by a single length byte.
+     *          Otherwise each frame is sent as a datagram on its own, one per poll().
+     * @note    By default the SIM900 is restarted every 255 datagrams
+     *          and the UDP status is checked before sending each burst of queued frames.
+     *          In persistent-session mode (setPersistentSession())
+     *          the session is kept up until a failure is seen,
+     *          and the UDP status is only checked when the last good status or send
+     *          is more than udpStatusCacheDuration seconds old.
+     *          Only in persistent-session mode is the reply to each datagram
+     *          (SEND OK, ERROR or SEND FAIL) collected, without blocking, before the next is sent,
+     *          so that a failed send can be acted on;
+     *          by default each datagram is written and forgotten, as before.
+     * @note    AT commands are run by an OTRadioLink::ATCommandEngine.
+     *          With a buffered or interrupt-driven ser_t poll() returns while waiting for slow replies
+     *          (eg from AT+CIICR, AT+CIPSTART and AT+CIPSEND)
+     *          and carries on with them at the next call.
+     *          With an unbuffered ser_t (eg the default OTSoftSerial2) replies must be read as they arrive,
+     *          so poll() blocks for them as before, except for AT+CIICR (see gprsTimeOut).
      * @todo    SIM900 has a low power state which stays connected to network
      *             - Not sure how much power reduced
      *             - If not sending often may be more efficient to power up and wait for connect each time
@@ -221,9 +271,12 @@ typedef const char *AT_t;
 #ifdef OTSoftSerial2_DEFINED
         = OTV0P2BASE::OTSoftSerial2<rxPin, txPin, OTSIM900LinkBase::SIM900_MAX_baud>
 #endif
+    , uint8_t txQueueFrames = 1 // Max frames queued for TX; strictly positive.
     >
     class OTSIM900Link final : public OTSIM900LinkBase
         {
+            static_assert(txQueueFrames > 0, "must be able to queue at least one TX frame");
+
             // Maximum number of significant chars in the SIM900 response.
             // Minimising this reduces stack and/or global space pressures.
             static constexpr int MAX_SIM900_RESPONSE_CHARS = 64;
@@ -297,16 +350,27 @@ typedef const char *AT_t;
              * @param   buflen  length of buffer to send
              * @param   channel ignored
              * @param   Txpower ignored
-             * @retval  returns true if send process inited.
-             * @note    requires calling of poll() to check if message sent successfully
+             * @retval  returns true if the SIM900 reports the frame sent.
+             * @note    Blocks until sent or timed out, unlike queueToSend() and poll().
+             *          Returns false at once if poll() has an AT command in progress.
              */
             virtual bool sendRaw(const uint8_t *buf, uint8_t buflen,
                     int8_t /*channel*/ = 0, TXpower /*power*/ = TXnormal,
                     bool /*listenAfter*/ = false) override
                 {
-                bool bSent = false;
                 OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("Send Raw")
-                bSent = UDPSend((const char *) buf, buflen);
+                if (at.isBusy() || (0 != txSendFrames)) return false;
+                txSendLen = buflen;
+                atCmd = ATC_SEND_PROMPT;
+                startAT(ATC_SEND_PROMPT);
+                bool bSent = false;
+                if (ATCommandEngine::AT_OK == waitAT())
+                    {
+                    at.begin(ATR_SEND_OK, ATR_ERROR, ATR_FAIL, uint8_t(getCurrentSeconds()), flushTimeOut);
+                    (static_cast<Print *>(&ser))->write(buf, buflen);
+                    bSent = (ATCommandEngine::AT_OK == waitAT());
+                    }
+                atCmd = ATC_NONE;
                 return bSent;
                 }
 
@@ -322,18 +386,51 @@ typedef const char *AT_t;
             virtual bool queueToSend(const uint8_t *buf, uint8_t buflen, int8_t,
                     TXpower) override
                 {
-                if ((buf == NULL) || (buflen > sizeof(txQueue)))
+                if ((buf == NULL) || (buflen > MAX_TX_FRAME_LEN))
                     return false;    //
-//        if ((buf == NULL) || (buflen > sizeof(txQueue)) || (txMessageQueue >= maxTxQueueLength)) return false;    //
-//        // Increment message queue
-//        txMessageQueue++; //
-                    // copy into queue here?
-                txMessageQueue = 1;
-                memcpy(txQueue, buf, buflen); // Last message queued is copied to buffer, ensuring freshest message is sent.
-                txMsgLen = buflen;
+                // If full, drop the oldest frame, ensuring freshest message is sent,
+                // unless it is being sent right now.
+                if (txMessageQueue >= txQueueFrames)
+                    {
+                    if (0 != txSendFrames) return false;
+                    popTXQueue();
+                    }
+                const uint8_t slot = getTXQueueSlot(txMessageQueue);
+                memcpy(txQueue[slot], buf, buflen);
+                txMsgLen[slot] = buflen;
+                ++txMessageQueue;
                 return true;
                 }
 
+            // Number of frames currently queued for TX.
+            uint8_t getTXMsgsQueued() const { return(txMessageQueue); }
+
+            /**
+             * @brief   Enable or disable persistent-session mode.
+             * @note    When enabled there is no forced restart every 255 datagrams;
+             *          instead the SIM900 is restarted when the UDP status shows a dead end
+             *          or after maxSendFailures consecutive failed sends.
+             */
+            void setPersistentSession(const bool enable) { persistentSession = enable; }
+
+            /**
+             * @brief   Enable or disable packing of queued frames into one datagram.
+             * @note    Coalesced datagrams hold one or more frames, each preceded by its length as one byte.
+             */
+            void setTXCoalescing(const bool enable) { coalesceTX = enable; }
+
+            /**
+             * @brief   Set the max bytes written as datagram payload per poll() when coalescing.
+             * @param   bytesPerPoll: constrained so that one maximum-length frame always fits,
+             *          and to no more than MAX_TX_BUDGET_PER_POLL
+             *          so that the write completes near the start of the major cycle.
+             */
+            void setTXBudget(const uint16_t bytesPerPoll)
+                {
+                txBudgetPerPoll = (bytesPerPoll < MAX_TX_FRAME_LEN + 1U) ? uint16_t(MAX_TX_FRAME_LEN + 1U) :
+                    ((bytesPerPoll > MAX_TX_BUDGET_PER_POLL) ? uint16_t(MAX_TX_BUDGET_PER_POLL) : bytesPerPoll);
+                }
+
             // Returns true if radio is present, independent of its power state.
             virtual bool isAvailable() const override { return(bAvailable); }
 
@@ -347,7 +444,7 @@ typedef const char *AT_t;
                 if (-1 != retryTimer) {  // not locked out when retryTimer is -1.
                     retryLockOut();
                     return;
-                } else if (messageCounter == 255) { // Force a hard restart every 255 messages.
+                } else if ((messageCounter == 255) && !persistentSession) { // Force a hard restart every 255 messages.
                     messageCounter = 0;  // reset counter.
                     state = RESET;
                     return;
@@ -357,18 +454,22 @@ typedef const char *AT_t;
                     switch (state) {
                     case INIT:
                         OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*INIT")
-                        memset(txQueue, 0, sizeof(txQueue));
                         messageCounter = 0;
                         retryTimer = -1;
-                        txMsgLen = 0;
+                        clearAT();
+                        udpStatusGood = false;
+                        sendFailures = 0;
+                        txQueueHead = 0;
                         txMessageQueue = 0;
                         bAvailable = false;
                         state = GET_STATE;
                         break;
-                    case GET_STATE: // Check SIM900 is present and can be talked to. Takes up to 220 ticks?
+                    case GET_STATE: // Check SIM900 is present and can be talked to.
                         OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*GET_STATE")
-                        if (isSIM900Replying()) {
-                            bAvailable = true;
+                        {
+                            const ATCommandEngine::Status s = runAT(ATC_AT);
+                            if (ATCommandEngine::AT_PENDING == s) break;
+                            if (ATCommandEngine::AT_OK == s) bAvailable = true;
                         }
                         setPwrPinHigh(true);
                         powerTimer = static_cast<int8_t>(getCurrentSeconds());
@@ -385,48 +486,62 @@ typedef const char *AT_t;
                         OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*START_UP")
                         if (waitedLongEnough(powerTimer, powerLockOutDuration)) state = START_UP;
                         break;
-                    case START_UP: // takes up to 150 ticks
+                    case START_UP:
                         OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*START_UP")
-                        if (isSIM900Replying()) {
-                            state = CHECK_PIN;
-                        } else {
-                            state = GET_STATE;
+                        {
+                            const ATCommandEngine::Status s = runAT(ATC_AT);
+                            if (ATCommandEngine::AT_PENDING == s) break;
+                            state = (ATCommandEngine::AT_OK == s) ? CHECK_PIN : GET_STATE;
                         }
                         break;
-                    case CHECK_PIN: // Set pin if required. Takes ~100 ticks to exit.
+                    case CHECK_PIN: // Set pin if required.
                         OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*CHECK_PIN")
-                        if (isPINRequired()) {
-                            state = WAIT_FOR_REGISTRATION;
-                        } else {
-                            setRetryLock();
+                        {
+                            const ATCommandEngine::Status s = runAT(ATC_PIN);
+                            if (ATCommandEngine::AT_PENDING == s) break;
+                            if ((ATCommandEngine::AT_OK == s) && isPINRequired()) {
+                                state = WAIT_FOR_REGISTRATION;
+                            } else {
+                                setRetryLock();
+                            }
                         }
                         //                if(setPIN()) state = PANIC;// TODO make sure setPin returns true or false
                         break;
-                    case WAIT_FOR_REGISTRATION: // Wait for registration to GSM network. Stuck in this state until success. Takes ~150 ticks to exit.
+                    case WAIT_FOR_REGISTRATION: // Wait for registration to GSM network. Stuck in this state until success.
                         OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*WAIT_FOR_REG")
-                        if (isRegistered()) {
-                            state = SET_APN;
-                        } else {
-                            setRetryLock();
+                        {
+                            const ATCommandEngine::Status s = runAT(ATC_REG);
+                            if (ATCommandEngine::AT_PENDING == s) break;
+                            if ((ATCommandEngine::AT_OK == s) && isRegistered()) {
+                                state = SET_APN;
+                            } else {
+                                setRetryLock();
+                            }
                         }
                         break;
-                    case SET_APN: // Attempt to set the APN. Stuck in this state until success. Takes up to 200 ticks to exit.
+                    case SET_APN: // Attempt to set the APN. Stuck in this state until success.
                         OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*SET_APN")
-                        if (setAPN()) {
-                            messageCounter = 0;
-                            state = START_GPRS;
-                        } else {
-                            setRetryLock();
+                        {
+                            const ATCommandEngine::Status s = runAT(ATC_APN);
+                            if (ATCommandEngine::AT_PENDING == s) break;
+                            if (ATCommandEngine::AT_OK == s) {
+                                messageCounter = 0;
+                                state = START_GPRS;
+                            } else {
+                                setRetryLock();
+                            }
                         }
                         break;
                     case START_GPRS:  // Start GPRS context.
                         OTSIM900LINK_DEBUG_SERIAL_PRINTLN("*START_GPRS")
                         {
-                            uint8_t udpState = checkUDPStatus();
+                            const ATCommandEngine::Status s = runAT(ATC_STATUS);
+                            if (ATCommandEngine::AT_PENDING == s) break;
+                            const uint8_t udpState = checkUDPStatus(s);
                             if (3 == udpState) {  // GPRS active, UDP shut.
                                 state = GET_IP;
                             } else if(0 == udpState) {  // GPRS shut.
-                                startGPRS();
+                                runAT(ATC_GPRS);  // Outcome seen by the next status check.
                             } else {
                                 setRetryLock();
                             }
@@ -434,32 +549,41 @@ typedef const char *AT_t;
 //                          if(!startGPRS()) state = GET_IP;  // TODO: Add retries, Option to shut GPRS here (probably needs a new state)
                         // FIXME 20160505: Need to work out how to handle this. If signal is marginal this will fail.
                         break;
-                    case GET_IP: // Takes up to 200 ticks to exit.
+                    case GET_IP:
                         // For some reason, AT+CIFSR must done to be able to do any networking.
                         // It is the way recommended in SIM900_Appication_Note.pdf section 3: Single Connections.
                         // This was not necessary when opening and shutting GPRS as in OTSIM900Link v1.0
                         OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*GET IP")
-                        getIP();
+                        if (ATCommandEngine::AT_PENDING == runAT(ATC_IP)) break;
                         state = OPEN_UDP;
                         break;
-                    case OPEN_UDP: // Open a udp socket. Takes ~200 ticks to exit.
+                    case OPEN_UDP: // Open a udp socket.
                         OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*OPEN UDP")
-                        if (openUDPSocket()) {
-                            state = IDLE;
-                        } else {
-                            setRetryLock();
+                        {
+                            const ATCommandEngine::Status s = runAT(ATC_UDP);
+                            if (ATCommandEngine::AT_PENDING == s) break;
+                            if (ATCommandEngine::AT_OK == s) {
+                                state = IDLE;
+                            } else {
+                                setRetryLock();
+                            }
                         }
                         break;
                     case IDLE:  // Waiting for outbound message.
-                        if (txMessageQueue > 0) { // If message is queued, go to WAIT_FOR_UDP
-                            state = WAIT_FOR_UDP;
+                        // Expire the cached UDP status before the seconds count can wrap.
+                        if (udpStatusGood && waitedLongEnough(udpStatusTime, udpStatusCacheDuration)) udpStatusGood = false;
+                        if (txMessageQueue > 0) { // If message is queued, go to WAIT_FOR_UDP unless UDP recently seen OK.
+                            state = (persistentSession && udpStatusGood) ? SENDING : WAIT_FOR_UDP;
                         }
                         break;
-                    case WAIT_FOR_UDP: // Make sure UDP context is open. Takes up to 200 ticks to exit.
+                    case WAIT_FOR_UDP: // Make sure UDP context is open.
                         OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*WAIT_FOR_UDP")
                         {
-                            uint8_t udpState = checkUDPStatus();
+                            const ATCommandEngine::Status s = runAT(ATC_STATUS);
+                            if (ATCommandEngine::AT_PENDING == s) break;
+                            const uint8_t udpState = checkUDPStatus(s);
                             if (udpState == 1) {  // UDP connected
+                                setUDPStatusGood();
                                 state = SENDING;
                             }
 //                            else if (udpState == 0) state = GET_STATE; // START_GPRS; // TODO needed for optional wake GPRS to send.
@@ -470,17 +594,27 @@ typedef const char *AT_t;
                             }
                         }
                         break;
-                    case SENDING: // Attempt to send a message. Takes ~100 ticks to exit.
+                    case SENDING: // Attempt to send a message.
                         OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*SENDING")
                         if (txMessageQueue > 0) { // Check to make sure it is near the start of the subcycle to avoid overrunning.
-                            // TODO logic to check if send attempt successful
-                            sendRaw(txQueue, txMsgLen); /// @note can't use strlen with encrypted/binary packets
-                            if (!(--txMessageQueue)) state = IDLE; // Once done, decrement number of messages in queue and return to IDLE
+                            const ATCommandEngine::Status s = sendQueued();
+                            if (ATCommandEngine::AT_PENDING == s) break;
+                            if (ATCommandEngine::AT_OK == s) {
+                                sendFailures = 0;
+                                setUDPStatusGood();
+                            } else if (persistentSession) {
+                                // Check the UDP status before sending again, or restart if sends keep failing.
+                                udpStatusGood = false;
+                                if (++sendFailures >= maxSendFailures) { sendFailures = 0; state = RESET; break; }
+                                if (0 != txMessageQueue) { state = WAIT_FOR_UDP; break; }
+                            }
+                            if (0 == txMessageQueue) state = IDLE; // Once the queue is drained return to IDLE.
                         }
                         else if (txMessageQueue == 0) state = IDLE;
                         break;
                     case RESET:
                         OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*RESET")
+                        clearAT();
                         state = GET_STATE;
                         break;
                     case PANIC:
@@ -505,11 +639,27 @@ typedef const char *AT_t;
             // Power up/down takes a while, and prints stuff we want to ignore to the serial connection.
             static constexpr uint8_t powerLockOutDuration = 10 + powerPinToggleDuration;  // DE20160703:Increased duration due to startup issues.
             static constexpr uint8_t flushTimeOut = 10;  // Time in seconds we should block for while polling for a specific character.
+            // Time in seconds to wait for AT+CIICR, which may take up to 85s to reply.
+            static constexpr uint8_t gprsTimeOut = 90;
             // Standard Responses
 
             // Software serial: for V0p2 boards (eg REV10) expected to be of type:
             //     OTV0P2BASE::OTSoftSerial2<rxPin, txPin, baud>
             ser_t ser;
+            // Runs one AT command at a time over ser,
+            // without blocking unless ser is unbuffered (eg OTSoftSerial2).
+            ATCommandEngine at{ser, getCurrentSeconds};
+            // AT commands run through at by poll().
+            enum ATCmd : uint8_t
+                {
+                ATC_NONE, ATC_AT, ATC_PIN, ATC_REG, ATC_APN, ATC_GPRS, ATC_IP,
+                ATC_STATUS, ATC_UDP, ATC_SEND_PROMPT, ATC_SEND_RESULT
+                };
+            // Command in progress in at, or ATC_NONE.
+            ATCmd atCmd = ATC_NONE;
+            // Frames from the TX queue in the datagram being sent, and its length; 0 frames if none.
+            uint8_t txSendFrames = 0;
+            uint16_t txSendLen = 0;
 
             // variables
             bool bAvailable = false;
@@ -520,6 +670,15 @@ typedef const char *AT_t;
             int8_t retryTimer = -1;     // Store the retry lockout time. This takes a value in range [0,60] and is set to (-1) when no lockout is desired.
             static constexpr uint8_t maxRetriesDefault = 10;  // Default number of retries.
             volatile uint8_t txMessageQueue = 0; // Number of frames currently queued for TX.
+            // Persistent-session state.
+            bool persistentSession = false;
+            bool udpStatusGood = false; // True if UDP was seen connected (or a send succeeded) at udpStatusTime.
+            uint8_t udpStatusTime = 0;
+            uint8_t sendFailures = 0; // Consecutive failed sends.
+            // Seconds to trust a good UDP status for; well under the 60s wrap of the seconds count.
+            static constexpr uint8_t udpStatusCacheDuration = 30;
+            // Consecutive failed sends before a restart in persistent-session mode.
+            static constexpr uint8_t maxSendFailures = 3;
             const OTSIM900LinkConfig_t *config = NULL;
             OTSIM900LinkState oldState;
             /************************* Private Methods *******************************/
@@ -537,6 +696,213 @@ typedef const char *AT_t;
                     else retriesRemaining = maxRetriesDefault;  // default case.
                 }
             }
+            // Record that UDP was seen working just now.
+            inline void setUDPStatusGood()
+                {
+                udpStatusGood = true;
+                udpStatusTime = uint8_t(getCurrentSeconds());
+                }
+            // Slot index of the i-th oldest queued TX frame.
+            inline uint8_t getTXQueueSlot(const uint8_t i) const
+                {
+                const uint_fast16_t s = uint_fast16_t(txQueueHead) + i;
+                return(uint8_t((s >= txQueueFrames) ? (s - txQueueFrames) : s));
+                }
+            // Discard the oldest queued TX frame; queue must not be empty.
+            inline void popTXQueue()
+                {
+                txQueueHead = getTXQueueSlot(1);
+                --txMessageQueue;
+                }
+            /**
+             * @brief   Abandon any AT command and datagram in progress.
+             */
+            void clearAT()
+                {
+                at.clear();
+                atCmd = ATC_NONE;
+                txSendFrames = 0;
+                }
+            /**
+             * @brief   Start an AT command: set up the reply tokens, then write the command.
+             * @note    Quick commands have a zero timeout, so complete as soon as the SIM900 goes quiet.
+             */
+            void startAT(const ATCmd cmd)
+                {
+                const uint8_t now = uint8_t(getCurrentSeconds());
+                switch (cmd)
+                    {
+                    case ATC_AT: // reply: b'AT\r\n\r\nOK\r\n'
+                        at.begin(ATR_OK, ATR_ERROR, NULL, now, 0, true);
+                        ser.println(AT_START);
+                        break;
+                    case ATC_PIN: // reply: b'AT+CPIN?\r\n\r\n+CPIN: READY\r\n\r\nOK\r\n'
+                        at.begin(ATR_OK, ATR_ERROR, NULL, now, 0, true);
+                        ser.print(AT_START);
+                        ser.print(AT_PIN);
+                        ser.println(ATc_QUERY);
+                        break;
+                    case ATC_REG: // reply: b'AT+CREG?\r\n\r\n+CREG: 0,5\r\n\r\n'OK\r\n'
+                        at.begin(ATR_OK, ATR_ERROR, NULL, now, 0, true);
+                        ser.print(AT_START);
+                        ser.print(AT_REGISTRATION);
+                        ser.println(ATc_QUERY);
+                        break;
+                    case ATC_APN: // reply: b'AT+CSTT="mobiledata"\r\n\r\nOK\r\n'
+                        at.begin(ATR_OK, ATR_ERROR, NULL, now, 0, true);
+                        ser.print(AT_START);
+                        ser.print(AT_SET_APN);
+                        ser.print(ATc_SET);
+                        printConfig(config->APN);
+                        ser.println();
+                        break;
+                    case ATC_GPRS: // reply: b'AT+CIICR\r\n\r\nOK\r\n' after up to 85s.
+                        // Blocking that long on an unbuffered serial port would stall the main loop,
+                        // so there only start it: the next status check sees the outcome.
+                        at.begin(ATR_OK, ATR_ERROR, NULL, now, (ser.available() < 0) ? 0 : gprsTimeOut, true);
+                        ser.print(AT_START);
+                        ser.println(AT_START_GPRS);
+                        break;
+                    case ATC_IP: // reply: b'AT+CIFSR\r\n\r\n172.16.101.199\r\n'
+                        at.begin(ATR_IP, ATR_ERROR, NULL, now, 0, true);
+                        ser.print(AT_START);
+                        ser.println(AT_GET_IP);
+                        break;
+                    case ATC_STATUS: // reply: b'AT+CIPSTATUS\r\n\r\nOK\r\nSTATE: CONNECT OK\r\n'
+                        at.begin(ATR_STATE, ATR_ERROR, NULL, now, 0, true);
+                        ser.print(AT_START);
+                        ser.println(AT_STATUS);
+                        break;
+                    case ATC_UDP: // reply: b'AT+CIPSTART="UDP","0.0.0.0","9999"\r\n\r\nOK\r\n\r\nCONNECT OK\r\n'
+                        at.begin(ATR_OK, ATR_ERROR, ATR_FAIL, now, flushTimeOut, true);
+                        ser.print(AT_START);
+                        ser.print(AT_START_UDP);
+                        ser.print("=\"UDP\",");
+                        ser.print('\"');
+                        printConfig(config->UDP_Address);
+                        ser.print("\",\"");
+                        printConfig(config->UDP_Port);
+                        ser.println('\"');
+                        break;
+                    case ATC_SEND_PROMPT: // reply: b'AT+CIPSEND=62\r\n\r\n>'
+                        messageCounter++; // increment counter
+                        at.begin(ATR_PROMPT, ATR_ERROR, NULL, now, flushTimeOut);
+                        ser.print(AT_START);
+                        ser.print(AT_SEND_UDP);
+                        ser.print('=');
+                        ser.println((unsigned long) txSendLen);
+                        break;
+                    default: break;
+                    }
+                }
+            /**
+             * @brief   Run an AT command over successive calls without blocking.
+             * @note    Lets any other command still in progress finish first, discarding its result.
+             * @retval  AT_PENDING until complete, then the result once.
+             */
+            ATCommandEngine::Status runAT(const ATCmd cmd)
+                {
+                const uint8_t now = uint8_t(getCurrentSeconds());
+                if ((ATC_NONE != atCmd) && (cmd != atCmd))
+                    {
+                    if (ATCommandEngine::AT_PENDING == at.poll(now)) return(ATCommandEngine::AT_PENDING);
+                    atCmd = ATC_NONE;
+                    }
+                if (ATC_NONE == atCmd) { atCmd = cmd; startAT(cmd); }
+                const ATCommandEngine::Status s = at.poll(now);
+                if (ATCommandEngine::AT_PENDING != s) atCmd = ATC_NONE;
+                return(s);
+                }
+            /**
+             * @brief   Blocks until the AT command in progress completes.
+             * @note    Off AVR gives up if nothing arrives and time does not move, as in tests.
+             */
+            ATCommandEngine::Status waitAT()
+                {
+                for ( ; ; )
+                    {
+                    const uint8_t now = uint8_t(getCurrentSeconds());
+#ifndef ARDUINO_ARCH_AVR
+                    const uint8_t replyLen = at.getReplyLen();
+#endif // ARDUINO_ARCH_AVR
+                    const ATCommandEngine::Status s = at.poll(now);
+                    if (ATCommandEngine::AT_PENDING != s) return(s);
+#ifndef ARDUINO_ARCH_AVR
+                    if ((replyLen == at.getReplyLen()) && (now == uint8_t(getCurrentSeconds())))
+                        {
+                        at.clear();
+                        return(ATCommandEngine::AT_TIMEOUT);
+                        }
+#endif // ARDUINO_ARCH_AVR
+                    }
+                }
+            /**
+             * @brief   Send from the TX queue, one datagram at a time, without blocking.
+             * @note    Without coalescing sends the oldest queued frame as is.
+             *          With coalescing sends as many of the oldest frames as fit in txBudgetPerPoll,
+             *          but always at least one, each preceded by its length.
+             *          Frames sent are dequeued whether or not the send succeeds.
+             * @retval  AT_PENDING while in progress, then AT_OK if the SIM900 reported the datagram sent,
+             *          or outside persistent-session mode as soon as the datagram is written.
+             */
+            ATCommandEngine::Status sendQueued()
+                {
+                if (0 == txSendFrames)
+                    {
+                    // Choose the frames for the next datagram.
+                    uint8_t nFrames = 0;
+                    uint16_t datagramLen = 0;
+                    if (!coalesceTX) { nFrames = 1; datagramLen = txMsgLen[txQueueHead]; }
+                    else while (nFrames < txMessageQueue)
+                        {
+                        const uint16_t nextLen = datagramLen + 1 + txMsgLen[getTXQueueSlot(nFrames)];
+                        if ((nFrames > 0) && (nextLen > txBudgetPerPoll)) { break; }
+                        datagramLen = nextLen;
+                        ++nFrames;
+                        }
+                    txSendFrames = nFrames;
+                    txSendLen = datagramLen;
+                    }
+                if (ATC_SEND_RESULT != atCmd)
+                    {
+                    const ATCommandEngine::Status s = runAT(ATC_SEND_PROMPT);
+                    if (ATCommandEngine::AT_PENDING == s) return(s);
+                    if (ATCommandEngine::AT_OK != s)
+                        {
+                        OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*fail")
+                        finishSend();
+                        return(s);
+                        }
+                    // '>' indicates module is ready for UDP frame.
+                    atCmd = ATC_SEND_RESULT;
+                    at.begin(ATR_SEND_OK, ATR_ERROR, ATR_FAIL, uint8_t(getCurrentSeconds()), flushTimeOut);
+                    if (!coalesceTX)
+                        {
+                        /// @note can't use strlen with encrypted/binary packets
+                        (static_cast<Print *>(&ser))->write(txQueue[txQueueHead], txMsgLen[txQueueHead]);
+                        }
+                    else for (uint8_t i = 0; i < txSendFrames; ++i)
+                        {
+                        const uint8_t slot = getTXQueueSlot(i);
+                        ser.write(txMsgLen[slot]);
+                        (static_cast<Print *>(&ser))->write(txQueue[slot], txMsgLen[slot]);
+                        }
+                    // Only wait for the reply if a failed send will be acted on;
+                    // otherwise it is discarded when the next command starts.
+                    if (!persistentSession) { finishSend(); return(ATCommandEngine::AT_OK); }
+                    }
+                // reply: b'\r\nSEND OK\r\n', possibly after an echo of the datagram.
+                const ATCommandEngine::Status s = at.poll(uint8_t(getCurrentSeconds()));
+                if (ATCommandEngine::AT_PENDING != s) finishSend();
+                return(s);
+                }
+            // Dequeue the frames of the datagram just sent (or failed).
+            void finishSend()
+                {
+                while (txSendFrames > 0) { popTXQueue(); --txSendFrames; }
+                atCmd = ATC_NONE;
+                }
+
             /**
              * @brief   Check if enough time has passed to retry again and update the retry counter.
              * @note    retryCounter must be set by the caller.
@@ -650,7 +1016,7 @@ typedef const char *AT_t;
                 return true;
                 }
             /**
-             * @brief   Check if module connected and registered (GSM and GPRS).
+             * @brief   Check if module connected and registered (GSM and GPRS), from the AT+CREG? reply.
              * @retval  True if registered.
              * @note    reply: b'AT+CREG?\r\n\r\n+CREG: 0,5\r\n\r\n'OK\r\n'
              */
@@ -658,57 +1024,11 @@ typedef const char *AT_t;
                 {
                 //  Check the GSM registration via AT commands ( "AT+CREG?" returns "+CREG:x,1" or "+CREG:x,5"; where "x" is 0, 1 or 2).
                 //  Check the GPRS registration via AT commands ("AT+CGATT?" returns "+CGATT:1" and "AT+CGREG?" returns "+CGREG:x,1" or "+CGREG:x,5"; where "x" is 0, 1 or 2).
-                char data[MAX_SIM900_RESPONSE_CHARS];
-                ser.print(AT_START);
-                ser.print(AT_REGISTRATION);
-                ser.println(ATc_QUERY);
-                //    ser.print(AT_END);
-                readMany(data, sizeof(data));
-                // response stuff
-                const char *dataCut = getResponse(data, sizeof(data), ' '); // first ' ' appears right before useful part of message
+                const char *dataCut = getResponse(at.getReply(), at.getReplyLen(), ' '); // first ' ' appears right before useful part of message
                 if(NULL == dataCut) { return(false); }
                 // Expected response '1' or '5'.
                 return((dataCut[2] == '1') || (dataCut[2] == '5'));
                 }
-
-            /**
-             * @brief   Set Access Point Name and start task.
-             * @retval  True if APN set.
-             * @note    reply: b'AT+CSTT="mobiledata"\r\n\r\nOK\r\n'
-             */
-            bool setAPN()
-                {
-                char data[MAX_SIM900_RESPONSE_CHARS];
-                ser.print(AT_START);
-                ser.print(AT_SET_APN);
-                ser.print(ATc_SET);
-                printConfig(config->APN);
-                ser.println();
-                readMany(data, sizeof(data));
-                // response stuff
-                const char *dataCut = getResponse(data, sizeof(data), 0x0A);
-                if(NULL == dataCut) { return(-1); }
-                return(dataCut[2] == 'O'); // Expected response 'OK'.
-                }
-            /**
-             * @brief   Start GPRS connection.
-             * @retval  True if connected.
-             * @note    check power, check registered, check gprs active.
-             * @note    reply: b'AT+CIICR\r\n\r\nOK\r\nAT+CIICR\r\n\r\nERROR\r\n' (not sure why OK then ERROR happens.)
-             */
-            bool startGPRS()
-                {
-                char data[OTV0P2BASE::fnmin(16, MAX_SIM900_RESPONSE_CHARS)];
-                ser.print(AT_START);
-                ser.println(AT_START_GPRS);
-                //    ser.print(AT_END);
-                readMany(data, sizeof(data));
-
-                // response stuff
-                const char *dataCut = getResponse(data, sizeof(data), 0x0A); // unreliable
-                if(NULL == dataCut) { return(-1); }
-                return ((dataCut[0] == 'O') & (dataCut[1] == 'K'));
-                }
             /**
              * @brief   Shut GPRS connection.
              * @retval  True if shut.
@@ -728,29 +1048,8 @@ typedef const char *AT_t;
                 return (*dataCut == 'S');
                 }
             /**
-             * @brief   Get IP address from SIM900. Note that the function just returns a bool
-             *          as we currently have no need to know our IP address.
-             * @retval  True if no errors.
-             * @note    reply: b'AT+CIFSR\r\n\r\n172.16.101.199\r\n'
-             */
-            bool getIP()
-                {
-                char data[MAX_SIM900_RESPONSE_CHARS];
-                ser.print(AT_START);
-                ser.println(AT_GET_IP);
-                //  ser.print(AT_END);
-                readMany(data, sizeof(data));
-                // response stuff
-                const char *dataCut = getResponse(data, sizeof(data), 0x0A);
-                if(NULL == dataCut) { return(false); }
-                // All error messages will start with a '+'.
-                if (*dataCut == '+')
-                    { return(false); }
-                else
-                    { return(true); }
-                }
-            /**
-             * @brief   Check if UDP open.
+             * @brief   Check if UDP open, from the AT+CIPSTATUS reply.
+             * @param   s:  status of the AT+CIPSTATUS command.
              * @retval  0 if GPRS closed.
              * @retval  1 if UDP socket open.
              * @retval  2 if in dead end state.
@@ -759,16 +1058,11 @@ typedef const char *AT_t;
              * @note    GPRS active:   b'AT+CIPSTATUS\r\n\r\nOK\r\n\r\nSTATE: IP GPRSACT\r\n'
              * @note    UDP running:       b'AT+CIPSTATUS\r\n\r\nOK\r\nSTATE: CONNECT OK\r\n'
              */
-            uint8_t checkUDPStatus()
+            uint8_t checkUDPStatus(const ATCommandEngine::Status s)
                 {
-                char data[MAX_SIM900_RESPONSE_CHARS];
-                ser.print(AT_START);
-                ser.println(AT_STATUS);
-                //    ser.print(AT_END);
-                readMany(data, sizeof(data));
-
+                if (ATCommandEngine::AT_OK != s) { return(0); }
                 // First ' ' appears right before useful part of message.
-                const char *dataCut = getResponse(data, sizeof(data), ' ');
+                const char *dataCut = getResponse(at.getReply(), at.getReplyLen(), ' ');
                 if(NULL == dataCut) { return(0); }
                 if (*dataCut == 'C')
                     return 1; // expected string is 'CONNECT OK'. no other possible string begins with C
@@ -833,49 +1127,18 @@ typedef const char *AT_t;
             return true;
             }
         /**
-         * @brief   Check if PIN required
+         * @brief   Check if PIN required, from the AT+CPIN? reply.
          * @retval  True if SIM card unlocked.
          * @note    reply: b'AT+CPIN?\r\n\r\n+CPIN: READY\r\n\r\nOK\r\n'
          */
         bool isPINRequired()
             {
-            char data[OTV0P2BASE::fnmin(40, MAX_SIM900_RESPONSE_CHARS)];
-            ser.print(AT_START);
-            ser.print(AT_PIN);
-            ser.println(ATc_QUERY);
-            //    ser.print(AT_END);
-            readMany(data, sizeof(data));
-
-            // response stuff
             // First ' ' appears right before useful part of message
-            const char *dataCut = getResponse(data, sizeof(data), ' ');
+            const char *dataCut = getResponse(at.getReply(), at.getReplyLen(), ' ');
             if(NULL == dataCut) { return(false); }
             return('R' == *dataCut);  // Expected string is 'READY'. no other possible string begins with R.
             }
 
-        /**
-         * @brief   Blocks process until terminatingChar received.
-         * @param   terminatingChar:    Character to block until.
-         * @retval  True if character found, or false on 1000ms timeout
-         * @note    Blocks main loop but not interrupts.
-         */
-        bool flushUntil(uint8_t _terminatingChar)
-            {
-            const uint8_t terminatingChar = _terminatingChar;
-            const uint8_t endTime = getCurrentSeconds() + flushTimeOut;
-            while (getCurrentSeconds() <= endTime)
-                {
-                const uint8_t c = uint8_t(ser.read());
-                if (c == terminatingChar)
-                    return true;
-                }
-#if 0
-            OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING(" Timeout")
-            OTSIM900LINK_DEBUG_SERIAL_PRINTLN(getCurrentSeconds())
-#endif
-            return false;
-            }
-
         /**
          * @brief   Finds the first occurrence of a character within a buffer and returns a pointer to the next element.
          * @param   data:       pointer to array containing response from device.
@@ -897,32 +1160,6 @@ typedef const char *AT_t;
             return dp;
         }
 
-        /**
-         * @brief   Open UDP socket.
-         * @param   array containing server IP
-         * @retval  True if UDP opened
-         * @note    reply: b'AT+CIPSTART="UDP","0.0.0.0","9999"\r\n\r\nOK\r\n\r\nCONNECT OK\r\n'
-         */
-        bool openUDPSocket()
-            {
-            char data[MAX_SIM900_RESPONSE_CHARS];
-            memset(data, 0, sizeof(data));
-            ser.print(AT_START);
-            ser.print(AT_START_UDP);
-            ser.print("=\"UDP\",");
-            ser.print('\"');
-            printConfig(config->UDP_Address);
-            ser.print("\",\"");
-            printConfig(config->UDP_Port);
-            ser.println('\"');
-            // Implement check here
-            readMany(data, sizeof(data));
-            // response stuff
-            const char *dataCut = getResponse(data, sizeof(data), 0x0A);
-            if(NULL == dataCut) { return(false); }
-            OTSIM900LINK_DEBUG_SERIAL_PRINTLN(dataCut)
-            return ~('E' == *dataCut);  // Returns ERROR on fail, else successfully opened UDP.
-            }
         /**
          * @brief   Close UDP connection.
          * @todo    Implement checks.
@@ -935,47 +1172,6 @@ typedef const char *AT_t;
             ser.println(AT_CLOSE_UDP);
             return true;
             }
-        /**
-         * @brief   Send a UDP frame.
-         * @param   frame:  Pointer to array containing frame to send.
-         * @param   length: Length of frame.
-         * @retval  True if send successful.
-         * @note    On Success: b'AT+CIPSEND=62\r\n\r\n>' echos back input b'\r\nSEND OK\r\n'
-         */
-        bool UDPSend(const char *frame, uint8_t length)
-            {
-            messageCounter++; // increment counter
-            ser.print(AT_START);
-            ser.print(AT_SEND_UDP);
-            ser.print('=');
-            ser.println(length);
-            //    ser.print(AT_END);
-            if (flushUntil('>'))
-                {  // '>' indicates module is ready for UDP frame
-                (static_cast<Print *>(&ser))->write(frame, length);
-                OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*success")
-                return true;
-                }
-            else
-                {
-                OTSIM900LINK_DEBUG_SERIAL_PRINTLN_FLASHSTRING("*fail")
-                return false;
-                }
-            }
-
-        /**
-         * @brief   Checks module for response.
-         * @retval  True if correct response.
-         * @note     reply: b'AT\r\n\r\nOK\r\n'
-         */
-        bool isSIM900Replying()
-            {
-            char data[OTV0P2BASE::fnmin(16, MAX_SIM900_RESPONSE_CHARS)];
-            ser.println(AT_START);
-            readMany(data, sizeof(data));
-            return ('A' == *data);
-            }
-
         /**
          * @brief     Assigns OTSIM900LinkConfig config and does some basic validation. Must be called before begin()
          * @retval    returns true if assigned or false if config is NULL
@@ -996,11 +1192,14 @@ typedef const char *AT_t;
         }
 
         volatile OTSIM900LinkState state = INIT;
-        uint8_t txMsgLen = 0; // This stores the length of the tx message. will have to be redone for multiple txQueue
-        static constexpr uint8_t maxTxQueueLength = 1;
+        // TX queue: ring of txQueueFrames slots, oldest at txQueueHead, txMessageQueue in use.
+        uint8_t txQueueHead = 0;
+        bool coalesceTX = false;
+        uint16_t txBudgetPerPoll = DEFAULT_TX_BUDGET_PER_POLL;
+        uint8_t txMsgLen[txQueueFrames]; // Length of the frame in each slot.
 
         // Putting this last in the structure.
-        uint8_t txQueue[64]; // 64 is maxTxMsgLen (from OTRadioLink)
+        uint8_t txQueue[txQueueFrames][MAX_TX_FRAME_LEN];
 
     public:
         // define abstract methods here
@@ -1013,7 +1212,7 @@ typedef const char *AT_t;
             {
             queueRXMsgsMin = 0;
             maxRXMsgLen = 0;
-            maxTXMsgLen = 64;
+            maxTXMsgLen = MAX_TX_FRAME_LEN;
             }
         ;
         virtual uint8_t getRXMsgsQueued() const override
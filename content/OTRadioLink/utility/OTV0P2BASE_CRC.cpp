@@ -16,6 +16,10 @@ under the Licence.
 Author(s) / Copyright (s): Damon Hart-Davis 2015--2016
 */
 
+#ifdef ARDUINO_ARCH_AVR
+#include <avr/pgmspace.h>
+#endif
+
 #include "OTV0P2BASE_CRC.h"
 
 
@@ -24,6 +28,74 @@ namespace OTV0P2BASE
     {
 
 
+    // The table-driven forms work on the CRC shifted left by one bit
+    // so that its top bit lines up with the top bit of each data byte,
+    // ie with the polynomial 0x37 << 1 = 0x6e in an 8-bit register.
+    // Each table entry is the register after clocking in its index (and then zeros)
+    // for the stated number of bits.
+
+#ifdef ARDUINO_ARCH_AVR
+#define OTV0P2BASE_CRC_TABLE_ATTR PROGMEM
+#define OTV0P2BASE_CRC_TABLE_READ(t, i) ((uint8_t)pgm_read_byte((t) + (i)))
+#else
+#define OTV0P2BASE_CRC_TABLE_ATTR
+#define OTV0P2BASE_CRC_TABLE_READ(t, i) ((t)[(i)])
+#endif
+
+    // Register after clocking in 4 bits (the index in the top nibble).
+    static const uint8_t crc7_5B_nibbleTable[16] OTV0P2BASE_CRC_TABLE_ATTR =
+        {
+        0x00, 0x6e, 0xdc, 0xb2, 0xd6, 0xb8, 0x0a, 0x64, 0xc2, 0xac, 0x1e, 0x70, 0x14, 0x7a, 0xc8, 0xa6,
+        };
+
+    // Register after clocking in 8 bits.
+    static const uint8_t crc7_5B_byteTable[256] OTV0P2BASE_CRC_TABLE_ATTR =
+        {
+        0x00, 0x6e, 0xdc, 0xb2, 0xd6, 0xb8, 0x0a, 0x64, 0xc2, 0xac, 0x1e, 0x70, 0x14, 0x7a, 0xc8, 0xa6,
+        0xea, 0x84, 0x36, 0x58, 0x3c, 0x52, 0xe0, 0x8e, 0x28, 0x46, 0xf4, 0x9a, 0xfe, 0x90, 0x22, 0x4c,
+        0xba, 0xd4, 0x66, 0x08, 0x6c, 0x02, 0xb0, 0xde, 0x78, 0x16, 0xa4, 0xca, 0xae, 0xc0, 0x72, 0x1c,
+        0x50, 0x3e, 0x8c, 0xe2, 0x86, 0xe8, 0x5a, 0x34, 0x92, 0xfc, 0x4e, 0x20, 0x44, 0x2a, 0x98, 0xf6,
+        0x1a, 0x74, 0xc6, 0xa8, 0xcc, 0xa2, 0x10, 0x7e, 0xd8, 0xb6, 0x04, 0x6a, 0x0e, 0x60, 0xd2, 0xbc,
+        0xf0, 0x9e, 0x2c, 0x42, 0x26, 0x48, 0xfa, 0x94, 0x32, 0x5c, 0xee, 0x80, 0xe4, 0x8a, 0x38, 0x56,
+        0xa0, 0xce, 0x7c, 0x12, 0x76, 0x18, 0xaa, 0xc4, 0x62, 0x0c, 0xbe, 0xd0, 0xb4, 0xda, 0x68, 0x06,
+        0x4a, 0x24, 0x96, 0xf8, 0x9c, 0xf2, 0x40, 0x2e, 0x88, 0xe6, 0x54, 0x3a, 0x5e, 0x30, 0x82, 0xec,
+        0x34, 0x5a, 0xe8, 0x86, 0xe2, 0x8c, 0x3e, 0x50, 0xf6, 0x98, 0x2a, 0x44, 0x20, 0x4e, 0xfc, 0x92,
+        0xde, 0xb0, 0x02, 0x6c, 0x08, 0x66, 0xd4, 0xba, 0x1c, 0x72, 0xc0, 0xae, 0xca, 0xa4, 0x16, 0x78,
+        0x8e, 0xe0, 0x52, 0x3c, 0x58, 0x36, 0x84, 0xea, 0x4c, 0x22, 0x90, 0xfe, 0x9a, 0xf4, 0x46, 0x28,
+        0x64, 0x0a, 0xb8, 0xd6, 0xb2, 0xdc, 0x6e, 0x00, 0xa6, 0xc8, 0x7a, 0x14, 0x70, 0x1e, 0xac, 0xc2,
+        0x2e, 0x40, 0xf2, 0x9c, 0xf8, 0x96, 0x24, 0x4a, 0xec, 0x82, 0x30, 0x5e, 0x3a, 0x54, 0xe6, 0x88,
+        0xc4, 0xaa, 0x18, 0x76, 0x12, 0x7c, 0xce, 0xa0, 0x06, 0x68, 0xda, 0xb4, 0xd0, 0xbe, 0x0c, 0x62,
+        0x94, 0xfa, 0x48, 0x26, 0x42, 0x2c, 0x9e, 0xf0, 0x56, 0x38, 0x8a, 0xe4, 0x80, 0xee, 0x5c, 0x32,
+        0x7e, 0x10, 0xa2, 0xcc, 0xa8, 0xc6, 0x74, 0x1a, 0xbc, 0xd2, 0x60, 0x0e, 0x6a, 0x04, 0xb6, 0xd8,
+        };
+
+    // Bitwise implementation of crc7_5B_update(): smallest and slowest.
+    // This is the reference implementation that the others are tested against.
+    uint8_t crc7_5B_update_bitwise(uint8_t crc, const uint8_t datum)
+        {
+        for(uint8_t i = 0x80; i != 0; i >>= 1)
+            {
+            bool bit = (0 != (crc & 0x40));
+            if(0 != (datum & i)) { bit = !bit; }
+            crc <<= 1;
+            if(bit) { crc ^= 0x37; }
+            }
+        return(crc & 0x7f);
+        }
+
+    // Nibble-table implementation of crc7_5B_update(): two look-ups in a 16-byte table.
+    uint8_t crc7_5B_update_nibble(const uint8_t crc, const uint8_t datum)
+        {
+        uint8_t r = (uint8_t)(crc << 1) ^ datum;
+        r = (uint8_t)(r << 4) ^ OTV0P2BASE_CRC_TABLE_READ(crc7_5B_nibbleTable, r >> 4);
+        r = (uint8_t)(r << 4) ^ OTV0P2BASE_CRC_TABLE_READ(crc7_5B_nibbleTable, r >> 4);
+        return(r >> 1);
+        }
+
+    // Byte-table implementation of crc7_5B_update(): one look-up in a 256-byte table.
+    uint8_t crc7_5B_update_table(const uint8_t crc, const uint8_t datum)
+        { return(OTV0P2BASE_CRC_TABLE_READ(crc7_5B_byteTable, (uint8_t)(crc << 1) ^ datum) >> 1); }
+
     /**Update 7-bit CRC with next byte; result always has top bit zero.
      * Polynomial 0x5B (1011011, Koopman) = (x+1)(x^6 + x^5 + x^3 + x^2 + 1) = 0x37 (0110111, Normal)
      * <p>
@@ -37,19 +109,105 @@ namespace OTV0P2BASE
      * <p>
      * For 2 or 3 byte payloads this should have a Hamming distance of 4 and be within a factor of 2 of optimal error detection.
      * <p>
-     * TODO: provide table-driven optimised alternative,
-     *     eg see http://www.tty1.net/pycrc/index_en.html
+     * Implementation selected by OTV0P2BASE_CRC7_5B_IMPL.
      */
-    uint8_t crc7_5B_update(uint8_t crc, const uint8_t datum)
+    uint8_t crc7_5B_update(const uint8_t crc, const uint8_t datum)
         {
-        for(uint8_t i = 0x80; i != 0; i >>= 1)
+#if 0 == OTV0P2BASE_CRC7_5B_IMPL
+        return(crc7_5B_update_bitwise(crc, datum));
+#elif 1 == OTV0P2BASE_CRC7_5B_IMPL
+        return(crc7_5B_update_nibble(crc, datum));
+#else
+        return(crc7_5B_update_table(crc, datum));
+#endif
+        }
+
+#ifdef OTV0P2BASE_CRC7_5B_SLICE4
+    // Registers after clocking in 16, 24 and 32 bits (the index then zeros),
+    // for combining the effect of 4 bytes at once.
+    static const uint8_t crc7_5B_sliceTable[3][256] =
+        {
+        {
+            0x00, 0x68, 0xd0, 0xb8, 0xce, 0xa6, 0x1e, 0x76, 0xf2, 0x9a, 0x22, 0x4a, 0x3c, 0x54, 0xec, 0x84,
+            0x8a, 0xe2, 0x5a, 0x32, 0x44, 0x2c, 0x94, 0xfc, 0x78, 0x10, 0xa8, 0xc0, 0xb6, 0xde, 0x66, 0x0e,
+            0x7a, 0x12, 0xaa, 0xc2, 0xb4, 0xdc, 0x64, 0x0c, 0x88, 0xe0, 0x58, 0x30, 0x46, 0x2e, 0x96, 0xfe,
+            0xf0, 0x98, 0x20, 0x48, 0x3e, 0x56, 0xee, 0x86, 0x02, 0x6a, 0xd2, 0xba, 0xcc, 0xa4, 0x1c, 0x74,
+            0xf4, 0x9c, 0x24, 0x4c, 0x3a, 0x52, 0xea, 0x82, 0x06, 0x6e, 0xd6, 0xbe, 0xc8, 0xa0, 0x18, 0x70,
+            0x7e, 0x16, 0xae, 0xc6, 0xb0, 0xd8, 0x60, 0x08, 0x8c, 0xe4, 0x5c, 0x34, 0x42, 0x2a, 0x92, 0xfa,
+            0x8e, 0xe6, 0x5e, 0x36, 0x40, 0x28, 0x90, 0xf8, 0x7c, 0x14, 0xac, 0xc4, 0xb2, 0xda, 0x62, 0x0a,
+            0x04, 0x6c, 0xd4, 0xbc, 0xca, 0xa2, 0x1a, 0x72, 0xf6, 0x9e, 0x26, 0x4e, 0x38, 0x50, 0xe8, 0x80,
+            0x86, 0xee, 0x56, 0x3e, 0x48, 0x20, 0x98, 0xf0, 0x74, 0x1c, 0xa4, 0xcc, 0xba, 0xd2, 0x6a, 0x02,
+            0x0c, 0x64, 0xdc, 0xb4, 0xc2, 0xaa, 0x12, 0x7a, 0xfe, 0x96, 0x2e, 0x46, 0x30, 0x58, 0xe0, 0x88,
+            0xfc, 0x94, 0x2c, 0x44, 0x32, 0x5a, 0xe2, 0x8a, 0x0e, 0x66, 0xde, 0xb6, 0xc0, 0xa8, 0x10, 0x78,
+            0x76, 0x1e, 0xa6, 0xce, 0xb8, 0xd0, 0x68, 0x00, 0x84, 0xec, 0x54, 0x3c, 0x4a, 0x22, 0x9a, 0xf2,
+            0x72, 0x1a, 0xa2, 0xca, 0xbc, 0xd4, 0x6c, 0x04, 0x80, 0xe8, 0x50, 0x38, 0x4e, 0x26, 0x9e, 0xf6,
+            0xf8, 0x90, 0x28, 0x40, 0x36, 0x5e, 0xe6, 0x8e, 0x0a, 0x62, 0xda, 0xb2, 0xc4, 0xac, 0x14, 0x7c,
+            0x08, 0x60, 0xd8, 0xb0, 0xc6, 0xae, 0x16, 0x7e, 0xfa, 0x92, 0x2a, 0x42, 0x34, 0x5c, 0xe4, 0x8c,
+            0x82, 0xea, 0x52, 0x3a, 0x4c, 0x24, 0x9c, 0xf4, 0x70, 0x18, 0xa0, 0xc8, 0xbe, 0xd6, 0x6e, 0x06,
+        },
+        {
+            0x00, 0x62, 0xc4, 0xa6, 0xe6, 0x84, 0x22, 0x40, 0xa2, 0xc0, 0x66, 0x04, 0x44, 0x26, 0x80, 0xe2,
+            0x2a, 0x48, 0xee, 0x8c, 0xcc, 0xae, 0x08, 0x6a, 0x88, 0xea, 0x4c, 0x2e, 0x6e, 0x0c, 0xaa, 0xc8,
+            0x54, 0x36, 0x90, 0xf2, 0xb2, 0xd0, 0x76, 0x14, 0xf6, 0x94, 0x32, 0x50, 0x10, 0x72, 0xd4, 0xb6,
+            0x7e, 0x1c, 0xba, 0xd8, 0x98, 0xfa, 0x5c, 0x3e, 0xdc, 0xbe, 0x18, 0x7a, 0x3a, 0x58, 0xfe, 0x9c,
+            0xa8, 0xca, 0x6c, 0x0e, 0x4e, 0x2c, 0x8a, 0xe8, 0x0a, 0x68, 0xce, 0xac, 0xec, 0x8e, 0x28, 0x4a,
+            0x82, 0xe0, 0x46, 0x24, 0x64, 0x06, 0xa0, 0xc2, 0x20, 0x42, 0xe4, 0x86, 0xc6, 0xa4, 0x02, 0x60,
+            0xfc, 0x9e, 0x38, 0x5a, 0x1a, 0x78, 0xde, 0xbc, 0x5e, 0x3c, 0x9a, 0xf8, 0xb8, 0xda, 0x7c, 0x1e,
+            0xd6, 0xb4, 0x12, 0x70, 0x30, 0x52, 0xf4, 0x96, 0x74, 0x16, 0xb0, 0xd2, 0x92, 0xf0, 0x56, 0x34,
+            0x3e, 0x5c, 0xfa, 0x98, 0xd8, 0xba, 0x1c, 0x7e, 0x9c, 0xfe, 0x58, 0x3a, 0x7a, 0x18, 0xbe, 0xdc,
+            0x14, 0x76, 0xd0, 0xb2, 0xf2, 0x90, 0x36, 0x54, 0xb6, 0xd4, 0x72, 0x10, 0x50, 0x32, 0x94, 0xf6,
+            0x6a, 0x08, 0xae, 0xcc, 0x8c, 0xee, 0x48, 0x2a, 0xc8, 0xaa, 0x0c, 0x6e, 0x2e, 0x4c, 0xea, 0x88,
+            0x40, 0x22, 0x84, 0xe6, 0xa6, 0xc4, 0x62, 0x00, 0xe2, 0x80, 0x26, 0x44, 0x04, 0x66, 0xc0, 0xa2,
+            0x96, 0xf4, 0x52, 0x30, 0x70, 0x12, 0xb4, 0xd6, 0x34, 0x56, 0xf0, 0x92, 0xd2, 0xb0, 0x16, 0x74,
+            0xbc, 0xde, 0x78, 0x1a, 0x5a, 0x38, 0x9e, 0xfc, 0x1e, 0x7c, 0xda, 0xb8, 0xf8, 0x9a, 0x3c, 0x5e,
+            0xc2, 0xa0, 0x06, 0x64, 0x24, 0x46, 0xe0, 0x82, 0x60, 0x02, 0xa4, 0xc6, 0x86, 0xe4, 0x42, 0x20,
+            0xe8, 0x8a, 0x2c, 0x4e, 0x0e, 0x6c, 0xca, 0xa8, 0x4a, 0x28, 0x8e, 0xec, 0xac, 0xce, 0x68, 0x0a,
+        },
+        {
+            0x00, 0x7c, 0xf8, 0x84, 0x9e, 0xe2, 0x66, 0x1a, 0x52, 0x2e, 0xaa, 0xd6, 0xcc, 0xb0, 0x34, 0x48,
+            0xa4, 0xd8, 0x5c, 0x20, 0x3a, 0x46, 0xc2, 0xbe, 0xf6, 0x8a, 0x0e, 0x72, 0x68, 0x14, 0x90, 0xec,
+            0x26, 0x5a, 0xde, 0xa2, 0xb8, 0xc4, 0x40, 0x3c, 0x74, 0x08, 0x8c, 0xf0, 0xea, 0x96, 0x12, 0x6e,
+            0x82, 0xfe, 0x7a, 0x06, 0x1c, 0x60, 0xe4, 0x98, 0xd0, 0xac, 0x28, 0x54, 0x4e, 0x32, 0xb6, 0xca,
+            0x4c, 0x30, 0xb4, 0xc8, 0xd2, 0xae, 0x2a, 0x56, 0x1e, 0x62, 0xe6, 0x9a, 0x80, 0xfc, 0x78, 0x04,
+            0xe8, 0x94, 0x10, 0x6c, 0x76, 0x0a, 0x8e, 0xf2, 0xba, 0xc6, 0x42, 0x3e, 0x24, 0x58, 0xdc, 0xa0,
+            0x6a, 0x16, 0x92, 0xee, 0xf4, 0x88, 0x0c, 0x70, 0x38, 0x44, 0xc0, 0xbc, 0xa6, 0xda, 0x5e, 0x22,
+            0xce, 0xb2, 0x36, 0x4a, 0x50, 0x2c, 0xa8, 0xd4, 0x9c, 0xe0, 0x64, 0x18, 0x02, 0x7e, 0xfa, 0x86,
+            0x98, 0xe4, 0x60, 0x1c, 0x06, 0x7a, 0xfe, 0x82, 0xca, 0xb6, 0x32, 0x4e, 0x54, 0x28, 0xac, 0xd0,
+            0x3c, 0x40, 0xc4, 0xb8, 0xa2, 0xde, 0x5a, 0x26, 0x6e, 0x12, 0x96, 0xea, 0xf0, 0x8c, 0x08, 0x74,
+            0xbe, 0xc2, 0x46, 0x3a, 0x20, 0x5c, 0xd8, 0xa4, 0xec, 0x90, 0x14, 0x68, 0x72, 0x0e, 0x8a, 0xf6,
+            0x1a, 0x66, 0xe2, 0x9e, 0x84, 0xf8, 0x7c, 0x00, 0x48, 0x34, 0xb0, 0xcc, 0xd6, 0xaa, 0x2e, 0x52,
+            0xd4, 0xa8, 0x2c, 0x50, 0x4a, 0x36, 0xb2, 0xce, 0x86, 0xfa, 0x7e, 0x02, 0x18, 0x64, 0xe0, 0x9c,
+            0x70, 0x0c, 0x88, 0xf4, 0xee, 0x92, 0x16, 0x6a, 0x22, 0x5e, 0xda, 0xa6, 0xbc, 0xc0, 0x44, 0x38,
+            0xf2, 0x8e, 0x0a, 0x76, 0x6c, 0x10, 0x94, 0xe8, 0xa0, 0xdc, 0x58, 0x24, 0x3e, 0x42, 0xc6, 0xba,
+            0x56, 0x2a, 0xae, 0xd2, 0xc8, 0xb4, 0x30, 0x4c, 0x04, 0x78, 0xfc, 0x80, 0x9a, 0xe6, 0x62, 0x1e,
+        },
+        };
+
+    // Slice-by-4 implementation of crc7_5B_update_buf().
+    uint8_t crc7_5B_update_buf_slice4(const uint8_t crc, const uint8_t *buf, size_t len)
+        {
+        uint8_t r = (uint8_t)(crc << 1);
+        for( ; len >= 4; len -= 4, buf += 4)
             {
-            bool bit = (0 != (crc & 0x40));
-            if(0 != (datum & i)) { bit = !bit; }
-            crc <<= 1;
-            if(bit) { crc ^= 0x37; }
+            r = crc7_5B_sliceTable[2][r ^ buf[0]] ^
+                crc7_5B_sliceTable[1][buf[1]] ^
+                crc7_5B_sliceTable[0][buf[2]] ^
+                crc7_5B_byteTable[buf[3]];
             }
-        return(crc & 0x7f);
+        while(len-- > 0) { r = crc7_5B_byteTable[r ^ *buf++]; }
+        return(r >> 1);
+        }
+#endif // OTV0P2BASE_CRC7_5B_SLICE4
+
+    // Update 7-bit CRC with len bytes from buf, as for crc7_5B_update() on each in turn.
+    uint8_t crc7_5B_update_buf(uint8_t crc, const uint8_t *buf, size_t len)
+        {
+#ifdef OTV0P2BASE_CRC7_5B_SLICE4
+        return(crc7_5B_update_buf_slice4(crc, buf, len));
+#else
+        while(len-- > 0) { crc = crc7_5B_update(crc, *buf++); }
+        return(crc);
+#endif
         }
 
     /**As crc7_5B_update() but if the output would be 0, this returns 0x80 instead.
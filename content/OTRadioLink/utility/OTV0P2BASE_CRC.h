@@ -23,8 +23,29 @@ Author(s) / Copyright (s): Damon Hart-Davis 2015--2016
 #ifndef ARDUINO_LIB_OTV0P2BASE_CRC_H
 #define ARDUINO_LIB_OTV0P2BASE_CRC_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+// Implementation of OTV0P2BASE::crc7_5B_update(),
+// selectable at compile time (eg -DOTV0P2BASE_CRC7_5B_IMPL=1) to trade Flash for speed:
+//   * 0  bitwise, smallest and slowest; default on AVR
+//   * 1  nibble table, 16-byte table and two look-ups per byte
+//   * 2  byte table, 256-byte table and one look-up per byte; default elsewhere
+// All give identical results.
+#ifndef OTV0P2BASE_CRC7_5B_IMPL
+#ifdef ARDUINO_ARCH_AVR
+#define OTV0P2BASE_CRC7_5B_IMPL 0
+#else
+#define OTV0P2BASE_CRC7_5B_IMPL 2
+#endif
+#endif
+
+// Defined where crc7_5B_update_buf() processes 4 bytes per step with extra tables (768 bytes);
+// only for non-AVR (eg hosted) builds.
+#if !defined(ARDUINO_ARCH_AVR) && !defined(OTV0P2BASE_CRC7_5B_NO_SLICE4)
+#define OTV0P2BASE_CRC7_5B_SLICE4
+#endif
+
 // Use namespaces to help avoid collisions.
 namespace OTV0P2BASE
     {
@@ -46,6 +67,20 @@ namespace OTV0P2BASE
      */
     extern uint8_t crc7_5B_update(uint8_t crc, uint8_t datum);
 
+    // Update 7-bit CRC with len bytes from buf, as for crc7_5B_update() on each in turn.
+    // buf must not be NULL unless len is zero.
+    extern uint8_t crc7_5B_update_buf(uint8_t crc, const uint8_t *buf, size_t len);
+
+    // Specific implementations of crc7_5B_update(), eg for testing and benchmarking.
+    // Bitwise (reference), nibble table and byte table respectively.
+    extern uint8_t crc7_5B_update_bitwise(uint8_t crc, uint8_t datum);
+    extern uint8_t crc7_5B_update_nibble(uint8_t crc, uint8_t datum);
+    extern uint8_t crc7_5B_update_table(uint8_t crc, uint8_t datum);
+#ifdef OTV0P2BASE_CRC7_5B_SLICE4
+    // Slice-by-4 implementation of crc7_5B_update_buf().
+    extern uint8_t crc7_5B_update_buf_slice4(uint8_t crc, const uint8_t *buf, size_t len);
+#endif
+
     // Value to use in place of 0 for final CRC value, eg for crc7_5B_update_nz_final();
     static const uint8_t crc7_5B_update_nz_ALT = 0x80;
 
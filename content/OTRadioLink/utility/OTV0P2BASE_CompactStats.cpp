@@ -0,0 +1,205 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ Compact binary stats, as an alternative to JSON text in secure frames.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "OTV0P2BASE_CompactStats.h"
+
+
+namespace OTV0P2BASE
+{
+
+
+// Get the key for the given table ID, or NULL if none.
+// The order is part of the over-the-air format: append only.
+MSG_JSON_SimpleStatsKey_t getCompactStatsKey(const uint8_t id)
+  {
+  switch(id)
+    {
+    case 0: return(V0p2_SENSOR_TAG_F("+"));
+    case 1: return(V0p2_SENSOR_TAG_F("T|C16"));
+    case 2: return(V0p2_SENSOR_TAG_F("H|%"));
+    case 3: return(V0p2_SENSOR_TAG_F("L"));
+    case 4: return(V0p2_SENSOR_TAG_F("B|cV"));
+    case 5: return(V0p2_SENSOR_TAG_F("v|%"));
+    case 6: return(V0p2_SENSOR_TAG_F("tT|C"));
+    case 7: return(V0p2_SENSOR_TAG_F("tS|C"));
+    case 8: return(V0p2_SENSOR_TAG_F("vac|h"));
+    case 9: return(V0p2_SENSOR_TAG_F("occ|%"));
+    case 10: return(V0p2_SENSOR_TAG_F("vC|%"));
+    case 11: return(V0p2_SENSOR_TAG_F("O"));
+    case 12: return(V0p2_SENSOR_TAG_F("err"));
+    case 13: return(V0p2_SENSOR_TAG_F("av"));
+    case 14: return(V0p2_SENSOR_TAG_F("RXq0"));
+    case 15: return(V0p2_SENSOR_TAG_F("RXq1"));
+    case 16: return(V0p2_SENSOR_TAG_F("RXq2"));
+    case 17: return(V0p2_SENSOR_TAG_F("RXq3"));
+    case 18: return(V0p2_SENSOR_TAG_F("RXf0"));
+    case 19: return(V0p2_SENSOR_TAG_F("RXf1"));
+    case 20: return(V0p2_SENSOR_TAG_F("RXf2"));
+    case 21: return(V0p2_SENSOR_TAG_F("RXf3"));
+    case 22: return(V0p2_SENSOR_TAG_F("RXdrop"));
+    case 23: return(V0p2_SENSOR_TAG_F("RXhw"));
+    case 24: return(V0p2_SENSOR_TAG_F("RXl|st"));
+    case 25: return(V0p2_SENSOR_TAG_F("RXlx|st"));
+    }
+  return(NULL);
+  }
+
+// True iff the two (non-NULL) keys have the same text; either may be in Flash.
+static bool keysEqual(const MSG_JSON_SimpleStatsKey_t k1, const MSG_JSON_SimpleStatsKey_t k2)
+  {
+#ifdef V0p2_SENSOR_TAG_IS_FlashStringHelper
+  const char *p1 = reinterpret_cast<const char *>(k1);
+  const char *p2 = reinterpret_cast<const char *>(k2);
+  for( ; ; ++p1, ++p2)
+    {
+    const char c1 = pgm_read_byte(p1);
+    if(c1 != char(pgm_read_byte(p2))) { return(false); }
+    if('\0' == c1) { return(true); }
+    }
+#else
+  return(0 == strcmp(k1, k2));
+#endif
+  }
+
+// Get the table ID for the given (non-NULL) key, or MSG_COMPACT_STATS_KEY_ESCAPE if not in the table.
+uint8_t getCompactStatsKeyID(const MSG_JSON_SimpleStatsKey_t key)
+  {
+  for(uint8_t id = 0; id < MSG_COMPACT_STATS_TABLE_SIZE; ++id)
+    { if(keysEqual(key, getCompactStatsKey(id))) { return(id); } }
+  return(MSG_COMPACT_STATS_KEY_ESCAPE);
+  }
+
+// Parse one entry at pos within len bytes, advancing pos; false if malformed.
+// Rejects unknown table IDs, empty or unsafe explicit keys,
+// and varints that are over-long or out of the 16-bit range.
+bool CompactStatsDecoder::parseEntry(const uint8_t *const buf, const uint8_t len, uint8_t &pos, CompactStatsEntry &e)
+  {
+  if(pos >= len) { return(false); }
+  const uint8_t k = buf[pos++];
+  e.key = NULL;
+  e.rawKey = NULL;
+  e.rawKeyLen = 0;
+  e.changed = false;
+  if(MSG_COMPACT_STATS_KEY_ESCAPE != k)
+    {
+    e.key = getCompactStatsKey(k);
+    if(NULL == e.key) { return(false); }
+    }
+  else
+    {
+    if(pos >= len) { return(false); }
+    const uint8_t kl = buf[pos++];
+    if((0 == kl) || (kl > len - pos)) { return(false); }
+    for(uint8_t i = 0; i < kl; ++i)
+      {
+      const char c = char(buf[pos + i]);
+      if((c < 32) || (c > 126) || ('"' == c) || ('\\' == c)) { return(false); }
+      }
+    e.rawKey = reinterpret_cast<const char *>(buf + pos);
+    e.rawKeyLen = kl;
+    pos = uint8_t(pos + kl);
+    }
+  uint32_t z = 0;
+  for(uint8_t shift = 0; ; shift = uint8_t(shift + 7))
+    {
+    if((pos >= len) || (shift > 14)) { return(false); }
+    const uint8_t v = buf[pos++];
+    z |= uint32_t(v & 0x7f) << shift;
+    if(0 == (v & 0x80)) { break; }
+    }
+  if(z > 0xffff) { return(false); }
+  e.value = zigZagDecode16(uint16_t(z));
+  return(true);
+  }
+
+// Decode the len-byte compact stats body at buf.
+CompactStatsDecoder::CompactStatsDecoder(const uint8_t *const buf, const uint8_t len)
+  : b(buf), n(0), bitmapPos(0), pos(1), index(0)
+  {
+  if((NULL == buf) || (0 == len)) { return; }
+  if(MSG_COMPACT_STATS_HEADER_MSBS != (buf[0] & MSG_COMPACT_STATS_HEADER_MASK)) { return; }
+  const uint8_t count = uint8_t(buf[0] & ~MSG_COMPACT_STATS_HEADER_MASK);
+  // Walk all the entries to check them and find the bitmap.
+  uint8_t p = 1;
+  CompactStatsEntry e;
+  for(uint8_t i = 0; i < count; ++i)
+    { if(!parseEntry(buf, len, p, e)) { return; } }
+  const uint8_t bitmapLen = uint8_t((count + 7) / 8);
+  if(len - p != bitmapLen) { return; }
+  // Unused bits in the last bitmap byte must be clear.
+  if((0 != (count & 7)) && (0 != (buf[len-1] >> (count & 7)))) { return; }
+  n = count;
+  bitmapPos = p;
+  }
+
+// Fetch the next entry in order into e; false if none left.
+bool CompactStatsDecoder::next(CompactStatsEntry &e)
+  {
+  if(index >= n) { return(false); }
+  if(!parseEntry(b, uint8_t(bitmapPos), pos, e)) { return(false); } // Checked already.
+  e.changed = (0 != (b[bitmapPos + (index >> 3)] & (1 << (index & 7))));
+  ++index;
+  return(true);
+  }
+
+// Re-expand a compact stats body as JSON for a hub, eg for onward logging.
+// Field formatting follows SimpleStatsRotation::writeJSON(), with no spaces.
+uint8_t compactStatsToJSON(const uint8_t *const body, const uint8_t bodyLen,
+                           char *const buf, const uint8_t bufSize,
+                           const char *const id)
+  {
+  if((NULL == buf) || (bufSize < 3)) { return(0); }
+  CompactStatsDecoder d(body, bodyLen);
+  if(!d.isValid()) { buf[0] = '\0'; return(0); }
+  // As for writeJSON(), filling the buffer is taken as overflow.
+  BufPrint bp(buf, bufSize);
+  bp.print('{');
+  bool commaPending = false;
+  if((NULL != id) && ('\0' != id[0]))
+    {
+    bp.print(F("\"@\":\""));
+    bp.print(id);
+    bp.print('"');
+    commaPending = true;
+    }
+  CompactStatsEntry e;
+  while(d.next(e))
+    {
+    if(commaPending) { bp.print(','); }
+    bp.print('"');
+    if(NULL != e.key) { bp.print(e.key); }
+    else { for(uint8_t i = 0; i < e.rawKeyLen; ++i) { bp.print(e.rawKey[i]); } }
+    bp.print('"');
+    bp.print(':');
+    bp.print(e.value);
+    commaPending = true;
+    }
+  bp.print('}');
+  if(bp.isFull()) { buf[0] = '\0'; return(0); }
+  return(bp.getSize());
+  }
+
+
+} // OTV0P2BASE
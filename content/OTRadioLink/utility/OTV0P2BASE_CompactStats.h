@@ -0,0 +1,165 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ Compact binary stats, as an alternative to JSON text in secure frames.
+
+ The same stats as would be sent as JSON by SimpleStatsRotation
+ are encoded as small integer key IDs from a shared table
+ and zig-zag varint values,
+ so that a secure O frame body can carry several times as many stats.
+
+ The full format is:
+   byte 0   : |  1  |  0  |  1  |  1  |  N3 |  N2 |  N1 |  N0 |   header; N is the entry count [0,15]
+   N entries, each:
+     key    : 1 byte ID in the shared table (see getCompactStatsKey()),
+              or MSG_COMPACT_STATS_KEY_ESCAPE followed by a length byte [1,255] and the key text
+              for any key not in the table
+     value  : int16_t zig-zag encoded then as a little-endian base-128 varint, 1--3 bytes,
+              ie 0 => 0x00, -1 => 0x01, 1 => 0x02, -64 => 0x7f, 64 => 0x80 0x01
+   changed bitmap : (N+7)/8 bytes; bit (i&7) of byte (i>>3) is set iff entry i was
+              a changed value (not yet sent) at the time of writing, else clear;
+              unused trailing bits are zero.
+
+ The header can never be '{' so a compact body is distinguishable from JSON text.
+ There is no ID ("@") field since the frame header carries the ID;
+ the count ("+") field when enabled is the first entry, with key ID 0.
+ */
+
+#ifndef OTV0P2BASE_COMPACTSTATS_H
+#define OTV0P2BASE_COMPACTSTATS_H
+
+#include <stdint.h>
+
+#include "OTV0P2BASE_JSONStats.h"
+
+
+namespace OTV0P2BASE
+{
+
+
+// Header byte: top nibble fixed, bottom nibble the entry count.
+static const uint8_t MSG_COMPACT_STATS_HEADER_MSBS = 0xb0;
+static const uint8_t MSG_COMPACT_STATS_HEADER_MASK = 0xf0;
+// Maximum number of entries in one compact stats body.
+static const uint8_t MSG_COMPACT_STATS_MAX_ENTRIES = 15;
+// Key byte introducing an explicit key not in the shared table.
+static const uint8_t MSG_COMPACT_STATS_KEY_ESCAPE = 0xff;
+// Maximum length of compact stats carried in a secure O frame,
+// ie the 31-byte maximum plaintext body less the valve and flag bytes.
+static const uint8_t MSG_COMPACT_STATS_MAX_LENGTH_SECURE = 29;
+
+// Number of keys in the shared table, with IDs [0,MSG_COMPACT_STATS_TABLE_SIZE-1].
+// IDs must never be reassigned; new keys may only be appended.
+static const uint8_t MSG_COMPACT_STATS_TABLE_SIZE = 26;
+
+// Get the key for the given table ID, or NULL if none.
+MSG_JSON_SimpleStatsKey_t getCompactStatsKey(uint8_t id);
+
+// Get the table ID for the given (non-NULL) key, or MSG_COMPACT_STATS_KEY_ESCAPE if not in the table.
+// Does a linear search with string comparisons.
+uint8_t getCompactStatsKeyID(MSG_JSON_SimpleStatsKey_t key);
+
+// Zig-zag map signed values to unsigned so that small magnitudes give small values.
+inline uint16_t zigZagEncode16(const int16_t v)
+  { return(uint16_t((uint16_t(v) << 1) ^ uint16_t(-(uint16_t(v) >> 15)))); }
+inline int16_t zigZagDecode16(const uint16_t z)
+  { return(int16_t((z >> 1) ^ uint16_t(-(z & 1)))); }
+
+// Number of bytes that putCompactStatsValue() will write for v; 1--3.
+inline uint8_t compactStatsValueLength(const int16_t v)
+  {
+  const uint16_t z = zigZagEncode16(v);
+  return((z < 0x80) ? 1 : ((z < 0x4000) ? 2 : 3));
+  }
+
+// Write v as a zig-zag varint to buf, which must have room for 3 bytes; returns the number written.
+inline uint8_t putCompactStatsValue(uint8_t *const buf, const int16_t v)
+  {
+  uint16_t z = zigZagEncode16(v);
+  uint8_t n = 0;
+  while(z >= 0x80) { buf[n++] = uint8_t(z | 0x80); z >>= 7; }
+  buf[n++] = uint8_t(z);
+  return(n);
+  }
+
+// One decoded compact stats entry.
+struct CompactStatsEntry final
+  {
+  // Key from the shared table, or NULL if an explicit key.
+  MSG_JSON_SimpleStatsKey_t key;
+  // Explicit key text (not '\0'-terminated, within the decoded buffer) and its length, else NULL and 0.
+  const char *rawKey;
+  uint8_t rawKeyLen;
+  // Value.
+  int16_t value;
+  // True if flagged as changed in the bitmap.
+  bool changed;
+  };
+
+// Decodes a compact stats body.
+// The whole body is validated on construction:
+// if not isValid() then next() returns no entries.
+// The buffer must remain unchanged while in use.
+class CompactStatsDecoder final
+  {
+  private:
+    const uint8_t * const b;
+    // Number of entries if valid, else 0.
+    uint8_t n;
+    // Offset of the changed bitmap if valid, else 0.
+    uint8_t bitmapPos;
+    // Offset and index of the next entry for next().
+    uint8_t pos;
+    uint8_t index;
+
+    // Parse one entry at pos within len bytes, advancing pos; false if malformed.
+    static bool parseEntry(const uint8_t *buf, uint8_t len, uint8_t &pos, CompactStatsEntry &e);
+
+  public:
+    // Decode the len-byte compact stats body at buf.
+    CompactStatsDecoder(const uint8_t *buf, uint8_t len);
+
+    // True if the body is well formed, with exactly the length expected.
+    bool isValid() const { return(0 != bitmapPos); }
+
+    // Number of entries; 0 if not valid.
+    uint8_t size() const { return(n); }
+
+    // Fetch the next entry in order into e; false if none left.
+    bool next(CompactStatsEntry &e);
+
+    // Restart from the first entry.
+    void rewind() { pos = 1; index = 0; }
+  };
+
+// Re-expand a compact stats body as JSON for a hub, eg for onward logging.
+// Gives exactly the text that SimpleStatsRotation::writeJSON() would have written for the same stats,
+// with the "@" field from the given ID (eg the node ID in hex from the frame header)
+// unless NULL or empty.
+//   * body, bodyLen  the compact stats body
+//   * buf, bufSize  output buffer for the '\0'-terminated JSON text
+//   * id  printable ID text, with no " nor \, or NULL
+// Returns the JSON length, or 0 if the body is malformed or the buffer too small.
+uint8_t compactStatsToJSON(const uint8_t *body, uint8_t bodyLen,
+                           char *buf, uint8_t bufSize,
+                           const char *id = NULL);
+
+
+}
+#endif
@@ -0,0 +1,253 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ Host-side streaming replay of hub JSON stats logs.
+ */
+
+#include "OTV0P2BASE_JSONLogReplay.h"
+
+#ifdef JSONLogReplay_DEFINED
+
+#include <string.h>
+
+#include "OTV0P2BASE_JSONStats.h"
+
+
+namespace OTV0P2BASE
+{
+
+
+// Maximum number of fields in one record; bounded by MSG_JSON_MAX_LENGTH.
+static constexpr uint8_t maxFields = MSG_JSON_MAX_LENGTH / 4;
+
+// Parse n decimal digits at p into v; false if any is not a digit.
+static bool parseDigits(const char *p, const uint8_t n, uint16_t &v)
+  {
+  v = 0;
+  for(uint8_t i = 0; i < n; ++i)
+    {
+    const char c = p[i];
+    if((c < '0') || (c > '9')) { return(false); }
+    v = uint16_t(v * 10 + (c - '0'));
+    }
+  return(true);
+  }
+
+// Parse a fixed-format "YYYY-MM-DDThh:mm:ssZ" timestamp at p; false if malformed.
+static bool parseTimestamp(const char *p, JSONLogTime &t)
+  {
+  if(('-' != p[4]) || ('-' != p[7]) || ('T' != p[10]) ||
+     (':' != p[13]) || (':' != p[16]) || ('Z' != p[19])) { return(false); }
+  uint16_t mo, d, h, mi, s;
+  if(!parseDigits(p, 4, t.year) || !parseDigits(p+5, 2, mo) || !parseDigits(p+8, 2, d) ||
+     !parseDigits(p+11, 2, h) || !parseDigits(p+14, 2, mi) || !parseDigits(p+17, 2, s)) { return(false); }
+  if((mo < 1) || (mo > 12) || (d < 1) || (d > 31) || (h > 23) || (mi > 59) || (s > 60)) { return(false); }
+  t.month = uint8_t(mo); t.day = uint8_t(d); t.hour = uint8_t(h); t.minute = uint8_t(mi); t.second = uint8_t(s);
+  return(true);
+  }
+
+// Parse an integer value at p, advancing p past it.
+// Returns true if it is a plain in-range integer,
+// else false with p just past any number-like text (eg a fraction or exponent).
+static bool parseInt(const char *&p, int32_t &v)
+  {
+  const bool neg = ('-' == *p);
+  if(neg) { ++p; }
+  if((*p < '0') || (*p > '9')) { return(false); }
+  int64_t a = 0;
+  bool ok = true;
+  while((*p >= '0') && (*p <= '9'))
+    {
+    if(ok) { a = a * 10 + (*p - '0'); }
+    if(a > (int64_t(1) << 31)) { ok = false; }
+    ++p;
+    }
+  if(('.' == *p) || ('e' == *p) || ('E' == *p))
+    {
+    while((('0' <= *p) && (*p <= '9')) || ('.' == *p) || ('e' == *p) || ('E' == *p) || ('+' == *p) || ('-' == *p)) { ++p; }
+    return(false);
+    }
+  if(neg) { a = -a; }
+  if(!ok || (a > INT32_MAX)) { return(false); }
+  v = int32_t(a);
+  return(true);
+  }
+
+// A field parsed from a record.
+struct Field final
+  {
+  const char *key;
+  int32_t v;
+  };
+
+// Parse a superficially-valid simple JSON object in place, null-terminating each key,
+// collecting up to maxFields integer-valued fields.
+// Returns the number of integer fields, or -1 if the object is malformed.
+static int parseObject(char *p, Field *const fields)
+  {
+  int n = 0;
+  ++p; // Skip '{'.
+  if('}' == *p) { return(0); }
+  for( ; ; )
+    {
+    if('"' != *p) { return(-1); } // ERROR
+    char *const key = ++p;
+    while(('"' != *p) && ('\0' != *p)) { ++p; }
+    if('"' != *p) { return(-1); } // ERROR
+    *p++ = '\0';
+    if(':' != *p++) { return(-1); } // ERROR
+    const char *q = p;
+    if('"' == *q)
+      {
+      // Skip string value, allowing for escaped characters.
+      for(++q; '"' != *q; ++q)
+        {
+        if('\0' == *q) { return(-1); } // ERROR
+        if(('\\' == *q) && ('\0' != q[1])) { ++q; }
+        }
+      ++q;
+      }
+    else if(('-' == *q) || (('0' <= *q) && (*q <= '9')))
+      {
+      int32_t v;
+      if(parseInt(q, v) && (n < maxFields)) { fields[n].key = key; fields[n].v = v; ++n; }
+      }
+    else
+      {
+      // Skip other (eg true/false/null) values.
+      while((',' != *q) && ('}' != *q) && ('\0' != *q)) { ++q; }
+      }
+    p = const_cast<char *>(q);
+    if(',' == *p) { ++p; continue; }
+    if(('}' == *p) && ('\0' == p[1])) { return(n); }
+    return(-1); // ERROR
+    }
+  }
+
+JSONLogNodeSink *JSONLogReplay::getSink(const char *const id, const size_t idLen)
+  {
+  if((lastID.size() == idLen) && (0 == memcmp(lastID.data(), id, idLen))) { return(lastSink); }
+  idScratch.assign(id, idLen);
+  auto it = sinks.find(idScratch);
+  if(sinks.end() == it) { it = sinks.emplace(idScratch, factory.sinkForNode(idScratch.c_str())).first; }
+  lastID = idScratch;
+  lastSink = it->second;
+  return(lastSink);
+  }
+
+bool JSONLogReplay::processLine(char *const line)
+  {
+  ++linesRead;
+  // Trim trailing whitespace, including any '\r'.
+  size_t len = strlen(line);
+  while((len > 0) && ((' ' == line[len-1]) || ('\r' == line[len-1]) || ('\t' == line[len-1]))) { line[--len] = '\0'; }
+  if(0 == len) { return(false); }
+  JSONLogTime t;
+  if((len < 20) || !parseTimestamp(line, t) || (' ' != line[20])) { ++linesRejected; return(false); } // ERROR
+  char *p = line + 21;
+  while(' ' == *p) { ++p; }
+  const char *const id = p;
+  while((' ' != *p) && ('\0' != *p)) { ++p; }
+  const size_t idLen = size_t(p - id);
+  if((0 == idLen) || ('\0' == *p)) { ++linesRejected; return(false); } // ERROR
+  while(' ' == *p) { ++p; }
+  if(!quickValidateRawSimpleJSONMessage(p)) { ++linesRejected; return(false); } // ERROR
+  Field fields[maxFields];
+  const int n = parseObject(p, fields);
+  if(n < 0) { ++linesRejected; return(false); } // ERROR
+  ++linesAccepted;
+  JSONLogNodeSink *const sink = getSink(id, idLen);
+  if(NULL == sink) { return(true); }
+  sink->record(t);
+  for(int i = 0; i < n; ++i) { sink->value(t, fields[i].key, fields[i].v); }
+  return(true);
+  }
+
+bool JSONLogReplay::replay(FILE *const f)
+  {
+  if(readBuf.empty()) { readBuf.resize(readBufSize); }
+  char *const b = readBuf.data();
+  // Bytes of an incomplete line held at the start of the buffer.
+  size_t held = 0;
+  // True while skipping the rest of an over-long line.
+  bool discarding = false;
+  for( ; ; )
+    {
+    // Leave space for a terminating '\0' after a final unterminated line.
+    const size_t n = fread(b + held, 1, readBufSize - 1 - held, f);
+    if(0 == n) { break; }
+    char *const end = b + held + n;
+    char *start = b;
+    // Held bytes contain no newline, so only scan the new ones.
+    char *scan = b + held;
+    char *nl;
+    while(NULL != (nl = static_cast<char *>(memchr(scan, '\n', size_t(end - scan)))))
+      {
+      *nl = '\0';
+      if(discarding) { discarding = false; }
+      else { processLine(start); }
+      start = scan = nl + 1;
+      }
+    held = size_t(end - start);
+    if(readBufSize - 1 == held)
+      {
+      // No newline in a full buffer: reject the line and skip the rest of it.
+      if(!discarding) { ++linesRead; ++linesRejected; discarding = true; }
+      held = 0;
+      }
+    else if((0 != held) && (start != b)) { memmove(b, start, held); }
+    }
+  if(ferror(f)) { return(false); } // ERROR
+  if((0 != held) && !discarding) { b[held] = '\0'; processLine(b); }
+  return(true);
+  }
+
+bool JSONLogReplay::replay(const char *const filename)
+  {
+  FILE *const f = fopen(filename, "r");
+  if(NULL == f) { return(false); } // ERROR
+  const bool result = replay(f);
+  fclose(f);
+  return(result);
+  }
+
+void JSONLogKeyTimelines::NodeSink::value(const JSONLogTime &t, const char *const k, const int32_t v)
+  {
+  if(0 != strcmp(k, key)) { return; }
+  const Sample s = { t, v };
+  timeline.push_back(s);
+  }
+
+JSONLogNodeSink *JSONLogKeyTimelines::sinkForNode(const char *const id)
+  {
+  if(!onlyNode.empty() && (onlyNode != id)) { return(NULL); }
+  return(&nodes.emplace(id, key.c_str()).first->second);
+  }
+
+const JSONLogKeyTimelines::Timeline *JSONLogKeyTimelines::getTimeline(const char *const id) const
+  {
+  const auto it = nodes.find(id);
+  if(nodes.end() == it) { return(NULL); }
+  return(&it->second.timeline);
+  }
+
+
+}
+
+#endif // JSONLogReplay_DEFINED
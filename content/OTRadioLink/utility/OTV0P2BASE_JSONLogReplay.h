@@ -0,0 +1,185 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ Host-side (non-Arduino) streaming replay of hub JSON stats logs,
+ eg to feed months of real sensor data from many nodes into detectors under test.
+
+ Log lines are of the form:
+
+     2016-10-08T09:33:12Z 96F0CED3B4E690E8 {"@":"96F0CED3B4E690E8","+":1,"L":134}
+
+ ie a fixed-format UTC timestamp, a node ID, and a raw simple JSON stats message
+ as checked by quickValidateRawSimpleJSONMessage().
+
+ Keywords: JSON log replay hub stats timeline
+ */
+
+#ifndef OTV0P2BASE_JSONLOGREPLAY_H
+#define OTV0P2BASE_JSONLOGREPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(ARDUINO)
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#endif
+
+
+namespace OTV0P2BASE
+{
+
+
+#if !defined(ARDUINO)
+#define JSONLogReplay_DEFINED
+
+// UTC timestamp of a log line, as logged.
+struct JSONLogTime final
+  {
+  uint16_t year;
+  uint8_t month; // [1,12]
+  uint8_t day; // [1,31]
+  uint8_t hour; // [0,23]
+  uint8_t minute; // [0,59]
+  uint8_t second; // [0,60]
+  };
+
+// Consumer of the records from one node.
+// The key passed to value() is only valid for the duration of the call.
+class JSONLogNodeSink
+  {
+  public:
+    virtual ~JSONLogNodeSink() { }
+    // Called once for each valid record from this node, before its values.
+    virtual void record(const JSONLogTime &) { }
+    // Called for each integer-valued field of the record in order, eg "L" and 134.
+    // Fields with string, fractional or other values are not passed on.
+    virtual void value(const JSONLogTime &t, const char *key, int32_t v) = 0;
+  };
+
+// Supplies the consumer for each node ID as it is first seen in the log.
+class JSONLogSinkFactory
+  {
+  public:
+    virtual ~JSONLogSinkFactory() { }
+    // Return the sink for the given node ID, or NULL to ignore the node.
+    // Called once per distinct ID; the sink must remain valid for the lifetime of the replay.
+    virtual JSONLogNodeSink *sinkForNode(const char *id) = 0;
+  };
+
+// Streaming demultiplexer of hub JSON log lines to per-node consumers.
+// Reads the log in large fixed-size chunks and parses in place,
+// so does not load whole files nor allocate per line.
+// Malformed lines (bad timestamp, missing ID, invalid JSON, too long) are counted and skipped.
+// Not thread-safe.
+class JSONLogReplay final
+  {
+  public:
+    // Size of the read buffer and thus the maximum line length.
+    static constexpr size_t readBufSize = 1 << 16;
+
+  private:
+    JSONLogSinkFactory &factory;
+    // Sinks (possibly NULL) by node ID.
+    std::unordered_map<std::string, JSONLogNodeSink *> sinks;
+    // Scratch ID string for lookups, to avoid reallocation per line.
+    std::string idScratch;
+    // Most recent ID/sink looked up, as consecutive lines are often from the same node.
+    std::string lastID;
+    JSONLogNodeSink *lastSink;
+    // Read buffer, allocated on first use.
+    std::vector<char> readBuf;
+
+    // Find or create (via the factory) the sink for id; NULL if to be ignored.
+    JSONLogNodeSink *getSink(const char *id, size_t idLen);
+
+  public:
+    // Lines seen (including blank lines), valid (including from ignored nodes), and rejected as malformed.
+    uint32_t linesRead;
+    uint32_t linesAccepted;
+    uint32_t linesRejected;
+
+    JSONLogReplay(JSONLogSinkFactory &f) : factory(f), lastSink(NULL), linesRead(0), linesAccepted(0), linesRejected(0) { }
+
+    // Number of distinct node IDs seen in valid lines, including ignored nodes.
+    size_t nodesSeen() const { return(sinks.size()); }
+
+    // Process one null-terminated log line, without its line terminator (a trailing '\r' is allowed).
+    // Modifies the line in place.
+    // Blank lines are ignored.
+    // Returns true if the line was valid, whether or not its node is being ignored.
+    bool processLine(char *line);
+
+    // Stream every line from f (already open for reading) until EOF.
+    // A final line need not be newline-terminated.
+    // Lines of readBufSize-1 bytes or more (excluding the terminator) are rejected.
+    // Returns false on a read error.
+    bool replay(FILE *f);
+
+    // Replay the named file; false if it cannot be opened or read.
+    bool replay(const char *filename);
+  };
+
+// Collects a timeline of one integer field (eg "L" for ambient light level) per node,
+// eg to replace hand-extracted {day,hour,minute,level} test tables.
+class JSONLogKeyTimelines final : public JSONLogSinkFactory
+  {
+  public:
+    struct Sample final
+      {
+      JSONLogTime t;
+      int32_t v;
+      };
+    typedef std::vector<Sample> Timeline;
+
+  private:
+    class NodeSink final : public JSONLogNodeSink
+      {
+      public:
+        const char *const key;
+        Timeline timeline;
+        NodeSink(const char *k) : key(k) { }
+        virtual void value(const JSONLogTime &t, const char *k, int32_t v) override;
+      };
+    const std::string key;
+    // If non-empty, only this node is collected.
+    const std::string onlyNode;
+    std::map<std::string, NodeSink> nodes;
+
+  public:
+    // Collect field k from all nodes, or only from node id if not NULL.
+    JSONLogKeyTimelines(const char *k, const char *id = NULL) : key(k), onlyNode((NULL == id) ? "" : id) { }
+
+    virtual JSONLogNodeSink *sinkForNode(const char *id) override;
+
+    // Timeline for the given node; NULL if none collected.
+    const Timeline *getTimeline(const char *id) const;
+    // Number of nodes with timelines (possibly empty).
+    size_t size() const { return(nodes.size()); }
+  };
+
+#endif // !defined(ARDUINO)
+
+
+}
+
+#endif
@@ -25,6 +25,7 @@ Author(s) / Copyright (s): Damon Hart-Davis 2014--2016
 
 #include "OTV0P2BASE_ArduinoCompat.h"
 #include "OTV0P2BASE_JSONStats.h"
+#include "OTV0P2BASE_CompactStats.h"
 #include "OTV0P2BASE_CRC.h"
 #include "OTV0P2BASE_EEPROM.h"
 #include "OTV0P2BASE_QuickPRNG.h"
@@ -193,10 +194,32 @@ bool isValidSimpleStatsKey(const MSG_JSON_SimpleStatsKey_t key)
   return(true);
   }
 
+// Get the i-th char of a key, which may be in Flash.
+static inline char keyChar(const MSG_JSON_SimpleStatsKey_t key, const uint8_t i)
+  {
+#ifdef V0p2_SENSOR_TAG_IS_FlashStringHelper
+  return(char(pgm_read_byte(reinterpret_cast<const char *>(key) + i)));
+#else
+  return(key[i]);
+#endif
+  }
+
+// Get the length of a (valid, non-NULL) key, which may be in Flash.
+static uint8_t keyLength(const MSG_JSON_SimpleStatsKey_t key)
+  {
+  uint8_t n = 0;
+  while('\0' != keyChar(key, n)) { ++n; }
+  return(n);
+  }
+
 // Returns read/write pointer to stats tuple with given (non-NULL) key if present, else NULL.
-// Does a simple linear search.
+// Does a simple linear search,
+// first by pointer since keys are usually the same static (eg Sensor tag) strings each time,
+// then by content.
 SimpleStatsRotationBase::DescValueTuple * SimpleStatsRotationBase::findByKey(const MSG_JSON_SimpleStatsKey_t key) const
   {
+  for(int i = 0; i < nStats; ++i)
+    { if(key == stats[i].descriptor.key) { return(stats + i); } }
   for(int i = 0; i < nStats; ++i)
     {
     DescValueTuple * const p = stats + i;
@@ -224,12 +247,19 @@ SimpleStatsRotationBase::DescValueTuple * SimpleStatsRotationBase::findByKey(con
   return(NULL); // Not found.
   }
 
-// Remove given stat and properties.
-// True iff the item existed and was removed.
-bool SimpleStatsRotationBase::remove(const MSG_JSON_SimpleStatsKey_t key)
+// As findByKey() but first trying the cached slot, and updating it when found.
+// A slot hit costs one pointer comparison; a stale slot falls back to the full search.
+SimpleStatsRotationBase::DescValueTuple * SimpleStatsRotationBase::findBySlot(KeySlot &slot, const MSG_JSON_SimpleStatsKey_t key) const
+  {
+  if((slot.index < nStats) && (key == stats[slot.index].descriptor.key)) { return(stats + slot.index); }
+  DescValueTuple * const p = findByKey(key);
+  if(NULL != p) { slot.index = uint8_t(p - stats); }
+  return(p);
+  }
+
+// Remove the found stat p (non-NULL), moving the last stat into its place.
+void SimpleStatsRotationBase::_remove(DescValueTuple * const p)
   {
-  DescValueTuple *p = findByKey(key);
-  if(NULL == p) { return(false); }
   // If it needs to be removed and is not the last item
   // then move the last item down into its slot.
   const bool lastItem = ((p - stats) == (nStats - 1));
@@ -237,6 +267,26 @@ bool SimpleStatsRotationBase::remove(const MSG_JSON_SimpleStatsKey_t key)
   // We got rid of one!
   // TODO: possibly explicitly destroy/overwrite the removed one at the end.
   --nStats;
+  }
+
+// Remove given stat and properties.
+// True iff the item existed and was removed.
+bool SimpleStatsRotationBase::remove(const MSG_JSON_SimpleStatsKey_t key)
+  {
+  DescValueTuple *p = findByKey(key);
+  if(NULL == p) { return(false); }
+  _remove(p);
+  return(true);
+  }
+
+// Remove given stat and properties, using the cached slot for the key.
+// True iff the item existed and was removed.
+bool SimpleStatsRotationBase::remove(KeySlot &slot, const MSG_JSON_SimpleStatsKey_t key)
+  {
+  if(NULL == key) { return(false); }
+  DescValueTuple *p = findBySlot(slot, key);
+  if(NULL == p) { return(false); }
+  _remove(p);
   return(true);
   }
 
@@ -255,6 +305,7 @@ bool SimpleStatsRotationBase::putDescriptor(const GenericStatsDescriptor &descri
     p = stats + (nStats++);
     *p = DescValueTuple();
     p->descriptor = descriptor;
+    p->keyLen = keyLength(descriptor.key);
     }
   // Else failed: no space to add a new item.
   else { return(false); }
@@ -267,17 +318,26 @@ bool SimpleStatsRotationBase::putDescriptor(const GenericStatsDescriptor &descri
 // True if successful, false otherwise (eg capacity already reached).
 bool SimpleStatsRotationBase::put(const MSG_JSON_SimpleStatsKey_t key, const int16_t newValue, const bool statLowPriority)
   {
-  if(!isValidSimpleStatsKey(key))
-    {
-#if 0 && defined(DEBUG)
-DEBUG_SERIAL_PRINT_FLASHSTRING("Bad JSON key ");
-DEBUG_SERIAL_PRINT(key);
-DEBUG_SERIAL_PRINTLN();
-#endif
-    return(false);
-    }
+  if(NULL == key) { return(false); }
+  return(_put(findByKey(key), key, newValue, statLowPriority));
+  }
 
-  DescValueTuple *p = findByKey(key);
+// Create/update value for given stat/key, using and updating the cached slot for the key.
+bool SimpleStatsRotationBase::put(KeySlot &slot, const MSG_JSON_SimpleStatsKey_t key, const int16_t newValue, const bool statLowPriority)
+  {
+  if(NULL == key) { return(false); }
+  DescValueTuple * const p = findBySlot(slot, key);
+  if(!_put(p, key, newValue, statLowPriority)) { return(false); }
+  // If newly added then it is at the end.
+  if(NULL == p) { slot.index = nStats - 1; }
+  return(true);
+  }
+
+// Update the value of the found stat p, or add it if p is NULL.
+// The key is only validated when added, since any already present must be valid.
+// True if successful, false otherwise (eg capacity already reached).
+bool SimpleStatsRotationBase::_put(DescValueTuple *p, const MSG_JSON_SimpleStatsKey_t key, const int16_t newValue, const bool statLowPriority)
+  {
   // If item already exists, update it.
   if(NULL != p)
     {
@@ -291,6 +351,16 @@ DEBUG_SERIAL_PRINTLN();
     return(true);
     }
 
+  if(!isValidSimpleStatsKey(key))
+    {
+#if 0 && defined(DEBUG)
+DEBUG_SERIAL_PRINT_FLASHSTRING("Bad JSON key ");
+DEBUG_SERIAL_PRINT(key);
+DEBUG_SERIAL_PRINTLN();
+#endif
+    return(false);
+    }
+
   // If not yet at capacity then add this new item at the end.
   // Mark it as changed to prioritise seeing it in the JSON output.
   if(nStats < capacity)
@@ -301,6 +371,7 @@ DEBUG_SERIAL_PRINTLN();
     p->flags.changed = true;
     // Copy descriptor .
     p->descriptor = GenericStatsDescriptor(key, statLowPriority);
+    p->keyLen = keyLength(key);
     // Addition of new field done!
     return(true);
     }
@@ -313,22 +384,6 @@ DEBUG_SERIAL_PRINTLN();
   return(false); // FAILED: full.
   }
 
-// Print an object field "name":value to the given buffer.
-size_t SimpleStatsRotationBase::print(BufPrint &bp, const SimpleStatsRotationBase::DescValueTuple &s, bool &commaPending) const
-  {
-  size_t w = 0;
-  if(commaPending) { w += bp.print(','); }
-  w += bp.print('"');
-  w += bp.print(s.descriptor.key); // Assumed not to need escaping in any way.
-  w += bp.print('"');
-  w += bp.print(':');
-  const int16_t v = s.value;
-  // Optimisation here for common small non-negative values, eg zero.
-  w += ((v >= 0) && (v <= 9)) ? bp.print((char)('0' + v)) : bp.print(v);
-  commaPending = true;
-  return(w);
-  }
-
 // True if any changed values are pending (not yet written out).
 bool SimpleStatsRotationBase::changedValue() const
   {
@@ -338,39 +393,175 @@ bool SimpleStatsRotationBase::changedValue() const
   return(false);
   }
 
-// Write stats in JSON format to provided buffer; returns the non-zero JSON length if successful.
-// Output starts with an "@" (ID) string field,
-// then and optional count (if enabled),
-// then the tracked stats as space permits,
-// attempting to give priority to high-priority and changed values,
-// allowing a potentially large set of values to my multiplexed over time
-// into a constrained size/bandwidth message.
-//
-//   * buf  is the byte/char buffer to write the JSON to; never NULL
-//   * bufSize is the capacity of the buffer starting at buf in bytes;
-//       must be 2 greater than the largest JSON output to be generated
-//       to allow for a trailing null and one extra byte/char
-//       to ensure that the message is not over-large
-//   * sensitivity  CURRENTLY IGNORED threshold below which
-//     (sensitive) stats will not be included; 0 means include everything
-//   * maximise  if true then attempt to maximise the number of stats
-//       squeezed into each generated frame,
-//       potentially at the cost of significant CPU time and bandwidth,
-//       though where frame is padded anyway, eg before encryption,
-//       overall bandwidth efficiency may be increased
-//   * suppressClearChanged  if true then 'changed' flag for included fields
-//       is not cleared by this,
-//       allowing them to continue to be treated as higher priority
-uint8_t SimpleStatsRotationBase::writeJSON(uint8_t *const buf, const uint8_t bufSize, const uint8_t /*sensitivity*/,
-                                           const bool maximise, const bool suppressClearChanged)
-  {
-  if(NULL == buf) { return(0); } // Should never happen, but be graceful if given a NULL buffer.
+// Writers for SimpleStatsRotationBase::_writeJSON().
+// Each accepts chars for the header (silently dropping any beyond the buffer capacity)
+// and whole "key":value fields which are only kept if they fit within a given length.
+// minFieldAndClose is the space needed for the smallest possible extra field plus the close.
+namespace {
 
-// Minimum size is for {"@":""} plus null plus extra padding char/byte to check for overrun.
-  if(bufSize < 10) { return(0); } // Failed.
-
-  // Write/print to buffer passed in.
-  BufPrint bp((char *)buf, bufSize);
+// Prints to a BufPrint, rewinding any field that turns out not to fit.
+class PrintJSONWriter final
+  {
+  private:
+    uint8_t * const b;
+    BufPrint bp;
+  public:
+    // Smallest possible entry is 6 chars, eg ',"L":0', plus 3 needed at end.
+    static constexpr uint8_t minFieldAndClose = 6 + 3;
+    PrintJSONWriter(uint8_t * const buf, const uint8_t bufSize) : b(buf), bp((char *)buf, bufSize) { }
+    void putChar(const char c) { bp.print(c); }
+    void putText(const MSG_JSON_SimpleStatsKey_t t) { bp.print(t); }
+    void putClose() { bp.print('}'); }
+    void setMark() { bp.setMark(); }
+    bool putField(const bool comma, const MSG_JSON_SimpleStatsKey_t key, uint8_t /*keyLen*/, const int16_t v, bool /*changed*/, const uint8_t maxLen)
+      {
+      if(comma) { bp.print(','); }
+      bp.print('"');
+      bp.print(key); // Assumed not to need escaping in any way.
+      bp.print('"');
+      bp.print(':');
+      // Optimisation here for common small non-negative values, eg zero.
+      if((v >= 0) && (v <= 9)) { bp.print((char)('0' + v)); } else { bp.print(v); }
+      if(bp.getSize() > maxLen) { bp.rewind(); return(false); }
+      bp.setMark();
+      return(true);
+      }
+    uint8_t getSize() const { return(bp.getSize()); }
+    bool isFull() const { return(bp.isFull()); }
+    void abort() { *b = '\0'; }
+    void terminate() { } // Always terminated.
+  };
+
+// For writeJSONForTX(): computes each field's length before writing anything,
+// then writes it with a block copy of the key,
+// maintaining the running JSON TX CRC of everything after the leading '{'
+// and before the closing '}'.
+class FastJSONWriter final
+  {
+  private:
+    uint8_t * const b;
+    const uint8_t capacity;
+    uint8_t size = 0;
+  public:
+    // CRC as from adjustJSONMsgForTXAndComputeCRC(), so far.
+    uint8_t crc = '{';
+    static constexpr uint8_t minFieldAndClose = 6 + 3;
+    FastJSONWriter(uint8_t * const buf, const uint8_t bufSize) : b(buf), capacity(bufSize - 1) { }
+    void putChar(const char c)
+      {
+      if(size >= capacity) { return; }
+      if(0 != size) { crc = crc7_5B_update(crc, uint8_t(c)); }
+      b[size++] = uint8_t(c);
+      }
+    void putText(const MSG_JSON_SimpleStatsKey_t t)
+      { for(uint8_t i = 0; ; ++i) { const char c = keyChar(t, i); if('\0' == c) { break; } putChar(c); } }
+    void putClose() { if(size < capacity) { b[size++] = '}'; } }
+    void setMark() { }
+    bool putField(const bool comma, const MSG_JSON_SimpleStatsKey_t key, const uint8_t keyLen, const int16_t v, bool /*changed*/, const uint8_t maxLen)
+      {
+      // Render the value right-aligned; at most 6 chars, eg "-32768".
+      char digits[6];
+      uint8_t nd = 0;
+      uint16_t u = (v < 0) ? uint16_t(-int32_t(v)) : uint16_t(v);
+      do { digits[5 - nd++] = char('0' + (u % 10)); u /= 10; } while(0 != u);
+      if(v < 0) { digits[5 - nd++] = '-'; }
+      // Give up without writing anything if the whole field won't fit.
+      const uint8_t len = uint8_t((comma ? 1 : 0) + keyLen + 3 + nd);
+      if(uint16_t(size) + len > maxLen) { return(false); }
+      uint8_t * const start = b + size;
+      uint8_t *p = start;
+      if(comma) { *p++ = ','; }
+      *p++ = '"';
+#ifdef V0p2_SENSOR_TAG_IS_FlashStringHelper
+      memcpy_P(p, key, keyLen);
+#else
+      memcpy(p, key, keyLen);
+#endif
+      p += keyLen;
+      *p++ = '"';
+      *p++ = ':';
+      memcpy(p, digits + 6 - nd, nd);
+      crc = crc7_5B_update_buf(crc, start, len);
+      size = uint8_t(size + len);
+      return(true);
+      }
+    uint8_t getSize() const { return(size); }
+    bool isFull() const { return(size == capacity); }
+    void abort() { *b = '\0'; }
+    void terminate() { b[size] = '\0'; }
+  };
+
+// Writes the compact binary form (see OTV0P2BASE_CompactStats.h) using the whole buffer,
+// ignoring the JSON header chars and length limit.
+// The count, if enabled, is written at construction as the first entry.
+// Each entry is only written if it fits along with the changed bitmap,
+// which together with the header byte is filled in by putClose().
+class CompactStatsWriter final
+  {
+  private:
+    uint8_t * const b;
+    const uint8_t capacity;
+    // Header and entries so far.
+    uint8_t size = 1;
+    // Number of entries, and their changed flags with entry i at bit i.
+    uint8_t n = 0;
+    uint16_t changedBits = 0;
+  public:
+    // Smallest possible entry is 2 bytes, eg table key and value 0, plus 1 possible extra bitmap byte.
+    static constexpr uint8_t minFieldAndClose = 2 + 1;
+    // The buffer must have room for at least the header, count and bitmap, ie 5 bytes.
+    CompactStatsWriter(uint8_t * const buf, const uint8_t bufSize, const bool countEnabled, const uint8_t count)
+      : b(buf), capacity(bufSize)
+      {
+      if(!countEnabled) { return; }
+      b[size++] = 0; // Table ID for "+".
+      size = uint8_t(size + putCompactStatsValue(b + size, count));
+      ++n;
+      }
+    void putChar(char) { }
+    void putText(MSG_JSON_SimpleStatsKey_t) { }
+    void putClose()
+      {
+      b[0] = uint8_t(MSG_COMPACT_STATS_HEADER_MSBS | n);
+      for(uint8_t i = 0; i < n; i = uint8_t(i + 8)) { b[size++] = uint8_t(changedBits >> i); }
+      }
+    void setMark() { }
+    bool putField(bool /*comma*/, const MSG_JSON_SimpleStatsKey_t key, const uint8_t keyLen, const int16_t v, const bool changed, uint8_t /*maxLen*/)
+      {
+      if(n >= MSG_COMPACT_STATS_MAX_ENTRIES) { return(false); }
+      const uint8_t id = getCompactStatsKeyID(key);
+      const bool escaped = (MSG_COMPACT_STATS_KEY_ESCAPE == id);
+      const uint16_t len = uint16_t((escaped ? 2 + keyLen : 1) + compactStatsValueLength(v));
+      if(size + len + (n + 8) / 8 > capacity) { return(false); }
+      b[size++] = id;
+      if(escaped)
+        {
+        b[size++] = keyLen;
+#ifdef V0p2_SENSOR_TAG_IS_FlashStringHelper
+        memcpy_P(b + size, key, keyLen);
+#else
+        memcpy(b + size, key, keyLen);
+#endif
+        size = uint8_t(size + keyLen);
+        }
+      size = uint8_t(size + putCompactStatsValue(b + size, v));
+      if(changed) { changedBits |= uint16_t(1U << n); }
+      ++n;
+      return(true);
+      }
+    uint8_t getSize() const { return(size); }
+    bool isFull() const { return(false); } // Room for the bitmap is always kept.
+    void abort() { }
+    void terminate() { }
+  };
+
+}
+
+// Write the JSON with the given writer, choosing which fields to include; see writeJSON().
+// The field selection and side-effects are the same whichever writer is used.
+template<class W>
+uint8_t SimpleStatsRotationBase::_writeJSON(W &w, const uint8_t bufSize, const bool maximise, const bool suppressClearChanged)
+  {
   // Maximum size that can be taken up before final "}\0".
   const uint8_t maxLengthBeforeClose = bufSize - 3;
 
@@ -378,47 +569,41 @@ uint8_t SimpleStatsRotationBase::writeJSON(uint8_t *const buf, const uint8_t buf
   bool commaPending = false;
 
   // Start object.
-  bp.print('{');
+  w.putChar('{');
 
   // Write ID first unless disabled entirely by being set to an empty string.
-  if((NULL == id) ||
-#ifdef V0p2_SENSOR_TAG_IS_FlashStringHelper
-     ('\0' != pgm_read_byte(id))
-#else
-     ('\0' != *id)
-#endif
-    )
+  if((NULL == id) || ('\0' != keyChar(id, 0)))
     {
     // If an explicit ID is supplied then use it
     // else use the first two bytes of the node ID if accessible.
-    bp.print(F("\"@\":\""));
-    if(NULL != id) { bp.print(id); } // Value has to be 'safe' (eg no " nor \ in it).
+    w.putChar('"'); w.putChar('@'); w.putChar('"'); w.putChar(':'); w.putChar('"');
+    if(NULL != id) { w.putText(id); } // Value has to be 'safe' (eg no " nor \ in it).
 #ifdef V0P2BASE_EE_START_ID // TODO: improve logic/portability
     else
       {
       const uint8_t id1 = eeprom_read_byte(0 + (uint8_t *)V0P2BASE_EE_START_ID);
       const uint8_t id2 = eeprom_read_byte(1 + (uint8_t *)V0P2BASE_EE_START_ID);
-      bp.print(hexDigit(id1 >> 4));
-      bp.print(hexDigit(id1));
-      bp.print(hexDigit(id2 >> 4));
-      bp.print(hexDigit(id2));
+      w.putChar(hexDigit(id1 >> 4));
+      w.putChar(hexDigit(id1));
+      w.putChar(hexDigit(id2 >> 4));
+      w.putChar(hexDigit(id2));
       }
 #endif
-    bp.print('"');
+    w.putChar('"');
     commaPending = true;
     }
 
   // Write count next iff enabled.
   if(c.enabled)
     {
-    if(commaPending) { bp.print(','); commaPending = false; }
-    bp.print(F("\"+\":"));
-    bp.print(c.count);
+    if(commaPending) { w.putChar(','); commaPending = false; }
+    w.putChar('"'); w.putChar('+'); w.putChar('"'); w.putChar(':');
+    w.putChar(char('0' + c.count)); // Single digit.
     commaPending = true;
     }
 
   // Be prepared to rewind back to logical start of buffer.
-  bp.setMark();
+  w.setMark();
 
   if(nStats != 0)
     {
@@ -446,18 +631,14 @@ uint8_t SimpleStatsRotationBase::writeJSON(uint8_t *const buf, const uint8_t buf
         if(!s.flags.changed) { continue; }
         // Found suitable stat to include in output.
         hiPriIndex = next;
-        // Add to JSON output.
-        print(bp, s, commaPending);
-        // If successful, ie still space for the closing "}\0" within length,
-        // then mark this as a fall-back, else rewind and discard this item.
-        // If this is over-length rewind but try for the next (TODO-1079).
-        if(bp.getSize() > maxLengthBeforeClose) { bp.rewind(); continue; }
-        else
-          {
-          bp.setMark();
-          if(!suppressClearChanged) { stats[next].flags.changed = false; }
-          break;
-          }
+        // Add to JSON output, if there is still space for the closing "}\0" within length.
+        // Note that a separator is expected after any attempt, even if it did not fit.
+        // If this is over-length try the next (TODO-1079).
+        const bool fits = w.putField(commaPending, s.descriptor.key, s.keyLen, s.value, s.flags.changed, maxLengthBeforeClose);
+        commaPending = true;
+        if(!fits) { continue; }
+        if(!suppressClearChanged) { s.flags.changed = false; }
+        break;
         }
       }
 
@@ -482,29 +663,21 @@ uint8_t SimpleStatsRotationBase::writeJSON(uint8_t *const buf, const uint8_t buf
         if(s.descriptor.lowPriority && !s.flags.changed && doChangedFirst)
             { continue; }
         // Found suitable stat to include in output.
-        // Add to JSON output.
-        print(bp, s, commaPending);
-        // If successful then mark this as a fall-back, else rewind and discard this item.
-        // If successful, ie still space for the closing "}\0" without running over-length
-        // then mark this as a fall-back, else rewind and discard this item.
+        // Add to JSON output, if there is still space for the closing "}\0" within length.
         // If overlength then stop, to preserve the basic stats rotation.
-        if(bp.getSize() > maxLengthBeforeClose)
-          { bp.rewind(); break; }
-        else
-          {
-          bp.setMark();
-          if(!suppressClearChanged) { stats[next].flags.changed = false; }
-          lastTXed = next;
-          }
+        const bool fits = w.putField(commaPending, s.descriptor.key, s.keyLen, s.value, s.flags.changed, maxLengthBeforeClose);
+        commaPending = true;
+        if(!fits) { break; }
+        if(!suppressClearChanged) { s.flags.changed = false; }
+        lastTXed = next;
         if(!maximise) { break; }
         }
       }
 
     // Attempt to fill up any remaining space with more changes (TODO-1079).
     // Only attempt this if maximise==true and there is plausible space, etc.
-    // Smallest possible entry is 6 chars, eg ',"L":0', plus 3 needed at end.
     // Don't attempt this if 'changed' flags are not being cleared.
-    if(maximise && !suppressClearChanged && (bp.getSize() <= bufSize - (6 + 3)))
+    if(maximise && !suppressClearChanged && (w.getSize() + W::minFieldAndClose <= bufSize))
       {
       uint8_t next = lastTXed;
       for(int i = nStats; --i >= 0; )
@@ -517,42 +690,96 @@ uint8_t SimpleStatsRotationBase::writeJSON(uint8_t *const buf, const uint8_t buf
         // Skip stat if unchanged.
         if(!s.flags.changed) { continue; }
         // Found suitable stat to include in output.
-        // Add to JSON output.
-        print(bp, s, commaPending);
-        // If successful, ie still space for the closing "}\0" within length,
-        // then mark this as a fall-back, else rewind and discard this item.
+        // Add to JSON output, if there is still space for the closing "}\0" within length.
         // If this is over-length try the next to pack the frame (TODO-1079).
-        if(bp.getSize() > maxLengthBeforeClose)
-          { bp.rewind(); continue; }
-        else
-          {
-          bp.setMark();
-          stats[next].flags.changed = false; // NOTE: !suppressClearChanged
-          }
+        const bool fits = w.putField(commaPending, s.descriptor.key, s.keyLen, s.value, s.flags.changed, maxLengthBeforeClose);
+        commaPending = true;
+        if(!fits) { continue; }
+        s.flags.changed = false; // NOTE: !suppressClearChanged
         }
       }
     }
 
   // Terminate object.
-  bp.print('}');
-#if 0
-  DEBUG_SERIAL_PRINT_FLASHSTRING("JSON: ");
-  DEBUG_SERIAL_PRINT((char *)buf);
-  DEBUG_SERIAL_PRINTLN();
-#endif
-//  if(w >= (size_t)(bufSize-1))
-  if(bp.isFull())
+  w.putClose();
+  if(w.isFull())
     {
     // Overrun, so failed/aborted.
     // Shouldn't really be possible unless buffer far far too small.
-    *buf = '\0';
+    w.abort();
     return(0);
     }
+  w.terminate();
 
   // On successfully creating output, update some internal state including success count.
   ++c.count;
 
-  return(bp.getSize()); // Success!
+  return(w.getSize()); // Success!
+  }
+
+// Write stats in JSON format to provided buffer; returns the non-zero JSON length if successful.
+// Output starts with an "@" (ID) string field,
+// then and optional count (if enabled),
+// then the tracked stats as space permits,
+// attempting to give priority to high-priority and changed values,
+// allowing a potentially large set of values to my multiplexed over time
+// into a constrained size/bandwidth message.
+//
+//   * buf  is the byte/char buffer to write the JSON to; never NULL
+//   * bufSize is the capacity of the buffer starting at buf in bytes;
+//       must be 2 greater than the largest JSON output to be generated
+//       to allow for a trailing null and one extra byte/char
+//       to ensure that the message is not over-large
+//   * sensitivity  CURRENTLY IGNORED threshold below which
+//     (sensitive) stats will not be included; 0 means include everything
+//   * maximise  if true then attempt to maximise the number of stats
+//       squeezed into each generated frame,
+//       potentially at the cost of significant CPU time and bandwidth,
+//       though where frame is padded anyway, eg before encryption,
+//       overall bandwidth efficiency may be increased
+//   * suppressClearChanged  if true then 'changed' flag for included fields
+//       is not cleared by this,
+//       allowing them to continue to be treated as higher priority
+uint8_t SimpleStatsRotationBase::writeJSON(uint8_t *const buf, const uint8_t bufSize, const uint8_t /*sensitivity*/,
+                                           const bool maximise, const bool suppressClearChanged)
+  {
+  if(NULL == buf) { return(0); } // Should never happen, but be graceful if given a NULL buffer.
+  // Minimum size is for {"@":""} plus null plus extra padding char/byte to check for overrun.
+  if(bufSize < 10) { return(0); } // Failed.
+  PrintJSONWriter w(buf, bufSize);
+  return(_writeJSON(w, bufSize, maximise, suppressClearChanged));
+  }
+
+// As writeJSON() then adjustJSONMsgForTXAndComputeCRC() but in a single pass.
+// All the chars written are known to be valid for TX
+// (keys and ID are checked when set, and values are decimal)
+// so only the length needs checking.
+uint8_t SimpleStatsRotationBase::writeJSONForTX(uint8_t *const buf, const uint8_t bufSize, const uint8_t /*sensitivity*/,
+                                                uint8_t &crc,
+                                                const bool maximise, const bool suppressClearChanged)
+  {
+  crc = adjustJSONMsgForTXAndComputeCRC_ERR;
+  if(NULL == buf) { return(0); } // Should never happen, but be graceful if given a NULL buffer.
+  if(bufSize < 10) { return(0); } // Failed.
+  FastJSONWriter w(buf, bufSize);
+  const uint8_t len = _writeJSON(w, bufSize, maximise, suppressClearChanged);
+  if((0 == len) || (len > MSG_JSON_MAX_LENGTH)) { return(len); }
+  // Set high-bit on final '}' to make it unique, and complete the CRC.
+  const uint8_t newC = '}' | 0x80;
+  buf[len-1] = newC;
+  crc = crc7_5B_update(w.crc, newC);
+  return(len);
+  }
+
+// Write stats in compact binary form to the provided buffer; returns the non-zero length if successful.
+// Uses the same field selection as writeJSON(), and has the same side-effects.
+uint8_t SimpleStatsRotationBase::writeCompact(uint8_t *const buf, const uint8_t bufSize,
+                                              const bool maximise, const bool suppressClearChanged)
+  {
+  if(NULL == buf) { return(0); } // Should never happen, but be graceful if given a NULL buffer.
+  if(bufSize < 5) { return(0); } // Failed.
+  CompactStatsWriter w(buf, bufSize, c.enabled, c.count);
+  return(_writeJSON(w, bufSize, maximise, suppressClearChanged));
   }
 
 
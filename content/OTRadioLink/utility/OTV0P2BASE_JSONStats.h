@@ -174,6 +174,18 @@ typedef BufPrintT<Print> BufPrint;
 class SimpleStatsRotationBase
   {
   public:
+    // Remembered position of a stat in the set,
+    // so that repeated updates of the same key (eg from a fixed set of sensors every cycle)
+    // take a single check rather than a search and string comparisons.
+    // A stale slot (eg once remove() has moved that stat) is detected and refreshed by key.
+    // Only meaningful with the one SimpleStatsRotation instance that it is used with.
+    struct KeySlot final
+      {
+      constexpr KeySlot() : index(uint8_t(~0)) { }
+      // Index of the stat last found with this slot; ~0 if none yet.
+      uint8_t index;
+      };
+
     // Create/update value for given stat/key.
     // If properties not already set and not supplied then stat will get defaults.
     // If descriptor is supplied then its key must match (and the descriptor will be copied).
@@ -185,6 +197,10 @@ class SimpleStatsRotationBase
     template <class T> bool put(const OTV0P2BASE::SensorCore<T> &s, bool statLowPriority = false)
         { return(put(s.tag(), s.get(), statLowPriority)); }
 
+    // Create/update value for given stat/key, using and updating the cached slot for the key.
+    // Otherwise as put(key, newValue, statLowPriority).
+    bool put(KeySlot &slot, MSG_JSON_SimpleStatsKey_t key, int16_t newValue, bool statLowPriority = false);
+
     // Create/update stat/key with specified descriptor/properties.
     // The name is taken from the descriptor.
     bool putDescriptor(const GenericStatsDescriptor &descriptor);
@@ -193,6 +209,10 @@ class SimpleStatsRotationBase
     // True iff the item existed and was removed.
     bool remove(MSG_JSON_SimpleStatsKey_t key);
 
+    // Remove given stat and properties, using the cached slot for the key.
+    // True iff the item existed and was removed.
+    bool remove(KeySlot &slot, MSG_JSON_SimpleStatsKey_t key);
+
     // Create/update value for the given sensor if isAvailable(); remove otherwise.
     // True if put() succeeds or a remove() was requested; false if a put() was request and failed.
     template <class T> bool putOrRemove(const OTV0P2BASE::SensorCore<T> &s)
@@ -204,6 +224,12 @@ class SimpleStatsRotationBase
     template <class T> bool putOrRemove(const OTV0P2BASE::SubSensor<T> &s)
         { if(s.isAvailable()) { return(put(s.tag(), s.get(), s.lowPriority)); } remove(s.tag()); return(true); }
 
+    // As putOrRemove() for a sensor or sub-sensor, but using the cached slot for its key.
+    template <class T> bool putOrRemove(KeySlot &slot, const OTV0P2BASE::SensorCore<T> &s)
+        { if(s.isAvailable()) { return(put(slot, s.tag(), s.get(), false)); } remove(slot, s.tag()); return(true); }
+    template <class T> bool putOrRemove(KeySlot &slot, const OTV0P2BASE::SubSensor<T> &s)
+        { if(s.isAvailable()) { return(put(slot, s.tag(), s.get(), s.lowPriority)); } remove(slot, s.tag()); return(true); }
+
     // Set ID to given value, or NULL to use first 2 bytes of system ID; returns false if ID unsafe.
     // If NULL (the default) then dynamically generate the system ID,
     // eg house code as two bytes of hex if set, else first two bytes of binary ID as hex.
@@ -253,9 +279,35 @@ class SimpleStatsRotationBase
     //   * suppressClearChanged  if true then 'changed' flag for included fields
     //       is not cleared by this,
     //       allowing them to continue to be treated as higher priority
+    //
+    // Each field is only written once known to fit, with the key copied as a block,
+    // so the buffer is written once and never rewound.
     uint8_t writeJSON(uint8_t * const buf, const uint8_t bufSize, const uint8_t sensitivity,
                       const bool maximise = false, const bool suppressClearChanged = false);
 
+    // As writeJSON() then adjustJSONMsgForTXAndComputeCRC() but in a single pass,
+    // computing the CRC as the JSON is written.
+    // Returns the JSON length as writeJSON() does,
+    // and sets crc to the CRC as adjustJSONMsgForTXAndComputeCRC() would return it,
+    // ie 0xff if the message is not valid for TX (eg too long),
+    // in which case the final '}' is not adjusted.
+    uint8_t writeJSONForTX(uint8_t * const buf, const uint8_t bufSize, const uint8_t sensitivity,
+                           uint8_t &crc,
+                           const bool maximise = false, const bool suppressClearChanged = false);
+
+    // Write stats in compact binary form (see OTV0P2BASE_CompactStats.h) to the provided buffer;
+    // returns the non-zero length if successful.
+    // Chooses fields as writeJSON() does, with the same side-effects (eg on the count and changed flags),
+    // but all of bufSize is available for the output, with no trailing null,
+    // and there is no ID field since secure frames carry the ID in the header.
+    // For the same stats, compactStatsToJSON() on the output gives the writeJSON() text
+    // wherever the same fields fit in both.
+    //   * buf  is the byte buffer to write to; never NULL
+    //   * bufSize  is the capacity of buf in bytes, eg MSG_COMPACT_STATS_MAX_LENGTH_SECURE; at least 5
+    //   * maximise, suppressClearChanged  as for writeJSON()
+    uint8_t writeCompact(uint8_t * const buf, const uint8_t bufSize,
+                         const bool maximise = false, const bool suppressClearChanged = false);
+
     // Returns true if a stat with the specified key is currently in the stats set.
     // Mainly for unit testing.
     bool containsKey(const MSG_JSON_SimpleStatsKey_t key) const
@@ -273,7 +325,7 @@ class SimpleStatsRotationBase
   protected:
     struct DescValueTuple final
       {
-      constexpr DescValueTuple() : descriptor(NULL), value(0) { }
+      constexpr DescValueTuple() : descriptor(NULL), value(0), keyLen(0) { }
 
       // Descriptor of this stat.
       GenericStatsDescriptor descriptor;
@@ -281,6 +333,9 @@ class SimpleStatsRotationBase
       // Value.
       int16_t value;
 
+      // Length of the key text, computed when the stat is added.
+      uint8_t keyLen;
+
       // Various run-time flags.
       struct Flags final
         {
@@ -304,6 +359,9 @@ class SimpleStatsRotationBase
     // Returns read/write pointer to stat tuple with given key if present, else NULL.
     DescValueTuple *findByKey(MSG_JSON_SimpleStatsKey_t key) const;
 
+    // As findByKey() but first trying the cached slot, and updating it when found.
+    DescValueTuple *findBySlot(KeySlot &slot, MSG_JSON_SimpleStatsKey_t key) const;
+
     // Initialise base with appropriate storage (non-NULL) and capacity knowledge.
     constexpr SimpleStatsRotationBase(DescValueTuple *_stats, uint8_t _capacity)
       : capacity(_capacity), stats(_stats) { }
@@ -344,8 +402,15 @@ class SimpleStatsRotationBase
       uint8_t count : 3; // Increments on each successful write.
       } c;
 
-    // Print an object field "name":value to the given buffer.
-    size_t print(BufPrint &bp, const DescValueTuple &dvt, bool &commaPending) const;
+    // Update the value of the found stat p, or add it if p is NULL.
+    // True if successful, false otherwise (eg capacity already reached).
+    bool _put(DescValueTuple *p, MSG_JSON_SimpleStatsKey_t key, int16_t newValue, bool statLowPriority);
+
+    // Remove the found stat p (non-NULL), moving the last stat into its place.
+    void _remove(DescValueTuple *p);
+
+    // Write the JSON with the given writer, choosing which fields to include; see writeJSON().
+    template<class W> uint8_t _writeJSON(W &w, uint8_t bufSize, bool maximise, bool suppressClearChanged);
   };
 
 template<uint8_t MaxStats>
@@ -381,6 +446,12 @@ class JSONStatsHolder final
     typedef OTV0P2BASE::SimpleStatsRotation<argCount> ss_t;
     ss_t ss;
 
+  private:
+    // Cached stats slot for each argument's key, so that putOrRemoveAll() need not search for them.
+    typename ss_t::KeySlot slots[argCount];
+
+  public:
+
     // Construct an instance; though the template helper function is usually easier.
     template <typename... Args>
     constexpr JSONStatsHolder(Args&&... args) : args(std::forward<Args>(args)...)
@@ -393,14 +464,14 @@ class JSONStatsHolder final
     template<std::size_t> struct Int2Type { };
     // Put...
     // Ignore placeholder key or int entry.
-    bool _putOrRemove(int) { return(true); }
-    bool _putOrRemove(OTV0P2BASE::MSG_JSON_SimpleStatsKey_t) { return(true); }
+    bool _putOrRemove(int, typename ss_t::KeySlot &) { return(true); }
+    bool _putOrRemove(OTV0P2BASE::MSG_JSON_SimpleStatsKey_t, typename ss_t::KeySlot &) { return(true); }
     // Accept/put Sensor (don't over-constrain the arg type else SubSensor etc may not be handled correctly).
-    template <class T> bool _putOrRemove(T &s) { return(ss.putOrRemove(s)); }
+    template <class T> bool _putOrRemove(T &s, typename ss_t::KeySlot &slot) { return(ss.putOrRemove(slot, s)); }
     template<typename ... Args> bool putOrRemove(Int2Type<0>, std::tuple<Args...>& tup)
-        { return(_putOrRemove(std::get<0>(tup))); }
+        { return(_putOrRemove(std::get<0>(tup), slots[0])); }
     template<size_t I, typename ... Args> bool putOrRemove(Int2Type<I>, std::tuple<Args...>& tup)
-        { return(putOrRemove(Int2Type<I-1>(), tup) && _putOrRemove(std::get<I>(tup))); }
+        { return(putOrRemove(Int2Type<I-1>(), tup) && _putOrRemove(std::get<I>(tup), slots[I])); }
     // Read...
     template<typename ... Args> void read(Int2Type<0>, std::tuple<Args...>& tup)
         { return((std::get<0>(tup)).read()); }
@@ -257,7 +257,9 @@ class SupplyVoltageLow : public OTV0P2BASE::Sensor<uint16_t>
 // to save transmitting/logging an information-free final digit
 // even at the risk of some units confusion, though UCUM compliant.
 // To use this an instance should be defined (there is no overhead if not).
-class SupplyVoltageCentiVolts final : public SupplyVoltageLow
+// Supports split-phase reads for SensorScheduler,
+// but with nothing to wait for the whole measurement is done in finishRead().
+class SupplyVoltageCentiVolts final : public SupplyVoltageLow, public OTV0P2BASE::SensorSplitPhase
   {
   public:
     // Default V0p2 very low-battery threshold suitable for 2xAA NiMH, with AVR BOD at 1.8V.
@@ -289,6 +291,10 @@ class SupplyVoltageCentiVolts final : public SupplyVoltageLow
     // NOT thread-safe or usable within ISRs (Interrupt Service Routines).
     virtual uint16_t read() override;
 
+    // Nothing to start: the bandgap is measured in finishRead().
+    virtual uint16_t startRead() override { return(0); }
+    virtual void finishRead() override { read(); }
+
     // Return last value fetched by read(); undefined before first read()).
     // Fast.
     // NOT thread-safe nor usable within ISRs (Interrupt Service Routines).
@@ -28,6 +28,8 @@ Author(s) / Copyright (s): Damon Hart-Davis 2013--2016
 #include <Arduino.h>
 #endif
 
+#include <string.h>
+
 #include "OTV0P2BASE_Security.h"
 
 #include "OTV0P2BASE_ADC.h"
@@ -47,6 +49,64 @@ stats_TX_level getStatsTXLevel() { return((stats_TX_level)eeprom_read_byte((uint
 #endif
 
 
+// Compare ID against prefix of given length as for memcmp(); prefix may be NULL iff prefixLen is 0.
+static inline int cmpIDPrefix(const uint8_t *const id, const uint8_t *const prefix, const uint8_t prefixLen)
+    { return((0 == prefixLen) ? 0 : memcmp(id, prefix, prefixLen)); }
+
+// Returns position of first entry whose ID prefix is not less than the given prefix.
+uint8_t NodeIDPrefixIndexBase::lowerBound(const uint8_t *const prefix, const uint8_t prefixLen) const
+    {
+    uint8_t lo = 0;
+    uint8_t hi = nEntries;
+    while(lo < hi)
+        {
+        const uint8_t mid = lo + ((hi - lo) >> 1);
+        if(cmpIDPrefix(entries[mid].id, prefix, prefixLen) < 0) { lo = mid + 1; }
+        else { hi = mid; }
+        }
+    return(lo);
+    }
+
+// Add full (OpenTRV_Node_ID_Bytes) ID with its association index.
+// Returns false if the index is full or the arguments are bad.
+bool NodeIDPrefixIndexBase::add(const uint8_t *const nodeID, const uint8_t assocIndex)
+    {
+    if((NULL == nodeID) || (nEntries >= capacity) || (assocIndex > 127)) { return(false); }
+    // Find insertion point after any entries with identical IDs and lower association index.
+    uint8_t pos = lowerBound(nodeID, OpenTRV_Node_ID_Bytes);
+    while((pos < nEntries) &&
+          (0 == memcmp(entries[pos].id, nodeID, OpenTRV_Node_ID_Bytes)) &&
+          (entries[pos].assocIndex < assocIndex))
+        { ++pos; }
+    // Shuffle up the tail to make room (small n, so a simple move is fine).
+    memmove(entries + pos + 1, entries + pos, (nEntries - pos) * sizeof(Entry));
+    memcpy(entries[pos].id, nodeID, OpenTRV_Node_ID_Bytes);
+    entries[pos].assocIndex = assocIndex;
+    ++nEntries;
+    return(true);
+    }
+
+// Returns the lowest association index >= startIndex whose ID matches the prefix, else -1.
+int8_t NodeIDPrefixIndexBase::getNextMatchingNodeID(const uint8_t startIndex, const uint8_t *const prefix, const uint8_t prefixLen, uint8_t *const nodeID) const
+    {
+    // Validate inputs as for the non-volatile table scan.
+    if(prefixLen > OpenTRV_Node_ID_Bytes) { return(-1); }
+    if((NULL == prefix) && (0 != prefixLen)) { return(-1); }
+    // All matches are contiguous from the lower bound.
+    // There is usually at most one match for a reasonable prefix length.
+    const Entry *best = NULL;
+    for(uint8_t i = lowerBound(prefix, prefixLen); i < nEntries; ++i)
+        {
+        const Entry &e = entries[i];
+        if(0 != cmpIDPrefix(e.id, prefix, prefixLen)) { break; }
+        if((e.assocIndex >= startIndex) && ((NULL == best) || (e.assocIndex < best->assocIndex))) { best = &e; }
+        }
+    if(NULL == best) { return(-1); }
+    if(NULL != nodeID) { memcpy(nodeID, best->id, OpenTRV_Node_ID_Bytes); }
+    return(int8_t(best->assocIndex));
+    }
+
+
 #ifdef ARDUINO_ARCH_AVR
 
 // Coerce any EEPROM-based node OpenTRV ID bytes to valid values if unset (0xff) or if forced,
@@ -96,6 +156,10 @@ bool ensureIDCreated(const bool force)
   }
 
 
+// Count of calls to setPrimaryBuilding16ByteSecretKey(), wrapping.
+static uint8_t primaryBuildingKeyGeneration;
+uint8_t getPrimaryBuilding16ByteSecretKeyGeneration() { return(primaryBuildingKeyGeneration); }
+
 /**
  * @brief   Sets the primary building 16 byte secret key in EEPROM.
  * @param   newKey    A pointer to the first byte of a 16 byte array containing the new key.
@@ -107,6 +171,8 @@ bool ensureIDCreated(const bool force)
 // Functions for setting a 16 byte primary building secret key, which must not be all-1s.
 bool setPrimaryBuilding16ByteSecretKey(const uint8_t *const newKey) // <-- this should be 16-byte binary, NOT text!
 {
+    // Invalidate any cached material derived from the old key, even if the update fails part way.
+    ++primaryBuildingKeyGeneration;
     // If newKey is a null pointer then clear existing key.
     if(newKey == NULL) {
         // Clear key.
@@ -155,11 +221,37 @@ bool getPrimaryBuilding16ByteSecretKey(uint8_t *key)
   }
 
 
+// RAM copy of the association table IDs for fast look-up of incoming frame IDs.
+// Built from EEPROM on first use and kept in step by the functions that alter the table.
+static NodeIDPrefixIndex<V0P2BASE_EE_NODE_ASSOCIATIONS_MAX_SETS> nodeAssocIndex;
+// True once nodeAssocIndex reflects the EEPROM table.
+static bool nodeAssocIndexValid;
+
+// (Re)build the RAM index of node associations from EEPROM.
+// Called lazily on first look-up, but can usefully be called at start-up
+// to avoid the cost landing on the first received frame.
+void rebuildNodeAssociationIndex()
+    {
+    nodeAssocIndex.clear();
+    const uint8_t n = countNodeAssociations();
+    for(uint8_t i = 0; i < n; ++i)
+        {
+        uint8_t nodeID[OpenTRV_Node_ID_Bytes];
+        eeprom_read_block(nodeID,
+                          (uint8_t *)(V0P2BASE_EE_START_NODE_ASSOCIATIONS + i*(uint16_t)V0P2BASE_EE_NODE_ASSOCIATIONS_SET_SIZE),
+                          OpenTRV_Node_ID_Bytes);
+        nodeAssocIndex.add(nodeID, i);
+        }
+    nodeAssocIndexValid = true;
+    }
+
 /**
  * @brief Clears all existing node IDs.
  */
 void clearAllNodeAssociations()
 {
+    nodeAssocIndex.clear();
+    nodeAssocIndexValid = true;
     uint8_t *nodeIDPtr = (uint8_t *)V0P2BASE_EE_START_NODE_ASSOCIATIONS;
 ////     It would be sufficient to ensure that the first byte of the first entry is erased (0xff)
 ////     IF we erase the first byte of the following entry each time we add any except the last.
@@ -214,12 +306,15 @@ int8_t addNodeAssociation(const uint8_t *nodeID)
         if(eeprom_read_byte(eepromPtr) == 0xff) {
             for(uint8_t j = 0; j < V0P2BASE_EE_NODE_ASSOCIATIONS_SET_SIZE; j++) {
                 if(j < V0P2BASE_EE_NODE_ASSOCIATIONS_8B_ID_LENGTH) {
-                    eeprom_smart_update_byte(eepromPtr++, *nodeID++);
+                    eeprom_smart_update_byte(eepromPtr++, nodeID[j]);
                 } else {
                     // On writing a new association/entry all bytes after the ID must be erased to 0xff.
                     eeprom_smart_erase_byte(eepromPtr++);
                 }
             }
+            // Keep the RAM index in step, or force a rebuild if it is not yet in use.
+            if(nodeAssocIndexValid && !nodeAssocIndex.add(nodeID, i))
+                { nodeAssocIndexValid = false; }
             return (i);
         }
         eepromPtr += V0P2BASE_EE_NODE_ASSOCIATIONS_SET_SIZE; // increment ptr
@@ -240,41 +335,9 @@ int8_t getNextMatchingNodeID(const uint8_t _index, const uint8_t *prefix, const
 {
     // Validate inputs.
     if(_index >= V0P2BASE_EE_NODE_ASSOCIATIONS_MAX_SETS) { return(-1); }
-    if(prefixLen > V0P2BASE_EE_NODE_ASSOCIATIONS_8B_ID_LENGTH) { return(-1); }
-    if((NULL == prefix) && (0 != prefixLen)) { return(-1); }
-
-    // Loop through node IDs until match or last entry tested.
-    //   - if a match is found, return index and fill nodeID
-    //   - if no match, exit loop.
-    uint8_t *eepromPtr = (uint8_t *)V0P2BASE_EE_START_NODE_ASSOCIATIONS + (_index *  (int)V0P2BASE_EE_NODE_ASSOCIATIONS_SET_SIZE);
-    for(uint8_t index = _index; index < V0P2BASE_EE_NODE_ASSOCIATIONS_MAX_SETS; index++) {
-        uint8_t temp = eeprom_read_byte(eepromPtr); // temp variable for byte read
-        if(temp == 0xff) { return(-1); } // last entry reached. exit w/ error.
-        else if((0 == prefixLen) || (temp == *prefix)) { // this is the case where it matches
-            // loop through first prefixLen bytes of nodeID, comparing output
-            uint8_t i; // persistent loop counter
-            uint8_t *tempPtr = eepromPtr;    // temp pointer so that eepromPtr is preserved if not a match
-            if(NULL != nodeID) { nodeID[0] = temp; }
-            for(i = 1; i < prefixLen; i++) {
-                // if bytes match, copy and check next byte?
-                temp = eeprom_read_byte(tempPtr++);
-                if(prefix[i] == temp) {
-                    if(NULL != nodeID) { nodeID[i] = temp; }
-                } else break; // exit inner loop.
-            }
-            if(NULL != nodeID) {
-                // Since prefix matches, copy rest of node ID.
-                for (; i < (V0P2BASE_EE_NODE_ASSOCIATIONS_8B_ID_LENGTH); i++) {
-                    nodeID[i] = eeprom_read_byte(tempPtr++);
-                }
-            }
-            return index;
-        }
-        eepromPtr += V0P2BASE_EE_NODE_ASSOCIATIONS_SET_SIZE; // Increment ptr to next node ID field.
-    }
-
-    // No match has been found.
-    return(-1);
+    // Use the RAM index rather than scanning the EEPROM table entry by entry.
+    if(!nodeAssocIndexValid) { rebuildNodeAssociationIndex(); }
+    return(nodeAssocIndex.getNextMatchingNodeID(_index, prefix, prefixLen, nodeID));
 }
 
 #endif // ARDUINO_ARCH_AVR
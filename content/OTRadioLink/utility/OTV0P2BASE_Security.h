@@ -80,6 +80,11 @@ bool ensureIDCreated(const bool force = false);
  */
 bool setPrimaryBuilding16ByteSecretKey(const uint8_t *key);
 
+// Count of calls to setPrimaryBuilding16ByteSecretKey(), wrapping, starting at zero after reset.
+// Allows caches of material derived from the key (eg expanded key schedules)
+// to notice a change cheaply without re-reading or comparing the key itself.
+uint8_t getPrimaryBuilding16ByteSecretKeyGeneration();
+
 /**
  * @brief   Fills an array with the 16 byte primary building key.
  * @param   key  pointer to a 16 byte buffer to write the key too.
@@ -133,6 +138,81 @@ int8_t addNodeAssociation(const uint8_t *nodeID);
  */
 int8_t getNextMatchingNodeID(uint8_t _index, const uint8_t *prefix, uint8_t prefixLen, uint8_t *nodeID);
 
+// (Re)build the RAM index used by getNextMatchingNodeID() from the stored associations.
+// Done lazily on first look-up, but may usefully be called at start-up
+// to avoid the cost landing on the first received frame.
+void rebuildNodeAssociationIndex();
+
+// RAM-resident index of node association IDs for fast prefix look-up.
+// Holds a copy of each associated full node ID with its association index,
+// sorted by ID so that all entries matching a given prefix are contiguous
+// and can be found with a binary search, ie in O(log n) rather than O(n)
+// reads of (slow) non-volatile storage for every received frame.
+// Duplicate IDs are permitted and are held in association index order.
+// The association indexes are nominally small and dense starting from 0,
+// as for the EEPROM association table.
+// Portable (no hardware dependencies) so that it can be unit tested
+// and benchmarked off-target.
+// Not thread-/ISR- safe.
+class NodeIDPrefixIndexBase
+  {
+  public:
+    // Empty the index, eg to match clearAllNodeAssociations().
+    void clear() { nEntries = 0; }
+
+    // Number of entries currently held.
+    uint8_t size() const { return(nEntries); }
+
+    // Add full (OpenTRV_Node_ID_Bytes) ID with its association index.
+    // Returns false if the index is full or the arguments are bad.
+    bool add(const uint8_t *nodeID, uint8_t assocIndex);
+
+    // Returns the lowest association index >= startIndex whose ID matches the prefix, else -1.
+    // Same semantics as getNextMatchingNodeID().
+    //   * prefix  prefix to match; can be NULL iff prefixLen == 0
+    //   * prefixLen  length of prefix, [0,8] bytes
+    //   * nodeID  if not NULL filled with the full matching ID; NOT PRESERVED WHEN RETURNING -1
+    int8_t getNextMatchingNodeID(uint8_t startIndex, const uint8_t *prefix, uint8_t prefixLen, uint8_t *nodeID) const;
+
+  protected:
+    struct Entry final
+      {
+      uint8_t id[OpenTRV_Node_ID_Bytes];
+      uint8_t assocIndex;
+      };
+
+    // Maximum number of entries.
+    const uint8_t capacity;
+
+    // Initialise base with appropriate storage (non-NULL) and capacity knowledge.
+    constexpr NodeIDPrefixIndexBase(Entry *_entries, uint8_t _capacity)
+      : capacity(_capacity), entries(_entries) { }
+
+  private:
+    // Entries sorted by ID then association index; never NULL.
+    // The initial nEntries slots are used.
+    Entry * const entries;
+
+    // Number of entries in use (packed at the start of the entries[] array).
+    uint8_t nEntries = 0;
+
+    // Returns position of first entry whose ID prefix is not less than the given prefix.
+    uint8_t lowerBound(const uint8_t *prefix, uint8_t prefixLen) const;
+  };
+
+template<uint8_t MaxEntries>
+class NodeIDPrefixIndex final : public NodeIDPrefixIndexBase
+  {
+  private:
+    Entry entries[MaxEntries];
+
+  public:
+    NodeIDPrefixIndex() : NodeIDPrefixIndexBase(entries, MaxEntries) { }
+
+    // Get capacity.
+    uint8_t getCapacity() const { return(MaxEntries); }
+  };
+
 //#if 0 // Pairing API outline.
 //struct pairInfo { bool successfullyPaired; };
 //bool startPairing(bool primary, &pairInfo);
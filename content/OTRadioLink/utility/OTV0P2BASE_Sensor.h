@@ -135,6 +135,30 @@ class Sensor : public SensorCore<T>
 #endif
   };
 
+// Optional mix-in for sensors whose read() can be split into start and finish phases.
+// This allows (eg) SensorScheduler to start conversions on several sensors at once,
+// sleep once until the slowest is ready, then collect all the results,
+// rather than each read() sleeping in turn.
+// A sensor implementing this must give the same result from
+// startRead() then (after the returned delay) finishRead() as from read().
+// Not thread-safe nor usable within ISRs (Interrupt Service Routines).
+class SensorSplitPhase
+  {
+  public:
+    // Returned by startRead() if the reading could not be started, eg on a bus error.
+    static constexpr uint16_t startReadFailed = 0xffff;
+
+    // Start a new reading (eg power up the sensor and trigger a conversion) and return at once.
+    // Returns the maximum time in ms before finishRead() can collect the result,
+    // or 0 if finishRead() can be called immediately (eg if there is nothing to wait for),
+    // or startReadFailed in case of error, when finishRead() must not be called.
+    virtual uint16_t startRead() = 0;
+
+    // Collect the result of the reading begun by startRead(), updating get() as read() would.
+    // Must be called once for each successful startRead(), no sooner than the delay returned.
+    virtual void finishRead() = 0;
+  };
+
 
 // Simple mainly thread-safe uint8_t-valued sensor.
 // Made thread-safe in get() by marking the value volatile
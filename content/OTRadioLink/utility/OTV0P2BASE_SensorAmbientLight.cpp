@@ -190,10 +190,24 @@ static const uint8_t shiftRawScaleTo8Bit = 2;
 // If possible turn off all heavy current drains on supply before calling.
 uint8_t SensorAmbientLight::read()
   {
-  // Power on to top of LDR/phototransistor, directly connected to IO_POWER_UP.
-  OTV0P2BASE::power_intermittent_peripherals_enable(false);
+  startRead();
   // Give supply a moment to settle, eg from heavy current draw elsewhere.
   OTV0P2BASE::nap(WDTO_30MS);
+  finishRead();
+  return(value);
+  }
+
+// Power up the sensor; returns the ms to allow the supply to settle.
+uint16_t SensorAmbientLight::startRead()
+  {
+  // Power on to top of LDR/phototransistor, directly connected to IO_POWER_UP.
+  OTV0P2BASE::power_intermittent_peripherals_enable(false);
+  return(30);
+  }
+
+// Take the reading, power down the sensor, and update the derived values as read() does.
+void SensorAmbientLight::finishRead()
+  {
   // Photosensor vs Vsupply [0,1023].  // May allow against Vbandgap again for some variants.
   const uint16_t al0 = OTV0P2BASE::analogueNoiseReducedRead(V0p2_PIN_LDR_SENSOR_AIN, DEFAULT); // ALREFERENCE);
   const uint16_t al = al0; // Use raw value as-is.
@@ -234,8 +248,6 @@ uint8_t SensorAmbientLight::read()
   DEBUG_SERIAL_PRINT(isRoomLitFlag);
   DEBUG_SERIAL_PRINTLN();
 #endif
-
-   return(value);
   }
 
 // DHD20161104: impl removed from main app.
@@ -219,7 +219,7 @@ class SensorAmbientLightAdaptiveMock : public SensorAmbientLightAdaptive
 // Measurement should be taken wrt to supply voltage, since light indication is a fraction of that.
 // Values below from PICAXE V0.09 impl approx multiplied by 4+ to allow for scale change.
 #define SensorAmbientLight_DEFINED
-class SensorAmbientLight final : public SensorAmbientLightAdaptive
+class SensorAmbientLight final : public SensorAmbientLightAdaptive, public SensorSplitPhase
   {
   private:
   public:
@@ -231,6 +231,11 @@ class SensorAmbientLight final : public SensorAmbientLightAdaptive
     // If possible turn off all local light sources (eg UI LEDs) before calling.
     // If possible turn off all heavy current drains on supply before calling.
     virtual uint8_t read();
+
+    // Power up the sensor; returns the ms to allow the supply to settle.
+    virtual uint16_t startRead() override;
+    // Take the reading, power down the sensor, and update the derived values as read() does.
+    virtual void finishRead() override;
   };
 #endif // ARDUINO_ARCH_AVR
 
@@ -23,6 +23,12 @@ Author(s) / Copyright (s): Damon Hart-Davis 2014--2017
  DS18B20 OneWire(TM) temperature sensor.
  */
 
+#include <string.h>
+
+#ifdef ARDUINO_ARCH_AVR
+#include <util/crc16.h>
+#endif
+
 #include "OTV0P2BASE_SensorDS18B20.h"
 
 
@@ -63,7 +69,7 @@ namespace OTV0P2BASE
 
 // Initialise the device(s) (if any) before first use.
 // Returns true iff successful.
-// Uses specified order DS18B20 found on bus.
+// Searches the bus and caches the addresses of the DS18B20s found, in order.
 // May need to be reinitialised if precision changed.
 bool TemperatureC16_DS18B20::init()
   {
@@ -72,14 +78,13 @@ bool TemperatureC16_DS18B20::init()
   DEBUG_SERIAL_PRINTLN();
 #endif
 
-  bool found = false;
   uint8_t count = 0;
   uint8_t address[8];
 
   // Ensure no bad search state.
   minOW.reset_search();
 
-  while(minOW.search(address))
+  while((count < OTV0P2BASE_DS18B20_MAX_SENSORS) && minOW.search(address))
     {
 #if 0 && defined(DEBUG)
     // Found a device.
@@ -100,33 +105,35 @@ bool TemperatureC16_DS18B20::init()
       continue;
       }
 
-    // Found one and configured it!
-    found = true;
-    count++;
+    // Found one: remember it.
+    memcpy(addresses[count++], address, sizeof(address));
+    }
 
 #if 0 && defined(DEBUG)
-    DEBUG_SERIAL_PRINTLN_FLASHSTRING("Setting precision...");
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("No more devices...");
 #endif
+  minOW.reset_search(); // Be kind to any other OW search user.
 
+#if 0 && defined(DEBUG)
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("Setting precision...");
+#endif
+  for(uint8_t i = 0; i < count; ++i)
+    {
     minOW.reset();
     // Write scratchpad/config.
-    minOW.select(address);
+    minOW.select(addresses[i]);
     minOW.write(CMD_WRITE_SCRATCH);
     minOW.write(0); // Th: not used.
     minOW.write(0); // Tl: not used.
     minOW.write(((precision - 9) << 5) | 0x1f); // Config register; lsbs all 1.
     }
 
-#if 0 && defined(DEBUG)
-  DEBUG_SERIAL_PRINTLN_FLASHSTRING("No more devices...");
-#endif
-  minOW.reset_search(); // Be kind to any other OW search user.
-
   // Search has been run (whether DS18B20 was found or not).
   initialised = true;
+  conversionPending = false;
 
   sensorCount = count;
-  return(found);
+  return(0 != count);
   }
 
 // Force a read/poll of temperature and return the value sensed in nominal units of 1/16 C.
@@ -140,6 +147,65 @@ int16_t TemperatureC16_DS18B20::read()
   return(DEFAULT_INVALID_TEMP);
   }
 
+// Start all DS18B20s on the bus converting, and return immediately.
+// Searches the bus first if not yet done.
+// Returns false if there are no sensors.
+bool TemperatureC16_DS18B20::startConversion()
+  {
+  if(!initialised) { init(); }
+  if(0 == sensorCount) { return(false); }
+
+  // Start a temperature reading on all devices at once.
+  minOW.reset();
+  minOW.skip();
+  minOW.write(CMD_START_CONVO); // Start conversion without parasite power.
+  conversionPending = true;
+  return(true);
+  }
+
+// True once the conversion started by startConversion() is complete (or if none is pending).
+// After a convert command the DS18B20s hold the bus low for read slots until done.
+bool TemperatureC16_DS18B20::isConversionComplete()
+  {
+  if(!conversionPending) { return(true); }
+  return(minOW.read_bit());
+  }
+
+// Collect the results of the conversion started by startConversion(); returns number of values written.
+// One pass over the cached addresses, with no bus search.
+uint8_t TemperatureC16_DS18B20::collect(int16_t *const values, const uint8_t count, const uint8_t index)
+  {
+  if(!conversionPending) { return(0); }
+  conversionPending = false;
+
+  uint8_t n = 0;
+  for(uint8_t s = index; (s < sensorCount) && (n < count); ++s)
+    {
+    // Fetch temperature (scratchpad read).
+    int16_t rawC16 = DEFAULT_INVALID_TEMP;
+    if(minOW.reset())
+      {
+      minOW.select(addresses[s]);
+      minOW.write(CMD_READ_SCRATCH);
+      // Read the first two bytes, or all 9 including the CRC if checking it.
+      uint8_t sp[LOC_SCRATCHPAD_CRC + 1];
+      const uint8_t len = checkCRC ? sizeof(sp) : 2;
+      uint8_t crc = 0;
+      for(uint8_t i = 0; i < len; ++i) { crc = _crc_ibutton_update(crc, (sp[i] = minOW.read())); }
+      // Terminate read and let DS18B20 go back to sleep.
+      minOW.reset();
+      // With the CRC byte included the CRC of the whole scratchpad is 0.
+      if(!checkCRC || (0 == crc))
+        {
+        // Extract raw temperature, masking any undefined lsbit.
+        rawC16 = int16_t((sp[LOC_TEMP_MSB] << 8) | sp[LOC_TEMP_LSB]) & int16_t(~((1 << (MAX_PRECISION - precision)) - 1));
+        }
+      }
+    values[n++] = rawC16;
+    }
+  return(n);
+  }
+
 // Force a read/poll of temperature from multiple DS18B20 sensors; returns number of values read.
 // The value sensed, in nominal units of 1/16 C,
 // is written to the array of uint16_t (with count elements) pointed to by values.
@@ -151,75 +217,21 @@ int16_t TemperatureC16_DS18B20::read()
 // At sub-maximum precision lsbits will be zero or undefined.
 // Expensive/slow.
 // Not thread-safe nor usable within ISRs (Interrupt Service Routines).
-uint8_t TemperatureC16_DS18B20::readMultiple(int16_t *const values, const uint8_t count, uint8_t index)
+uint8_t TemperatureC16_DS18B20::readMultiple(int16_t *const values, const uint8_t count, const uint8_t index)
   {
-  if(!initialised) { init(); }
-  if(0 == sensorCount) { return(0); }
-
-  uint8_t sensor = 0;
-
-  // Start a temperature reading.
-  minOW.reset();
-  minOW.skip();
-  minOW.write(CMD_START_CONVO); // Start conversion without parasite power.
-
-  // Ensure no bad search state.
-  minOW.reset_search();
+  if(!startConversion()) { return(0); }
 
-  uint8_t address[8];
-  while(minOW.search(address))
+  // Poll for conversion complete (bus released)...
+  // Don't allow indefinite blocking;
+  // give up after a second of so.
+  uint8_t i = 67; // Allow for ~1s as ~15ms per loop.
+  while(!isConversionComplete())
     {
-    // Is this a DS18B20?
-    if(DS18B20_MODEL_ID != address[0])
-      {
-#if 0 && defined(DEBUG)
-      DEBUG_SERIAL_PRINTLN_FLASHSTRING("Not a DS18B20, skipping...");
-#endif
-      continue;
-      }
-
-    // Have we reached the first sensor we are interested in
-    if(index > 0)
-      {
-      index--;
-      continue;
-      }
-
-    minOW.reset();
-    minOW.select(address);
-
-    // Poll for conversion complete (bus released)...
-    // Don't allow indefinite blocking;
-    // give up after a second of so returning count of values read before this.
-    uint8_t i = 67; // Allow for ~1s as ~15ms per loop.
-    while(minOW.read_bit() == 0)
-      {
-      if(--i == 0) { return(sensor); }
-      OTV0P2BASE::nap(WDTO_15MS);
-      }
-
-    // Fetch temperature (scratchpad read).
-    minOW.reset();
-    minOW.select(address);
-    minOW.write(CMD_READ_SCRATCH);
-
-    // Read first two bytes of 9 available.  (No CRC config or check.)
-    const uint8_t d0 = minOW.read();
-    const uint8_t d1 = minOW.read();
-    // Terminate read and let DS18B20 go back to sleep.
-    minOW.reset();
-
-    // Extract raw temperature, masking any undefined lsbit.
-    // TODO: mask out undefined LSBs if precision not maximum.
-    const int16_t rawC16 = (d1 << 8) | (d0);
-
-    values[sensor++] = rawC16;
-
-    // Do we have any space left?
-    if(sensor >= count) { break; }
+    if(--i == 0) { conversionPending = false; return(0); }
+    OTV0P2BASE::nap(WDTO_15MS);
     }
 
-  return(sensor);
+  return(collect(values, count, index));
   }
 
 uint8_t TemperatureC16_DS18B20::getSensorCount()
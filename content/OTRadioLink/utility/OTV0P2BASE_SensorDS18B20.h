@@ -34,6 +34,11 @@ namespace OTV0P2BASE
 
 
 #if defined(MinimalOneWireBase_DEFINED) // Required definition.
+// Maximum number of DS18B20s whose ROM addresses are cached (8 bytes of RAM each); others are ignored.
+#ifndef OTV0P2BASE_DS18B20_MAX_SENSORS
+#define OTV0P2BASE_DS18B20_MAX_SENSORS 4
+#endif
+
 // External/off-board DS18B20 temperature sensor in nominal 1/16 C.
 // Requires OneWire support.
 // Will in future be templated on:
@@ -49,8 +54,17 @@ namespace OTV0P2BASE
 // Multiple DS18B20s can nominally be supported on one or multiple OW buses.
 // Not all template parameter combinations may be supported.
 // Provides temperature as a signed int value with 0C == 0 at all precisions.
+//
+// The bus is searched once at init() and the ROM addresses of up to
+// OTV0P2BASE_DS18B20_MAX_SENSORS DS18B20s are kept, in bus search order.
+// Reads can be split-phase so that the caller can sleep or do other work during conversion:
+// startConversion() starts all sensors converting at once and returns immediately,
+// then after getConversionTimeMs() (or once isConversionComplete())
+// collect() fetches the results with one pass over the cached addresses.
+// read() and readMultiple() do both, waiting in between.
+// startRead() and finishRead() do the same for the first sensor, eg for SensorScheduler.
 #define TemperatureC16_DS18B20_DEFINED
-class TemperatureC16_DS18B20 final : public TemperatureC16Base
+class TemperatureC16_DS18B20 final : public TemperatureC16Base, public SensorSplitPhase
   {
   private:
     // Reference to minimal OneWire support instance for appropriate GPIO.
@@ -60,11 +74,20 @@ class TemperatureC16_DS18B20 final : public TemperatureC16Base
     bool initialised = false;
 
     // Precision in range [9,12].
-    const uint8_t precision = DEFAULT_PRECISION;
+    uint8_t precision = DEFAULT_PRECISION;
+
+    // If true, check the CRC of each scratchpad read, at some cost in time and code.
+    const bool checkCRC = false;
+
+    // True while a conversion started by startConversion() has not been collected.
+    bool conversionPending = false;
 
-    // The number of sensors found on the bus
+    // The number of sensors found on the bus, up to OTV0P2BASE_DS18B20_MAX_SENSORS.
     uint8_t sensorCount = 0;
 
+    // ROM addresses of the sensors found, in bus search order.
+    uint8_t addresses[OTV0P2BASE_DS18B20_MAX_SENSORS][8] = { };
+
     // Initialise the device (if any) before first use.
     // Returns true iff successful.
     // Uses specified order DS18B20 found on bus.
@@ -91,13 +114,44 @@ class TemperatureC16_DS18B20 final : public TemperatureC16Base
     // No two instances should attempt to target the same DS18B20,
     // though different DS18B20s on the same bus or different buses is allowed.
     // Precision defaults to minimum (9 bits, 0.5C resolution) for speed.
-    constexpr TemperatureC16_DS18B20(OTV0P2BASE::MinimalOneWireBase &ow, uint8_t _precision = DEFAULT_PRECISION)
-      : minOW(ow), precision(constrain(_precision, MIN_PRECISION, MAX_PRECISION))
+    // If _checkCRC is true then readings whose scratchpad CRC is bad are rejected,
+    // eg for long or noisy connections, at the cost of reading all 9 scratchpad bytes.
+    constexpr TemperatureC16_DS18B20(OTV0P2BASE::MinimalOneWireBase &ow, uint8_t _precision = DEFAULT_PRECISION, bool _checkCRC = false)
+      : minOW(ow), precision(constrain(_precision, MIN_PRECISION, MAX_PRECISION)), checkCRC(_checkCRC)
       { }
 
     // Get current precision in bits [9,12]; 9 gives 1/2C resolution, 12 gives 1/16C resolution.
     uint8_t getPrecisionBits() const { return(precision); }
 
+    // Set precision in bits, constrained to [9,12]; takes effect from the next conversion.
+    // Each bit less halves the conversion time.
+    void setPrecisionBits(const uint8_t bits)
+      {
+      const uint8_t p = constrain(bits, MIN_PRECISION, MAX_PRECISION);
+      if(p != precision) { precision = p; initialised = false; }
+      }
+
+    // Max time for a conversion at the current precision, in ms: 94, 188, 375 or 750.
+    uint16_t getConversionTimeMs() const { return(uint16_t(750U >> (MAX_PRECISION - precision)) + ((precision < 11) ? 1 : 0)); }
+
+    // Start all DS18B20s on the bus converting, and return immediately.
+    // Searches the bus first if not yet done.
+    // Returns false if there are no sensors.
+    // Not thread-safe nor usable within ISRs (Interrupt Service Routines).
+    bool startConversion();
+
+    // True once the conversion started by startConversion() is complete (or if none is pending).
+    // Samples the bus, so no other use of it should intervene after startConversion().
+    bool isConversionComplete();
+
+    // Collect the results of the conversion started by startConversion(); returns number of values written.
+    // Values are written in units of 1/16 C for up to count sensors from index (0 being the first),
+    // in bus search order, as for readMultiple().
+    // A sensor that fails to respond or (if checked) has a bad CRC gives DEFAULT_INVALID_TEMP.
+    // Returns 0 if no conversion has been started.
+    // Not thread-safe nor usable within ISRs (Interrupt Service Routines).
+    uint8_t collect(int16_t *values, uint8_t count, uint8_t index = 0);
+
     // return the number of DS18B20 sensors on the bus
     uint8_t getSensorCount();
 
@@ -110,6 +164,7 @@ class TemperatureC16_DS18B20 final : public TemperatureC16Base
     virtual int16_t read() override;
 
     // Force a read/poll of temperature from multiple DS18B20 sensors; returns number of values read.
+    // Starts a conversion, waits (napping) for it to complete, then collects it.
     // The value sensed, in nominal units of 1/16 C,
     // is written to the array of uint16_t (with count elements) pointed to by values.
     // The values are written in the order they are found on the One-Wire bus.
@@ -121,6 +176,12 @@ class TemperatureC16_DS18B20 final : public TemperatureC16Base
     // Expensive/slow.
     // Not thread-safe nor usable within ISRs (Interrupt Service Routines).
     uint8_t readMultiple(int16_t *values, uint8_t count, uint8_t index = 0);
+
+    // Start all DS18B20s on the bus converting; returns the conversion time in ms, or 0 if there are no sensors.
+    virtual uint16_t startRead() override { return(startConversion() ? getConversionTimeMs() : 0); }
+
+    // Collect the first sensor's result, as read() would.
+    virtual void finishRead() override { if(1 != collect(&value, 1)) { value = DEFAULT_INVALID_TEMP; } }
   };
 #endif // defined(MinimalOneWireBase_DEFINED) // Required definition.
 
@@ -97,32 +97,56 @@ static void SHT21_init()
 // The first read will initialise the device as necessary
 // and leave it in a low-power mode afterwards.
 int16_t RoomTemperatureC16_SHT21::read()
+  {
+  if(startReadFailed == startRead()) { return(DEFAULT_INVALID_TEMP); } // Failure value: may be able to to better.
+  if(SHT21_USE_REDUCED_PRECISION)
+    // Should cover 12-bit conversion (22ms).
+    { OTV0P2BASE::nap(WDTO_30MS); }
+  else
+    // Should be plenty for slowest (14-bit) conversion (85ms).
+    { OTV0P2BASE::sleepLowPowerMs(90); }
+  return(collect());
+  }
+
+// Start a temperature conversion; returns the ms to wait, or startReadFailed in case of error.
+// Uses the no-hold-master command so that TWI can be powered down during the conversion.
+uint16_t RoomTemperatureC16_SHT21::startRead()
   {
   const bool neededPowerUp = OTV0P2BASE::powerUpTWIIfDisabled();
 
   // Initialise/config if necessary.
   if(!SHT21_initialised) { SHT21_init(); }
 
-  // Max RH measurement time:
+  // Max temperature measurement time:
   //   * 14-bit: 85ms
   //   * 12-bit: 22ms
   //   * 11-bit: 11ms
-  // Use blocking data fetch for now.
   Wire.beginTransmission(SHT21_I2C_ADDR);
-  Wire.write((byte) SHT21_I2C_CMD_TEMP_HOLD); // Select control register.
-  if(SHT21_USE_REDUCED_PRECISION)
-    // Should cover 12-bit conversion (22ms).
-    { OTV0P2BASE::nap(WDTO_30MS); }
-  else
-    // Should be plenty for slowest (14-bit) conversion (85ms).
-    { OTV0P2BASE::sleepLowPowerMs(90); }
-  Wire.endTransmission();
-  Wire.requestFrom(SHT21_I2C_ADDR, 3U);
-  while(Wire.available() < 3)
+  Wire.write((byte) SHT21_I2C_CMD_TEMP_NOHOLD); // Start conversion.
+  const bool error = (0 != Wire.endTransmission());
+
+  if(neededPowerUp) { OTV0P2BASE::powerDownTWI(); }
+  if(error) { return(startReadFailed); }
+  return(SHT21_USE_REDUCED_PRECISION ? 25 : 90);
+  }
+
+// Fetch the completed conversion, and store and return the temperature.
+int16_t RoomTemperatureC16_SHT21::collect()
+  {
+  const bool neededPowerUp = OTV0P2BASE::powerUpTWIIfDisabled();
+
+  // In no-hold-master mode the SHT21 does not acknowledge a read until the conversion is complete,
+  // so allow a couple of short retries in case it is running a little slow.
+  bool gotData = false;
+  for(uint8_t i = 3; i-- > 0; )
     {
-    // Wait for data, but avoid rolling over the end of a minor cycle...
-    if(OTV0P2BASE::getSubCycleTime() >= OTV0P2BASE::GSCT_MAX - 2)
-      { return(DEFAULT_INVALID_TEMP); } // Failure value: may be able to to better.
+    if(3 == Wire.requestFrom(SHT21_I2C_ADDR, 3U)) { gotData = true; break; }
+    OTV0P2BASE::sleepLowPowerMs(5);
+    }
+  if(!gotData)
+    {
+    if(neededPowerUp) { OTV0P2BASE::powerDownTWI(); }
+    return(DEFAULT_INVALID_TEMP); // Failure value: may be able to to better.
     }
   uint16_t rawTemp = (Wire.read() << 8);
   rawTemp |= (Wire.read() & 0xfc); // Clear status ls bits.
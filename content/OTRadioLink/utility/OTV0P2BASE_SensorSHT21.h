@@ -99,14 +99,33 @@ class HumiditySensorMock final : public HumiditySensorBase
 // Sensor for relative humidity percentage; 0 is dry, 100 is condensing humid, 255 for error.
 // TODO: detect low supply voltage with user reg, and make isAvailable() return false if too low to be reliable.
 #define HumiditySensorSHT21_DEFINED
-class HumiditySensorSHT21 final : public HumiditySensorBase
-  { public: virtual uint8_t read(); };
+// The SHT21 does one conversion at a time, and at the reduced precision used
+// an RH conversion takes only ~4ms, so the split-phase support simply does the whole read() in finishRead().
+// With SensorScheduler add RoomTemperatureC16_SHT21 before this so that its conversion is collected first.
+class HumiditySensorSHT21 final : public HumiditySensorBase, public OTV0P2BASE::SensorSplitPhase
+  {
+  public:
+    virtual uint8_t read();
+    virtual uint16_t startRead() override { return(0); }
+    virtual void finishRead() override { read(); }
+  };
 
 // SHT21 sensor for ambient/room temperature in 1/16th of one degree Celsius.
 // TODO: detect low supply voltage with user reg, and make isAvailable() return false if too low to be reliable.
+// Split-phase reads use the SHT21 no-hold-master mode so that the bus and CPU are free during conversion.
 #define RoomTemperatureC16_SHT21_DEFINED
-class RoomTemperatureC16_SHT21 final : public OTV0P2BASE::TemperatureC16Base
-  { public: virtual int16_t read(); };
+class RoomTemperatureC16_SHT21 final : public OTV0P2BASE::TemperatureC16Base, public OTV0P2BASE::SensorSplitPhase
+  {
+  private:
+    // Fetch the completed conversion, and store and return the temperature.
+    int16_t collect();
+  public:
+    virtual int16_t read();
+    // Start a temperature conversion; returns the ms to wait, or startReadFailed in case of error.
+    virtual uint16_t startRead() override;
+    // Fetch the result of the conversion begun by startRead().
+    virtual void finishRead() override { collect(); }
+  };
 
 #endif // ARDUINO_ARCH_AVR
 
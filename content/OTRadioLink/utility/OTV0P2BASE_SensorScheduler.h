@@ -0,0 +1,176 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ Scheduler to overlap conversions of split-phase sensors.
+
+ Rather than each sensor's read() sleeping in turn for its own conversion,
+ all sensors due to be polled are started together,
+ the CPU sleeps once until the slowest conversion should be complete,
+ and then all the results are collected.
+ This shortens the time awake in each basic cycle
+ and leaves more of it free for (eg) radio RX.
+ */
+
+#ifndef OTV0P2BASE_SENSORSCHEDULER_H
+#define OTV0P2BASE_SENSORSCHEDULER_H
+
+#include <stdint.h>
+
+#include "OTV0P2BASE_Sensor.h"
+
+
+namespace OTV0P2BASE
+{
+
+
+// Polls a fixed set of split-phase sensors, each at its own interval.
+// Template parameters:
+//   * maxSensors  maximum number of sensors that can be added; strictly positive
+//   * getSubCycleTime  returns the current sub-cycle time [0,gsctMax]
+//   * sleepUntilSubCycleTime  sleeps (in low power) until the specified sub-cycle time
+//   * gsctMax  maximum sub-cycle time; the basic cycle is gsctMax+1 ticks long
+//   * basicCycleMs  length of the basic cycle in milliseconds
+// The defaults match the V0p2 2s basic cycle of 256 ticks.
+//
+// Sensors are started and collected in the order added.
+// Where two sensors share a device that can only do one conversion at a time
+// (eg SHT21 temperature and humidity) the one that is truly split-phase should be added first.
+template<uint8_t maxSensors,
+         uint8_t (*getSubCycleTime)(),
+         bool (*sleepUntilSubCycleTime)(uint8_t),
+         uint8_t gsctMax = 255,
+         uint16_t basicCycleMs = 2000>
+class SensorScheduler final
+  {
+  static_assert(maxSensors > 0, "must allow at least one sensor");
+
+  public:
+    // Sub-cycle ticks to keep clear of the end of the basic cycle when sleeping.
+    static constexpr uint8_t endOfCycleMarginTicks = 2;
+
+  private:
+    struct Entry
+      {
+      SensorSplitPhase *sensor;
+      // Poll interval in seconds; 0 to poll on every call to poll().
+      uint8_t interval_s;
+      // Seconds until the next poll is due; 0 if due at next poll().
+      uint8_t countdown_s;
+      // True while started but not yet collected.
+      bool started;
+      };
+    Entry sensors[maxSensors];
+
+    // Number of sensors added so far.
+    uint8_t nSensors = 0;
+
+    // True if some sensors have been started and not yet collected.
+    bool collectPending = false;
+
+  public:
+    // Convert a delay in ms to whole sub-cycle ticks, rounded up,
+    // plus one to allow for the part of the current tick already gone.
+    static constexpr uint16_t msToTicks(const uint16_t ms)
+      { return(uint16_t(1 + ((uint32_t(ms) * (1U + gsctMax)) + basicCycleMs - 1) / basicCycleMs)); }
+
+    // Add a sensor to be polled every pollInterval_s seconds, or at every poll() if 0.
+    // The interval will typically be the sensor's preferredPollInterval_s() where that is non-zero.
+    // The first poll() after adding will read the sensor.
+    // Returns false if there is no room for the sensor.
+    bool add(SensorSplitPhase &s, const uint8_t pollInterval_s)
+      {
+      if(nSensors >= maxSensors) { return(false); }
+      Entry &e = sensors[nSensors++];
+      e.sensor = &s;
+      e.interval_s = pollInterval_s;
+      e.countdown_s = 0;
+      e.started = false;
+      return(true);
+      }
+
+    // Get the number of sensors added.
+    uint8_t getSensorCount() const { return(nSensors); }
+
+    // True if there are started readings not yet collected by poll() or collect().
+    bool isCollectPending() const { return(collectPending); }
+
+    // Collect the results of all readings started and not yet collected.
+    // Should only be called once the delays returned by the sensors' startRead() have passed;
+    // always safe once the basic cycle in which they were started has ended.
+    // Returns the number of sensors collected.
+    uint8_t collect()
+      {
+      if(!collectPending) { return(0); }
+      uint8_t collected = 0;
+      for(uint8_t i = 0; i < nSensors; ++i)
+        {
+        Entry &e = sensors[i];
+        if(!e.started) { continue; }
+        e.sensor->finishRead();
+        e.started = false;
+        ++collected;
+        }
+      collectPending = false;
+      return(collected);
+      }
+
+    // Start all sensors that are due, sleep once until the slowest is ready, then collect them all.
+    // Should be called once per basic cycle (or more rarely),
+    // with elapsed_s the whole seconds since the previous call, eg 2 for the V0p2 2s cycle.
+    // First collects any readings left over from the previous call.
+    // If sleeping until all are ready would overrun the end of this basic cycle
+    // then the readings are left pending to be collected at the start of the next call
+    // (all supported conversions being shorter than one basic cycle)
+    // or by an explicit collect() once the new cycle has started.
+    // Returns the number of sensors collected during this call.
+    uint8_t poll(const uint8_t elapsed_s)
+      {
+      uint8_t collected = collect();
+
+      // Start all due sensors, noting the longest wait.
+      uint16_t maxDelayMs = 0;
+      for(uint8_t i = 0; i < nSensors; ++i)
+        {
+        Entry &e = sensors[i];
+        if(e.countdown_s > elapsed_s) { e.countdown_s -= elapsed_s; continue; }
+        e.countdown_s = e.interval_s;
+        const uint16_t d = e.sensor->startRead();
+        // Do not try to collect a reading that failed to start; retry when next due.
+        if(SensorSplitPhase::startReadFailed == d) { continue; }
+        if(d > maxDelayMs) { maxDelayMs = d; }
+        e.started = true;
+        collectPending = true;
+        }
+      if(!collectPending) { return(collected); }
+
+      // Sleep once for the slowest conversion, unless that would overrun the cycle.
+      if(0 != maxDelayMs)
+        {
+        const uint16_t target = getSubCycleTime() + msToTicks(maxDelayMs);
+        if(target > uint16_t(gsctMax - endOfCycleMarginTicks)) { return(collected); }
+        sleepUntilSubCycleTime(uint8_t(target));
+        }
+
+      return(collected + collect());
+      }
+  };
+
+
+}
+#endif
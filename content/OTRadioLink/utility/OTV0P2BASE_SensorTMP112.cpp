@@ -49,6 +49,9 @@ static const uint8_t TMP112_CTRL_B1 = 0x31; // Byte 1 for control register: 12-b
 static const uint8_t TMP112_CTRL_B1_OS = 0x80; // Control register: one-shot flag in byte 1.
 static const uint8_t TMP112_CTRL_B2 = 0x0; // Byte 2 for control register: 0.25Hz conversion rate and not extended mode (EM).
 
+// Time to allow for a one-shot conversion, in ms; typically ~26ms, max 35ms.
+static const uint8_t TMP112_CONVERSION_MS = 30;
+
 // Measure/store/return the current room ambient temperature in units of 1/16th C.
 // This may contain up to 4 bits of information to the right of the fixed binary point.
 // This may consume significant power and time.
@@ -57,6 +60,14 @@ static const uint8_t TMP112_CTRL_B2 = 0x0; // Byte 2 for control register: 0.25H
 // This will simulate a zero temperature in case of detected error talking to the sensor as fail-safe for this use.
 // Check for errors at certain critical places, not everywhere.
 int16_t RoomTemperatureC16_TMP112::read()
+  {
+  if(startReadFailed == startRead()) { return(DEFAULT_INVALID_TEMP); } // Exit if error.
+  return(collect());
+  }
+
+// Start a one-shot conversion; returns the ms to wait, or startReadFailed in case of error.
+// TWI is left as found: the conversion continues without it.
+uint16_t RoomTemperatureC16_TMP112::startRead()
   {
   const bool neededPowerUp = OTV0P2BASE::powerUpTWIIfDisabled();
 
@@ -76,9 +87,19 @@ int16_t RoomTemperatureC16_TMP112::read()
   Wire.write((byte) TMP112_REG_CTRL); // Select control register.
   Wire.write((byte) TMP112_CTRL_B1 | TMP112_CTRL_B1_OS); // Start one-shot conversion.
   //Wire.write((byte) TMP112_CTRL_B2);
-  if(Wire.endTransmission()) { return(DEFAULT_INVALID_TEMP); } // Exit if error.
+  const bool error = (0 != Wire.endTransmission());
+
+  if(neededPowerUp) { OTV0P2BASE::powerDownTWI(); }
+  return(error ? startReadFailed : TMP112_CONVERSION_MS);
+  }
+
+// Wait for the conversion to complete if need be, then fetch, store and return the temperature.
+int16_t RoomTemperatureC16_TMP112::collect()
+  {
+  const bool neededPowerUp = OTV0P2BASE::powerUpTWIIfDisabled();
 
   // Wait for temperature measurement/conversion to complete, in low-power sleep mode for the bulk of the time.
+  // After a split-phase startRead() it should already be complete.
 #if 0 && defined(DEBUG)
   DEBUG_SERIAL_PRINTLN_FLASHSTRING("TMP112 waiting for conversion...");
 #endif
@@ -25,6 +25,7 @@ Author(s) / Copyright (s): Damon Hart-Davis 2013--2016
 #ifndef OTV0P2BASE_SENSORTMP112_H
 #define OTV0P2BASE_SENSORTMP112_H
 
+#include "OTV0P2BASE_Sensor.h"
 #include "OTV0P2BASE_SensorTemperatureC16Base.h"
 
 
@@ -33,9 +34,20 @@ namespace OTV0P2BASE
 
 #ifdef ARDUINO_ARCH_AVR
 // TMP112 sensor for ambient/room temperature in 1/16th of one degree Celsius.
+// Split-phase reads allow the ~26ms one-shot conversion to overlap with other sensors'.
 #define RoomTemperatureC16_TMP112_DEFINED
-class RoomTemperatureC16_TMP112 final : public OTV0P2BASE::TemperatureC16Base
-  { public: virtual int16_t read(); };
+class RoomTemperatureC16_TMP112 final : public OTV0P2BASE::TemperatureC16Base, public OTV0P2BASE::SensorSplitPhase
+  {
+  private:
+    // Wait for the conversion to complete if need be, then fetch, store and return the temperature.
+    int16_t collect();
+  public:
+    virtual int16_t read();
+    // Start a one-shot conversion; returns the ms to wait, or startReadFailed in case of error.
+    virtual uint16_t startRead() override;
+    // Fetch the result of the conversion begun by startRead().
+    virtual void finishRead() override { collect(); }
+  };
 #endif // ARDUINO_ARCH_AVR
 
 
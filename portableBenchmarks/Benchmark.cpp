@@ -0,0 +1,137 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * Minimal host-side micro-benchmark harness and driver main().
+ *
+ * Usage: benchmark [-o file.json] [--filter=substring] [--min-time-ms=N]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+#include "Benchmark.h"
+
+
+// Count of heap allocations via operator new, for allocations_per_item.
+static std::atomic<uint32_t> allocationCount(0);
+
+void *operator new(const size_t size)
+    {
+    ++allocationCount;
+    void *const p = malloc((0 == size) ? 1 : size);
+    if(NULL == p) { throw std::bad_alloc(); }
+    return(p);
+    }
+void *operator new[](const size_t size) { return(operator new(size)); }
+void operator delete(void *const p) noexcept { free(p); }
+void operator delete[](void *const p) noexcept { free(p); }
+void operator delete(void *const p, size_t) noexcept { free(p); }
+void operator delete[](void *const p, size_t) noexcept { free(p); }
+
+
+namespace OTBenchmark
+    {
+
+// Registered benchmarks; fixed-size so that registration does not allocate.
+struct Entry final
+    {
+    const char *suite;
+    const char *name;
+    benchmark_fn_t fn;
+    };
+static const int maxBenchmarks = 256;
+static Entry benchmarks[maxBenchmarks];
+static int nBenchmarks;
+
+Registration::Registration(const char *const suite, const char *const name, const benchmark_fn_t fn)
+    {
+    if(nBenchmarks >= maxBenchmarks) { fprintf(stderr, "too many benchmarks, ignoring %s.%s\n", suite, name); return; }
+    benchmarks[nBenchmarks].suite = suite;
+    benchmarks[nBenchmarks].name = name;
+    benchmarks[nBenchmarks].fn = fn;
+    ++nBenchmarks;
+    }
+
+static volatile uint32_t sinkValue;
+void sink(const uint32_t v) { sinkValue = sinkValue + v; }
+
+    }
+
+
+int main(const int argc, char **const argv)
+    {
+    const char *outFile = NULL;
+    const char *filter = NULL;
+    long minTimeMs = 200;
+    for(int i = 1; i < argc; ++i)
+        {
+        if((0 == strcmp(argv[i], "-o")) && (i + 1 < argc)) { outFile = argv[++i]; }
+        else if(0 == strncmp(argv[i], "--filter=", 9)) { filter = argv[i] + 9; }
+        else if(0 == strncmp(argv[i], "--min-time-ms=", 14)) { minTimeMs = atol(argv[i] + 14); }
+        else { fprintf(stderr, "usage: %s [-o file.json] [--filter=substring] [--min-time-ms=N]\n", argv[0]); return(2); }
+        }
+    FILE *const out = (NULL == outFile) ? stdout : fopen(outFile, "w");
+    if(NULL == out) { perror(outFile); return(2); }
+
+    bool allOK = true;
+    fprintf(out, "{\"compiler\":\"%s\",\"benchmarks\":[", __VERSION__);
+    bool first = true;
+    for(int b = 0; b < OTBenchmark::nBenchmarks; ++b)
+        {
+        const OTBenchmark::Entry &e = OTBenchmark::benchmarks[b];
+        char fullName[128];
+        snprintf(fullName, sizeof(fullName), "%s.%s", e.suite, e.name);
+        if((NULL != filter) && (NULL == strstr(fullName, filter))) { continue; }
+        // Warm up, then double the iteration count until the run takes long enough.
+        uint32_t items = e.fn(1);
+        uint32_t iterations = 1;
+        double ns = 0;
+        uint32_t allocs = 0;
+        while(0 != items)
+            {
+            const uint32_t a0 = allocationCount;
+            const auto t0 = std::chrono::steady_clock::now();
+            items = e.fn(iterations);
+            const auto t1 = std::chrono::steady_clock::now();
+            allocs = allocationCount - a0;
+            ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+            if((ns >= minTimeMs * 1e6) || (iterations >= (1U << 30))) { break; }
+            iterations *= 2;
+            }
+        const bool ok = (0 != items);
+        if(!ok) { allOK = false; fprintf(stderr, "FAILED: %s\n", fullName); }
+        fprintf(out, "%s\n{\"name\":\"%s\",\"ok\":%s,\"iterations\":%lu,\"items\":%lu,"
+                     "\"ns_per_item\":%.1f,\"items_per_second\":%.0f,\"allocations_per_item\":%.3f}",
+                first ? "" : ",",
+                fullName, ok ? "true" : "false",
+                (unsigned long)iterations, (unsigned long)items,
+                ok ? ns / items : 0.0,
+                (ok && (ns > 0)) ? items * 1e9 / ns : 0.0,
+                ok ? double(allocs) / items : 0.0);
+        first = false;
+        fflush(out);
+        }
+    fprintf(out, "\n]}\n");
+    if(stdout != out) { fclose(out); }
+    return(allOK ? 0 : 1);
+    }
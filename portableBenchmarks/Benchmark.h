@@ -0,0 +1,55 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * Minimal host-side micro-benchmark harness.
+ *
+ * Each benchmark is run with increasing iteration counts
+ * until it takes at least the minimum time,
+ * and the results are emitted as JSON to allow tracking across releases.
+ */
+
+#ifndef OTRADIOLINK_PORTABLEBENCHMARKS_BENCHMARK_H
+#define OTRADIOLINK_PORTABLEBENCHMARKS_BENCHMARK_H
+
+#include <stdint.h>
+
+namespace OTBenchmark
+    {
+    // Benchmark body: run the operation under test iterations times,
+    // returning the number of items (eg frames) processed, or 0 on failure.
+    typedef uint32_t (*benchmark_fn_t)(uint32_t iterations);
+
+    // Registers a benchmark at static initialisation time; use via OTBENCHMARK().
+    class Registration final
+        {
+        public:
+            Registration(const char *suite, const char *name, benchmark_fn_t fn);
+        };
+
+    // Consume a value so that the compiler cannot optimise away the work that produced it.
+    void sink(uint32_t v);
+    }
+
+// Define a benchmark; the body follows as a function of uint32_t iterations.
+#define OTBENCHMARK(suite, name) \
+    static uint32_t OTBenchmark_##suite##_##name(uint32_t iterations); \
+    static const OTBenchmark::Registration OTBenchmarkRegistration_##suite##_##name(#suite, #name, OTBenchmark_##suite##_##name); \
+    static uint32_t OTBenchmark_##suite##_##name(const uint32_t iterations)
+
+#endif
@@ -0,0 +1,64 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * crc7_5B throughput benchmarks, per byte, for each implementation.
+ */
+
+#include <OTV0p2Base.h>
+
+#include "Benchmark.h"
+
+
+namespace
+    {
+
+// Typical maximum-size small frame.
+uint8_t frame[64];
+
+// CRC a whole frame per iteration using the given per-byte update, returning bytes processed.
+uint32_t benchPerByte(const uint32_t iterations, uint8_t (*const update)(uint8_t, uint8_t))
+    {
+    for(uint8_t i = 0; i < sizeof(frame); ++i) { frame[i] = uint8_t(i * 37 + 11); }
+    uint8_t crc = 0x7f;
+    for(uint32_t n = 0; n < iterations; ++n)
+        {
+        for(uint8_t i = 0; i < sizeof(frame); ++i) { crc = update(crc, frame[i]); }
+        }
+    OTBenchmark::sink(crc);
+    return(iterations * sizeof(frame));
+    }
+
+    }
+
+
+OTBENCHMARK(CRC, crc7_5B_update_bitwise)
+    { return(benchPerByte(iterations, OTV0P2BASE::crc7_5B_update_bitwise)); }
+OTBENCHMARK(CRC, crc7_5B_update_nibble)
+    { return(benchPerByte(iterations, OTV0P2BASE::crc7_5B_update_nibble)); }
+OTBENCHMARK(CRC, crc7_5B_update_table)
+    { return(benchPerByte(iterations, OTV0P2BASE::crc7_5B_update_table)); }
+
+OTBENCHMARK(CRC, crc7_5B_update_buf)
+    {
+    for(uint8_t i = 0; i < sizeof(frame); ++i) { frame[i] = uint8_t(i * 37 + 11); }
+    uint8_t crc = 0x7f;
+    for(uint32_t n = 0; n < iterations; ++n) { crc = OTV0P2BASE::crc7_5B_update_buf(crc, frame, sizeof(frame)); }
+    OTBenchmark::sink(crc);
+    return(iterations * sizeof(frame));
+    }
@@ -0,0 +1,140 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * FHT8V/FS20 200us bit-stream encode and decode throughput, per frame,
+ * for the original bit-at-a-time and the table-driven implementations.
+ */
+
+#include <string.h>
+#include <vector>
+
+#include <OTRadValve.h>
+
+#include "Benchmark.h"
+
+
+namespace
+    {
+
+typedef OTRadValve::FHT8VRadValveUtil FHT8V;
+
+// Stride and length of each captured stream.
+const size_t stride = 48;
+const size_t streamLen = FHT8V::MIN_FHT8V_200US_BIT_STREAM_BUF_SIZE;
+const size_t nStreams = 256;
+
+// Varied commands, as from many house codes.
+FHT8V::fht8v_msg_t getCommand(const uint32_t i)
+    {
+    FHT8V::fht8v_msg_t c;
+    memset(&c, 0, sizeof(c));
+    c.hc1 = uint8_t(i % 100);
+    c.hc2 = uint8_t((i * 7) % 100);
+    c.command = 0x26;
+    c.extension = uint8_t(i * 13);
+    return(c);
+    }
+
+// Captured streams of varied commands.
+const std::vector<uint8_t> &getStreams()
+    {
+    static std::vector<uint8_t> s;
+    if(s.empty())
+        {
+        s.resize(nStreams * stride);
+        for(size_t i = 0; i < nStreams; ++i)
+            {
+            const FHT8V::fht8v_msg_t c = getCommand(uint32_t(i));
+            FHT8V::FHT8VCreate200usBitStreamBptr(&s[i * stride], &c);
+            }
+        }
+    return(s);
+    }
+
+    }
+
+
+OTBENCHMARK(FHT8V, encodeBitwise)
+    {
+    uint8_t buf[FHT8V::MIN_FHT8V_200US_BIT_STREAM_BUF_SIZE];
+    uint32_t sum = 0;
+    for(uint32_t i = 0; i < iterations; ++i)
+        {
+        const FHT8V::fht8v_msg_t c = getCommand(i);
+        sum += uint32_t(FHT8V::FHT8VCreate200usBitStreamBptr(buf, &c) - buf);
+        }
+    OTBenchmark::sink(sum);
+    return(iterations);
+    }
+
+OTBENCHMARK(FHT8V, encodeTable)
+    {
+    uint8_t buf[FHT8V::MIN_FHT8V_200US_BIT_STREAM_BUF_SIZE];
+    uint32_t sum = 0;
+    for(uint32_t i = 0; i < iterations; ++i)
+        {
+        const FHT8V::fht8v_msg_t c = getCommand(i);
+        sum += uint32_t(FHT8V::FHT8VCreate200usBitStreamBptrFast(buf, &c) - buf);
+        }
+    OTBenchmark::sink(sum);
+    return(iterations);
+    }
+
+OTBENCHMARK(FHT8V, decodeBitwise)
+    {
+    const std::vector<uint8_t> &s = getStreams();
+    FHT8V::fht8v_msg_t c;
+    uint32_t ok = 0;
+    for(uint32_t i = 0; i < iterations; ++i)
+        {
+        const uint8_t *const p = &s[(i % nStreams) * stride];
+        if(NULL != FHT8V::FHT8VDecodeBitStream(p, p + streamLen - 1, &c)) { ++ok; }
+        }
+    if(ok != iterations) { return(0); }
+    OTBenchmark::sink(c.extension);
+    return(iterations);
+    }
+
+OTBENCHMARK(FHT8V, decodeTable)
+    {
+    const std::vector<uint8_t> &s = getStreams();
+    FHT8V::fht8v_msg_t c;
+    uint32_t ok = 0;
+    for(uint32_t i = 0; i < iterations; ++i)
+        {
+        const uint8_t *const p = &s[(i % nStreams) * stride];
+        if(NULL != FHT8V::FHT8VDecodeBitStreamFast(p, p + streamLen - 1, &c)) { ++ok; }
+        }
+    if(ok != iterations) { return(0); }
+    OTBenchmark::sink(c.extension);
+    return(iterations);
+    }
+
+OTBENCHMARK(FHT8V, decodeBatch)
+    {
+    const std::vector<uint8_t> &s = getStreams();
+    static FHT8V::fht8v_msg_t c[nStreams];
+    static uint8_t decoded[nStreams];
+    uint32_t ok = 0;
+    for(uint32_t i = 0; i < iterations; ++i)
+        { ok += uint32_t(FHT8V::FHT8VDecodeBitStreams(s.data(), stride, streamLen, nStreams, c, decoded)); }
+    if(ok != iterations * nStreams) { return(0); }
+    OTBenchmark::sink(c[0].extension);
+    return(uint32_t(iterations * nStreams));
+    }
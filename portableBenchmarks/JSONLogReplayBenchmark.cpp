@@ -0,0 +1,86 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * JSON log replay throughput, per byte of log, from an in-memory stream.
+ */
+
+#include <stdio.h>
+#include <string>
+
+#include <OTV0p2Base.h>
+#include <utility/OTV0P2BASE_JSONLogReplay.h>
+
+#include "Benchmark.h"
+
+
+namespace
+    {
+
+// Synthetic hub log of a few thousand lines from a few dozen nodes.
+const std::string &getLog()
+    {
+    static std::string log;
+    if(log.empty())
+        {
+        char line[128];
+        for(int i = 0; i < 4096; ++i)
+            {
+            snprintf(line, sizeof(line), "2016-10-%02dT%02d:%02d:%02dZ %016X {\"@\":\"%04X\",\"+\":%d,\"L\":%d,\"T|C16\":%d,\"O\":%d}\n",
+                1 + (i / 1440) % 28, (i / 60) % 24, i % 60, (i * 7) % 60,
+                0x1000 + (i % 37), 0x1000 + (i % 37), i & 15, i % 255, 300 + (i % 50), i % 3);
+            log += line;
+            }
+        }
+    return(log);
+    }
+
+// Sums all the values seen.
+class SummingSink final : public OTV0P2BASE::JSONLogNodeSink
+    {
+    public:
+        uint32_t sum = 0;
+        virtual void value(const OTV0P2BASE::JSONLogTime &, const char *, int32_t v) override { sum += uint32_t(v); }
+    };
+class SummingFactory final : public OTV0P2BASE::JSONLogSinkFactory
+    {
+    public:
+        SummingSink s;
+        virtual OTV0P2BASE::JSONLogNodeSink *sinkForNode(const char *) override { return(&s); }
+    };
+
+    }
+
+
+OTBENCHMARK(JSONLogReplay, replay)
+    {
+    const std::string &log = getLog();
+    SummingFactory f;
+    OTV0P2BASE::JSONLogReplay r(f);
+    for(uint32_t i = 0; i < iterations; ++i)
+        {
+        FILE *const m = fmemopen(const_cast<char *>(log.data()), log.size(), "r");
+        if(NULL == m) { return(0); }
+        const bool ok = r.replay(m);
+        fclose(m);
+        if(!ok) { return(0); }
+        }
+    if(0 != r.linesRejected) { return(0); }
+    OTBenchmark::sink(f.s.sum);
+    return(uint32_t(iterations * log.size()));
+    }
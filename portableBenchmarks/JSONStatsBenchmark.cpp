@@ -0,0 +1,101 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * JSON stats generation benchmarks, per frame,
+ * comparing writeJSON() plus a separate CRC pass
+ * with the single-pass writeJSONForTX() and the compact binary form.
+ */
+
+#include <OTV0p2Base.h>
+
+#include "Benchmark.h"
+
+
+namespace
+    {
+
+// Typical set of stats for a valve, some changing each frame.
+void update(OTV0P2BASE::SimpleStatsRotationBase &ss, const uint32_t n)
+    {
+    ss.put(V0p2_SENSOR_TAG_F("T|C16"), int16_t(300 + (n & 7)));
+    ss.put(V0p2_SENSOR_TAG_F("H|%"), int16_t(55 + ((n >> 2) & 3)));
+    ss.put(V0p2_SENSOR_TAG_F("L"), int16_t(n & 0xff));
+    ss.put(V0p2_SENSOR_TAG_F("B|cV"), 256, true);
+    ss.put(V0p2_SENSOR_TAG_F("v|%"), int16_t((n >> 3) % 101));
+    ss.put(V0p2_SENSOR_TAG_F("tT|C"), 18);
+    ss.put(V0p2_SENSOR_TAG_F("vac|h"), int16_t(n >> 8), true);
+    ss.put(V0p2_SENSOR_TAG_F("O"), int16_t(n & 3));
+    }
+
+typedef OTV0P2BASE::SimpleStatsRotation<8> ss_t;
+
+    }
+
+
+// Reference path: print each field via BufPrint, then validate, adjust and CRC the result.
+OTBENCHMARK(JSONStats, writeJSONThenCRC)
+    {
+    ss_t ss;
+    ss.setID(V0p2_SENSOR_TAG_F("cdfb"));
+    char buf[OTV0P2BASE::MSG_JSON_MAX_LENGTH + 2];
+    uint32_t sum = 0;
+    for(uint32_t n = 0; n < iterations; ++n)
+        {
+        update(ss, n);
+        if(0 == ss.writeJSON((uint8_t *)buf, sizeof(buf), 0, true)) { return(0); }
+        sum += OTV0P2BASE::adjustJSONMsgForTXAndComputeCRC(buf);
+        }
+    OTBenchmark::sink(sum);
+    return(iterations);
+    }
+
+// Single pass including the CRC.
+OTBENCHMARK(JSONStats, writeJSONForTX)
+    {
+    ss_t ss;
+    ss.setID(V0p2_SENSOR_TAG_F("cdfb"));
+    uint8_t buf[OTV0P2BASE::MSG_JSON_MAX_LENGTH + 2];
+    uint32_t sum = 0;
+    for(uint32_t n = 0; n < iterations; ++n)
+        {
+        update(ss, n);
+        uint8_t crc;
+        if(0 == ss.writeJSONForTX(buf, sizeof(buf), 0, crc, true)) { return(0); }
+        sum += crc;
+        }
+    OTBenchmark::sink(sum);
+    return(iterations);
+    }
+
+// Compact binary form for a secure frame.
+OTBENCHMARK(JSONStats, writeCompact)
+    {
+    ss_t ss;
+    uint8_t buf[OTV0P2BASE::MSG_COMPACT_STATS_MAX_LENGTH_SECURE];
+    uint32_t sum = 0;
+    for(uint32_t n = 0; n < iterations; ++n)
+        {
+        update(ss, n);
+        const uint8_t l = ss.writeCompact(buf, sizeof(buf), true);
+        if(0 == l) { return(0); }
+        sum += l;
+        }
+    OTBenchmark::sink(sum);
+    return(iterations);
+    }
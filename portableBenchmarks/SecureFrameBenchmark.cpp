@@ -0,0 +1,310 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * Secure (and non-secure) frame throughput benchmarks.
+ *
+ * Each secure operation is run with the NULL crypto stubs
+ * (measuring framing cost alone) and with the test reference AES-GCM
+ * (framing plus crypto), so that the two costs can be separated.
+ */
+
+#include <string.h>
+
+#include <OTRadioLink.h>
+#include <utility/OTRadioLink_ISRRXQueue.h>
+
+#include "Benchmark.h"
+#include "../portableUnitTests/OTRadioLink/ReferenceAESGCM.h"
+
+
+namespace
+    {
+
+const uint8_t key[16] = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80, 0x90, 0xa0, 0xb0, 0xc0, 0xd0, 0xe0, 0xf0, 0x01 };
+const uint8_t id[OTV0P2BASE::OpenTRV_Node_ID_Bytes] = { 0x88, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87 };
+// Typical valve body: valve %, stats flag, compact stats JSON (without trailing '}').
+const uint8_t body[] = { 0x7f, 0x10, '{', '"', '@', '"', ':', '"', 'f', '9', 'c', 'd', '"', ',', '"', 'T', '|', 'C', '1', '6', '"', ':', '2', '0', '1' };
+const char statsJSON[] = "{\"@\":\"f9cd\",\"T|C16\":201}";
+
+// Host-side TX state with RAM-only ID and counters.
+class BenchmarkTX final : public OTRadioLink::SimpleSecureFrame32or0BodyTXBase
+    {
+    private:
+        uint8_t counter[fullMessageCounterBytes] = { 0, 0, 1, 0, 0, 0 };
+    public:
+        virtual bool getTXID(uint8_t *const idOut) const override { memcpy(idOut, id, sizeof(id)); return(true); }
+        virtual bool get3BytePersistentTXRestartCounter(uint8_t *const buf) const override { memcpy(buf, counter, 3); return(true); }
+        virtual bool resetRaw3BytePersistentTXRestartCounter(bool /*allZeros*/) override { return(false); }
+        virtual bool increment3BytePersistentTXRestartCounter() override { return(false); }
+        virtual bool incrementAndGetPrimarySecure6BytePersistentTXMessageCounter(uint8_t *const buf) override
+            {
+            if(!msgcounteradd(counter, 1)) { return(false); }
+            memcpy(buf, counter, sizeof(counter));
+            return(true);
+            }
+    };
+
+// Workspace-style adapters for the enc functions, as needed by the ...PadInPlace encoder.
+bool encNULLWithWorkspace(uint8_t *const workspace, const uint8_t workspaceSize,
+        const uint8_t *const k, const uint8_t *const iv,
+        const uint8_t *const authtext, const uint8_t authtextSize,
+        const uint8_t *const plaintext,
+        uint8_t *const ciphertextOut, uint8_t *const tagOut)
+    {
+    if((NULL == workspace) || (0 == workspaceSize)) { return(false); }
+    return(OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleEnc_NULL_IMPL(NULL, k, iv, authtext, authtextSize, plaintext, ciphertextOut, tagOut));
+    }
+bool encRefWithWorkspace(uint8_t *const workspace, const uint8_t workspaceSize,
+        const uint8_t *const k, const uint8_t *const iv,
+        const uint8_t *const authtext, const uint8_t authtextSize,
+        const uint8_t *const plaintext,
+        uint8_t *const ciphertextOut, uint8_t *const tagOut)
+    {
+    if((NULL == workspace) || (0 == workspaceSize)) { return(false); }
+    return(ReferenceAESGCM::enc(NULL, k, iv, authtext, authtextSize, plaintext, ciphertextOut, tagOut));
+    }
+
+bool decNULLWithWorkspace(uint8_t *const workspace, const uint8_t workspaceSize,
+        const uint8_t *const k, const uint8_t *const iv,
+        const uint8_t *const authtext, const uint8_t authtextSize,
+        const uint8_t *const ciphertext, const uint8_t *const tag,
+        uint8_t *const plaintextOut)
+    {
+    if((NULL == workspace) || (0 == workspaceSize)) { return(false); }
+    return(OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleDec_NULL_IMPL(NULL, k, iv, authtext, authtextSize, ciphertext, tag, plaintextOut));
+    }
+bool decRefWithWorkspace(uint8_t *const workspace, const uint8_t workspaceSize,
+        const uint8_t *const k, const uint8_t *const iv,
+        const uint8_t *const authtext, const uint8_t authtextSize,
+        const uint8_t *const ciphertext, const uint8_t *const tag,
+        uint8_t *const plaintextOut)
+    {
+    if((NULL == workspace) || (0 == workspaceSize)) { return(false); }
+    return(ReferenceAESGCM::dec(NULL, k, iv, authtext, authtextSize, ciphertext, tag, plaintextOut));
+    }
+
+// Make IV from ID and a varying counter.
+void makeIV(uint8_t *const iv, const uint32_t n)
+    {
+    memcpy(iv, id, 6);
+    iv[6] = 0; iv[7] = 1;
+    iv[8] = uint8_t(n >> 24); iv[9] = uint8_t(n >> 16); iv[10] = uint8_t(n >> 8); iv[11] = uint8_t(n);
+    }
+
+uint32_t benchEncodePadInPlace(const uint32_t iterations, const OTRadioLink::SimpleSecureFrame32or0BodyTXBase::fixed32BTextSize12BNonce16BTagSimpleEncWithWorkspace_ptr_t e)
+    {
+    uint8_t workspace[OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRawPadInPlace_total_scratch_usage_OTAESGCM_2p0];
+    const OTV0P2BASE::ScratchSpace scratch(workspace, sizeof(workspace));
+    uint8_t buf[64], bodyBuf[32], iv[12];
+    for(uint32_t i = 0; i < iterations; ++i)
+        {
+        makeIV(iv, i);
+        memcpy(bodyBuf, body, sizeof(body));
+        const uint8_t l = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRawPadInPlace(buf, sizeof(buf),
+                            OTRadioLink::FTS_BasicSensorOrValve, id, 4, bodyBuf, sizeof(body), iv, e, scratch, key);
+        if(0 == l) { return(0); }
+        OTBenchmark::sink(buf[l - 2]);
+        }
+    return(iterations);
+    }
+
+uint32_t benchGenerateOFrame(const uint32_t iterations, const OTRadioLink::SimpleSecureFrame32or0BodyTXBase::fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t e)
+    {
+    BenchmarkTX tx;
+    uint8_t buf[64];
+    for(uint32_t i = 0; i < iterations; ++i)
+        {
+        const uint8_t l = tx.generateSecureOFrameRawForTX(buf, sizeof(buf), 4, uint8_t(i % 101), statsJSON, e, NULL, key);
+        if(0 == l) { return(0); }
+        OTBenchmark::sink(buf[l - 2]);
+        }
+    return(iterations);
+    }
+
+uint32_t benchDecode(const uint32_t iterations,
+                     const OTRadioLink::SimpleSecureFrame32or0BodyTXBase::fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t e,
+                     const OTRadioLink::SimpleSecureFrame32or0BodyRXBase::fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t d)
+    {
+    uint8_t buf[64], iv[12];
+    makeIV(iv, 42);
+    const uint8_t l = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(buf, sizeof(buf),
+                        OTRadioLink::FTS_BasicSensorOrValve, id, 4, body, sizeof(body), iv, e, NULL, key);
+    if(0 == l) { return(0); }
+    OTRadioLink::SecurableFrameHeader sfh;
+    if(0 == sfh.checkAndDecodeSmallFrameHeader(buf, l)) { return(0); }
+    uint8_t out[32];
+    uint8_t outSize;
+    for(uint32_t i = 0; i < iterations; ++i)
+        {
+        if(0 == OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRaw(&sfh, buf, l,
+                        d, NULL, key, iv, out, sizeof(out), outSize)) { return(0); }
+        OTBenchmark::sink(outSize);
+        }
+    return(iterations);
+    }
+
+
+// Queue a frame in an RX queue as the radio ISR would.
+bool loadRXQueue(OTRadioLink::ISRRXQueue &q, const uint8_t *const frame, const uint8_t l)
+    {
+    volatile uint8_t *const qb = q._getRXBufForInbound();
+    if(NULL == qb) { return(false); }
+    for(uint8_t i = 0; i < l; ++i) { qb[i] = frame[i]; }
+    q._loadedBuf(l);
+    return(true);
+    }
+
+// As a hub has had to: copy each frame out of the RX queue and decode it to a separate buffer.
+uint32_t benchDecodeCopyFromQueue(const uint32_t iterations,
+                                  const OTRadioLink::SimpleSecureFrame32or0BodyTXBase::fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t e,
+                                  const OTRadioLink::SimpleSecureFrame32or0BodyRXBase::fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t d)
+    {
+    uint8_t frame[64], iv[12];
+    makeIV(iv, 42);
+    const uint8_t l = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(frame, sizeof(frame),
+                        OTRadioLink::FTS_BasicSensorOrValve, id, 4, body, sizeof(body), iv, e, NULL, key);
+    if(0 == l) { return(0); }
+    OTRadioLink::SecurableFrameHeader sfh;
+    if(0 == sfh.checkAndDecodeSmallFrameHeader(frame, l)) { return(0); }
+    OTRadioLink::ISRRXQueue1Deep<64> q;
+    uint8_t buf[64];
+    uint8_t out[32];
+    uint8_t outSize;
+    for(uint32_t i = 0; i < iterations; ++i)
+        {
+        if(!loadRXQueue(q, frame, l)) { return(0); }
+        const volatile uint8_t *const pb = q.peekRXMsg();
+        const uint8_t len = pb[-1];
+        for(uint8_t j = 0; j < len; ++j) { buf[j] = pb[j]; }
+        q.removeRXMsg();
+        if(0 == OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRaw(&sfh, buf, len,
+                        d, NULL, key, iv, out, sizeof(out), outSize)) { return(0); }
+        OTBenchmark::sink(out[0]);
+        }
+    return(iterations);
+    }
+
+// Decode each frame in place in its RX queue slot, with no copy or plaintext buffer.
+uint32_t benchDecodeInPlaceInQueue(const uint32_t iterations,
+                                   const OTRadioLink::SimpleSecureFrame32or0BodyTXBase::fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t e,
+                                   const OTRadioLink::SimpleSecureFrame32or0BodyRXBase::fixed32BTextSize12BNonce16BTagSimpleDecWithWorkspace_ptr_t d)
+    {
+    uint8_t frame[64], iv[12];
+    makeIV(iv, 42);
+    const uint8_t l = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(frame, sizeof(frame),
+                        OTRadioLink::FTS_BasicSensorOrValve, id, 4, body, sizeof(body), iv, e, NULL, key);
+    if(0 == l) { return(0); }
+    OTRadioLink::SecurableFrameHeader sfh;
+    if(0 == sfh.checkAndDecodeSmallFrameHeader(frame, l)) { return(0); }
+    uint8_t workspace[OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRawInPlace_total_scratch_usage_OTAESGCM_2p0];
+    const OTV0P2BASE::ScratchSpace scratch(workspace, sizeof(workspace));
+    OTRadioLink::ISRRXQueue1Deep<64> q;
+    for(uint32_t i = 0; i < iterations; ++i)
+        {
+        if(!loadRXQueue(q, frame, l)) { return(0); }
+        uint8_t *const pb = q.peekRXMsgMutable();
+        const uint8_t *view;
+        uint8_t viewSize;
+        if(0 == OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRawInPlace(&sfh, pb, pb[-1],
+                        d, scratch, key, iv, view, viewSize)) { return(0); }
+        OTBenchmark::sink(view[0]);
+        q.removeRXMsg();
+        }
+    return(iterations);
+    }
+
+    }
+
+
+OTBENCHMARK(SecureFrame, encodeSecureSmallFrameRawPadInPlace_NULL)
+    { return(benchEncodePadInPlace(iterations, encNULLWithWorkspace)); }
+OTBENCHMARK(SecureFrame, encodeSecureSmallFrameRawPadInPlace_RefGCM)
+    { return(benchEncodePadInPlace(iterations, encRefWithWorkspace)); }
+
+OTBENCHMARK(SecureFrame, generateSecureOFrameRawForTX_NULL)
+    { return(benchGenerateOFrame(iterations, OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleEnc_NULL_IMPL)); }
+OTBENCHMARK(SecureFrame, generateSecureOFrameRawForTX_RefGCM)
+    { return(benchGenerateOFrame(iterations, ReferenceAESGCM::enc)); }
+
+OTBENCHMARK(SecureFrame, decodeSecureSmallFrameRaw_NULL)
+    { return(benchDecode(iterations, OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleEnc_NULL_IMPL, OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleDec_NULL_IMPL)); }
+OTBENCHMARK(SecureFrame, decodeSecureSmallFrameRaw_RefGCM)
+    { return(benchDecode(iterations, ReferenceAESGCM::enc, ReferenceAESGCM::dec)); }
+
+// RX queue to plaintext: copy out then decode, vs decode in place in the queue slot.
+OTBENCHMARK(SecureFrame, decodeSecureSmallFrameRawFromQueue_NULL)
+    { return(benchDecodeCopyFromQueue(iterations, OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleEnc_NULL_IMPL, OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleDec_NULL_IMPL)); }
+OTBENCHMARK(SecureFrame, decodeSecureSmallFrameRawInPlace_NULL)
+    { return(benchDecodeInPlaceInQueue(iterations, OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleEnc_NULL_IMPL, decNULLWithWorkspace)); }
+OTBENCHMARK(SecureFrame, decodeSecureSmallFrameRawFromQueue_RefGCM)
+    { return(benchDecodeCopyFromQueue(iterations, ReferenceAESGCM::enc, ReferenceAESGCM::dec)); }
+OTBENCHMARK(SecureFrame, decodeSecureSmallFrameRawInPlace_RefGCM)
+    { return(benchDecodeInPlaceInQueue(iterations, ReferenceAESGCM::enc, decRefWithWorkspace)); }
+
+// Decode with the key expanded once up front, for comparison with decodeSecureSmallFrameRaw_RefGCM.
+OTBENCHMARK(SecureFrame, decodeSecureSmallFrameRaw_RefGCMKeyContext)
+    {
+    OTRadioLink::SimpleSecureFrame32or0KeyContextCache<ReferenceAESGCM::keyContextBytes> cache(ReferenceAESGCM::keySetup);
+    const void *const kc = cache.getKeyContext(key);
+    uint8_t buf[64], iv[12];
+    makeIV(iv, 42);
+    const uint8_t l = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(buf, sizeof(buf),
+                        OTRadioLink::FTS_BasicSensorOrValve, id, 4, body, sizeof(body), iv, ReferenceAESGCM::encWithKeyContext, kc);
+    OTRadioLink::SecurableFrameHeader sfh;
+    if((0 == l) || (0 == sfh.checkAndDecodeSmallFrameHeader(buf, l))) { return(0); }
+    uint8_t out[32];
+    uint8_t outSize;
+    for(uint32_t i = 0; i < iterations; ++i)
+        {
+        if(0 == OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRaw(&sfh, buf, l,
+                        ReferenceAESGCM::decWithKeyContext, kc, iv, out, sizeof(out), outSize)) { return(0); }
+        OTBenchmark::sink(outSize);
+        }
+    return(iterations);
+    }
+
+OTBENCHMARK(SecureFrame, encodeNonsecureSmallFrame)
+    {
+    uint8_t buf[64];
+    for(uint32_t i = 0; i < iterations; ++i)
+        {
+        const uint8_t l = OTRadioLink::encodeNonsecureSmallFrame(buf, sizeof(buf),
+                            OTRadioLink::FTS_BasicSensorOrValve, uint8_t(i), id, 2, body, sizeof(body));
+        if(0 == l) { return(0); }
+        OTBenchmark::sink(buf[l - 1]);
+        }
+    return(iterations);
+    }
+
+OTBENCHMARK(SecureFrame, checkAndDecodeSmallFrameHeader)
+    {
+    uint8_t buf[64], iv[12];
+    makeIV(iv, 42);
+    const uint8_t l = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(buf, sizeof(buf),
+                        OTRadioLink::FTS_BasicSensorOrValve, id, 4, body, sizeof(body), iv,
+                        OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleEnc_NULL_IMPL, NULL, key);
+    if(0 == l) { return(0); }
+    OTRadioLink::SecurableFrameHeader sfh;
+    for(uint32_t i = 0; i < iterations; ++i)
+        {
+        if(0 == sfh.checkAndDecodeSmallFrameHeader(buf, l)) { return(0); }
+        OTBenchmark::sink(sfh.bl);
+        }
+    return(iterations);
+    }
@@ -0,0 +1,73 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * Multi-room thermal simulation throughput, per room-minute simulated,
+ * single-threaded and on all hardware threads.
+ */
+
+#include <OTRadValve.h>
+#include <utility/OTRadValve_ThermalSim.h>
+
+#include "Benchmark.h"
+
+
+namespace
+    {
+
+// Simulate one day of 256 rooms in 64 houses, with 6 physics steps per minute.
+uint32_t simulateDay(const OTRadValve::WorkStealingPool &pool)
+    {
+    OTRadValve::ThermalSim sim;
+    for(int h = 0; h < 64; ++h)
+        {
+        sim.addHouse();
+        for(int r = 0; r < 4; ++r)
+            {
+            OTRadValve::ThermalSim::RoomParams p;
+            p.outsideTempC = float(h % 10);
+            p.radiatorTimeConstantS = 600;
+            p.airCapacitance = 500000;
+            OTRadValve::ThermalSim::ControlParams c;
+            c.setbackC = uint8_t(r);
+            sim.addRoom(p, c);
+            }
+        }
+    if(!sim.run(1440, pool, 6)) { return(0); }
+    OTBenchmark::sink(uint32_t(sim.getEnergyJ(0)));
+    return(uint32_t(sim.getRooms() * 1440));
+    }
+
+    }
+
+
+OTBENCHMARK(ThermalSim, roomMinutes1Thread)
+    {
+    const OTRadValve::WorkStealingPool pool(1);
+    uint32_t n = 0;
+    for(uint32_t i = 0; i < iterations; ++i) { n += simulateDay(pool); }
+    return(n);
+    }
+
+OTBENCHMARK(ThermalSim, roomMinutesAllThreads)
+    {
+    const OTRadValve::WorkStealingPool pool;
+    uint32_t n = 0;
+    for(uint32_t i = 0; i < iterations; ++i) { n += simulateDay(pool); }
+    return(n);
+    }
@@ -25,6 +25,9 @@ Author(s) / Copyright (s): Damon Hart-Davis 2016
 #include <gtest/gtest.h>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
 
 #include "OTRadValve_FHT8VRadValve.h"
 
@@ -422,3 +425,123 @@ TEST(FHT8VRadValve,FHTEncodingHeadAndTail)
 //    #endif
 //    #endif
 }
+
+// Encode with both encoders, checking that they match exactly, then decode with both decoders.
+static void checkFastEncodeDecode(const OTRadValve::FHT8VRadValveUtil::fht8v_msg_t &command)
+{
+    uint8_t buf1[OTRadValve::FHT8VRadValveUtil::MIN_FHT8V_200US_BIT_STREAM_BUF_SIZE];
+    uint8_t buf2[OTRadValve::FHT8VRadValveUtil::MIN_FHT8V_200US_BIT_STREAM_BUF_SIZE];
+    memset(buf1, 0x55, sizeof(buf1));
+    memset(buf2, 0x55, sizeof(buf2));
+    const uint8_t *const e1 = OTRadValve::FHT8VRadValveUtil::FHT8VCreate200usBitStreamBptr(buf1, &command);
+    const uint8_t *const e2 = OTRadValve::FHT8VRadValveUtil::FHT8VCreate200usBitStreamBptrFast(buf2, &command);
+    ASSERT_EQ(e1 - buf1, e2 - buf2);
+    ASSERT_EQ(0, memcmp(buf1, buf2, sizeof(buf1)));
+    OTRadValve::FHT8VRadValveUtil::fht8v_msg_t d1, d2;
+    const uint8_t *const r1 = OTRadValve::FHT8VRadValveUtil::FHT8VDecodeBitStream(buf1, e1, &d1);
+    const uint8_t *const r2 = OTRadValve::FHT8VRadValveUtil::FHT8VDecodeBitStreamFast(buf1, e1, &d2);
+    ASSERT_TRUE(NULL != r1);
+    ASSERT_EQ(r1, r2);
+    ASSERT_EQ(command.hc1, d2.hc1);
+    ASSERT_EQ(command.hc2, d2.hc2);
+    ASSERT_EQ(command.command, d2.command);
+    ASSERT_EQ(command.extension, d2.extension);
+}
+
+// Check the table-driven encoder and decoder against the originals
+// over every value of each pair of fields, with the other pair varied.
+TEST(FHT8VRadValve,FastEncodeDecodeExhaustive)
+{
+    OTRadValve::FHT8VRadValveUtil::fht8v_msg_t command;
+#ifdef OTV0P2BASE_FHT8V_ADR_USED
+    command.address = 0;
+#endif
+    for(uint32_t i = 0; i < 0x10000; ++i)
+        {
+        command.hc1 = uint8_t(i >> 8);
+        command.hc2 = uint8_t(i);
+        command.command = uint8_t(i * 37 + 11);
+        command.extension = uint8_t(i * 101 + (i >> 8));
+        checkFastEncodeDecode(command);
+        if(HasFatalFailure()) { FAIL() << i; }
+        command.hc1 = uint8_t(i * 13 + 7);
+        command.hc2 = uint8_t(i * 59 + (i >> 8));
+        command.command = uint8_t(i >> 8);
+        command.extension = uint8_t(i);
+        checkFastEncodeDecode(command);
+        if(HasFatalFailure()) { FAIL() << i; }
+        }
+}
+
+// Check that the decoders agree on corrupted, truncated and offset streams,
+// including on the returned pointer.
+TEST(FHT8VRadValve,FastDecodeCorrupt)
+{
+    uint8_t buf[OTRadValve::FHT8VRadValveUtil::MIN_FHT8V_200US_BIT_STREAM_BUF_SIZE + 8];
+    OTRadValve::FHT8VRadValveUtil::fht8v_msg_t command, d1, d2;
+    int successes = 0;
+    for(uint32_t i = 0; i < 20000; ++i)
+        {
+        command.hc1 = uint8_t(rand());
+        command.hc2 = uint8_t(rand());
+        command.command = uint8_t(rand());
+        command.extension = uint8_t(rand());
+        const int offset = rand() % 4;
+        memset(buf, (rand() & 1) ? 0 : 0xcc, offset);
+        uint8_t *const end = OTRadValve::FHT8VRadValveUtil::FHT8VCreate200usBitStreamBptr(buf + offset, &command);
+        // Random trailing data.
+        for(uint8_t *p = end; p < buf + sizeof(buf); ++p) { *p = uint8_t(rand()); }
+        // Corrupt (or not) a random bit or two.
+        for(int c = rand() % 3; --c >= 0; ) { buf[rand() % sizeof(buf)] ^= uint8_t(1 << (rand() % 8)); }
+        // Sometimes truncate.
+        const uint8_t *const last = (0 == (i & 3)) ? (buf + rand() % sizeof(buf)) : (buf + sizeof(buf) - 1);
+        const uint8_t *const r1 = OTRadValve::FHT8VRadValveUtil::FHT8VDecodeBitStream(buf, last, &d1);
+        const uint8_t *const r2 = OTRadValve::FHT8VRadValveUtil::FHT8VDecodeBitStreamFast(buf, last, &d2);
+        ASSERT_EQ(r1, r2) << i;
+        if(NULL == r1) { continue; }
+        ++successes;
+        ASSERT_EQ(0, memcmp(&d1, &d2, sizeof(d1))) << i;
+        }
+    // Both outcomes should be well exercised.
+    EXPECT_LT(2000, successes);
+    EXPECT_GT(19000, successes);
+    // Empty range.
+    EXPECT_TRUE(NULL == OTRadValve::FHT8VRadValveUtil::FHT8VDecodeBitStreamFast(buf + 1, buf, &d2));
+}
+
+// Check that batch decoding matches individual decoding, for batches not a multiple of the interleave.
+TEST(FHT8VRadValve,DecodeBitStreams)
+{
+    const size_t n = 37, stride = 64, len = 50;
+    std::vector<uint8_t> streams(n * stride);
+    OTRadValve::FHT8VRadValveUtil::fht8v_msg_t command;
+    for(size_t i = 0; i < n; ++i)
+        {
+        uint8_t *const s = &streams[i * stride];
+        command.hc1 = uint8_t(i);
+        command.hc2 = uint8_t(99 - i);
+        command.command = 0x26;
+        command.extension = uint8_t(i * 7);
+        OTRadValve::FHT8VRadValveUtil::FHT8VCreate200usBitStreamBptr(s, &command);
+        if(0 == (i % 5)) { s[10 + (i % 20)] ^= 0x10; } // Corrupt some.
+        }
+    std::vector<OTRadValve::FHT8VRadValveUtil::fht8v_msg_t> commands(n);
+    std::vector<uint8_t> decoded(n, 0xaa);
+    const size_t count = OTRadValve::FHT8VRadValveUtil::FHT8VDecodeBitStreams(streams.data(), stride, len, n, commands.data(), decoded.data());
+    size_t expected = 0;
+    for(size_t i = 0; i < n; ++i)
+        {
+        OTRadValve::FHT8VRadValveUtil::fht8v_msg_t d;
+        const bool ok = (NULL != OTRadValve::FHT8VRadValveUtil::FHT8VDecodeBitStream(&streams[i * stride], &streams[i * stride + len - 1], &d));
+        EXPECT_EQ(ok ? 1 : 0, decoded[i]) << i;
+        if(!ok) { continue; }
+        ++expected;
+        EXPECT_EQ(i, commands[i].hc1);
+        EXPECT_EQ(99 - i, commands[i].hc2);
+        EXPECT_EQ(0x26, commands[i].command);
+        EXPECT_EQ(uint8_t(i * 7), commands[i].extension);
+        }
+    EXPECT_EQ(expected, count);
+    EXPECT_LT(n / 2, count);
+    EXPECT_GT(n, count);
+}
@@ -23,6 +23,8 @@ Author(s) / Copyright (s): Damon Hart-Davis 2016--2017
 #include <gtest/gtest.h>
 #include <cstdint>
 #include <cstdio>
+#include <memory>
+#include <vector>
 
 #include <OTV0P2BASE_QuickPRNG.h>
 #include "OTRadValve_AbstractRadValve.h"
@@ -381,7 +383,7 @@ TEST(ModelledRadValve,MRVSExtremes)
     // Filtering should not have been engaged
     // and velocity should be zero (temperature is flat).
     for(int i = OTRadValve::ModelledRadValveState::filterLength; --i >= 0; )
-        { ASSERT_EQ(100<<4, rs1.prevRawTempC16[i]); }
+        { ASSERT_EQ(100<<4, rs1.rawTempHistory.get(uint8_t(i))); }
     EXPECT_EQ(100<<4, rs1.getSmoothedRecent());
     //  AssertIsEqual(0, rs1.getVelocityC16PerTick());
     EXPECT_TRUE(!rs1.isFiltering);
@@ -548,6 +550,136 @@ TEST(ModelledRadValve,ModelledRadValveComputeTargetTempBasic)
     EXPECT_EQ(w+bu, cttb0.computeTargetTemp()) << "BAKE should win and force full uplift from WARM";
 }
 
+// Check that the run-time-bound target temperature engine
+// makes identical decisions to the compile-time-bound one,
+// over a wide range of randomly-generated sensor states.
+namespace MRVCTTRT
+    {
+    // Instances with linkage to support the test.
+    static OTRadValve::ValveMode valveMode;
+    static OTV0P2BASE::TemperatureC16Mock roomTemp;
+    static OTRadValve::TempControlSimpleVCPMock<OTRadValve::DEFAULT_ValveControlParameters> tempControl;
+    static OTV0P2BASE::PseudoSensorOccupancyTracker occupancy;
+    static OTV0P2BASE::SensorAmbientLightAdaptiveMock ambLight;
+    static OTRadValve::NULLActuatorPhysicalUI physicalUI;
+    static OTRadValve::SimpleValveScheduleMock<2> schedule;
+    static OTV0P2BASE::NVByHourByteStatsMock byHourStats;
+    static OTV0P2BASE::HumiditySensorMock rh;
+    static bool lockout;
+    static bool getLockout() { return(lockout); }
+    }
+TEST(ModelledRadValve,ModelledRadValveComputeTargetTempRuntime)
+{
+    typedef OTRadValve::DEFAULT_ValveControlParameters parameters;
+    const OTRadValve::ModelledRadValveComputeTargetTempBasic<
+        parameters,
+        &MRVCTTRT::valveMode,
+        decltype(MRVCTTRT::roomTemp),                    &MRVCTTRT::roomTemp,
+        decltype(MRVCTTRT::tempControl),                 &MRVCTTRT::tempControl,
+        decltype(MRVCTTRT::occupancy),                   &MRVCTTRT::occupancy,
+        decltype(MRVCTTRT::ambLight),                    &MRVCTTRT::ambLight,
+        decltype(MRVCTTRT::physicalUI),                  &MRVCTTRT::physicalUI,
+        decltype(MRVCTTRT::schedule),                    &MRVCTTRT::schedule,
+        decltype(MRVCTTRT::byHourStats),                 &MRVCTTRT::byHourStats,
+        decltype(MRVCTTRT::rh),                          &MRVCTTRT::rh,
+        MRVCTTRT::getLockout
+        > cttbCT;
+    const OTRadValve::ModelledRadValveSensorCtrlStats inputs(
+        &MRVCTTRT::valveMode, &MRVCTTRT::roomTemp, &MRVCTTRT::tempControl, &MRVCTTRT::occupancy,
+        &MRVCTTRT::ambLight, &MRVCTTRT::physicalUI, &MRVCTTRT::schedule, &MRVCTTRT::byHourStats);
+    const OTRadValve::ModelledRadValveComputeTargetTempBasicRuntime<parameters, OTV0P2BASE::HumiditySensorBase>
+        cttbRT(inputs, &MRVCTTRT::rh, MRVCTTRT::getLockout);
+    const OTRadValve::ModelledRadValveComputeTargetTempBase &ct = cttbCT, &rt = cttbRT;
+
+    MRVCTTRT::occupancy.reset();
+    MRVCTTRT::byHourStats.zapStats();
+    for(int i = 0; i < 5000; ++i)
+        {
+        // Randomise the inputs.
+        const uint8_t r = OTV0P2BASE::randRNG8();
+        MRVCTTRT::valveMode.setWarmModeDebounced(0 != (r & 3));
+        if(0 == (r & 0x1c)) { MRVCTTRT::valveMode.startBake(); }
+        else { MRVCTTRT::valveMode.cancelBakeDebounced(); }
+        MRVCTTRT::tempControl._setWarmTarget(uint8_t(parameters::TEMP_SCALE_MIN +
+            OTV0P2BASE::randRNG8() % (1 + parameters::TEMP_SCALE_MAX - parameters::TEMP_SCALE_MIN)));
+        MRVCTTRT::roomTemp.set(int16_t(OTV0P2BASE::randRNG8() * 2));
+        switch(OTV0P2BASE::randRNG8() & 7)
+            {
+            case 0: MRVCTTRT::occupancy.markAsOccupied(); break;
+            case 1: MRVCTTRT::occupancy.markAsPossiblyOccupied(); break;
+            case 2: MRVCTTRT::occupancy.setHolidayMode(); break;
+            case 3: MRVCTTRT::occupancy.reset(); break;
+            default: for(int m = OTV0P2BASE::randRNG8() & 0x7f; --m >= 0; ) { MRVCTTRT::occupancy.read(); } break;
+            }
+        MRVCTTRT::ambLight.set(OTV0P2BASE::randRNG8(), uint16_t(OTV0P2BASE::randRNG8() * 4), OTV0P2BASE::randRNG8NextBoolean());
+        MRVCTTRT::ambLight.read();
+        MRVCTTRT::byHourStats._setHour(OTV0P2BASE::randRNG8() % 24);
+        MRVCTTRT::byHourStats.setByHourStatSimple(OTV0P2BASE::NVByHourByteStatsBase::STATS_SET_OCCPC_BY_HOUR_SMOOTHED,
+            OTV0P2BASE::randRNG8() % 24, OTV0P2BASE::randRNG8() % 101);
+        MRVCTTRT::schedule.setSimpleSchedule(uint_least16_t((OTV0P2BASE::randRNG8() * 6) % 1440), 0);
+        OTV0P2BASE::_minutesSinceMidnightLT = uint_least16_t((OTV0P2BASE::randRNG8() * 6) % 1440);
+        MRVCTTRT::rh.set(OTV0P2BASE::randRNG8() % 101);
+        MRVCTTRT::lockout = (0 == (OTV0P2BASE::randRNG8() & 7));
+
+        // Compare the decisions.
+        const uint8_t tt = ct.computeTargetTemp();
+        ASSERT_EQ(tt, rt.computeTargetTemp()) << i;
+        const bool isFiltering = OTV0P2BASE::randRNG8NextBoolean();
+        const uint8_t maxPCOpen = OTV0P2BASE::randRNG8() % 101;
+        const bool glacial = OTV0P2BASE::randRNG8NextBoolean();
+        OTRadValve::ModelledRadValveInputState isCT(0), isRT(0);
+        ct.setupInputState(isCT, isFiltering, tt, 0, maxPCOpen, glacial);
+        rt.setupInputState(isRT, isFiltering, tt, 0, maxPCOpen, glacial);
+        ASSERT_EQ(isCT.targetTempC, isRT.targetTempC);
+        ASSERT_EQ(isCT.maxTargetTempC, isRT.maxTargetTempC);
+        ASSERT_EQ(isCT.maxPCOpen, isRT.maxPCOpen);
+        ASSERT_EQ(isCT.glacial, isRT.glacial);
+        ASSERT_EQ(isCT.inBakeMode, isRT.inBakeMode);
+        ASSERT_EQ(isCT.hasEcoBias, isRT.hasEcoBias);
+        ASSERT_EQ(isCT.fastResponseRequired, isRT.fastResponseRequired);
+        ASSERT_EQ(isCT.widenDeadband, isRT.widenDeadband);
+        ASSERT_EQ(isCT.refTempC16, isRT.refTempC16);
+        }
+    OTV0P2BASE::_minutesSinceMidnightLT = 0;
+    MRVCTTRT::schedule.clearSimpleSchedule(0);
+}
+
+// Check that many independent run-time-bound engines can be created and used,
+// eg as for a fleet simulation, each following its own inputs.
+TEST(ModelledRadValve,ModelledRadValveComputeTargetTempRuntimeFleet)
+{
+    typedef OTRadValve::DEFAULT_ValveControlParameters parameters;
+    static constexpr int valves = 1000;
+    struct Valve final
+        {
+        OTRadValve::ValveMode valveMode;
+        OTV0P2BASE::TemperatureC16Mock roomTemp;
+        OTRadValve::TempControlSimpleVCPMock<parameters> tempControl;
+        OTV0P2BASE::PseudoSensorOccupancyTracker occupancy;
+        OTV0P2BASE::SensorAmbientLightAdaptiveMock ambLight;
+        OTRadValve::NULLActuatorPhysicalUI physicalUI;
+        OTRadValve::NULLValveSchedule schedule;
+        OTV0P2BASE::NULLByHourByteStats byHourStats;
+        const OTRadValve::ModelledRadValveComputeTargetTempBasicRuntime<parameters> ctt;
+        Valve() : ctt(OTRadValve::ModelledRadValveSensorCtrlStats(&valveMode, &roomTemp, &tempControl,
+            &occupancy, &ambLight, &physicalUI, &schedule, &byHourStats)) { }
+        };
+    std::vector<std::unique_ptr<Valve>> fleet;
+    for(int i = 0; i < valves; ++i)
+        {
+        fleet.emplace_back(new Valve);
+        Valve &v = *fleet.back();
+        v.valveMode.setWarmModeDebounced(0 != (i % 3));
+        v.tempControl._setWarmTarget(uint8_t(parameters::TEMP_SCALE_MIN + (i % 5)));
+        v.occupancy.markAsOccupied();
+        }
+    for(int i = 0; i < valves; ++i)
+        {
+        const uint8_t expected = (0 != (i % 3)) ? uint8_t(parameters::TEMP_SCALE_MIN + (i % 5)) : parameters::FROST;
+        ASSERT_EQ(expected, fleet[i]->ctt.computeTargetTemp()) << i;
+        }
+}
+
 // Test the logic in ModelledRadValveState to open fast from well below target (TODO-593).
 // This is to cover the case where the use manually turns on/up the valve
 // and expects quick response from the valve and the remote boiler
@@ -797,7 +929,7 @@ TEST(ModelledRadValve,MRVSFilteringOnOff)
         const int16_t bigOffsetC16 = 5 << 4; // 5C perturbation.
         rs0.isFiltering = OTV0P2BASE::randRNG8NextBoolean(); // Futz it.
         rs0._backfillTemperatures(ambientTempC16);
-        rs0.prevRawTempC16[2] += bigOffsetC16;
+        rs0.rawTempHistory._adjust(2, bigOffsetC16);
         rs0.tick(valvePCOpen, is0, NULL);
         // Should be able to see that mean is now very different to current temp.
         const uint8_t mtj = rs0.MAX_TEMP_JUMP_C16;
@@ -806,7 +938,7 @@ TEST(ModelledRadValve,MRVSFilteringOnOff)
         // Set hugely-off point near one end other way; filtering should come on.
         rs0.isFiltering = OTV0P2BASE::randRNG8NextBoolean(); // Futz it.
         rs0._backfillTemperatures(ambientTempC16);
-        rs0.prevRawTempC16[2] -= bigOffsetC16;
+        rs0.rawTempHistory._adjust(2, -bigOffsetC16);
         rs0.tick(valvePCOpen, is0, NULL);
         // Should be able to see that mean is now very different to current temp.
         EXPECT_GT(OTV0P2BASE::fnabsdiff(rs0.getSmoothedRecent(), ambientTempC16), mtj);
@@ -815,8 +947,8 @@ TEST(ModelledRadValve,MRVSFilteringOnOff)
         // Mean should barely be affected but filtering should stay on.
         rs0.isFiltering = OTV0P2BASE::randRNG8NextBoolean(); // Futz it.
         rs0._backfillTemperatures(ambientTempC16);
-        rs0.prevRawTempC16[rs0.filterLength - 2] += bigOffsetC16;
-        rs0.prevRawTempC16[2] -= bigOffsetC16;
+        rs0.rawTempHistory._adjust(rs0.filterLength - 2, bigOffsetC16);
+        rs0.rawTempHistory._adjust(2, -bigOffsetC16);
         rs0.tick(valvePCOpen, is0, NULL);
         // Should be able to see that mean is unchanged.
         EXPECT_EQ(OTV0P2BASE::fnabsdiff(rs0.getSmoothedRecent(), ambientTempC16), 0);
@@ -824,14 +956,92 @@ TEST(ModelledRadValve,MRVSFilteringOnOff)
         // Reversing the direction should make no difference.
         rs0.isFiltering = OTV0P2BASE::randRNG8NextBoolean(); // Futz it.
         rs0._backfillTemperatures(ambientTempC16);
-        rs0.prevRawTempC16[rs0.filterLength - 2] -= bigOffsetC16;
-        rs0.prevRawTempC16[2] += bigOffsetC16;
+        rs0.rawTempHistory._adjust(rs0.filterLength - 2, -bigOffsetC16);
+        rs0.rawTempHistory._adjust(2, bigOffsetC16);
         rs0.tick(valvePCOpen, is0, NULL);
         // Should be able to see that mean is unchanged.
         EXPECT_EQ(OTV0P2BASE::fnabsdiff(rs0.getSmoothedRecent(), ambientTempC16), 0);
         }
 }
 
+// Check the running-sum filter history against a naive shifted array.
+TEST(ModelledRadValve,RawTempFilterHistory)
+{
+    static constexpr uint8_t len = 13;
+    static constexpr uint8_t maxStep = 3;
+    OTRadValve::RawTempFilterHistory<len, maxStep> h;
+    int_fast16_t ref[len];
+    h.fill(300);
+    for(int i = 0; i < len; ++i) { ref[i] = 300; }
+    for(int t = 0; t < 1000; ++t)
+        {
+        // Mostly small moves, with occasional jumps, and occasionally negative.
+        const int_fast16_t step = (0 == (t % 17)) ? 10 : ((int)(OTV0P2BASE::randRNG8() % 7) - 3);
+        const int_fast16_t v = int_fast16_t(ref[0] + step - ((t > 500) ? 2 : 0));
+        if(0 == (t % 101))
+            {
+            // Poke a value in the middle as the jitter tests do.
+            const uint8_t n = uint8_t(OTV0P2BASE::randRNG8() % len);
+            h._adjust(n, 50);
+            ref[n] += 50;
+            }
+        else
+            {
+            h.push(v);
+            for(int i = len; --i > 0; ) { ref[i] = ref[i-1]; }
+            ref[0] = v;
+            }
+        int_fast16_t sum = 0;
+        bool bigStep = false;
+        for(int i = 0; i < len; ++i)
+            {
+            ASSERT_EQ(ref[i], h.get(uint8_t(i)));
+            sum += ref[i];
+            if((i > 0) && (OTV0P2BASE::fnabsdiff(ref[i], ref[i-1]) > maxStep)) { bigStep = true; }
+            }
+        ASSERT_EQ((sum + len/2) / len, h.getMean()) << t;
+        ASSERT_EQ(bigStep, h.hasBigStep()) << t;
+        }
+    // Without a step threshold no big steps are reported.
+    OTRadValve::RawTempFilterHistory<len> h0;
+    h0.push(1000);
+    EXPECT_FALSE(h0.hasBigStep());
+    EXPECT_EQ(1000, h0.get(0));
+    EXPECT_EQ(0, h0.get(len-1));
+}
+
+// Check that a longer filter behaves as the default for flat and rising temperatures,
+// but reacts more slowly.
+TEST(ModelledRadValve,LongerFilter)
+{
+    const int_fast16_t ambientTempC16 = 18 << 4;
+    OTRadValve::ModelledRadValveInputState is0(ambientTempC16);
+    is0.targetTempC = 18;
+    OTRadValve::ModelledRadValveState rs16;
+    OTRadValve::ModelledRadValveStateT<32> rs32;
+    EXPECT_EQ(32U, rs32.filterLength);
+    volatile uint8_t v16 = 50, v32 = 50;
+    for(int i = 0; i < 100; ++i)
+        {
+        rs16.tick(v16, is0, NULL);
+        rs32.tick(v32, is0, NULL);
+        ASSERT_EQ(v16, v32);
+        }
+    // Rise quickly enough to turn on filtering in both.
+    for(int i = 0; i < 8; ++i)
+        {
+        is0.setReferenceTemperatures(ambientTempC16 + 2*i);
+        rs16.tick(v16, is0, NULL);
+        rs32.tick(v32, is0, NULL);
+        }
+    EXPECT_TRUE(rs16.isFiltering);
+    EXPECT_TRUE(rs32.isFiltering);
+    EXPECT_EQ(rs16.getRawDelta(31), rs16.getRawDelta(15));
+    EXPECT_EQ(14, rs32.getRawDelta(31));
+    // The longer filter lags further behind.
+    EXPECT_LT(rs32.getSmoothedRecent(), rs16.getSmoothedRecent());
+}
+
 // Test that the cold draught detector works, with simple synthetic case.
 // Check that a sufficiently sharp drop in temperature
 // (when already below target temperature)
@@ -0,0 +1,265 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * OTRadValve multi-room thermal simulation and boiler call-for-heat tests.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "OTRadValve_BoilerDriver.h"
+#include "OTRadValve_ThermalSim.h"
+
+
+// Check boiler thresholds and anti-short-cycling.
+TEST(ThermalSim,OnOffBoilerCallForHeat)
+{
+    OTRadValve::OnOffBoilerCallForHeat b;
+    uint8_t pcs[3] = { 0, 0, 0 };
+    EXPECT_FALSE(b.tick(pcs, 3));
+    // Aggregate reached but no valve individually open enough.
+    pcs[0] = 14; pcs[1] = 14; pcs[2] = 14; b.setThresholds(15, 40);
+    EXPECT_FALSE(b.tick(pcs, 3));
+    pcs[2] = 15;
+    EXPECT_TRUE(b.tick(pcs, 3));
+    // Individual reached but not aggregate.
+    pcs[0] = 0; pcs[1] = 0; pcs[2] = 39;
+    EXPECT_FALSE(b.tick(pcs, 3));
+    // Minimum time in each state.
+    b.setMinTicksInEitherState(3);
+    pcs[2] = 100;
+    EXPECT_FALSE(b.tick(pcs, 3));
+    EXPECT_FALSE(b.tick(pcs, 3));
+    EXPECT_TRUE(b.tick(pcs, 3));
+    pcs[2] = 0;
+    EXPECT_TRUE(b.tick(pcs, 3));
+    EXPECT_TRUE(b.tick(pcs, 3));
+    EXPECT_FALSE(b.tick(pcs, 3));
+    EXPECT_FALSE(b.isCallingForHeat());
+}
+
+// Check that every task is run exactly once whatever the thread count, with uneven task costs.
+TEST(ThermalSim,WorkStealingPool)
+{
+    for(unsigned threads = 1; threads <= 8; threads *= 2)
+        {
+        const OTRadValve::WorkStealingPool pool(threads);
+        EXPECT_EQ(threads, pool.getThreads());
+        for(size_t n : { size_t(0), size_t(1), size_t(5), size_t(1000) })
+            {
+            std::vector<std::atomic<int>> runs(n);
+            for(auto &r : runs) { r = 0; }
+            std::atomic<uint32_t> work(0);
+            pool.run(n, [&](const size_t i)
+                {
+                ++runs[i];
+                // The first few tasks are far more costly.
+                uint32_t x = 0;
+                for(uint32_t j = (i < 4) ? 200000 : 10; j > 0; --j) { x = x * 31 + j; }
+                work += x & 1;
+                });
+            for(size_t i = 0; i < n; ++i) { ASSERT_EQ(1, runs[i]) << i; }
+            }
+        }
+    EXPECT_LE(1U, OTRadValve::WorkStealingPool().getThreads());
+}
+
+// With the valve shut the room cools exactly as in the ThermalModelBase basic test.
+TEST(ThermalSim,PassiveCooling)
+{
+    OTRadValve::ThermalSim sim;
+    const OTRadValve::ThermalSim::RoomParams p;
+    OTRadValve::ThermalSim::ControlParams c;
+    c.warmC = OTRadValve::MIN_TARGET_C;
+    sim.addRoom(p, c);
+    const OTRadValve::WorkStealingPool pool(1);
+    EXPECT_FALSE(sim.run(10, pool, 0));
+    // ThermalModelBase steps in seconds.
+    ASSERT_TRUE(sim.run(1020 / 60, pool, 60));
+    EXPECT_EQ(17U, sim.getMinutesElapsed());
+    float air = p.startTempC, stored = p.startTempC * p.storageCapacitance;
+    for(int i = 0; i < 1020; ++i)
+        {
+        const float d = ((stored / p.storageCapacitance) - air) * p.storageConductance;
+        stored -= d;
+        air += ((p.outsideTempC - air) * p.wallConductance + d) / p.airCapacitance;
+        }
+    EXPECT_NEAR(air, sim.getAirTempC(0), 0.01);
+    EXPECT_EQ(0, sim.getValvePC(0));
+    EXPECT_EQ(0U, sim.getBoilerOnTicks(0));
+    EXPECT_EQ(0, sim.getEnergyJ(0));
+}
+
+// A cold room is warmed to the target and held near it.
+// Uses a (more realistic) larger effective air heat capacity
+// so that the room does not warm by several degrees per minute.
+TEST(ThermalSim,Regulates)
+{
+    OTRadValve::ThermalSim sim;
+    OTRadValve::ThermalSim::RoomParams p;
+    p.startTempC = 12;
+    p.radiatorTimeConstantS = 600;
+    p.airCapacitance = 500000;
+    p.storageConductance = 50;
+    OTRadValve::ThermalSim::ControlParams c;
+    c.warmC = 19;
+    c.warmStartM = 0;
+    c.warmEndM = 1440;
+    sim.addHouse(4);
+    sim.addRoom(p, c);
+    const OTRadValve::WorkStealingPool pool(1);
+    ASSERT_TRUE(sim.run(6 * 60, pool, 10));
+    ASSERT_TRUE(sim.run(24 * 60, pool, 10, 15));
+    ASSERT_EQ(96U, sim.getTraceSamples());
+    int minC16 = 1000, maxC16 = -1000, sumC16 = 0;
+    for(uint32_t s = 0; s < sim.getTraceSamples(); ++s)
+        {
+        const OTRadValve::ThermalSim::Sample &x = sim.getSample(0, s);
+        EXPECT_EQ(19, x.targetTempC);
+        minC16 = std::min(minC16, int(x.airTempC16));
+        maxC16 = std::max(maxC16, int(x.airTempC16));
+        sumC16 += x.airTempC16;
+        }
+    EXPECT_LE(17 * 16, minC16);
+    EXPECT_GE(23 * 16, maxC16);
+    EXPECT_NEAR(20 * 16, sumC16 / 96, 16);
+    EXPECT_LT(0U, sim.getBoilerStarts(0));
+    EXPECT_LT(0U, sim.getValveTravelPC(0));
+    EXPECT_LT(0, sim.getEnergyJ(0));
+}
+
+// Build a varied set of houses, some rooms with setbacks and glacial valves.
+static void buildEstate(OTRadValve::ThermalSim &sim, const int houses, const uint8_t setbackC = 0xff)
+{
+    for(int h = 0; h < houses; ++h)
+        {
+        sim.addHouse(uint8_t(2 + h % 5));
+        for(int r = 0; r <= h % 4; ++r)
+            {
+            OTRadValve::ThermalSim::RoomParams p;
+            p.startTempC = 10 + r;
+            p.outsideTempC = -2 + h % 9;
+            p.outsideSwingC = 3;
+            p.radiatorConductance = 20 + 4 * r;
+            p.radiatorTimeConstantS = 60 * (h % 7);
+            p.wallConductance = 30 + h % 13;
+            OTRadValve::ThermalSim::ControlParams c;
+            c.warmC = uint8_t(17 + (h + r) % 5);
+            c.setbackC = (0xff != setbackC) ? setbackC : uint8_t(r % 3);
+            c.warmStartM = uint16_t(6 * 60 + 30 * (h % 4));
+            c.glacial = (3 == r);
+            sim.addRoom(p, c);
+            }
+        }
+}
+
+// Results do not depend on the number of threads.
+TEST(ThermalSim,ThreadIndependent)
+{
+    OTRadValve::ThermalSim s1, s4;
+    buildEstate(s1, 24);
+    buildEstate(s4, 24);
+    ASSERT_EQ(s1.getRooms(), s4.getRooms());
+    ASSERT_TRUE(s1.run(1440, OTRadValve::WorkStealingPool(1), 6, 30));
+    ASSERT_TRUE(s4.run(1440, OTRadValve::WorkStealingPool(4), 6, 30));
+    for(size_t h = 0; h < s1.getHouses(); ++h)
+        {
+        EXPECT_EQ(s1.getBoilerOnTicks(h), s4.getBoilerOnTicks(h));
+        EXPECT_EQ(s1.getBoilerStarts(h), s4.getBoilerStarts(h));
+        }
+    for(size_t r = 0; r < s1.getRooms(); ++r)
+        {
+        EXPECT_EQ(s1.getAirTempC(r), s4.getAirTempC(r));
+        EXPECT_EQ(s1.getValvePC(r), s4.getValvePC(r));
+        EXPECT_EQ(s1.getEnergyJ(r), s4.getEnergyJ(r));
+        EXPECT_EQ(s1.getColdCMinutes(r), s4.getColdCMinutes(r));
+        EXPECT_EQ(s1.getValveTravelPC(r), s4.getValveTravelPC(r));
+        for(uint32_t s = 0; s < s1.getTraceSamples(); ++s)
+            { ASSERT_EQ(0, memcmp(&s1.getSample(r, s), &s4.getSample(r, s), sizeof(OTRadValve::ThermalSim::Sample))); }
+        }
+}
+
+// Sweeping the setback across identical estates: deeper setbacks use no more energy.
+TEST(ThermalSim,SetbackSweep)
+{
+    double lastEnergy = 0;
+    for(uint8_t setback = 0; setback <= OTRadValve::DEFAULT_ValveControlParameters::SETBACK_FULL; ++setback)
+        {
+        OTRadValve::ThermalSim sim;
+        buildEstate(sim, 8, setback);
+        ASSERT_TRUE(sim.run(2 * 1440, OTRadValve::WorkStealingPool(2), 6));
+        double energy = 0;
+        for(size_t r = 0; r < sim.getRooms(); ++r) { energy += sim.getEnergyJ(r); }
+        if(0 != setback) { EXPECT_GT(lastEnergy, energy) << int(setback); }
+        lastEnergy = energy;
+        }
+}
+
+// Check the CSV and binary output streams.
+TEST(ThermalSim,Output)
+{
+    OTRadValve::ThermalSim sim;
+    buildEstate(sim, 3);
+    ASSERT_EQ(6U, sim.getRooms());
+    ASSERT_TRUE(sim.run(60, OTRadValve::WorkStealingPool(1), 6));
+    ASSERT_TRUE(sim.run(100, OTRadValve::WorkStealingPool(2), 6, 10));
+    ASSERT_EQ(10U, sim.getTraceSamples());
+
+    char buf[4096];
+    FILE *f = fmemopen(buf, sizeof(buf), "w");
+    ASSERT_TRUE(NULL != f);
+    EXPECT_TRUE(sim.writeTraceCSV(f));
+    fclose(f);
+    EXPECT_EQ(0, strncmp(buf, "minute,house,room,airC,valvePC,targetC,boiler\n60,0,0,", 52));
+    int lines = 0;
+    for(const char *p = buf; NULL != (p = strchr(p, '\n')); ++p) { ++lines; }
+    EXPECT_EQ(1 + 6 * 10, lines);
+    EXPECT_TRUE(NULL != strstr(buf, "\n150,2,5,"));
+
+    f = fmemopen(buf, sizeof(buf), "w");
+    ASSERT_TRUE(NULL != f);
+    EXPECT_TRUE(sim.writeSummaryCSV(f));
+    fclose(f);
+    EXPECT_EQ(0, strncmp(buf, "house,room,energyJ,coldCMinutes,valveTravelPC,boilerOnMinutes,boilerStarts\n0,0,", 78));
+
+    std::vector<uint8_t> bin(1000);
+    f = fmemopen(bin.data(), bin.size(), "wb");
+    ASSERT_TRUE(NULL != f);
+    EXPECT_TRUE(sim.writeTraceBinary(f));
+    const long size = ftell(f);
+    fclose(f);
+    EXPECT_EQ(19 + 6 * 10 * 5, size);
+    EXPECT_EQ(0, memcmp(bin.data(), "OTTS\1", 5));
+    EXPECT_EQ(6, bin[5]);
+    EXPECT_EQ(10, bin[9]);
+    EXPECT_EQ(60, bin[13]);
+    EXPECT_EQ(10, bin[17]);
+    // Last sample of the last room.
+    const OTRadValve::ThermalSim::Sample &last = sim.getSample(5, 9);
+    EXPECT_EQ(uint8_t(last.airTempC16), bin[size - 5]);
+    EXPECT_EQ(uint8_t(last.airTempC16 >> 8), bin[size - 4]);
+    EXPECT_EQ(last.valvePC, bin[size - 3]);
+    EXPECT_EQ(last.targetTempC, bin[size - 2]);
+    EXPECT_EQ(last.boilerOn, bin[size - 1]);
+}
@@ -0,0 +1,251 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * OTRadioLink AT-command engine tests.
+ */
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <string>
+
+#include <OTRadioLink.h>
+
+
+namespace
+    {
+// Stream with canned input; buffered (reports how much is available) or not.
+class StubStream final : public Stream
+    {
+    public:
+        const bool buffered;
+        std::string toBeRead;
+        std::string written;
+        explicit StubStream(const bool b) : buffered(b) { }
+        virtual size_t write(uint8_t c) override { written += char(c); return(1); }
+        virtual int available() override { return(buffered ? int(toBeRead.size()) : -1); }
+        virtual int read() override
+            {
+            if(toBeRead.empty()) { return(-1); }
+            const char c = toBeRead[0];
+            toBeRead.erase(0, 1);
+            return(uint8_t(c));
+            }
+        virtual int peek() override { return(toBeRead.empty() ? -1 : uint8_t(toBeRead[0])); }
+        virtual void flush() override { }
+    };
+
+// Unbuffered stream whose reply only arrives after a number of empty read()s,
+// with a clock that ticks a second at each look, as if each read() waited that long.
+class SlowStream final : public Stream
+    {
+    public:
+        static uint8_t seconds;
+        static uint_fast8_t getSeconds() { seconds = uint8_t((seconds + 1) % 60); return(seconds); }
+        uint8_t quietReads = 0;
+        std::string toBeRead;
+        virtual size_t write(uint8_t) override { return(1); }
+        virtual int available() override { return(-1); }
+        virtual int read() override
+            {
+            if(quietReads > 0) { --quietReads; return(-1); }
+            if(toBeRead.empty()) { return(-1); }
+            const char c = toBeRead[0];
+            toBeRead.erase(0, 1);
+            return(uint8_t(c));
+            }
+        virtual int peek() override { return(-1); }
+        virtual void flush() override { }
+    };
+uint8_t SlowStream::seconds;
+    }
+
+// Check the token matcher, including restarts part way through.
+TEST(ATCommandEngine, tokenMatcher)
+{
+    OTRadioLink::ATTokenMatcher m;
+    m.reset("OK");
+    const char s[] = "xOOxOK";
+    int matchedAt = -1;
+    for(int i = 0; '\0' != s[i]; ++i) { if(m.next(s[i])) { matchedAt = i; } }
+    EXPECT_EQ(5, matchedAt);
+    m.reset(NULL);
+    EXPECT_FALSE(m.next('O'));
+}
+
+// Check that a reply arriving in pieces completes the transaction only when the token is seen.
+TEST(ATCommandEngine, incrementalReply)
+{
+    StubStream s(true);
+    OTRadioLink::ATCommandEngine at(s);
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_IDLE, at.getStatus());
+    at.begin("SEND OK", "ERROR", "FAIL", 0, 10);
+    s.toBeRead = "\r\nSEND";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_PENDING, at.poll(1));
+    EXPECT_TRUE(at.isBusy());
+    s.toBeRead = " OK\r\n";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_OK, at.poll(2));
+    EXPECT_FALSE(at.isBusy());
+    EXPECT_STREQ("\r\nSEND OK", at.getReply());
+    // Result is sticky until the next transaction.
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_OK, at.poll(3));
+    EXPECT_EQ("\r\n", s.toBeRead);
+    at.clear();
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_IDLE, at.getStatus());
+}
+
+// Check error tokens, and that an error outranks OK seen on the same char.
+TEST(ATCommandEngine, errors)
+{
+    StubStream s(true);
+    OTRadioLink::ATCommandEngine at(s);
+    at.begin("OK", "ERROR", "FAIL", 0, 10);
+    s.toBeRead = "SEND FAIL\r\n";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_ERROR, at.poll(0));
+    at.begin("K", "OK", NULL, 0, 10);
+    s.toBeRead = "OK";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_ERROR, at.poll(0));
+}
+
+// Check that untilEOL collects the rest of the line before completing.
+TEST(ATCommandEngine, untilEOL)
+{
+    StubStream s(true);
+    OTRadioLink::ATCommandEngine at(s);
+    at.begin("STATE: ", "ERROR", NULL, 0, 10, true);
+    s.toBeRead = "AT+CIPSTATUS\r\n\r\nOK\r\nSTATE: CONNECT";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_PENDING, at.poll(0));
+    s.toBeRead = " OK\r\nextra";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_OK, at.poll(0));
+    EXPECT_STREQ("AT+CIPSTATUS\r\n\r\nOK\r\nSTATE: CONNECT OK\r\n", at.getReply());
+    EXPECT_EQ("extra", s.toBeRead);
+    // Left-over input is discarded by the next transaction.
+    at.begin("OK", NULL, NULL, 0, 10);
+    EXPECT_TRUE(s.toBeRead.empty());
+}
+
+// Check timeouts, including across the minute wrap, and the per-poll byte limit.
+TEST(ATCommandEngine, timeout)
+{
+    StubStream s(true);
+    OTRadioLink::ATCommandEngine at(s);
+    at.begin(">", "ERROR", NULL, 55, 10);
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_PENDING, at.poll(59));
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_PENDING, at.poll(5));
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_TIMEOUT, at.poll(6));
+    at.begin(">", NULL, NULL, 0, 10);
+    s.toBeRead = "abcdef>";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_PENDING, at.poll(0, 4));
+    EXPECT_EQ(3U, s.toBeRead.size());
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_OK, at.poll(0, 4));
+}
+
+// Check that more than 255 bytes waiting is not mistaken for a few (by truncation to 8 bits).
+TEST(ATCommandEngine, manyBytesWaiting)
+{
+    StubStream s(true);
+    OTRadioLink::ATCommandEngine at(s);
+    at.begin("OK", NULL, NULL, 0, 10);
+    // 257 bytes available, which would truncate to 1.
+    s.toBeRead = std::string(255, 'x') + "OK";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_PENDING, at.poll(0));
+    EXPECT_EQ(2U, s.toBeRead.size());
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_OK, at.poll(0));
+}
+
+// Check that on an unbuffered stream an immediate (zero-timeout) reply completes when the stream goes quiet.
+TEST(ATCommandEngine, unbufferedQuiet)
+{
+    StubStream s(false);
+    OTRadioLink::ATCommandEngine at(s);
+    // Line not terminated, but the token was seen.
+    at.begin("OK", "ERROR", NULL, 0, 0, true);
+    s.toBeRead = "AT+CSTT\r\n\r\nOK\r";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_OK, at.poll(0));
+    // No reply at all.
+    at.begin("OK", "ERROR", NULL, 0, 0, true);
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_TIMEOUT, at.poll(0));
+    // A non-zero timeout keeps waiting.
+    at.begin(">", "ERROR", NULL, 0, 10);
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_PENDING, at.poll(0));
+    s.toBeRead = "AT+CIPSEND=3\r\n\r\n>";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_OK, at.poll(1));
+}
+
+// Check that with a clock poll() blocks on an unbuffered stream until the reply or the timeout,
+// so that a reply arriving after poll() would have returned is not lost.
+TEST(ATCommandEngine, unbufferedBlocking)
+{
+    SlowStream s;
+    SlowStream::seconds = 50;
+    OTRadioLink::ATCommandEngine at(s, SlowStream::getSeconds);
+    at.begin("SEND OK", "ERROR", "FAIL", SlowStream::seconds, 15);
+    s.quietReads = 8;
+    s.toBeRead = "\r\nSEND OK\r\n";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_OK, at.poll(SlowStream::seconds));
+    EXPECT_EQ(0, s.quietReads);
+    // Nothing arrives in time.
+    at.begin("SEND OK", "ERROR", "FAIL", SlowStream::seconds, 15);
+    s.quietReads = 30;
+    s.toBeRead = "\r\nSEND OK\r\n";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_TIMEOUT, at.poll(SlowStream::seconds));
+    EXPECT_LT(0, s.quietReads);
+}
+
+// Check that timeouts of a minute or more are tracked across polls.
+TEST(ATCommandEngine, longTimeout)
+{
+    StubStream s(true);
+    OTRadioLink::ATCommandEngine at(s);
+    at.begin("OK", "ERROR", NULL, 10, 90, true);
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_PENDING, at.poll(40));
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_PENDING, at.poll(10));
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_PENDING, at.poll(40));
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_TIMEOUT, at.poll(41));
+    // A reply after more than a minute still completes the transaction.
+    at.begin("OK", "ERROR", NULL, 0, 90, true);
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_PENDING, at.poll(50));
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_PENDING, at.poll(25));
+    s.toBeRead = "AT+CIICR\r\n\r\nOK\r\n";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_OK, at.poll(26));
+}
+
+// Check that a long reply is truncated safely.
+TEST(ATCommandEngine, longReply)
+{
+    StubStream s(true);
+    OTRadioLink::ATCommandEngine at(s);
+    at.begin("OK", NULL, NULL, 0, 10);
+    s.toBeRead = std::string(200, 'x') + "OK";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_OK, at.poll(0));
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::MAX_REPLY_CHARS - 1, at.getReplyLen());
+}
+
+// Check that next() picks up a further reply already waiting, where begin() would discard it.
+TEST(ATCommandEngine, followOnReply)
+{
+    StubStream s(true);
+    OTRadioLink::ATCommandEngine at(s);
+    at.begin("\n", NULL, NULL, 0, 10);
+    s.toBeRead = "ok\r\naccepted\r\n";
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_OK, at.poll(0));
+    EXPECT_STREQ("ok\r\n", at.getReply());
+    at.next("accepted", "denied", NULL, 0, 10, true);
+    EXPECT_EQ(OTRadioLink::ATCommandEngine::AT_OK, at.poll(0));
+    EXPECT_STREQ("accepted\r\n", at.getReply());
+}
@@ -0,0 +1,210 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * OTRadioLink multi-producer RX queue tests.
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include <OTRadioLink.h>
+#include <utility/OTRadioLink_ISRRXQueueMP.h>
+
+
+// Queue one frame of len bytes all set to v, via the generic interface; false if full.
+static bool queueFrame(OTRadioLink::ISRRXQueue &q, const uint8_t len, const uint8_t v)
+    {
+    volatile uint8_t *const b = q._getRXBufForInbound();
+    if(NULL == b) { return(false); }
+    for(int i = 0; i < len; ++i) { b[i] = v; }
+    q._loadedBuf(len);
+    return(true);
+    }
+
+// Check basic queue/dequeue behaviour, with more than 256 bytes of buffer.
+TEST(ISRRXQueueMP,basics)
+{
+    OTRadioLink::ISRRXQueueMP<64, 8> q;
+    OTRadioLink::ISRRXQueue &iq = q;
+    uint8_t cap, maxLen;
+    iq.getRXCapacity(cap, maxLen);
+    EXPECT_EQ(8, cap);
+    EXPECT_EQ(64, maxLen);
+    EXPECT_TRUE(iq.isEmpty());
+    EXPECT_FALSE(iq.isFull());
+    EXPECT_TRUE(NULL == iq.peekRXMsg());
+    iq.removeRXMsg(); // Harmless when empty.
+    for(int i = 0; i < 8; ++i) { EXPECT_TRUE(queueFrame(iq, 64, uint8_t(i))); }
+    EXPECT_TRUE(iq.isFull());
+    EXPECT_FALSE(queueFrame(iq, 64, 99));
+    EXPECT_EQ(8, iq.getRXMsgsQueued());
+    for(int i = 0; i < 8; ++i)
+        {
+        const volatile uint8_t *const m = iq.peekRXMsg();
+        ASSERT_TRUE(NULL != m);
+        EXPECT_EQ(64, m[-1]);
+        EXPECT_EQ(i, m[0]);
+        EXPECT_EQ(i, m[63]);
+        iq.removeRXMsg();
+        EXPECT_FALSE(iq.isFull());
+        }
+    EXPECT_TRUE(iq.isEmpty());
+    EXPECT_TRUE(NULL == iq.peekRXMsg());
+}
+
+// Check that an upload can be abandoned, and that an unfinished one is reused.
+TEST(ISRRXQueueMP,abandon)
+{
+    OTRadioLink::ISRRXQueueMP<8, 4> q;
+    volatile uint8_t *const b1 = q._getRXBufForInbound();
+    ASSERT_TRUE(NULL != b1);
+    EXPECT_TRUE(b1 == q._getRXBufForInbound());
+    q._loadedBuf(0);
+    EXPECT_TRUE(q.isEmpty());
+    EXPECT_TRUE(NULL == q.peekRXMsg());
+    // Abandoned slots do not block later frames.
+    EXPECT_TRUE(queueFrame(q, 3, 0x55));
+    const volatile uint8_t *const m = q.peekRXMsg();
+    ASSERT_TRUE(NULL != m);
+    EXPECT_EQ(3, m[-1]);
+    EXPECT_EQ(0x55, m[2]);
+    // Oversize frames are truncated.
+    q.removeRXMsg();
+    volatile uint8_t *const b2 = q._getRXBufForInbound();
+    ASSERT_TRUE(NULL != b2);
+    q._loadedBuf(200);
+    EXPECT_EQ(8, q.peekRXMsg()[-1]);
+    // _loadedBuf() without an upload in progress does nothing.
+    q._loadedBuf(1);
+    EXPECT_EQ(1, q.getRXMsgsQueued());
+}
+
+// Check batch peek and remove.
+TEST(ISRRXQueueMP,batch)
+{
+    OTRadioLink::ISRRXQueueMP<4, 16> q;
+    for(int i = 0; i < 10; ++i) { ASSERT_TRUE(queueFrame(q, uint8_t(1 + (i % 4)), uint8_t(i))); }
+    // An abandoned upload in the middle of the batch is skipped.
+    ASSERT_TRUE(NULL != q._getRXBufForInbound());
+    q._loadedBuf(0);
+    ASSERT_TRUE(queueFrame(q, 1, 10));
+    EXPECT_EQ(11, q.getRXMsgsQueued16());
+    const volatile uint8_t *frames[16];
+    EXPECT_EQ(0, q.peekRXMsgs(frames, 0));
+    EXPECT_EQ(4, q.peekRXMsgs(frames, 4));
+    for(int i = 0; i < 4; ++i) { EXPECT_EQ(i, frames[i][0]); EXPECT_EQ(1 + (i % 4), frames[i][-1]); }
+    EXPECT_EQ(11, q.peekRXMsgs(frames, 16));
+    for(int i = 0; i < 11; ++i) { EXPECT_EQ(i, frames[i][0]); }
+    EXPECT_EQ(4, q.removeRXMsgs(4));
+    EXPECT_EQ(7, q.getRXMsgsQueued());
+    EXPECT_EQ(7, q.peekRXMsgs(frames, 16));
+    EXPECT_EQ(4, frames[0][0]);
+    EXPECT_EQ(7, q.removeRXMsgs(255));
+    EXPECT_TRUE(q.isEmpty());
+    EXPECT_EQ(0, q.removeRXMsgs(1));
+    EXPECT_EQ(0, q.peekRXMsgs(frames, 16));
+}
+
+// Check that the 16-bit positions wrap correctly.
+TEST(ISRRXQueueMP,wrap)
+{
+    OTRadioLink::ISRRXQueueMP<2, 4> q;
+    for(uint32_t i = 0; i < 3 * 65536UL; ++i)
+        {
+        ASSERT_TRUE(queueFrame(q, 2, uint8_t(i)));
+        if(0 == (i & 1)) { continue; }
+        for(uint32_t j = i - 1; j <= i; ++j)
+            {
+            const volatile uint8_t *const m = q.peekRXMsg();
+            ASSERT_TRUE(NULL != m);
+            ASSERT_EQ(uint8_t(j), m[0]);
+            q.removeRXMsg();
+            }
+        }
+    EXPECT_TRUE(q.isEmpty());
+}
+
+// Several producer threads feeding one consumer.
+// Each frame carries its producer and per-producer sequence number,
+// which must arrive intact, once each and in order for each producer.
+TEST(ISRRXQueueMP,stress)
+{
+    static constexpr int producers = 4;
+    static constexpr uint32_t framesPerProducer = 50000;
+    static OTRadioLink::ISRRXQueueMP<32, 64> q;
+    // Set if the consumer gives up, so that producers blocked on a full queue exit and can be joined.
+    static std::atomic<bool> stop;
+    stop = false;
+    std::vector<std::thread> threads;
+    for(int p = 0; p < producers; ++p)
+        {
+        threads.push_back(std::thread([p]
+            {
+            for(uint32_t n = 0; (n < framesPerProducer) && !stop.load(); )
+                {
+                volatile uint8_t *const b = q._getRXBufForInbound();
+                if(NULL == b) { std::this_thread::yield(); continue; }
+                // Abandon an upload now and again.
+                if(0 == (n % 97)) { q._loadedBuf(0); ++n; continue; }
+                const uint8_t len = uint8_t(5 + (n % 28));
+                b[0] = uint8_t(p);
+                b[1] = uint8_t(n >> 16); b[2] = uint8_t(n >> 8); b[3] = uint8_t(n);
+                for(int i = 4; i < len; ++i) { b[i] = uint8_t(n + i); }
+                q._loadedBuf(len);
+                ++n;
+                }
+            }));
+        }
+    uint32_t expected[producers] = { };
+    uint32_t received = 0;
+    const uint32_t abandonedPerProducer = (framesPerProducer + 96) / 97;
+    const uint32_t total = producers * (framesPerProducer - abandonedPerProducer);
+    const volatile uint8_t *frames[8];
+    bool ok = true;
+    while(ok && (received < total))
+        {
+        const uint8_t n = q.peekRXMsgs(frames, 8);
+        if(0 == n) { std::this_thread::yield(); continue; }
+        for(int f = 0; f < n; ++f)
+            {
+            const volatile uint8_t *const b = frames[f];
+            const uint8_t p = b[0];
+            if(p >= producers) { ok = false; break; }
+            const uint32_t seq = (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | b[3];
+            // Skip over abandoned sequence numbers.
+            if(0 == (expected[p] % 97)) { ++expected[p]; }
+            if(seq != expected[p]) { ok = false; break; }
+            if(b[-1] != uint8_t(5 + (seq % 28))) { ok = false; break; }
+            for(int i = 4; i < b[-1]; ++i) { if(b[i] != uint8_t(seq + i)) { ok = false; } }
+            ++expected[p];
+            }
+        received += q.removeRXMsgs(n);
+        }
+    stop = true;
+    for(std::thread &t : threads) { t.join(); }
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(total, received);
+    EXPECT_TRUE(q.isEmpty());
+    EXPECT_EQ(0, q.getRXMsgsQueued16());
+    EXPECT_TRUE(NULL == q.peekRXMsg());
+}
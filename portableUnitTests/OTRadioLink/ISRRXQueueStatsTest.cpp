@@ -0,0 +1,125 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * OTRadioLink RX queue instrumentation tests.
+ */
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <OTV0p2Base.h>
+#include <OTRadioLink.h>
+#include <utility/OTRadioLink_ISRRXQueueMP.h>
+#include <utility/OTRadioLink_ISRRXQueueStats.h>
+
+
+// Fake sub-cycle time, advanced by the test.
+static uint8_t fakeTicks;
+static uint8_t getFakeTicks() { return(fakeTicks); }
+
+// Load a frame (as a radio ISR would), returning false if there was no space.
+static bool queueFrame(OTRadioLink::ISRRXQueue &q, const uint8_t len)
+    {
+    volatile uint8_t *const b = q._getRXBufForInbound();
+    if(NULL == b) { return(false); }
+    for(int i = 0; i < len; ++i) { b[i] = uint8_t(i); }
+    q._loadedBuf(len);
+    return(true);
+    }
+
+// A filter that rejects everything.
+static bool rejectAll(const volatile uint8_t *, volatile uint8_t &) { return(false); }
+
+// Check depth, drop and latency collection.
+TEST(ISRRXQueueStats,instrumented)
+{
+    OTRadioLink::ISRRXQueueInstrumented<OTRadioLink::ISRRXQueueMP<8, 8>, getFakeTicks, 4> q;
+    OTRadioLink::ISRRXQueue &iq = q;
+    ASSERT_TRUE(&q.stats == OTRadioLink::getISRRXQueueStats(q));
+    const OTRadioLink::ISRRXQueueStats &s = q.stats;
+    EXPECT_EQ(0, s.highWater);
+    // Queue 6 frames, one tick apart; only the first 4 are timed.
+    fakeTicks = 250;
+    for(int i = 0; i < 6; ++i) { ASSERT_TRUE(queueFrame(iq, 4)); ++fakeTicks; }
+    EXPECT_EQ(6, iq.getRXMsgsQueued());
+    EXPECT_EQ(6, s.highWater);
+    EXPECT_EQ(1, s.depthAtEnqueue[0]);
+    EXPECT_EQ(1, s.depthAtEnqueue[1]);
+    EXPECT_EQ(1, s.depthAtEnqueue[2]);
+    EXPECT_EQ(3, s.depthAtEnqueue[3]);
+    // An abandoned upload is not counted (though it occupies a slot in this queue until dequeued).
+    ASSERT_TRUE(NULL != iq._getRXBufForInbound());
+    iq._loadedBuf(0);
+    EXPECT_EQ(6, iq.getRXMsgsQueued());
+    // Fill and overflow.
+    ASSERT_TRUE(queueFrame(iq, 4));
+    EXPECT_TRUE(iq.isFull());
+    EXPECT_FALSE(queueFrame(iq, 4));
+    EXPECT_EQ(1, s.dropped);
+    EXPECT_EQ(7, s.highWater);
+    // Dequeue everything 10 ticks after the last enqueue (across the tick wrap).
+    fakeTicks += 10;
+    while(!iq.isEmpty()) { ASSERT_TRUE(NULL != iq.peekRXMsg()); iq.removeRXMsg(); }
+    EXPECT_TRUE(NULL == iq.peekRXMsg());
+    EXPECT_EQ(4, s.latencyCount);
+    EXPECT_EQ(16, s.latencyMax);
+    EXPECT_EQ(14, s.getMeanLatency()); // (16+15+14+13)/4
+    // Once drained, new frames are timed again.
+    ASSERT_TRUE(queueFrame(iq, 1));
+    fakeTicks += 3;
+    iq.removeRXMsg();
+    EXPECT_EQ(5, s.latencyCount);
+    q.stats.reset();
+    EXPECT_EQ(0, s.highWater);
+    EXPECT_EQ(0, s.latencyCount);
+    EXPECT_EQ(0, s.dropped);
+}
+
+// Check per-filter counts and export as JSON stats.
+TEST(ISRRXQueueStats,putStats)
+{
+    OTRadioLink::ISRRXQueueStats s;
+    s.noteFiltered(rejectAll);
+    s.noteFiltered(OTRadioLink::frameFilterTrailingZeros);
+    s.noteFiltered(rejectAll);
+    EXPECT_TRUE(rejectAll == s.filters[0]);
+    EXPECT_EQ(2, s.filtered[0]);
+    EXPECT_EQ(1, s.filtered[1]);
+    s.noteEnqueued(0);
+    s.noteEnqueued(1);
+    s.noteLatency(20);
+    OTV0P2BASE::SimpleStatsRotation<12> ss;
+    ss.setID("");
+    EXPECT_TRUE(s.putStats(ss));
+    EXPECT_EQ(10, ss.size());
+    EXPECT_TRUE(ss.containsKey("RXhw"));
+    EXPECT_TRUE(ss.containsKey("RXf1"));
+    EXPECT_FALSE(ss.containsKey("RXf2"));
+    char buf[OTV0P2BASE::MSG_JSON_MAX_LENGTH + 2];
+    const uint8_t l = ss.writeJSON((uint8_t *)buf, sizeof(buf), OTV0P2BASE::stTXalwaysAll, true);
+    ASSERT_NE(0, l);
+    EXPECT_TRUE(NULL != strstr(buf, "\"RXhw\":2"));
+    // Too little capacity fails.
+    OTV0P2BASE::SimpleStatsRotation<4> small;
+    EXPECT_FALSE(s.putStats(small));
+    // Non-instrumented queues have no stats.
+    OTRadioLink::ISRRXQueueNULL plain;
+    EXPECT_TRUE(NULL == OTRadioLink::getISRRXQueueStats(plain));
+}
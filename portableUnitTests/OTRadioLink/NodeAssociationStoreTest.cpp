@@ -0,0 +1,413 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * OTRadioLink tests of the host-side node association store
+ * and the secure RX implementation that uses it.
+ */
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <OTRadioLink.h>
+#include <utility/OTRadioLink_ISRRXQueue.h>
+
+
+// Make a valid-looking random node ID.
+static void randomID(uint8_t *id)
+    {
+    for(uint8_t i = 0; i < OTV0P2BASE::OpenTRV_Node_ID_Bytes; ++i)
+        { do { id[i] = 0x80 | uint8_t(random()); } while(!OTV0P2BASE::validIDByte(id[i])); }
+    }
+
+// Get a fresh temporary file name for a log, with no existing file.
+static void tmpLogName(char *buf, size_t bufsize)
+    {
+    snprintf(buf, bufsize, "/tmp/OTNodeAssocTest.%d.%ld.log", int(getpid()), long(random()));
+    remove(buf);
+    }
+
+// Basic RAM-only store behaviour.
+TEST(NodeAssociationStore,basics)
+{
+    OTRadioLink::NodeAssociationStoreHashed store;
+    EXPECT_TRUE(store.isOK());
+    EXPECT_EQ(0, store.countNodeAssociations());
+    const uint8_t id0[] = { 0x88, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87 };
+    const uint8_t id1[] = { 0x88, 0x81, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99 };
+    uint8_t counter[OTRadioLink::SimpleSecureFrame32or0BodyBase::fullMessageCounterBytes];
+    EXPECT_FALSE(store.getLastRXMessageCounter(id0, counter));
+    EXPECT_EQ(-1, store.getNextMatchingNodeID(0, id0, 4, NULL));
+    EXPECT_EQ(0, store.addNodeAssociation(id0));
+    EXPECT_EQ(1, store.addNodeAssociation(id1));
+    EXPECT_EQ(0, store.addNodeAssociation(id0)); // Already present.
+    EXPECT_EQ(2, store.countNodeAssociations());
+    // New associations start with a zero counter.
+    EXPECT_TRUE(store.getLastRXMessageCounter(id0, counter));
+    for(size_t i = 0; i < sizeof(counter); ++i) { EXPECT_EQ(0, counter[i]); }
+    // Prefix matching.
+    uint8_t out[OTV0P2BASE::OpenTRV_Node_ID_Bytes];
+    EXPECT_EQ(0, store.getNextMatchingNodeID(0, id0, 2, out));
+    EXPECT_EQ(0, memcmp(id0, out, sizeof(out)));
+    EXPECT_EQ(1, store.getNextMatchingNodeID(1, id0, 2, out));
+    EXPECT_EQ(0, memcmp(id1, out, sizeof(out)));
+    EXPECT_EQ(1, store.getNextMatchingNodeID(0, id1, 3, NULL));
+    EXPECT_EQ(-1, store.getNextMatchingNodeID(2, id0, 2, NULL));
+    // Short and empty prefixes.
+    EXPECT_EQ(0, store.getNextMatchingNodeID(0, NULL, 0, NULL));
+    EXPECT_EQ(1, store.getNextMatchingNodeID(1, id1, 1, NULL));
+    EXPECT_EQ(-1, store.getNextMatchingNodeID(0, NULL, 1, NULL));
+    // Counters only move forwards.
+    const uint8_t c1[] = { 0, 0, 0, 0, 0, 1 };
+    const uint8_t c2[] = { 0, 0, 1, 0, 0, 0 };
+    EXPECT_TRUE(store.updateRXMessageCount(id0, c2));
+    EXPECT_FALSE(store.updateRXMessageCount(id0, c2));
+    EXPECT_FALSE(store.updateRXMessageCount(id0, c1));
+    EXPECT_TRUE(store.getLastRXMessageCounter(id0, counter));
+    EXPECT_EQ(0, memcmp(c2, counter, sizeof(counter)));
+    EXPECT_TRUE(store.updateRXMessageCount(id1, c1));
+    EXPECT_TRUE(store.clearAllNodeAssociations());
+    EXPECT_EQ(0, store.countNodeAssociations());
+    EXPECT_FALSE(store.getLastRXMessageCounter(id0, counter));
+}
+
+// Check that the store scales to thousands of nodes and agrees with a linear scan.
+TEST(NodeAssociationStore,manyNodes)
+{
+    static const int n = 5000;
+    std::vector<uint8_t> ids(n * OTV0P2BASE::OpenTRV_Node_ID_Bytes);
+    OTRadioLink::NodeAssociationStoreHashed store;
+    for(int i = 0; i < n; ++i)
+        {
+        uint8_t *const id = &ids[i * OTV0P2BASE::OpenTRV_Node_ID_Bytes];
+        randomID(id);
+        ASSERT_EQ(i, store.addNodeAssociation(id));
+        }
+    EXPECT_EQ(n, store.countNodeAssociations());
+    for(int t = 0; t < 1000; ++t)
+        {
+        const int i = int(random() % n);
+        const uint8_t *const id = &ids[i * OTV0P2BASE::OpenTRV_Node_ID_Bytes];
+        const uint8_t prefixLen = uint8_t(2 + (random() % 7));
+        int expected = -1;
+        for(int j = 0; j < n; ++j)
+            { if(0 == memcmp(&ids[j * OTV0P2BASE::OpenTRV_Node_ID_Bytes], id, prefixLen)) { expected = j; break; } }
+        EXPECT_EQ(expected, store.getNextMatchingNodeID(0, id, prefixLen, NULL));
+        uint8_t counter[OTRadioLink::SimpleSecureFrame32or0BodyBase::fullMessageCounterBytes] = { 0, 0, 0, 0, 0, uint8_t(1 + t) };
+        counter[4] = uint8_t(t >> 8);
+        store.updateRXMessageCount(id, counter);
+        }
+}
+
+// Check persistence via the append-only log, including recovery from a torn final record and compaction.
+TEST(NodeAssociationStore,log)
+{
+    char name[64];
+    tmpLogName(name, sizeof(name));
+    const uint8_t id0[] = { 0x88, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87 };
+    const uint8_t id1[] = { 0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97 };
+    const uint8_t c1[] = { 0, 0, 0, 0, 0, 1 };
+    const uint8_t c2[] = { 0, 0, 0, 0, 0, 2 };
+    uint8_t counter[OTRadioLink::SimpleSecureFrame32or0BodyBase::fullMessageCounterBytes];
+        {
+        OTRadioLink::NodeAssociationStoreHashed store(name);
+        EXPECT_TRUE(store.isOK());
+        EXPECT_EQ(0, store.addNodeAssociation(id0));
+        EXPECT_EQ(1, store.addNodeAssociation(id1));
+        EXPECT_TRUE(store.updateRXMessageCount(id0, c1));
+        EXPECT_TRUE(store.updateRXMessageCount(id0, c2));
+        }
+    // Simulate a torn write at the end of the log.
+        {
+        FILE *f = fopen(name, "ab");
+        ASSERT_TRUE(NULL != f);
+        fputc('C', f);
+        fputc(0x88, f);
+        fclose(f);
+        }
+        {
+        OTRadioLink::NodeAssociationStoreHashed store(name);
+        EXPECT_TRUE(store.isOK());
+        EXPECT_EQ(2, store.countNodeAssociations());
+        EXPECT_EQ(1, store.getNextMatchingNodeID(0, id1, 4, NULL));
+        EXPECT_TRUE(store.getLastRXMessageCounter(id0, counter));
+        EXPECT_EQ(0, memcmp(c2, counter, sizeof(counter)));
+        EXPECT_FALSE(store.updateRXMessageCount(id0, c1));
+        EXPECT_TRUE(store.compact());
+        EXPECT_TRUE(store.updateRXMessageCount(id1, c1));
+        }
+        {
+        OTRadioLink::NodeAssociationStoreHashed store(name);
+        EXPECT_EQ(2, store.countNodeAssociations());
+        EXPECT_TRUE(store.getLastRXMessageCounter(id0, counter));
+        EXPECT_EQ(0, memcmp(c2, counter, sizeof(counter)));
+        EXPECT_TRUE(store.getLastRXMessageCounter(id1, counter));
+        EXPECT_EQ(0, memcmp(c1, counter, sizeof(counter)));
+        EXPECT_TRUE(store.clearAllNodeAssociations());
+        }
+        {
+        OTRadioLink::NodeAssociationStoreHashed store(name);
+        EXPECT_EQ(0, store.countNodeAssociations());
+        }
+    remove(name);
+}
+
+// Check that updates made after recovering from a torn record survive the next restart,
+// ie are not appended after the torn bytes where replay would never reach them.
+TEST(NodeAssociationStore,updateAfterTornRecord)
+{
+    char name[64];
+    tmpLogName(name, sizeof(name));
+    const uint8_t id0[] = { 0x88, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87 };
+    const uint8_t c1[] = { 0, 0, 0, 0, 0, 1 };
+    const uint8_t c2[] = { 0, 0, 0, 0, 0, 2 };
+    uint8_t counter[OTRadioLink::SimpleSecureFrame32or0BodyBase::fullMessageCounterBytes];
+        {
+        OTRadioLink::NodeAssociationStoreHashed store(name);
+        EXPECT_EQ(0, store.addNodeAssociation(id0));
+        EXPECT_TRUE(store.updateRXMessageCount(id0, c1));
+        }
+    // Simulate a partial record from a crash mid-write.
+        {
+        FILE *f = fopen(name, "ab");
+        ASSERT_TRUE(NULL != f);
+        const uint8_t partial[] = { 'C', 0x88, 0x81, 0x82 };
+        EXPECT_EQ(1U, fwrite(partial, sizeof(partial), 1, f));
+        fclose(f);
+        }
+        {
+        OTRadioLink::NodeAssociationStoreHashed store(name);
+        EXPECT_TRUE(store.isOK());
+        EXPECT_TRUE(store.updateRXMessageCount(id0, c2));
+        }
+        {
+        OTRadioLink::NodeAssociationStoreHashed store(name);
+        EXPECT_TRUE(store.isOK());
+        EXPECT_TRUE(store.getLastRXMessageCounter(id0, counter));
+        EXPECT_EQ(0, memcmp(c2, counter, sizeof(counter)));
+        EXPECT_FALSE(store.updateRXMessageCount(id0, c2));
+        }
+    // Likewise for a full-length record with a bad CRC.
+        {
+        FILE *f = fopen(name, "ab");
+        ASSERT_TRUE(NULL != f);
+        uint8_t bad[OTRadioLink::NodeAssociationStoreHashed::logRecordBytes];
+        memset(bad, 0xff, sizeof(bad));
+        EXPECT_EQ(1U, fwrite(bad, sizeof(bad), 1, f));
+        fclose(f);
+        }
+    const uint8_t c3[] = { 0, 0, 0, 0, 0, 3 };
+        {
+        OTRadioLink::NodeAssociationStoreHashed store(name);
+        EXPECT_TRUE(store.updateRXMessageCount(id0, c3));
+        }
+        {
+        OTRadioLink::NodeAssociationStoreHashed store(name);
+        EXPECT_TRUE(store.getLastRXMessageCounter(id0, counter));
+        EXPECT_EQ(0, memcmp(c3, counter, sizeof(counter)));
+        }
+    remove(name);
+}
+
+// As fixed32BTextSize12BNonce16BTagSimpleDec_NULL_IMPL() but checking the whole nonce in the tag,
+// so that decoding with the wrong sender ID (and thus IV) fails.
+static bool decStrictNULL(void *const state,
+        const uint8_t *const key, const uint8_t *const iv,
+        const uint8_t *const authtext, const uint8_t authtextSize,
+        const uint8_t *const ciphertext, const uint8_t *const tag,
+        uint8_t *const plaintextOut)
+    {
+    if((NULL == iv) || (NULL == tag) || (0 != memcmp(tag, iv, 12))) { return(false); }
+    return(OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleDec_NULL_IMPL(state, key, iv, authtext, authtextSize, ciphertext, tag, plaintextOut));
+    }
+
+// End-to-end secure RX through the store with the NULL (test-only) crypto.
+TEST(NodeAssociationStore,secureRXWithStore)
+{
+    const uint8_t id[] = { 0x88, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87 };
+    const uint8_t key[16] = { };
+    OTRadioLink::NodeAssociationStoreHashed store;
+    OTRadioLink::SimpleSecureFrame32or0BodyRXWithStore rx(store);
+    // Some other nodes, one sharing the 4-byte header ID prefix.
+    uint8_t other[OTV0P2BASE::OpenTRV_Node_ID_Bytes];
+    for(int i = 0; i < 10; ++i) { randomID(other); store.addNodeAssociation(other); }
+    memcpy(other, id, 4);
+    store.addNodeAssociation(other);
+    store.addNodeAssociation(id);
+    // Build a frame as the leaf would.
+    uint8_t iv[12];
+    memcpy(iv, id, 6);
+    const uint8_t counter[] = { 0, 0, 1, 0, 0, 5 };
+    memcpy(iv + 6, counter, 6);
+    const uint8_t body[] = { 0x7f, 0x11, '{', '}' };
+    uint8_t buf[64];
+    const uint8_t bytes = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(buf, sizeof(buf),
+                                    OTRadioLink::FTS_BasicSensorOrValve,
+                                    id, 4,
+                                    body, sizeof(body),
+                                    iv,
+                                    OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleEnc_NULL_IMPL,
+                                    NULL, key);
+    ASSERT_NE(0, bytes);
+    OTRadioLink::SecurableFrameHeader sfh;
+    ASSERT_NE(0, sfh.checkAndDecodeSmallFrameHeader(buf, bytes));
+    uint8_t plain[32];
+    uint8_t plainSize = 0;
+    uint8_t senderID[OTV0P2BASE::OpenTRV_Node_ID_Bytes];
+    // The first prefix match is the wrong node, so only the exhaustive search succeeds.
+    EXPECT_EQ(0, rx.decodeSecureSmallFrameSafely(&sfh, buf, bytes,
+                                    decStrictNULL,
+                                    NULL, key, plain, sizeof(plain), plainSize, senderID, true));
+    EXPECT_EQ(bytes, rx.decodeSecureSmallFrameSafely(&sfh, buf, bytes,
+                                    decStrictNULL,
+                                    NULL, key, plain, sizeof(plain), plainSize, senderID, false));
+    EXPECT_EQ(sizeof(body), plainSize);
+    EXPECT_EQ(0, memcmp(body, plain, sizeof(body)));
+    EXPECT_EQ(0, memcmp(id, senderID, sizeof(senderID)));
+    uint8_t stored[6];
+    EXPECT_TRUE(rx.getLastRXMessageCounter(id, stored));
+    EXPECT_EQ(0, memcmp(counter, stored, sizeof(stored)));
+    // Replay must be rejected.
+    EXPECT_EQ(0, rx.decodeSecureSmallFrameSafely(&sfh, buf, bytes,
+                                    decStrictNULL,
+                                    NULL, key, plain, sizeof(plain), plainSize, senderID, false));
+}
+
+// Encode a secure test frame from the given node with the given counter least-significant byte into buf.
+static uint8_t encodeTestFrame(uint8_t *const buf, const uint8_t buflen, const uint8_t *const id, const uint8_t counterLSB)
+    {
+    const uint8_t key[16] = { };
+    uint8_t iv[12];
+    memcpy(iv, id, 6);
+    const uint8_t counter[] = { 0, 0, 1, 0, 0, counterLSB };
+    memcpy(iv + 6, counter, 6);
+    const uint8_t body[] = { 0x7f, 0x11, '{', '}', counterLSB };
+    return(OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(buf, buflen,
+                                    OTRadioLink::FTS_BasicSensorOrValve,
+                                    id, 4,
+                                    body, sizeof(body),
+                                    iv,
+                                    OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleEnc_NULL_IMPL,
+                                    NULL, key));
+    }
+
+// Queue a raw frame for RX as the radio ISR would.
+static bool queueFrame(OTRadioLink::ISRRXQueue &q, const uint8_t *const frame, const uint8_t len)
+    {
+    volatile uint8_t *const b = q._getRXBufForInbound();
+    if(NULL == b) { return(false); }
+    for(uint8_t i = 0; i < len; ++i) { b[i] = frame[i]; }
+    q._loadedBuf(len);
+    return(true);
+    }
+
+// Simple host-side FIFO RX queue of up to 4 frames of up to 64 bytes for testing.
+class TestRXQueue final : public OTRadioLink::ISRRXQueue
+    {
+    private:
+        volatile uint8_t bufs[4][1 + 64];
+        uint8_t oldest = 0;
+    public:
+        virtual void getRXCapacity(uint8_t &queueRXMsgsMin, uint8_t &maxRXMsgLen) const override
+            { queueRXMsgsMin = 4; maxRXMsgLen = 64; }
+        virtual uint8_t isFull() const override { return(queuedRXedMessageCount >= 4); }
+        virtual volatile uint8_t *_getRXBufForInbound() const override
+            { return(isFull() ? NULL : const_cast<volatile uint8_t *>(bufs[(oldest + queuedRXedMessageCount) & 3] + 1)); }
+        virtual void _loadedBuf(const uint8_t frameLen) override
+            {
+            if((0 == frameLen) || isFull()) { return; }
+            bufs[(oldest + queuedRXedMessageCount) & 3][0] = frameLen;
+            ++queuedRXedMessageCount;
+            }
+        virtual const volatile uint8_t *peekRXMsg() const override
+            { return((0 == queuedRXedMessageCount) ? NULL : bufs[oldest] + 1); }
+        virtual void removeRXMsg() override
+            {
+            if(0 == queuedRXedMessageCount) { return; }
+            oldest = (oldest + 1) & 3;
+            --queuedRXedMessageCount;
+            }
+    };
+
+// Batch decode from an RX queue, including grouping, replay rejection and non-secure frames.
+TEST(NodeAssociationStore,batchDecode)
+{
+    const uint8_t key[16] = { };
+    const uint8_t idA[] = { 0x88, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87 };
+    const uint8_t idB[] = { 0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97 };
+    const uint8_t idC[] = { 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7 }; // Not associated.
+    OTRadioLink::NodeAssociationStoreHashed store;
+    store.addNodeAssociation(idA);
+    store.addNodeAssociation(idB);
+    OTRadioLink::SimpleSecureFrame32or0BodyRXWithStore rx(store);
+    TestRXQueue q;
+    OTRadioLink::SimpleSecureFrame32or0BodyRXWithStore::BatchRXResult results[4];
+    uint8_t buf[64];
+    uint8_t len;
+
+    // Empty queue.
+    EXPECT_EQ(0, rx.decodeSecureSmallFramesBatch(q, 4, decStrictNULL, NULL, key, results));
+
+    // Interleaved senders, all fresh.
+    len = encodeTestFrame(buf, sizeof(buf), idA, 5); ASSERT_TRUE(queueFrame(q, buf, len));
+    len = encodeTestFrame(buf, sizeof(buf), idB, 1); ASSERT_TRUE(queueFrame(q, buf, len));
+    len = encodeTestFrame(buf, sizeof(buf), idA, 6); ASSERT_TRUE(queueFrame(q, buf, len));
+    EXPECT_EQ(3, rx.decodeSecureSmallFramesBatch(q, 4, decStrictNULL, NULL, key, results));
+    EXPECT_EQ(0, q.getRXMsgsQueued());
+    const uint8_t expectedLSB[] = { 5, 1, 6 };
+    const uint8_t *const expectedID[] = { idA, idB, idA };
+    for(int i = 0; i < 3; ++i)
+        {
+        EXPECT_NE(0, results[i].decodeResult);
+        EXPECT_EQ(5, results[i].bodyLen);
+        EXPECT_EQ(expectedLSB[i], results[i].body[4]);
+        EXPECT_EQ(0, memcmp(expectedID[i], results[i].senderID, 8));
+        }
+    uint8_t counter[6];
+    EXPECT_TRUE(store.getLastRXMessageCounter(idA, counter));
+    EXPECT_EQ(6, counter[5]);
+
+    // Replay, then fresh frame from same sender, then unassociated sender.
+    len = encodeTestFrame(buf, sizeof(buf), idA, 6); ASSERT_TRUE(queueFrame(q, buf, len));
+    len = encodeTestFrame(buf, sizeof(buf), idA, 7); ASSERT_TRUE(queueFrame(q, buf, len));
+    len = encodeTestFrame(buf, sizeof(buf), idC, 9); ASSERT_TRUE(queueFrame(q, buf, len));
+    EXPECT_EQ(3, rx.decodeSecureSmallFramesBatch(q, 4, decStrictNULL, NULL, key, results));
+    EXPECT_EQ(0, results[0].decodeResult);
+    EXPECT_NE(0, results[1].decodeResult);
+    EXPECT_EQ(7, results[1].body[4]);
+    EXPECT_EQ(0, results[2].decodeResult);
+    EXPECT_TRUE(store.getLastRXMessageCounter(idA, counter));
+    EXPECT_EQ(7, counter[5]);
+
+    // Non-secure frame passed through undecoded, and batch size limit respected.
+    const uint8_t body[] = { '{', '}' };
+    len = OTRadioLink::encodeNonsecureSmallFrame(buf, sizeof(buf), OTRadioLink::FTS_BasicSensorOrValve, 0, idB, 2, body, sizeof(body));
+    ASSERT_NE(0, len);
+    ASSERT_TRUE(queueFrame(q, buf, len));
+    len = encodeTestFrame(buf, sizeof(buf), idB, 2); ASSERT_TRUE(queueFrame(q, buf, len));
+    EXPECT_EQ(1, rx.decodeSecureSmallFramesBatch(q, 1, decStrictNULL, NULL, key, results));
+    EXPECT_EQ(0, results[0].decodeResult);
+    EXPECT_FALSE(results[0].sfh.isInvalid());
+    EXPECT_FALSE(results[0].sfh.isSecure());
+    EXPECT_EQ(1, q.getRXMsgsQueued());
+    EXPECT_EQ(1, rx.decodeSecureSmallFramesBatch(q, 4, decStrictNULL, NULL, key, results));
+    EXPECT_NE(0, results[0].decodeResult);
+}
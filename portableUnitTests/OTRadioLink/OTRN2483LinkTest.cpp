@@ -0,0 +1,302 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * OTRadioLink RN2483 tests, against a simulated RN2483.
+ */
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "OTRN2483Link.h"
+
+
+namespace RN2483Emu {
+
+// Virtual time in seconds within the minute [0,59].
+static uint_fast8_t secondsVT;
+static uint_fast8_t getSecondsVT() { return(secondsVT); }
+static void incrementVT(const uint_fast8_t s) { secondsVT = (secondsVT + s) % 60; }
+
+// An uplink as received by the simulated RN2483.
+struct Uplink
+    {
+    int port;
+    std::vector<uint8_t> payload;
+    };
+
+// Simulated RN2483 behind a buffered serial connection,
+// replying to each command line as soon as it is written.
+class RN2483Simulator final : public Stream
+    {
+    private:
+        // Partial command line written so far.
+        static std::string line;
+        static uint8_t fromHex(const char c) { return(uint8_t((c <= '9') ? (c - '0') : (c - 'A' + 10))); }
+        // Reply to a complete command line, without its CR LF.
+        static void command(const std::string &c)
+            {
+            commands.push_back(c);
+            const std::string tx = "mac tx uncnf ";
+            if(0 == c.compare(0, 8, "mac set ")) { toBeRead += "ok\r\n"; }
+            else if("mac join abp" == c) { toBeRead += "ok\r\naccepted\r\n"; }
+            else if("mac get dr" == c) { toBeRead += dataRate + "\r\n"; }
+            else if(0 == c.compare(0, tx.size(), tx))
+                {
+                if(noFreeCh) { toBeRead += "no_free_ch\r\n"; return; }
+                Uplink u;
+                u.port = atoi(c.c_str() + tx.size());
+                const std::string hex = c.substr(c.find(' ', tx.size()) + 1);
+                for(size_t i = 0; i + 1 < hex.size(); i += 2) { u.payload.push_back(uint8_t((fromHex(hex[i]) << 4) | fromHex(hex[i+1]))); }
+                uplinks.push_back(u);
+                toBeRead += "ok\r\nmac_tx_ok\r\n";
+                }
+            else { toBeRead += "invalid_param\r\n"; }
+            }
+
+    public:
+        // Data available to be read().
+        static std::string toBeRead;
+        // Command lines received, and uplinks sent.
+        static std::vector<std::string> commands;
+        static std::vector<Uplink> uplinks;
+        // Data rate reported.
+        static std::string dataRate;
+        // If true, refuse uplinks as the RN2483 does when its own duty-cycle check fails.
+        static bool noFreeCh;
+
+        // Reset to clear state before a new test.
+        static void reset() { line = ""; toBeRead = ""; commands.clear(); uplinks.clear(); dataRate = "5"; noFreeCh = false; secondsVT = 0; }
+
+        void begin(unsigned long) { }
+        virtual size_t write(uint8_t uc) override
+            {
+            const char c = char(uc);
+            if('\n' == c)
+                {
+                if(!line.empty() && ('\r' == line.back())) { line.pop_back(); }
+                command(line);
+                line.clear();
+                }
+            else { line += c; }
+            return(1);
+            }
+        virtual int read() override
+            {
+            if(toBeRead.empty()) { return(-1); }
+            const char c = toBeRead[0];
+            toBeRead.erase(0, 1);
+            return(uint8_t(c));
+            }
+        virtual int available() override { return(int(toBeRead.size())); }
+        virtual int peek() override { return(toBeRead.empty() ? -1 : uint8_t(toBeRead[0])); }
+        virtual void flush() override { }
+    };
+std::string RN2483Simulator::line;
+std::string RN2483Simulator::toBeRead;
+std::vector<std::string> RN2483Simulator::commands;
+std::vector<Uplink> RN2483Simulator::uplinks;
+std::string RN2483Simulator::dataRate;
+bool RN2483Simulator::noFreeCh;
+
+typedef OTRN2483Link::OTRN2483Link<0, 0, 0, getSecondsVT, RN2483Simulator, 4> Link;
+
+// Poll once per 2s major cycle for the given number of seconds.
+static void pollFor(Link &l, const int seconds)
+    {
+    for(int i = 0; i < seconds; i += 2) { l.poll(); incrementVT(2); }
+    }
+
+// Start the link and get it joined and idle.
+static void startUp(Link &l)
+    {
+    ASSERT_TRUE(l.begin());
+    for(int i = 0; (i < 20) && (OTRN2483Link::IDLE != l._getState()); ++i) { l.poll(); incrementVT(2); }
+    ASSERT_EQ(OTRN2483Link::IDLE, l._getState());
+    }
+
+}
+
+// Check airtime, payload limit and duty-cycle calculations against known values.
+TEST(OTRN2483Link, airtime)
+{
+    // 10 bytes at SF7: 61.7ms; 51 bytes at SF12: 2793.5ms.
+    EXPECT_EQ(61696U, OTRN2483Link::OTRN2483LinkBase::getAirtimeUs(5, 10));
+    EXPECT_EQ(2793472U, OTRN2483Link::OTRN2483LinkBase::getAirtimeUs(0, 51));
+    EXPECT_EQ(OTRN2483Link::OTRN2483LinkBase::getAirtimeUs(5, 0), OTRN2483Link::OTRN2483LinkBase::getAirtimeUs(6, 0));
+    EXPECT_EQ(51, OTRN2483Link::OTRN2483LinkBase::getMaxPayload(0));
+    EXPECT_EQ(51, OTRN2483Link::OTRN2483LinkBase::getMaxPayload(2));
+    EXPECT_EQ(115, OTRN2483Link::OTRN2483LinkBase::getMaxPayload(3));
+    EXPECT_EQ(222, OTRN2483Link::OTRN2483LinkBase::getMaxPayload(5));
+    // 1% of the time: 2.7935s needs 279.4s, so 280s.
+    EXPECT_EQ(280, OTRN2483Link::OTRN2483LinkBase::getOffTimeS(OTRN2483Link::OTRN2483LinkBase::SUBBAND_G1, 2793472));
+    EXPECT_EQ(28, OTRN2483Link::OTRN2483LinkBase::getOffTimeS(OTRN2483Link::OTRN2483LinkBase::SUBBAND_G3, 2793472));
+}
+
+// Check configuration, join, and a single frame sent as is.
+TEST(OTRN2483Link, startupAndSend)
+{
+    RN2483Emu::RN2483Simulator::reset();
+    RN2483Emu::Link l;
+    RN2483Emu::startUp(l);
+    EXPECT_TRUE(l.isAvailable());
+    const std::vector<std::string> &cmds = RN2483Emu::RN2483Simulator::commands;
+    ASSERT_LE(2U, cmds.size());
+    EXPECT_EQ("mac set devaddr 02011123", cmds[0]);
+    EXPECT_EQ("mac get dr", cmds.back());
+    EXPECT_EQ(5, l.getDataRate());
+
+    const uint8_t frame[] = { 0x12, 0xab };
+    EXPECT_TRUE(l.queueToSend(frame, sizeof(frame)));
+    EXPECT_EQ(1, l.getTXMsgsQueued());
+    RN2483Emu::pollFor(l, 10);
+    EXPECT_EQ(0, l.getTXMsgsQueued());
+    const std::vector<RN2483Emu::Uplink> &up = RN2483Emu::RN2483Simulator::uplinks;
+    ASSERT_EQ(1U, up.size());
+    EXPECT_EQ(OTRN2483Link::OTRN2483LinkBase::TX_PORT_FRAME, up[0].port);
+    EXPECT_EQ(std::vector<uint8_t>(frame, frame + sizeof(frame)), up[0].payload);
+    EXPECT_EQ(OTRN2483Link::IDLE, l._getState());
+}
+
+// Check that nothing is sent until the duty cycle allows, and that frames queued meanwhile share an uplink.
+TEST(OTRN2483Link, dutyCycle)
+{
+    RN2483Emu::RN2483Simulator::reset();
+    RN2483Emu::RN2483Simulator::dataRate = "0";
+    RN2483Emu::Link l;
+    RN2483Emu::startUp(l);
+    EXPECT_EQ(0, l.getDataRate());
+
+    uint8_t big[OTRN2483Link::OTRN2483LinkBase::MAX_TX_FRAME_LEN];
+    memset(big, 0x55, sizeof(big));
+    EXPECT_TRUE(l.queueToSend(big, sizeof(big)));
+    RN2483Emu::pollFor(l, 6);
+    ASSERT_EQ(1U, RN2483Emu::RN2483Simulator::uplinks.size());
+    const uint16_t offTime = l.getSubBandAvailableInS(OTRN2483Link::OTRN2483LinkBase::SUBBAND_G1);
+    EXPECT_LE(270, offTime);
+    EXPECT_GE(280, offTime);
+
+    const uint8_t a[] = { 1, 2, 3 };
+    const uint8_t b[] = { 4 };
+    EXPECT_TRUE(l.queueToSend(a, sizeof(a)));
+    EXPECT_TRUE(l.queueToSend(b, sizeof(b)));
+    RN2483Emu::pollFor(l, offTime - 4);
+    EXPECT_EQ(1U, RN2483Emu::RN2483Simulator::uplinks.size());
+    EXPECT_EQ(2, l.getTXMsgsQueued());
+    RN2483Emu::pollFor(l, 12);
+    const std::vector<RN2483Emu::Uplink> &up = RN2483Emu::RN2483Simulator::uplinks;
+    ASSERT_EQ(2U, up.size());
+    EXPECT_EQ(OTRN2483Link::OTRN2483LinkBase::TX_PORT_BATCH, up[1].port);
+    const uint8_t expected[] = { 3, 1, 2, 3, 1, 4 };
+    EXPECT_EQ(std::vector<uint8_t>(expected, expected + sizeof(expected)), up[1].payload);
+}
+
+// Check that frames are held back up to the batch delay to fill an uplink, for less airtime.
+TEST(OTRN2483Link, batchDelay)
+{
+    RN2483Emu::RN2483Simulator::reset();
+    RN2483Emu::Link l;
+    RN2483Emu::startUp(l);
+    l.setMaxBatchDelay(60);
+
+    uint8_t frame[10];
+    for(int i = 0; i < 3; ++i)
+        {
+        memset(frame, i, sizeof(frame));
+        EXPECT_TRUE(l.queueToSend(frame, sizeof(frame)));
+        RN2483Emu::pollFor(l, 16);
+        }
+    EXPECT_TRUE(RN2483Emu::RN2483Simulator::uplinks.empty());
+    RN2483Emu::pollFor(l, 20);
+    const std::vector<RN2483Emu::Uplink> &up = RN2483Emu::RN2483Simulator::uplinks;
+    ASSERT_EQ(1U, up.size());
+    EXPECT_EQ(OTRN2483Link::OTRN2483LinkBase::TX_PORT_BATCH, up[0].port);
+    ASSERT_EQ(33U, up[0].payload.size());
+    EXPECT_EQ(10, up[0].payload[0]);
+    EXPECT_EQ(2, up[0].payload[32]);
+    EXPECT_GT(3 * OTRN2483Link::OTRN2483LinkBase::getAirtimeUs(5, 10), OTRN2483Link::OTRN2483LinkBase::getAirtimeUs(5, 33));
+}
+
+// Check that an uplink is never more than the max payload for the data rate.
+TEST(OTRN2483Link, payloadCeiling)
+{
+    RN2483Emu::RN2483Simulator::reset();
+    RN2483Emu::RN2483Simulator::dataRate = "2";
+    RN2483Emu::Link l;
+    RN2483Emu::startUp(l);
+
+    uint8_t frame[20];
+    for(int i = 0; i < 4; ++i)
+        {
+        memset(frame, i, sizeof(frame));
+        EXPECT_TRUE(l.queueToSend(frame, sizeof(frame)));
+        }
+    // A fifth frame replaces the oldest.
+    memset(frame, 4, sizeof(frame));
+    EXPECT_TRUE(l.queueToSend(frame, sizeof(frame)));
+    EXPECT_EQ(4, l.getTXMsgsQueued());
+    RN2483Emu::pollFor(l, 300);
+    EXPECT_EQ(0, l.getTXMsgsQueued());
+    const std::vector<RN2483Emu::Uplink> &up = RN2483Emu::RN2483Simulator::uplinks;
+    ASSERT_EQ(2U, up.size());
+    for(const RN2483Emu::Uplink &u : up)
+        {
+        EXPECT_EQ(OTRN2483Link::OTRN2483LinkBase::TX_PORT_BATCH, u.port);
+        EXPECT_EQ(42U, u.payload.size());
+        }
+    EXPECT_EQ(1, up[0].payload[1]);
+    EXPECT_EQ(4, up[1].payload[22]);
+}
+
+// Check that frames are kept and retried when the RN2483 has no free channel.
+TEST(OTRN2483Link, noFreeChannel)
+{
+    RN2483Emu::RN2483Simulator::reset();
+    RN2483Emu::Link l;
+    RN2483Emu::startUp(l);
+
+    RN2483Emu::RN2483Simulator::noFreeCh = true;
+    const uint8_t frame[] = { 0x42 };
+    EXPECT_TRUE(l.queueToSend(frame, sizeof(frame)));
+    RN2483Emu::pollFor(l, 6);
+    EXPECT_EQ(1, l.getTXMsgsQueued());
+    EXPECT_LT(0, l.getSubBandAvailableInS(OTRN2483Link::OTRN2483LinkBase::SUBBAND_G1));
+    RN2483Emu::RN2483Simulator::noFreeCh = false;
+    RN2483Emu::pollFor(l, 20);
+    EXPECT_EQ(0, l.getTXMsgsQueued());
+    ASSERT_EQ(1U, RN2483Emu::RN2483Simulator::uplinks.size());
+    EXPECT_EQ(0x42, RN2483Emu::RN2483Simulator::uplinks[0].payload[0]);
+}
+
+// Check the blocking send path.
+TEST(OTRN2483Link, sendRaw)
+{
+    RN2483Emu::RN2483Simulator::reset();
+    RN2483Emu::Link l;
+    const uint8_t frame[] = { 0xfe, 0x01 };
+    EXPECT_FALSE(l.sendRaw(frame, sizeof(frame))); // Not started.
+    RN2483Emu::startUp(l);
+    EXPECT_TRUE(l.sendRaw(frame, sizeof(frame)));
+    ASSERT_EQ(1U, RN2483Emu::RN2483Simulator::uplinks.size());
+    EXPECT_EQ(std::vector<uint8_t>(frame, frame + sizeof(frame)), RN2483Emu::RN2483Simulator::uplinks[0].payload);
+    // Now within the duty-cycle off time.
+    EXPECT_FALSE(l.sendRaw(frame, sizeof(frame)));
+}
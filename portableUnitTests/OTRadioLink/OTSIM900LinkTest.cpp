@@ -24,6 +24,8 @@ Author(s) / Copyright (s): Damon Hart-Davis 2016
 #include <gtest/gtest.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string>
+#include <vector>
 
 #include "OTSIM900Link.h"
 
@@ -35,13 +37,15 @@ namespace SIM900Emu {
  */
 class VirtualTime {
 public:
-    VirtualTime() : secondsVT(0) {};
+    VirtualTime() : secondsVT(0), totalSecondsVT(0) {};
     /**
      * @brief   Increment secondsVT by 1 minor cycle.
      */
-    void incrementVTOneSecond() { ++secondsVT; secondsVT = checkForOverFlow(secondsVT);}
-    void incrementVTOneCycle() { secondsVT += minorCycleTimeSecs; secondsVT = checkForOverFlow(secondsVT);}
+    void incrementVTOneSecond() { ++secondsVT; ++totalSecondsVT; secondsVT = checkForOverFlow(secondsVT);}
+    void incrementVTOneCycle() { secondsVT += minorCycleTimeSecs; totalSecondsVT += minorCycleTimeSecs; secondsVT = checkForOverFlow(secondsVT);}
     unsigned int getSeconds() { return secondsVT; }
+    // Seconds elapsed in total, without wrapping, for measuring durations.
+    unsigned long getTotalSeconds() { return totalSecondsVT; }
 private:
     /**
      * @brief   Make sure secondsVT wraps around at a multiple of 60.
@@ -50,6 +54,7 @@ private:
         { return (59 < seconds ? (seconds - 60) : seconds); }  // subtract 60 if 60 or above to preserve change in time.
     static constexpr uint_fast8_t minorCycleTimeSecs = 2;  // V0p2 normally runs on a 2 second cycle.
     unsigned int secondsVT; // variable holding the time.
+    unsigned long totalSecondsVT;
 };
 
 static VirtualTime vt;
@@ -239,6 +244,7 @@ public:
         if (0 < command.size()) {
             if((command.front() == 'A') && (command.back() == '\n')) {
                 valid = true;
+                ++atCommands;
                 command.pop_back();
                 command.pop_back();
             }
@@ -258,7 +264,17 @@ public:
      * @todo    add state machine updates
      * @note    APN must be set to "apn" with no quotes to be accepted.
      */
-    void poll(std::string const &command, std::string &reply) {
+    void poll(std::string const &_command, std::string &reply) {
+        // Treat a send of any length as the canned AT+CIPSEND=3,
+        // and expect that many bytes of datagram if the send is accepted.
+        std::string command = _command;
+        const std::string sendPrefix = "AT+CIPSEND=";
+        size_t sendLen = 0;
+        if (0 == command.compare(0, sendPrefix.size(), sendPrefix)) {
+            sendLen = size_t(atoi(command.c_str() + sendPrefix.size()));
+            command = commands.CIPSEND;
+        }
+        const size_t oldReplySize = reply.size();
         // Respond to particular commands when not powered down...
         switch (myState) {
         case POWER_OFF: break;  // do nothing
@@ -398,6 +414,23 @@ public:
             break;
         default: break;
         }
+        if ((0 != sendLen) && (reply.size() > oldReplySize) && ('>' == reply.back())) { datagramLenExpected = sendLen; }
+    }
+
+    // Datagram payload bytes still expected after an accepted AT+CIPSEND; 0 if none.
+    size_t datagramLenExpected = 0;
+    // Datagrams received, in order, and the virtual time each arrived.
+    std::vector<std::string> datagrams;
+    std::vector<unsigned long> datagramTimes;
+    // Number of valid AT commands received.
+    unsigned long atCommands = 0;
+    /**
+     * @brief   Accept a complete datagram and reply as the SIM900 does.
+     */
+    void receiveDatagram(std::string const &datagram, std::string &reply) {
+        datagrams.push_back(datagram);
+        datagramTimes.push_back(SIM900Emu::vt.getTotalSeconds());
+        reply.append("\r\nSEND OK\r\n");
     }
 
     // Trigger fail states:
@@ -415,7 +448,7 @@ public:
     /**
      * @brief   Set all state back to defaults.
      */
-    void reset() { myState = POWER_OFF; verbose = false; oldPinState = false, startTime = 0; }
+    void reset() { myState = POWER_OFF; verbose = false; oldPinState = false, startTime = 0; datagramLenExpected = 0; datagrams.clear(); datagramTimes.clear(); atCommands = 0; }
 
 
     /**
@@ -536,6 +569,17 @@ public:
      */
     void poll()
     {
+        // Collect datagram payload, which may contain any byte including '\n'.
+        if(0 != emu.datagramLenExpected) {
+            if(serialConnection.written.size() >= emu.datagramLenExpected) {
+                std::string toBeRead = "";
+                emu.receiveDatagram(serialConnection.written, toBeRead);
+                SIM900Emu::serialConnection.addCharToRead(toBeRead);
+                emu.datagramLenExpected = 0;
+                serialConnection.written.clear();
+            }
+            return;
+        }
         if(isEndCharReceived(serialConnection.written)) {
             std::string toBeRead = "";
             if(emu.parseCommand(serialConnection.written)) emu.poll(serialConnection.written, toBeRead);
@@ -1287,3 +1331,335 @@ TEST(OTSIM900Link, PDPDeactResetTest)
         l0.end();
 }
 
+
+// Check that frames queued while idle are all sent, in order, and that the oldest is dropped when the queue is full.
+TEST(OTSIM900Link, TXQueueRingTest)
+{
+        // Reset static state to make tests re-runnable.
+        SIM900Emu::serialConnection.reset();
+        SIM900Emu::serialConnection.writeCallback = SIM900Emu::sim900WriteCallback;
+        SIM900Emu::sim900.reset();
+        SIM900Emu::sim900.emu.myState = SIM900Emu::SIM900StateEmulator::POWERING_UP; // Start from here to simplify startup process.
+
+        const char SIM900_PIN[] = "1111";
+        const char SIM900_APN[] = "apn";
+        const char SIM900_UDP_ADDR[] = "0.0.0.0"; // ORS server
+        const char SIM900_UDP_PORT[] = "9999";
+        const OTSIM900Link::OTSIM900LinkConfig_t SIM900Config(false, SIM900_PIN, SIM900_APN, SIM900_UDP_ADDR, SIM900_UDP_PORT);
+        const OTRadioLink::OTRadioChannelConfig l0Config(&SIM900Config, true);
+        OTSIM900Link::OTSIM900Link<0, 0, 0, SIM900Emu::getSecondsVT, SIM900Emu::SoftSerialSimulator, 3> l0;
+        EXPECT_TRUE(l0.configure(1, &l0Config));
+        EXPECT_TRUE(l0.begin());
+
+        // Get to IDLE state
+        for(int i = 0; i < 100; ++i) { l0.poll(); SIM900Emu::vt.incrementVTOneCycle(); if(l0._getState() == OTSIM900Link::IDLE) break;}
+        ASSERT_EQ(OTSIM900Link::IDLE, l0._getState());
+
+        // Queue one more frame than fits; the first should be dropped.
+        const char *const frames[] = { "a", "bb", "ccc", "dddd" };
+        for(const char *f : frames) { EXPECT_TRUE(l0.queueToSend((const uint8_t *)f, (uint8_t)strlen(f), (int8_t) 0, OTRadioLink::OTRadioLink::TXnormal)); }
+        EXPECT_EQ(3, l0.getTXMsgsQueued());
+        // Too long to queue.
+        const uint8_t big[OTSIM900Link::OTSIM900LinkBase::MAX_TX_FRAME_LEN + 1] = { };
+        EXPECT_FALSE(l0.queueToSend(big, sizeof(big), (int8_t) 0, OTRadioLink::OTRadioLink::TXnormal));
+        EXPECT_TRUE(l0.queueToSend(big, sizeof(big) - 1, (int8_t) 0, OTRadioLink::OTRadioLink::TXnormal));
+        EXPECT_EQ(3, l0.getTXMsgsQueued());
+
+        // Each frame is sent as its own datagram, one per poll once the link is checked.
+        for(int i = 0; i < 20; ++i) { l0.poll(); SIM900Emu::vt.incrementVTOneCycle(); if((0 == l0.getTXMsgsQueued()) && (l0._getState() == OTSIM900Link::IDLE)) break; }
+        EXPECT_EQ(OTSIM900Link::IDLE, l0._getState());
+        const std::vector<std::string> &sent = SIM900Emu::sim900.emu.datagrams;
+        ASSERT_EQ(3U, sent.size());
+        EXPECT_EQ("ccc", sent[0]);
+        EXPECT_EQ("dddd", sent[1]);
+        EXPECT_EQ(std::string(sizeof(big) - 1, '\0'), sent[2]);
+        l0.end();
+}
+
+// Check that with coalescing, queued frames are packed length-prefixed into as few datagrams as the budget allows.
+TEST(OTSIM900Link, TXCoalescingTest)
+{
+        // Reset static state to make tests re-runnable.
+        SIM900Emu::serialConnection.reset();
+        SIM900Emu::serialConnection.writeCallback = SIM900Emu::sim900WriteCallback;
+        SIM900Emu::sim900.reset();
+        SIM900Emu::sim900.emu.myState = SIM900Emu::SIM900StateEmulator::POWERING_UP; // Start from here to simplify startup process.
+
+        const char SIM900_PIN[] = "1111";
+        const char SIM900_APN[] = "apn";
+        const char SIM900_UDP_ADDR[] = "0.0.0.0"; // ORS server
+        const char SIM900_UDP_PORT[] = "9999";
+        const OTSIM900Link::OTSIM900LinkConfig_t SIM900Config(false, SIM900_PIN, SIM900_APN, SIM900_UDP_ADDR, SIM900_UDP_PORT);
+        const OTRadioLink::OTRadioChannelConfig l0Config(&SIM900Config, true);
+        OTSIM900Link::OTSIM900Link<0, 0, 0, SIM900Emu::getSecondsVT, SIM900Emu::SoftSerialSimulator, 8> l0;
+        EXPECT_TRUE(l0.configure(1, &l0Config));
+        EXPECT_TRUE(l0.begin());
+        l0.setTXCoalescing(true);
+        l0.setTXBudget(0); // Constrained up to fit one full frame plus length: 65 bytes.
+
+        // Get to IDLE state
+        for(int i = 0; i < 100; ++i) { l0.poll(); SIM900Emu::vt.incrementVTOneCycle(); if(l0._getState() == OTSIM900Link::IDLE) break;}
+        ASSERT_EQ(OTSIM900Link::IDLE, l0._getState());
+
+        // 5 frames of 20 bytes: 3 fit in each 65-byte datagram.
+        // Include '\n' to check binary payloads survive.
+        for(int i = 0; i < 5; ++i) {
+            uint8_t frame[20];
+            memset(frame, 'A' + i, sizeof(frame));
+            frame[0] = '\n';
+            EXPECT_TRUE(l0.queueToSend(frame, sizeof(frame), (int8_t) 0, OTRadioLink::OTRadioLink::TXnormal));
+        }
+        EXPECT_EQ(5, l0.getTXMsgsQueued());
+        for(int i = 0; i < 20; ++i) { l0.poll(); SIM900Emu::vt.incrementVTOneCycle(); if((0 == l0.getTXMsgsQueued()) && (l0._getState() == OTSIM900Link::IDLE)) break; }
+        EXPECT_EQ(OTSIM900Link::IDLE, l0._getState());
+        const std::vector<std::string> &sent = SIM900Emu::sim900.emu.datagrams;
+        ASSERT_EQ(2U, sent.size());
+        ASSERT_EQ(63U, sent[0].size());
+        ASSERT_EQ(42U, sent[1].size());
+        for(int i = 0; i < 5; ++i) {
+            const std::string &d = sent[i / 3];
+            const size_t off = size_t(21 * (i % 3));
+            EXPECT_EQ(20, d[off]);
+            EXPECT_EQ('\n', d[off + 1]);
+            EXPECT_EQ(std::string(19, char('A' + i)), d.substr(off + 2, 19));
+        }
+
+        // A larger budget packs all queued frames into one datagram.
+        l0.setTXBudget(OTSIM900Link::OTSIM900LinkBase::DEFAULT_TX_BUDGET_PER_POLL);
+        for(int i = 0; i < 5; ++i) { EXPECT_TRUE(l0.queueToSend((const uint8_t *)"xyz", 3, (int8_t) 0, OTRadioLink::OTRadioLink::TXnormal)); }
+        for(int i = 0; i < 20; ++i) { l0.poll(); SIM900Emu::vt.incrementVTOneCycle(); if((0 == l0.getTXMsgsQueued()) && (l0._getState() == OTSIM900Link::IDLE)) break; }
+        ASSERT_EQ(3U, sent.size());
+        EXPECT_EQ(std::string("\3xyz\3xyz\3xyz\3xyz\3xyz"), sent[2]);
+
+        // A budget too long to write near the start of the major cycle is capped.
+        l0.setTXBudget(OTSIM900Link::OTSIM900LinkBase::SIM900_MAX_UDP_SEND);
+        for(int i = 0; i < 4; ++i) {
+            uint8_t frame[OTSIM900Link::OTSIM900LinkBase::MAX_TX_FRAME_LEN];
+            memset(frame, 'a' + i, sizeof(frame));
+            EXPECT_TRUE(l0.queueToSend(frame, sizeof(frame), (int8_t) 0, OTRadioLink::OTRadioLink::TXnormal));
+        }
+        for(int i = 0; i < 20; ++i) { l0.poll(); SIM900Emu::vt.incrementVTOneCycle(); if((0 == l0.getTXMsgsQueued()) && (l0._getState() == OTSIM900Link::IDLE)) break; }
+        ASSERT_EQ(5U, sent.size());
+        EXPECT_GE(size_t(OTSIM900Link::OTSIM900LinkBase::MAX_TX_BUDGET_PER_POLL), sent[3].size());
+        EXPECT_EQ(2U * (OTSIM900Link::OTSIM900LinkBase::MAX_TX_FRAME_LEN + 1U), sent[4].size());
+        l0.end();
+}
+
+namespace SessionTest {
+// Send nFrames frames one at a time from IDLE, in persistent-session mode or not,
+// measuring the AT commands and virtual seconds per delivered frame from when each is queued.
+// Returns the number of frames delivered; stops early if the link drops back below IDLE.
+static size_t sendFrames(const bool persistent, const size_t nFrames, double &atCommandsPerFrame, double &secondsPerFrame)
+{
+    SIM900Emu::serialConnection.reset();
+    SIM900Emu::serialConnection.writeCallback = SIM900Emu::sim900WriteCallback;
+    SIM900Emu::sim900.reset();
+    SIM900Emu::sim900.emu.myState = SIM900Emu::SIM900StateEmulator::POWERING_UP; // Start from here to simplify startup process.
+
+    const char SIM900_PIN[] = "1111";
+    const char SIM900_APN[] = "apn";
+    const char SIM900_UDP_ADDR[] = "0.0.0.0"; // ORS server
+    const char SIM900_UDP_PORT[] = "9999";
+    const OTSIM900Link::OTSIM900LinkConfig_t SIM900Config(false, SIM900_PIN, SIM900_APN, SIM900_UDP_ADDR, SIM900_UDP_PORT);
+    const OTRadioLink::OTRadioChannelConfig l0Config(&SIM900Config, true);
+    OTSIM900Link::OTSIM900Link<0, 0, 0, SIM900Emu::getSecondsVT, SIM900Emu::SoftSerialSimulator> l0;
+    EXPECT_TRUE(l0.configure(1, &l0Config));
+    EXPECT_TRUE(l0.begin());
+    l0.setPersistentSession(persistent);
+
+    // Get to IDLE state
+    for(int i = 0; i < 100; ++i) { l0.poll(); SIM900Emu::vt.incrementVTOneCycle(); if(l0._getState() == OTSIM900Link::IDLE) break;}
+    EXPECT_EQ(OTSIM900Link::IDLE, l0._getState());
+
+    const char message[] = "123";
+    const unsigned long atCommandsStart = SIM900Emu::sim900.emu.atCommands;
+    unsigned long totalSeconds = 0;
+    for(size_t n = 0; n < nFrames; ++n) {
+        if (OTSIM900Link::IDLE > l0._getState()) break;
+        const unsigned long queuedAt = SIM900Emu::vt.getTotalSeconds();
+        l0.queueToSend((const uint8_t *)message, (uint8_t)sizeof(message)-1, (int8_t) 0, OTRadioLink::OTRadioLink::TXnormal);
+        for(int j = 0; j < 10; ++j) {
+            l0.poll();
+            if((SIM900Emu::sim900.emu.datagrams.size() > n) || (OTSIM900Link::IDLE > l0._getState())) break;
+            SIM900Emu::vt.incrementVTOneCycle();
+        }
+        if(SIM900Emu::sim900.emu.datagrams.size() <= n) break;
+        totalSeconds += SIM900Emu::sim900.emu.datagramTimes[n] - queuedAt;
+        // Let the link settle back to IDLE before queuing the next frame.
+        for(int j = 0; (j < 10) && (OTSIM900Link::SENDING == l0._getState()); ++j) { SIM900Emu::vt.incrementVTOneCycle(); l0.poll(); }
+        SIM900Emu::vt.incrementVTOneCycle();
+    }
+    const size_t delivered = SIM900Emu::sim900.emu.datagrams.size();
+    atCommandsPerFrame = delivered ? double(SIM900Emu::sim900.emu.atCommands - atCommandsStart) / delivered : 0;
+    secondsPerFrame = delivered ? double(totalSeconds) / delivered : 0;
+    l0.end();
+    return(delivered);
+}
+}
+
+// Check that persistent-session mode does not force a restart after 255 datagrams,
+// and needs fewer AT commands and less time per frame than the default mode.
+TEST(OTSIM900Link, PersistentSessionTest)
+{
+    double legacyAT, legacySeconds;
+    // Stay below the forced restart, which the emulator cannot recover from.
+    ASSERT_EQ(250U, SessionTest::sendFrames(false, 250, legacyAT, legacySeconds));
+    double sessionAT, sessionSeconds;
+    ASSERT_EQ(300U, SessionTest::sendFrames(true, 300, sessionAT, sessionSeconds));
+    EXPECT_GT(legacyAT, sessionAT);
+    EXPECT_GT(legacySeconds, sessionSeconds);
+    // One AT+CIPSEND per frame, plus an occasional AT+CIPSTATUS.
+    EXPECT_GT(1.1, sessionAT);
+}
+
+// Check that in persistent-session mode a failed send leads to a UDP status check and then a restart.
+TEST(OTSIM900Link, PersistentSessionFailTest)
+{
+    SIM900Emu::serialConnection.reset();
+    SIM900Emu::serialConnection.writeCallback = SIM900Emu::sim900WriteCallback;
+    SIM900Emu::sim900.reset();
+    SIM900Emu::sim900.emu.myState = SIM900Emu::SIM900StateEmulator::POWERING_UP; // Start from here to simplify startup process.
+
+    const char SIM900_PIN[] = "1111";
+    const char SIM900_APN[] = "apn";
+    const char SIM900_UDP_ADDR[] = "0.0.0.0"; // ORS server
+    const char SIM900_UDP_PORT[] = "9999";
+    const OTSIM900Link::OTSIM900LinkConfig_t SIM900Config(false, SIM900_PIN, SIM900_APN, SIM900_UDP_ADDR, SIM900_UDP_PORT);
+    const OTRadioLink::OTRadioChannelConfig l0Config(&SIM900Config, true);
+    OTSIM900Link::OTSIM900Link<0, 0, 0, SIM900Emu::getSecondsVT, SIM900Emu::SoftSerialSimulator> l0;
+    EXPECT_TRUE(l0.configure(1, &l0Config));
+    EXPECT_TRUE(l0.begin());
+    l0.setPersistentSession(true);
+
+    // Get to IDLE state
+    for(int i = 0; i < 100; ++i) { l0.poll(); SIM900Emu::vt.incrementVTOneCycle(); if(l0._getState() == OTSIM900Link::IDLE) break;}
+    ASSERT_EQ(OTSIM900Link::IDLE, l0._getState());
+
+    // One good send, so that the UDP status is cached.
+    const char message[] = "123";
+    l0.queueToSend((const uint8_t *)message, (uint8_t)sizeof(message)-1, (int8_t) 0, OTRadioLink::OTRadioLink::TXnormal);
+    for(int j = 0; (j < 10) && (0 != l0.getTXMsgsQueued()); ++j) { l0.poll(); SIM900Emu::vt.incrementVTOneCycle(); }
+    ASSERT_EQ(1U, SIM900Emu::sim900.emu.datagrams.size());
+    l0.poll();
+    ASSERT_EQ(OTSIM900Link::IDLE, l0._getState());
+
+    // The next send fails, invalidating the cached status; the status check then finds the dead end.
+    SIM900Emu::sim900.triggerPDPDeactFail();
+    bool sawWaitForUDP = false;
+    for(int i = 0; i < 20; i++) {
+        if (OTSIM900Link::IDLE > l0._getState()) break;
+        if (OTSIM900Link::WAIT_FOR_UDP == l0._getState()) sawWaitForUDP = true;
+        if (0 == l0.getTXMsgsQueued()) l0.queueToSend((const uint8_t *)message, (uint8_t)sizeof(message)-1, (int8_t) 0, OTRadioLink::OTRadioLink::TXnormal);
+        l0.poll();
+        SIM900Emu::vt.incrementVTOneCycle();
+    }
+    EXPECT_TRUE(sawWaitForUDP);
+    EXPECT_EQ(OTSIM900Link::GET_STATE, l0._getState());
+    EXPECT_EQ(1U, SIM900Emu::sim900.emu.datagrams.size());
+    l0.end();
+}
+
+// Check that poll() does not block waiting for a slow SIM900 while sending,
+// but picks up the replies as they arrive over later calls.
+TEST(OTSIM900Link, NonBlockingSendTest)
+{
+    SIM900Emu::serialConnection.reset();
+    SIM900Emu::serialConnection.writeCallback = SIM900Emu::sim900WriteCallback;
+    SIM900Emu::sim900.reset();
+    SIM900Emu::sim900.emu.myState = SIM900Emu::SIM900StateEmulator::POWERING_UP; // Start from here to simplify startup process.
+
+    const char SIM900_PIN[] = "1111";
+    const char SIM900_APN[] = "apn";
+    const char SIM900_UDP_ADDR[] = "0.0.0.0"; // ORS server
+    const char SIM900_UDP_PORT[] = "9999";
+    const OTSIM900Link::OTSIM900LinkConfig_t SIM900Config(false, SIM900_PIN, SIM900_APN, SIM900_UDP_ADDR, SIM900_UDP_PORT);
+    const OTRadioLink::OTRadioChannelConfig l0Config(&SIM900Config, true);
+    OTSIM900Link::OTSIM900Link<0, 0, 0, SIM900Emu::getSecondsVT, SIM900Emu::SoftSerialSimulator> l0;
+    EXPECT_TRUE(l0.configure(1, &l0Config));
+    EXPECT_TRUE(l0.begin());
+    l0.setPersistentSession(true);
+
+    // Get to IDLE state
+    for(int i = 0; i < 100; ++i) { l0.poll(); SIM900Emu::vt.incrementVTOneCycle(); if(l0._getState() == OTSIM900Link::IDLE) break;}
+    ASSERT_EQ(OTSIM900Link::IDLE, l0._getState());
+
+    // One good send, so that the UDP status is cached and the next send goes straight to SENDING.
+    const char message[] = "123";
+    l0.queueToSend((const uint8_t *)message, (uint8_t)sizeof(message)-1, (int8_t) 0, OTRadioLink::OTRadioLink::TXnormal);
+    for(int j = 0; (j < 10) && (0 != l0.getTXMsgsQueued()); ++j) { l0.poll(); SIM900Emu::vt.incrementVTOneCycle(); }
+    ASSERT_EQ(1U, SIM900Emu::sim900.emu.datagrams.size());
+    l0.poll();
+    ASSERT_EQ(OTSIM900Link::IDLE, l0._getState());
+
+    // Now the SIM900 only replies when explicitly polled, and time stands still.
+    SIM900Emu::serialConnection.writeCallback = NULL;
+    l0.queueToSend((const uint8_t *)message, (uint8_t)sizeof(message)-1, (int8_t) 0, OTRadioLink::OTRadioLink::TXnormal);
+    l0.poll();
+    ASSERT_EQ(OTSIM900Link::SENDING, l0._getState());
+    // AT+CIPSEND written, waiting for the '>' prompt.
+    l0.poll();
+    EXPECT_EQ(OTSIM900Link::SENDING, l0._getState());
+    EXPECT_EQ(1, l0.getTXMsgsQueued());
+    l0.poll();
+    EXPECT_EQ(1, l0.getTXMsgsQueued());
+    // The prompt arrives: the datagram is written, then waits for SEND OK.
+    SIM900Emu::sim900.poll();
+    l0.poll();
+    EXPECT_EQ(OTSIM900Link::SENDING, l0._getState());
+    EXPECT_EQ(1, l0.getTXMsgsQueued());
+    EXPECT_EQ(1U, SIM900Emu::sim900.emu.datagrams.size());
+    // The SIM900 takes the datagram and reports it sent.
+    SIM900Emu::sim900.poll();
+    EXPECT_EQ(2U, SIM900Emu::sim900.emu.datagrams.size());
+    l0.poll();
+    EXPECT_EQ(0, l0.getTXMsgsQueued());
+    l0.poll();
+    EXPECT_EQ(OTSIM900Link::IDLE, l0._getState());
+    l0.end();
+}
+
+// Check that outside persistent-session mode each datagram is written and forgotten,
+// without waiting for SEND OK before the frame is dequeued.
+TEST(OTSIM900Link, DefaultModeNoSendWaitTest)
+{
+    SIM900Emu::serialConnection.reset();
+    SIM900Emu::serialConnection.writeCallback = SIM900Emu::sim900WriteCallback;
+    SIM900Emu::sim900.reset();
+    SIM900Emu::sim900.emu.myState = SIM900Emu::SIM900StateEmulator::POWERING_UP; // Start from here to simplify startup process.
+
+    const char SIM900_PIN[] = "1111";
+    const char SIM900_APN[] = "apn";
+    const char SIM900_UDP_ADDR[] = "0.0.0.0"; // ORS server
+    const char SIM900_UDP_PORT[] = "9999";
+    const OTSIM900Link::OTSIM900LinkConfig_t SIM900Config(false, SIM900_PIN, SIM900_APN, SIM900_UDP_ADDR, SIM900_UDP_PORT);
+    const OTRadioLink::OTRadioChannelConfig l0Config(&SIM900Config, true);
+    OTSIM900Link::OTSIM900Link<0, 0, 0, SIM900Emu::getSecondsVT, SIM900Emu::SoftSerialSimulator> l0;
+    EXPECT_TRUE(l0.configure(1, &l0Config));
+    EXPECT_TRUE(l0.begin());
+
+    // Get to IDLE state
+    for(int i = 0; i < 100; ++i) { l0.poll(); SIM900Emu::vt.incrementVTOneCycle(); if(l0._getState() == OTSIM900Link::IDLE) break;}
+    ASSERT_EQ(OTSIM900Link::IDLE, l0._getState());
+
+    // Get through the UDP status check to SENDING.
+    const char message[] = "123";
+    l0.queueToSend((const uint8_t *)message, (uint8_t)sizeof(message)-1, (int8_t) 0, OTRadioLink::OTRadioLink::TXnormal);
+    for(int i = 0; (i < 10) && (OTSIM900Link::SENDING != l0._getState()); ++i) { l0.poll(); SIM900Emu::vt.incrementVTOneCycle(); }
+    ASSERT_EQ(OTSIM900Link::SENDING, l0._getState());
+
+    // Now the SIM900 only replies when explicitly polled.
+    SIM900Emu::serialConnection.writeCallback = NULL;
+    // AT+CIPSEND written, waiting for the '>' prompt.
+    l0.poll();
+    EXPECT_EQ(1, l0.getTXMsgsQueued());
+    // The prompt arrives: the datagram is written and dequeued at once.
+    SIM900Emu::sim900.poll();
+    l0.poll();
+    EXPECT_EQ(0, l0.getTXMsgsQueued());
+    EXPECT_EQ(0U, SIM900Emu::sim900.emu.datagrams.size());
+    SIM900Emu::sim900.poll();
+    EXPECT_EQ(1U, SIM900Emu::sim900.emu.datagrams.size());
+    l0.poll();
+    EXPECT_EQ(OTSIM900Link::IDLE, l0._getState());
+    l0.end();
+}
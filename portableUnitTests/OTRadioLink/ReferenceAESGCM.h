@@ -0,0 +1,284 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * Small portable reference AES-128-GCM FOR TESTS AND BENCHMARKS ONLY,
+ * so that the secure frame code can be exercised with real crypto
+ * when the OTAESGCM library is not available.
+ *
+ * Byte-oriented and written for clarity rather than speed,
+ * and NOT hardened against side-channel attacks:
+ * DO NOT USE IN PRODUCTION SYSTEMS.
+ *
+ * The key context holds the AES round keys and a 4-bit (Shoup) GHASH table,
+ * ie the per-key work that the ...WithKeyContext enc/dec functions avoid repeating.
+ */
+
+#ifndef OTRADIOLINK_PORTABLEUNITTESTS_REFERENCEAESGCM_H
+#define OTRADIOLINK_PORTABLEUNITTESTS_REFERENCEAESGCM_H
+
+#include <stdint.h>
+#include <string.h>
+
+namespace ReferenceAESGCM
+    {
+    // Per-key context: AES-128 round keys and GHASH table M[n] = n * H (nibble n, GCM bit order).
+    struct KeyContext final
+        {
+        uint8_t roundKeys[176];
+        uint8_t M[16][16];
+        };
+    static constexpr uint16_t keyContextBytes = sizeof(KeyContext);
+
+    // Tables computed once: AES S-box, and GHASH reduction for each 4-bit value shifted out.
+    struct Tables final
+        {
+        uint8_t sbox[256];
+        uint8_t R[16][2];
+        Tables()
+            {
+            // S-box from multiplicative inverse in GF(2^8) and affine transform.
+            uint8_t p = 1, q = 1;
+            do  {
+                p = uint8_t(p ^ (p << 1) ^ ((p & 0x80) ? 0x1b : 0));
+                q ^= uint8_t(q << 1); q ^= uint8_t(q << 2); q ^= uint8_t(q << 4);
+                if(q & 0x80) { q ^= 0x09; }
+                const uint8_t x = uint8_t(q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4));
+                sbox[p] = uint8_t(x ^ 0x63);
+                } while(p != 1);
+            sbox[0] = 0x63;
+            // Reduction terms, by simulating four single-bit shifts of a lone trailing nibble.
+            for(uint8_t n = 0; n < 16; ++n)
+                {
+                uint8_t b[16] = { };
+                b[15] = n;
+                for(int i = 0; i < 4; ++i) { mulx(b); }
+                R[n][0] = b[0];
+                R[n][1] = b[1];
+                }
+            }
+        static uint8_t rotl8(const uint8_t x, const int s) { return(uint8_t((x << s) | (x >> (8 - s)))); }
+        // Multiply by x in GF(2^128) with GCM bit ordering.
+        static void mulx(uint8_t *const b)
+            {
+            const bool carry = (0 != (b[15] & 1));
+            for(int i = 15; i > 0; --i) { b[i] = uint8_t((b[i] >> 1) | (b[i-1] << 7)); }
+            b[0] >>= 1;
+            if(carry) { b[0] ^= 0xe1; }
+            }
+        };
+    inline const Tables &tables() { static const Tables t; return(t); }
+
+    inline uint8_t xtime(const uint8_t x) { return(uint8_t((x << 1) ^ ((x & 0x80) ? 0x1b : 0))); }
+
+    // Encrypt one 16-byte block in place.
+    inline void encryptBlock(const uint8_t *const rk, uint8_t *const s)
+        {
+        const uint8_t *const sbox = tables().sbox;
+        for(int i = 0; i < 16; ++i) { s[i] ^= rk[i]; }
+        for(int round = 1; round <= 10; ++round)
+            {
+            // SubBytes and ShiftRows together (state is column-major).
+            uint8_t t[16];
+            for(int c = 0; c < 4; ++c)
+                for(int r = 0; r < 4; ++r)
+                    { t[4*c + r] = sbox[s[4*((c + r) & 3) + r]]; }
+            // MixColumns (not in final round).
+            if(round != 10)
+                {
+                for(int c = 0; c < 4; ++c)
+                    {
+                    uint8_t *const a = t + 4*c;
+                    const uint8_t a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+                    const uint8_t all = uint8_t(a0 ^ a1 ^ a2 ^ a3);
+                    a[0] ^= uint8_t(all ^ xtime(uint8_t(a0 ^ a1)));
+                    a[1] ^= uint8_t(all ^ xtime(uint8_t(a1 ^ a2)));
+                    a[2] ^= uint8_t(all ^ xtime(uint8_t(a2 ^ a3)));
+                    a[3] ^= uint8_t(all ^ xtime(uint8_t(a3 ^ a0)));
+                    }
+                }
+            const uint8_t *const k = rk + 16*round;
+            for(int i = 0; i < 16; ++i) { s[i] = uint8_t(t[i] ^ k[i]); }
+            }
+        }
+
+    // Expand key into round keys and GHASH table.
+    inline void setup(KeyContext &ctx, const uint8_t *const key)
+        {
+        const uint8_t *const sbox = tables().sbox;
+        memcpy(ctx.roundKeys, key, 16);
+        uint8_t rcon = 1;
+        for(int i = 16; i < 176; i += 4)
+            {
+            uint8_t t[4];
+            memcpy(t, ctx.roundKeys + i - 4, 4);
+            if(0 == (i & 15))
+                {
+                const uint8_t t0 = t[0];
+                t[0] = uint8_t(sbox[t[1]] ^ rcon); t[1] = sbox[t[2]]; t[2] = sbox[t[3]]; t[3] = sbox[t0];
+                rcon = xtime(rcon);
+                }
+            for(int j = 0; j < 4; ++j) { ctx.roundKeys[i + j] = uint8_t(ctx.roundKeys[i + j - 16] ^ t[j]); }
+            }
+        // H = E(K, 0^128); M[8] = H, M[4] = H.x, M[2] = H.x^2, M[1] = H.x^3, others by linearity.
+        uint8_t h[16] = { };
+        encryptBlock(ctx.roundKeys, h);
+        memset(ctx.M[0], 0, 16);
+        for(int n = 8; n > 0; n >>= 1) { memcpy(ctx.M[n], h, 16); Tables::mulx(h); }
+        for(int n = 2; n < 16; n <<= 1)
+            for(int j = 1; j < n; ++j)
+                for(int i = 0; i < 16; ++i) { ctx.M[n + j][i] = uint8_t(ctx.M[n][i] ^ ctx.M[j][i]); }
+        }
+
+    // X = X * H using the 4-bit table.
+    inline void gmulH(const KeyContext &ctx, uint8_t *const x)
+        {
+        const Tables &t = tables();
+        uint8_t z[16];
+        memcpy(z, ctx.M[x[15] & 0xf], 16);
+        for(int k = 30; k >= 0; --k)
+            {
+            const uint8_t nibble = (k & 1) ? (x[k >> 1] & 0xf) : (x[k >> 1] >> 4);
+            // z = z * x^4.
+            const uint8_t rem = z[15] & 0xf;
+            for(int i = 15; i > 0; --i) { z[i] = uint8_t((z[i] >> 4) | (z[i-1] << 4)); }
+            z[0] >>= 4;
+            z[0] ^= t.R[rem][0];
+            z[1] ^= t.R[rem][1];
+            for(int i = 0; i < 16; ++i) { z[i] ^= ctx.M[nibble][i]; }
+            }
+        memcpy(x, z, 16);
+        }
+
+    // GHASH over data (zero-padded to whole blocks) into y.
+    inline void ghash(const KeyContext &ctx, uint8_t *const y, const uint8_t *const data, const size_t len)
+        {
+        for(size_t off = 0; off < len; off += 16)
+            {
+            const size_t n = ((len - off) < 16) ? (len - off) : 16;
+            for(size_t i = 0; i < n; ++i) { y[i] ^= data[off + i]; }
+            gmulH(ctx, y);
+            }
+        }
+
+    // Core GCM with 12-byte IV: CTR-mode transform of in to out (len bytes) and tag over A and the ciphertext.
+    // If decrypting, in is the ciphertext, else out is.
+    inline void gcm(const KeyContext &ctx, const uint8_t *const iv,
+                    const uint8_t *const aad, const size_t aadLen,
+                    const uint8_t *const in, uint8_t *const out, const size_t len,
+                    const bool decrypting, uint8_t *const tag)
+        {
+        uint8_t j0[16];
+        memcpy(j0, iv, 12);
+        j0[12] = 0; j0[13] = 0; j0[14] = 0; j0[15] = 1;
+        uint8_t y[16] = { };
+        ghash(ctx, y, aad, aadLen);
+        if(decrypting) { ghash(ctx, y, in, len); }
+        uint8_t ctr[16];
+        memcpy(ctr, j0, 16);
+        for(size_t off = 0; off < len; off += 16)
+            {
+            for(int i = 15; i >= 12; --i) { if(0 != ++ctr[i]) { break; } }
+            uint8_t ks[16];
+            memcpy(ks, ctr, 16);
+            encryptBlock(ctx.roundKeys, ks);
+            const size_t n = ((len - off) < 16) ? (len - off) : 16;
+            for(size_t i = 0; i < n; ++i) { out[off + i] = uint8_t(in[off + i] ^ ks[i]); }
+            }
+        if(!decrypting) { ghash(ctx, y, out, len); }
+        uint8_t lens[16] = { };
+        const uint64_t abits = uint64_t(aadLen) * 8, cbits = uint64_t(len) * 8;
+        for(int i = 0; i < 8; ++i) { lens[7 - i] = uint8_t(abits >> (8*i)); lens[15 - i] = uint8_t(cbits >> (8*i)); }
+        ghash(ctx, y, lens, 16);
+        encryptBlock(ctx.roundKeys, j0);
+        for(int i = 0; i < 16; ++i) { tag[i] = uint8_t(y[i] ^ j0[i]); }
+        }
+
+    // fixed32BTextSize12BNonce16BTagSimpleKeySetup_ptr_t.
+    inline bool keySetup(void *const keyContext, const uint16_t keyContextSize, const uint8_t *const key)
+        {
+        if((NULL == keyContext) || (NULL == key) || (keyContextSize < keyContextBytes)) { return(false); }
+        setup(*static_cast<KeyContext *>(keyContext), key);
+        return(true);
+        }
+
+    // fixed32BTextSize12BNonce16BTagSimpleEncWithKeyContext_ptr_t.
+    inline bool encWithKeyContext(const void *const keyContext,
+            const uint8_t *const iv,
+            const uint8_t *const authtext, const uint8_t authtextSize,
+            const uint8_t *const plaintext,
+            uint8_t *const ciphertextOut, uint8_t *const tagOut)
+        {
+        if((NULL == keyContext) || (NULL == iv) || (NULL == authtext) || (NULL == ciphertextOut) || (NULL == tagOut)) { return(false); }
+        gcm(*static_cast<const KeyContext *>(keyContext), iv, authtext, authtextSize,
+            plaintext, ciphertextOut, (NULL == plaintext) ? 0 : 32, false, tagOut);
+        return(true);
+        }
+
+    // fixed32BTextSize12BNonce16BTagSimpleDecWithKeyContext_ptr_t.
+    inline bool decWithKeyContext(const void *const keyContext,
+            const uint8_t *const iv,
+            const uint8_t *const authtext, const uint8_t authtextSize,
+            const uint8_t *const ciphertext, const uint8_t *const tag,
+            uint8_t *const plaintextOut)
+        {
+        if((NULL == keyContext) || (NULL == iv) || (NULL == authtext) || (NULL == tag) || (NULL == plaintextOut)) { return(false); }
+        uint8_t tmp[32];
+        uint8_t computedTag[16];
+        const size_t len = (NULL == ciphertext) ? 0 : 32;
+        gcm(*static_cast<const KeyContext *>(keyContext), iv, authtext, authtextSize,
+            ciphertext, tmp, len, true, computedTag);
+        uint8_t diff = 0;
+        for(int i = 0; i < 16; ++i) { diff |= uint8_t(computedTag[i] ^ tag[i]); }
+        if(0 != diff) { return(false); }
+        memcpy(plaintextOut, tmp, len);
+        return(true);
+        }
+
+    // fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t: expands the key on every call.
+    inline bool enc(void *const /*state*/,
+            const uint8_t *const key, const uint8_t *const iv,
+            const uint8_t *const authtext, const uint8_t authtextSize,
+            const uint8_t *const plaintext,
+            uint8_t *const ciphertextOut, uint8_t *const tagOut)
+        {
+        if(NULL == key) { return(false); }
+        KeyContext ctx;
+        setup(ctx, key);
+        const bool result = encWithKeyContext(&ctx, iv, authtext, authtextSize, plaintext, ciphertextOut, tagOut);
+        memset(&ctx, 0, sizeof(ctx));
+        return(result);
+        }
+
+    // fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t: expands the key on every call.
+    inline bool dec(void *const /*state*/,
+            const uint8_t *const key, const uint8_t *const iv,
+            const uint8_t *const authtext, const uint8_t authtextSize,
+            const uint8_t *const ciphertext, const uint8_t *const tag,
+            uint8_t *const plaintextOut)
+        {
+        if(NULL == key) { return(false); }
+        KeyContext ctx;
+        setup(ctx, key);
+        const bool result = decWithKeyContext(&ctx, iv, authtext, authtextSize, ciphertext, tag, plaintextOut);
+        memset(&ctx, 0, sizeof(ctx));
+        return(result);
+        }
+    }
+
+#endif
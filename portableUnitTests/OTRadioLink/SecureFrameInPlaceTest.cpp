@@ -0,0 +1,193 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * OTRadioLink tests of in-place secure frame decode.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <OTRadioLink.h>
+#include <utility/OTRadioLink_ISRRXQueue.h>
+
+#include "ReferenceAESGCM.h"
+
+
+// Workspace-style adapters for the test dec functions.
+static bool decNULLWithWorkspace(uint8_t *const workspace, const uint8_t workspaceSize,
+        const uint8_t *const key, const uint8_t *const iv,
+        const uint8_t *const authtext, const uint8_t authtextSize,
+        const uint8_t *const ciphertext, const uint8_t *const tag,
+        uint8_t *const plaintextOut)
+    {
+    if((NULL == workspace) || (0 == workspaceSize)) { return(false); }
+    return(OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleDec_NULL_IMPL(NULL, key, iv, authtext, authtextSize, ciphertext, tag, plaintextOut));
+    }
+static bool decRefWithWorkspace(uint8_t *const workspace, const uint8_t workspaceSize,
+        const uint8_t *const key, const uint8_t *const iv,
+        const uint8_t *const authtext, const uint8_t authtextSize,
+        const uint8_t *const ciphertext, const uint8_t *const tag,
+        uint8_t *const plaintextOut)
+    {
+    if((NULL == workspace) || (0 == workspaceSize)) { return(false); }
+    return(ReferenceAESGCM::dec(NULL, key, iv, authtext, authtextSize, ciphertext, tag, plaintextOut));
+    }
+
+// Check that in-place decode gives the same result as decodeSecureSmallFrameRaw(),
+// with the plaintext left in the body region of the frame buffer.
+static void checkInPlace(const OTRadioLink::SimpleSecureFrame32or0BodyTXBase::fixed32BTextSize12BNonce16BTagSimpleEnc_ptr_t e,
+                         const OTRadioLink::SimpleSecureFrame32or0BodyRXBase::fixed32BTextSize12BNonce16BTagSimpleDec_ptr_t d,
+                         const OTRadioLink::SimpleSecureFrame32or0BodyRXBase::fixed32BTextSize12BNonce16BTagSimpleDecWithWorkspace_ptr_t dw)
+    {
+    const uint8_t id[] = { 0x88, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87 };
+    uint8_t workspace[OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRawInPlace_total_scratch_usage_OTAESGCM_2p0];
+    const OTV0P2BASE::ScratchSpace scratch(workspace, sizeof(workspace));
+    for(int t = 0; t < 50; ++t)
+        {
+        uint8_t key[16];
+        for(int i = 0; i < 16; ++i) { key[i] = uint8_t(random()); }
+        uint8_t iv[12];
+        memcpy(iv, id, 6);
+        for(int i = 6; i < 12; ++i) { iv[i] = uint8_t(random()); }
+        uint8_t body[OTRadioLink::ENC_BODY_SMALL_FIXED_PTEXT_MAX_SIZE];
+        const uint8_t bl = uint8_t(random() % (sizeof(body) + 1));
+        for(int i = 0; i < bl; ++i) { body[i] = uint8_t(random()); }
+        uint8_t buf[64];
+        const uint8_t l = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(buf, sizeof(buf),
+                            OTRadioLink::FTS_BasicSensorOrValve, id, 4, body, bl, iv, e, NULL, key);
+        ASSERT_NE(0, l);
+        OTRadioLink::SecurableFrameHeader sfh;
+        ASSERT_NE(0, sfh.checkAndDecodeSmallFrameHeader(buf, l));
+        // Reference decode to a separate buffer.
+        uint8_t out[32];
+        uint8_t outSize = 0xff;
+        ASSERT_EQ(l, OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRaw(&sfh, buf, l,
+                            d, NULL, key, iv, out, sizeof(out), outSize));
+        // In-place decode of a copy.
+        uint8_t bufIP[64];
+        memcpy(bufIP, buf, l);
+        const uint8_t *view = NULL;
+        uint8_t viewSize = 0xff;
+        ASSERT_EQ(l, OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRawInPlace(&sfh, bufIP, l,
+                            dw, scratch, key, iv, view, viewSize));
+        EXPECT_EQ(outSize, viewSize);
+        EXPECT_EQ(bl, viewSize);
+        if(0 == bl) { EXPECT_TRUE(NULL == view); continue; }
+        EXPECT_TRUE(bufIP + sfh.getBodyOffset() == view);
+        EXPECT_EQ(0, memcmp(body, view, bl));
+        // Header and trailer must be untouched.
+        EXPECT_EQ(0, memcmp(buf, bufIP, sfh.getBodyOffset()));
+        EXPECT_EQ(0, memcmp(buf + sfh.getTrailerOffset(), bufIP + sfh.getTrailerOffset(), l - sfh.getTrailerOffset()));
+        // A tampered frame must fail, leaving no plaintext behind and a NULL view.
+        memcpy(bufIP, buf, l);
+        bufIP[l - 2] ^= 0x10;
+        const bool tagIsChecked = (d != OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleDec_NULL_IMPL);
+        if(tagIsChecked)
+            {
+            EXPECT_EQ(0, OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRawInPlace(&sfh, bufIP, l,
+                                dw, scratch, key, iv, view, viewSize));
+            EXPECT_TRUE(NULL == view);
+            EXPECT_EQ(0, viewSize);
+            for(int i = 0; i < 32; ++i) { EXPECT_EQ(0, bufIP[sfh.getBodyOffset() + i]); }
+            }
+        }
+    // No workspace must fail safely.
+    uint8_t buf[64], iv[12] = { };
+    memcpy(iv, id, 6);
+    const uint8_t key[16] = { };
+    const uint8_t l = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(buf, sizeof(buf),
+                        OTRadioLink::FTS_BasicSensorOrValve, id, 4, id, 2, iv, e, NULL, key);
+    OTRadioLink::SecurableFrameHeader sfh;
+    ASSERT_NE(0, sfh.checkAndDecodeSmallFrameHeader(buf, l));
+    const OTV0P2BASE::ScratchSpace none(NULL, 0);
+    const uint8_t *view;
+    uint8_t viewSize;
+    EXPECT_EQ(0, OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRawInPlace(&sfh, buf, l,
+                        dw, none, key, iv, view, viewSize));
+    }
+
+TEST(SecureFrameInPlace,NULLImpl)
+{
+    checkInPlace(OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleEnc_NULL_IMPL,
+                 OTRadioLink::fixed32BTextSize12BNonce16BTagSimpleDec_NULL_IMPL,
+                 decNULLWithWorkspace);
+}
+
+TEST(SecureFrameInPlace,referenceAESGCM)
+{
+    checkInPlace(ReferenceAESGCM::enc, ReferenceAESGCM::dec, decRefWithWorkspace);
+}
+
+// Decode frames in place directly in their RX queue slots,
+// checking against decodeSecureSmallFrameRaw() of the same frames.
+TEST(SecureFrameInPlace,inRXQueue)
+{
+    const uint8_t id[] = { 0x88, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87 };
+    uint8_t workspace[OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRawInPlace_total_scratch_usage_OTAESGCM_2p0];
+    const OTV0P2BASE::ScratchSpace scratch(workspace, sizeof(workspace));
+    OTRadioLink::ISRRXQueue1Deep<64> q;
+    uint8_t key[16];
+    for(int i = 0; i < 16; ++i) { key[i] = uint8_t(random()); }
+    uint8_t iv[12];
+    memcpy(iv, id, 6);
+    for(int t = 0; t < 50; ++t)
+        {
+        for(int i = 6; i < 12; ++i) { iv[i] = uint8_t(random()); }
+        uint8_t body[OTRadioLink::ENC_BODY_SMALL_FIXED_PTEXT_MAX_SIZE];
+        const uint8_t bl = uint8_t(random() % (sizeof(body) + 1));
+        for(int i = 0; i < bl; ++i) { body[i] = uint8_t(random()); }
+        uint8_t buf[64];
+        const uint8_t l = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(buf, sizeof(buf),
+                            OTRadioLink::FTS_BasicSensorOrValve, id, 4, body, bl, iv, ReferenceAESGCM::enc, NULL, key);
+        ASSERT_NE(0, l);
+        OTRadioLink::SecurableFrameHeader sfh;
+        ASSERT_NE(0, sfh.checkAndDecodeSmallFrameHeader(buf, l));
+        // Copying decode for reference.
+        uint8_t out[32];
+        uint8_t outSize = 0xff;
+        ASSERT_EQ(l, OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRaw(&sfh, buf, l,
+                            ReferenceAESGCM::dec, NULL, key, iv, out, sizeof(out), outSize));
+        // Queue the frame as the radio ISR would.
+        volatile uint8_t *const qb = q._getRXBufForInbound();
+        ASSERT_TRUE(NULL != qb);
+        for(uint8_t i = 0; i < l; ++i) { qb[i] = buf[i]; }
+        q._loadedBuf(l);
+        // Decode in place in the queue slot.
+        uint8_t *const pb = q.peekRXMsgMutable();
+        ASSERT_TRUE(NULL != pb);
+        EXPECT_TRUE((const volatile uint8_t *)pb == q.peekRXMsg());
+        ASSERT_EQ(l, pb[-1]);
+        const uint8_t *view = NULL;
+        uint8_t viewSize = 0xff;
+        ASSERT_EQ(l, OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRawInPlace(&sfh, pb, pb[-1],
+                            decRefWithWorkspace, scratch, key, iv, view, viewSize));
+        EXPECT_EQ(outSize, viewSize);
+        if(0 != bl)
+            {
+            EXPECT_TRUE(pb + sfh.getBodyOffset() == view);
+            EXPECT_EQ(0, memcmp(out, view, outSize));
+            }
+        // The queued length is untouched and the slot is released as normal.
+        EXPECT_EQ(l, pb[-1]);
+        q.removeRXMsg();
+        EXPECT_TRUE(q.isEmpty());
+        EXPECT_TRUE(NULL == q.peekRXMsgMutable());
+        }
+}
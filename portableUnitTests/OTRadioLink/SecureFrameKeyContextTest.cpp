@@ -0,0 +1,203 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * OTRadioLink tests of secure frame encode/decode with pre-expanded key contexts,
+ * using the test-only reference AES-GCM.
+ */
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include <OTRadioLink.h>
+
+#include "ReferenceAESGCM.h"
+
+
+// Check the reference AES-GCM against published test vectors,
+// so that the key-context tests below are exercising real crypto.
+TEST(SecureFrameKeyContext,referenceAESGCMVectors)
+{
+    // FIPS-197 Appendix C.1 AES-128 block.
+    const uint8_t k1[] = { 0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0a,0x0b,0x0c,0x0d,0x0e,0x0f };
+    uint8_t b1[] = { 0x00,0x11,0x22,0x33,0x44,0x55,0x66,0x77,0x88,0x99,0xaa,0xbb,0xcc,0xdd,0xee,0xff };
+    const uint8_t c1[] = { 0x69,0xc4,0xe0,0xd8,0x6a,0x7b,0x04,0x30,0xd8,0xcd,0xb7,0x80,0x70,0xb4,0xc5,0x5a };
+    ReferenceAESGCM::KeyContext ctx;
+    ReferenceAESGCM::setup(ctx, k1);
+    ReferenceAESGCM::encryptBlock(ctx.roundKeys, b1);
+    EXPECT_EQ(0, memcmp(c1, b1, 16));
+    // GCM spec test cases 1 and 2: zero key and IV, empty and one zero block of plaintext.
+    const uint8_t zero[16] = { };
+    const uint8_t t1[] = { 0x58,0xe2,0xfc,0xce,0xfa,0x7e,0x30,0x61,0x36,0x7f,0x1d,0x57,0xa4,0xe7,0x45,0x5a };
+    const uint8_t c2[] = { 0x03,0x88,0xda,0xce,0x60,0xb6,0xa3,0x92,0xf3,0x28,0xc2,0xb9,0x71,0xb2,0xfe,0x78 };
+    const uint8_t t2[] = { 0xab,0x6e,0x47,0xd4,0x2c,0xec,0x13,0xbd,0xf5,0x3a,0x67,0xb2,0x12,0x57,0xbd,0xdf };
+    uint8_t out[64], tag[16];
+    ReferenceAESGCM::setup(ctx, zero);
+    ReferenceAESGCM::gcm(ctx, zero, NULL, 0, NULL, out, 0, false, tag);
+    EXPECT_EQ(0, memcmp(t1, tag, 16));
+    ReferenceAESGCM::gcm(ctx, zero, NULL, 0, zero, out, 16, false, tag);
+    EXPECT_EQ(0, memcmp(c2, out, 16));
+    EXPECT_EQ(0, memcmp(t2, tag, 16));
+    // GCM spec test case 4: 60 bytes of plaintext with 20 bytes of additional data.
+    const uint8_t k4[] = { 0xfe,0xff,0xe9,0x92,0x86,0x65,0x73,0x1c,0x6d,0x6a,0x8f,0x94,0x67,0x30,0x83,0x08 };
+    const uint8_t iv4[] = { 0xca,0xfe,0xba,0xbe,0xfa,0xce,0xdb,0xad,0xde,0xca,0xf8,0x88 };
+    const uint8_t p4[] = {
+        0xd9,0x31,0x32,0x25,0xf8,0x84,0x06,0xe5,0xa5,0x59,0x09,0xc5,0xaf,0xf5,0x26,0x9a,
+        0x86,0xa7,0xa9,0x53,0x15,0x34,0xf7,0xda,0x2e,0x4c,0x30,0x3d,0x8a,0x31,0x8a,0x72,
+        0x1c,0x3c,0x0c,0x95,0x95,0x68,0x09,0x53,0x2f,0xcf,0x0e,0x24,0x49,0xa6,0xb5,0x25,
+        0xb1,0x6a,0xed,0xf5,0xaa,0x0d,0xe6,0x57,0xba,0x63,0x7b,0x39 };
+    const uint8_t a4[] = { 0xfe,0xed,0xfa,0xce,0xde,0xad,0xbe,0xef,0xfe,0xed,0xfa,0xce,0xde,0xad,0xbe,0xef,0xab,0xad,0xda,0xd2 };
+    const uint8_t c4[] = {
+        0x42,0x83,0x1e,0xc2,0x21,0x77,0x74,0x24,0x4b,0x72,0x21,0xb7,0x84,0xd0,0xd4,0x9c,
+        0xe3,0xaa,0x21,0x2f,0x2c,0x02,0xa4,0xe0,0x35,0xc1,0x7e,0x23,0x29,0xac,0xa1,0x2e,
+        0x21,0xd5,0x14,0xb2,0x54,0x66,0x93,0x1c,0x7d,0x8f,0x6a,0x5a,0xac,0x84,0xaa,0x05,
+        0x1b,0xa3,0x0b,0x39,0x6a,0x0a,0xac,0x97,0x3d,0x58,0xe0,0x91 };
+    const uint8_t t4[] = { 0x5b,0xc9,0x4f,0xbc,0x32,0x21,0xa5,0xdb,0x94,0xfa,0xe9,0x5a,0xe7,0x12,0x1a,0x47 };
+    ReferenceAESGCM::setup(ctx, k4);
+    ReferenceAESGCM::gcm(ctx, iv4, a4, sizeof(a4), p4, out, sizeof(p4), false, tag);
+    EXPECT_EQ(0, memcmp(c4, out, sizeof(c4)));
+    EXPECT_EQ(0, memcmp(t4, tag, 16));
+}
+
+// Check that the cache only rebuilds the context when the key changes, and wipes on invalidate().
+static int setupCalls;
+static bool countingKeySetup(void *const keyContext, const uint16_t keyContextSize, const uint8_t *const key)
+    { ++setupCalls; return(ReferenceAESGCM::keySetup(keyContext, keyContextSize, key)); }
+TEST(SecureFrameKeyContext,cache)
+{
+    const uint8_t key1[16] = { 1 };
+    const uint8_t key2[16] = { 2 };
+    setupCalls = 0;
+    OTRadioLink::SimpleSecureFrame32or0KeyContextCache<ReferenceAESGCM::keyContextBytes> cache(countingKeySetup);
+    EXPECT_TRUE(NULL == cache.getKeyContext(NULL));
+    const void *const c1 = cache.getKeyContext(key1);
+    ASSERT_TRUE(NULL != c1);
+    EXPECT_EQ(1, setupCalls);
+    EXPECT_EQ(c1, cache.getKeyContext(key1));
+    EXPECT_EQ(1, setupCalls);
+    ReferenceAESGCM::KeyContext expected;
+    ReferenceAESGCM::setup(expected, key2);
+    ASSERT_TRUE(NULL != cache.getKeyContext(key2));
+    EXPECT_EQ(2, setupCalls);
+    EXPECT_EQ(0, memcmp(&expected, cache.getKeyContext(key2), sizeof(expected)));
+    EXPECT_EQ(2, setupCalls);
+    cache.invalidate();
+    ASSERT_TRUE(NULL != cache.getKeyContext(key2));
+    EXPECT_EQ(3, setupCalls);
+    // A context too small for the enc/dec in use must fail safely.
+    OTRadioLink::SimpleSecureFrame32or0KeyContextCache<16> small(countingKeySetup);
+    EXPECT_TRUE(NULL == small.getKeyContext(key1));
+    EXPECT_TRUE(NULL == small.getKeyContext(key1));
+}
+
+// Frames encoded with per-call key expansion and with a key context must be identical and interoperable.
+TEST(SecureFrameKeyContext,encodeDecodeEquivalence)
+{
+    OTRadioLink::SimpleSecureFrame32or0KeyContextCache<ReferenceAESGCM::keyContextBytes> cache(ReferenceAESGCM::keySetup);
+    const uint8_t id[] = { 0x88, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87 };
+    for(int t = 0; t < 20; ++t)
+        {
+        uint8_t key[16];
+        for(int i = 0; i < 16; ++i) { key[i] = uint8_t(random()); }
+        uint8_t iv[12];
+        memcpy(iv, id, 6);
+        for(int i = 6; i < 12; ++i) { iv[i] = uint8_t(random()); }
+        uint8_t body[OTRadioLink::ENC_BODY_SMALL_FIXED_PTEXT_MAX_SIZE];
+        const uint8_t bl = uint8_t(random() % (sizeof(body) + 1));
+        for(int i = 0; i < bl; ++i) { body[i] = uint8_t(random()); }
+        const void *const kc = cache.getKeyContext(key);
+        ASSERT_TRUE(NULL != kc);
+        uint8_t buf1[64], buf2[64];
+        const uint8_t l1 = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(buf1, sizeof(buf1),
+                            OTRadioLink::FTS_BasicSensorOrValve, id, 4, body, bl, iv,
+                            ReferenceAESGCM::enc, NULL, key);
+        const uint8_t l2 = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(buf2, sizeof(buf2),
+                            OTRadioLink::FTS_BasicSensorOrValve, id, 4, body, bl, iv,
+                            ReferenceAESGCM::encWithKeyContext, kc);
+        ASSERT_NE(0, l1);
+        ASSERT_EQ(l1, l2);
+        EXPECT_EQ(0, memcmp(buf1, buf2, l1));
+        OTRadioLink::SecurableFrameHeader sfh;
+        ASSERT_NE(0, sfh.checkAndDecodeSmallFrameHeader(buf2, l2));
+        uint8_t out[32];
+        uint8_t outSize = 0xff;
+        EXPECT_EQ(l2, OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRaw(&sfh, buf2, l2,
+                            ReferenceAESGCM::decWithKeyContext, kc, iv, out, sizeof(out), outSize));
+        EXPECT_EQ(bl, outSize);
+        EXPECT_EQ(0, memcmp(body, out, bl));
+        EXPECT_EQ(l2, OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRaw(&sfh, buf2, l2,
+                            ReferenceAESGCM::dec, NULL, key, iv, out, sizeof(out), outSize));
+        // Tampering must be detected.
+        buf2[l2 - 2] ^= 1;
+        EXPECT_EQ(0, OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRaw(&sfh, buf2, l2,
+                            ReferenceAESGCM::decWithKeyContext, kc, iv, out, sizeof(out), outSize));
+        }
+}
+
+// Benchmark per-frame encode+decode with per-call key expansion vs a cached key context.
+// Timings are recorded as test properties (ns/frame) and also printed.
+TEST(SecureFrameKeyContext,benchmark)
+{
+    static const int frames = 200;
+    const uint8_t key[16] = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80, 0x90, 0xa0, 0xb0, 0xc0, 0xd0, 0xe0, 0xf0, 0x01 };
+    const uint8_t id[] = { 0x88, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87 };
+    const uint8_t body[] = { 0x7f, 0x11, '{', '"', 'b', '"', ':', '1', '}' };
+    OTRadioLink::SimpleSecureFrame32or0KeyContextCache<ReferenceAESGCM::keyContextBytes> cache(ReferenceAESGCM::keySetup);
+    uint8_t iv[12] = { };
+    memcpy(iv, id, 6);
+    uint8_t buf[64], out[32];
+    uint8_t outSize;
+    OTRadioLink::SecurableFrameHeader sfh;
+    int ok = 0;
+
+    const auto s1 = std::chrono::steady_clock::now();
+    for(int i = 0; i < frames; ++i)
+        {
+        iv[11] = uint8_t(i);
+        const uint8_t l = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(buf, sizeof(buf),
+                            OTRadioLink::FTS_BasicSensorOrValve, id, 4, body, sizeof(body), iv,
+                            ReferenceAESGCM::enc, NULL, key);
+        sfh.checkAndDecodeSmallFrameHeader(buf, l);
+        if(0 != OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRaw(&sfh, buf, l,
+                            ReferenceAESGCM::dec, NULL, key, iv, out, sizeof(out), outSize)) { ++ok; }
+        }
+    const auto e1 = std::chrono::steady_clock::now();
+    for(int i = 0; i < frames; ++i)
+        {
+        iv[11] = uint8_t(i);
+        // Look up the context per frame as a hub would, so the cache check cost is included.
+        const void *const kc = cache.getKeyContext(key);
+        const uint8_t l = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::encodeSecureSmallFrameRaw(buf, sizeof(buf),
+                            OTRadioLink::FTS_BasicSensorOrValve, id, 4, body, sizeof(body), iv,
+                            ReferenceAESGCM::encWithKeyContext, kc);
+        sfh.checkAndDecodeSmallFrameHeader(buf, l);
+        if(0 != OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRaw(&sfh, buf, l,
+                            ReferenceAESGCM::decWithKeyContext, cache.getKeyContext(key), iv, out, sizeof(out), outSize)) { ++ok; }
+        }
+    const auto e2 = std::chrono::steady_clock::now();
+    EXPECT_EQ(2 * frames, ok);
+
+    const long nsPerFrameKey = long(std::chrono::duration_cast<std::chrono::nanoseconds>(e1 - s1).count() / frames);
+    const long nsPerFrameKeyContext = long(std::chrono::duration_cast<std::chrono::nanoseconds>(e2 - e1).count() / frames);
+    RecordProperty("nsPerFrameKey", int(nsPerFrameKey));
+    RecordProperty("nsPerFrameKeyContext", int(nsPerFrameKeyContext));
+//    fprintf(stderr, "encode+decode ns/frame: key %ld, key context %ld\n", nsPerFrameKey, nsPerFrameKeyContext);
+}
@@ -1147,5 +1147,62 @@ TEST(OTAESGCMSecureFrame, OFrameEncoding)
     for(int i = 0; i < bodylenW; ++i) { ASSERT_EQ(expected[i], bufW[i]); }
 }
 
+// Test O frames with compact binary stats through encryption and back.
+TEST(OTAESGCMSecureFrame, OFrameCompactStats)
+{
+    TXBaseMock mockTX;
+    const uint8_t *const key = zeroBlock;
+    constexpr uint8_t encBufSize = 64;
+    const uint8_t txIDLen = 4;
+    constexpr uint8_t valvePC = 42;
+
+    OTV0P2BASE::SimpleStatsRotation<4> ss;
+    ss.put(V0p2_SENSOR_TAG_F("T|C16"), 331);
+    ss.put(V0p2_SENSOR_TAG_F("occ|%"), 0);
+    uint8_t stats[OTV0P2BASE::MSG_COMPACT_STATS_MAX_LENGTH_SECURE];
+    const uint8_t statsLen = ss.writeCompact(stats, sizeof(stats), true);
+    ASSERT_NE(0, statsLen);
+
+    // Encrypt via both APIs; the mock IV is fixed so the frames must match.
+    uint8_t bufS[encBufSize];
+    const uint8_t lS = mockTX.generateSecureOFrameRawForTX(
+        bufS, encBufSize, txIDLen, valvePC, stats, statsLen,
+        OTAESGCM::fixed32BTextSize12BNonce16BTagSimpleEnc_DEFAULT_STATELESS, NULL, key);
+    EXPECT_EQ(63, lS);
+    uint8_t bufW[encBufSize];
+    constexpr uint8_t workspaceSize = OTRadioLink::SimpleSecureFrame32or0BodyTXBase::generateSecureOFrameRawForTX_total_scratch_usage_OTAESGCM_2p0;
+    uint8_t workspace[workspaceSize];
+    OTV0P2BASE::ScratchSpace sW(workspace, workspaceSize);
+    const uint8_t lW = mockTX.generateSecureOFrameRawForTX(
+        bufW, encBufSize, txIDLen, valvePC, stats, statsLen,
+        OTAESGCM::fixed32BTextSize12BNonce16BTagSimpleEnc_DEFAULT_WITH_WORKSPACE, sW, key);
+    ASSERT_EQ(lS, lW);
+    EXPECT_EQ(0, memcmp(bufS, bufW, lS));
+
+    // Over-long stats are rejected.
+    uint8_t tooLong[OTV0P2BASE::MSG_COMPACT_STATS_MAX_LENGTH_SECURE + 1] = { };
+    EXPECT_EQ(0, mockTX.generateSecureOFrameRawForTX(
+        bufS, encBufSize, txIDLen, valvePC, tooLong, sizeof(tooLong),
+        OTAESGCM::fixed32BTextSize12BNonce16BTagSimpleEnc_DEFAULT_STATELESS, NULL, key));
+
+    // Decrypt and re-expand the stats as a hub would.
+    OTRadioLink::SecurableFrameHeader sfh;
+    ASSERT_NE(0, sfh.checkAndDecodeSmallFrameHeader(bufW, lW));
+    const uint8_t iv[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0, 0, 0, 0, 0, 0 };
+    uint8_t body[OTRadioLink::ENC_BODY_SMALL_FIXED_PTEXT_MAX_SIZE];
+    uint8_t bodyLen;
+    EXPECT_EQ(lW, OTRadioLink::SimpleSecureFrame32or0BodyRXBase::decodeSecureSmallFrameRaw(&sfh,
+                                    bufW, lW,
+                                    OTAESGCM::fixed32BTextSize12BNonce16BTagSimpleDec_DEFAULT_STATELESS,
+                                    NULL, key, iv,
+                                    body, sizeof(body), bodyLen));
+    ASSERT_EQ(2 + statsLen, bodyLen);
+    EXPECT_EQ(valvePC, body[0]);
+    EXPECT_EQ(0x20, body[1]);
+    char json[OTV0P2BASE::MSG_JSON_MAX_LENGTH + 2];
+    EXPECT_NE(0, OTV0P2BASE::compactStatsToJSON(body + 2, uint8_t(bodyLen - 2), json, sizeof(json), "80808080"));
+    EXPECT_STREQ("{\"@\":\"80808080\",\"T|C16\":331,\"occ|%\":0}", json);
+}
+
 
 #endif // ARDUINO_LIB_OTAESGCM
@@ -0,0 +1,68 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * OTV0P2BASE CRC tests.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <gtest/gtest.h>
+#include <OTV0p2Base.h>
+
+
+// Check all implementations against the bitwise reference for every CRC state and datum.
+// Includes CRC inputs with the top bit set, which must be ignored as for the reference.
+TEST(CRC,crc7_5BExhaustive)
+{
+    for(int crc = 0; crc < 256; ++crc)
+        {
+        for(int datum = 0; datum < 256; ++datum)
+            {
+            const uint8_t expected = OTV0P2BASE::crc7_5B_update_bitwise(uint8_t(crc), uint8_t(datum));
+            ASSERT_EQ(0, expected & 0x80);
+            ASSERT_EQ(expected, OTV0P2BASE::crc7_5B_update_nibble(uint8_t(crc), uint8_t(datum))) << crc << " " << datum;
+            ASSERT_EQ(expected, OTV0P2BASE::crc7_5B_update_table(uint8_t(crc), uint8_t(datum))) << crc << " " << datum;
+            ASSERT_EQ(expected, OTV0P2BASE::crc7_5B_update(uint8_t(crc), uint8_t(datum))) << crc << " " << datum;
+            }
+        }
+    // Spot values from the bitwise implementation as originally shipped.
+    EXPECT_EQ(0, OTV0P2BASE::crc7_5B_update(0, 0));
+    EXPECT_EQ(0x37, OTV0P2BASE::crc7_5B_update(0, 1));
+}
+
+// Check that buffer updates match byte-at-a-time updates for all lengths and alignments.
+TEST(CRC,crc7_5BBuf)
+{
+    uint8_t buf[100];
+    for(int i = 0; i < int(sizeof(buf)); ++i) { buf[i] = uint8_t(random()); }
+    EXPECT_EQ(0x7f, OTV0P2BASE::crc7_5B_update_buf(0x7f, NULL, 0));
+    for(int offset = 0; offset < 8; ++offset)
+        {
+        for(int len = 0; len + offset <= int(sizeof(buf)); ++len)
+            {
+            const uint8_t init = uint8_t(random() & 0x7f);
+            uint8_t expected = init;
+            for(int i = 0; i < len; ++i) { expected = OTV0P2BASE::crc7_5B_update_bitwise(expected, buf[offset + i]); }
+            ASSERT_EQ(expected, OTV0P2BASE::crc7_5B_update_buf(init, buf + offset, len));
+#ifdef OTV0P2BASE_CRC7_5B_SLICE4
+            ASSERT_EQ(expected, OTV0P2BASE::crc7_5B_update_buf_slice4(init, buf + offset, len));
+#endif
+            }
+        }
+}
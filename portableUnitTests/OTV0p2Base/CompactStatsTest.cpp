@@ -0,0 +1,235 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * Driver for OTV0P2BASE_CompactStats tests.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <gtest/gtest.h>
+#include <OTV0p2Base.h>
+#include "OTV0P2BASE_CompactStats.h"
+
+
+// Check the zig-zag varint encoding, including at the extremes.
+TEST(CompactStats,ValueEncoding)
+{
+    const struct { int16_t v; uint8_t len; uint8_t bytes[3]; } cases[] =
+        {
+        { 0, 1, { 0x00 } },
+        { -1, 1, { 0x01 } },
+        { 1, 1, { 0x02 } },
+        { -64, 1, { 0x7f } },
+        { 64, 2, { 0x80, 0x01 } },
+        { 8191, 2, { 0xfe, 0x7f } },
+        { -8193, 3, { 0x81, 0x80, 0x01 } },
+        { 32767, 3, { 0xfe, 0xff, 0x03 } },
+        { -32768, 3, { 0xff, 0xff, 0x03 } },
+        };
+    for(const auto &c : cases)
+        {
+        uint8_t buf[3];
+        EXPECT_EQ(c.len, OTV0P2BASE::compactStatsValueLength(c.v)) << c.v;
+        ASSERT_EQ(c.len, OTV0P2BASE::putCompactStatsValue(buf, c.v)) << c.v;
+        EXPECT_EQ(0, memcmp(c.bytes, buf, c.len)) << c.v;
+        EXPECT_EQ(c.v, OTV0P2BASE::zigZagDecode16(OTV0P2BASE::zigZagEncode16(c.v)));
+        // Decode as the value of a single "L" entry, with an empty bitmap byte.
+        uint8_t body[6] = { 0xb1, 3 };
+        memcpy(body + 2, buf, c.len);
+        body[2 + c.len] = 0;
+        OTV0P2BASE::CompactStatsDecoder d(body, uint8_t(3 + c.len));
+        ASSERT_TRUE(d.isValid()) << c.v;
+        OTV0P2BASE::CompactStatsEntry e;
+        ASSERT_TRUE(d.next(e));
+        EXPECT_EQ(c.v, e.value);
+        EXPECT_FALSE(e.changed);
+        EXPECT_FALSE(d.next(e));
+        }
+}
+
+// Check that the shared key table is consistent.
+TEST(CompactStats,KeyTable)
+{
+    for(uint8_t id = 0; id < OTV0P2BASE::MSG_COMPACT_STATS_TABLE_SIZE; ++id)
+        {
+        const OTV0P2BASE::MSG_JSON_SimpleStatsKey_t k = OTV0P2BASE::getCompactStatsKey(id);
+        ASSERT_TRUE(NULL != k) << int(id);
+        EXPECT_TRUE(OTV0P2BASE::isValidSimpleStatsKey(k));
+        EXPECT_EQ(id, OTV0P2BASE::getCompactStatsKeyID(k)) << k;
+        }
+    EXPECT_TRUE(NULL == OTV0P2BASE::getCompactStatsKey(OTV0P2BASE::MSG_COMPACT_STATS_TABLE_SIZE));
+    EXPECT_TRUE(NULL == OTV0P2BASE::getCompactStatsKey(OTV0P2BASE::MSG_COMPACT_STATS_KEY_ESCAPE));
+    // Matches by content, not pointer.
+    static const char occ[] = "occ|%";
+    EXPECT_EQ(9, OTV0P2BASE::getCompactStatsKeyID(occ));
+    EXPECT_EQ(OTV0P2BASE::MSG_COMPACT_STATS_KEY_ESCAPE, OTV0P2BASE::getCompactStatsKeyID("gE"));
+    EXPECT_EQ(OTV0P2BASE::MSG_COMPACT_STATS_KEY_ESCAPE, OTV0P2BASE::getCompactStatsKeyID("T|C"));
+}
+
+// Check a simple set of stats byte for byte, including the changed bitmap and an unknown key.
+TEST(CompactStats,Encoding)
+{
+    OTV0P2BASE::SimpleStatsRotation<4> ss;
+    ss.setID(V0p2_SENSOR_TAG_F("ab"));
+    ss.enableCount(true);
+    ss.put(V0p2_SENSOR_TAG_F("T|C16"), 300);
+    ss.put(V0p2_SENSOR_TAG_F("gE"), -1);
+    ss.put(V0p2_SENSOR_TAG_F("L"), 0);
+    uint8_t buf[OTV0P2BASE::MSG_COMPACT_STATS_MAX_LENGTH_SECURE];
+    // All new so changed; the count never is.
+    const uint8_t expected[] = { 0xb4, 0, 0, 1, 0xd8, 0x04, 0xff, 2, 'g', 'E', 0x01, 3, 0, 0x0e };
+    ASSERT_EQ(sizeof(expected), ss.writeCompact(buf, sizeof(buf), true));
+    EXPECT_EQ(0, memcmp(expected, buf, sizeof(expected)));
+    char json[OTV0P2BASE::MSG_JSON_MAX_LENGTH + 2];
+    EXPECT_EQ(42, OTV0P2BASE::compactStatsToJSON(buf, sizeof(expected), json, sizeof(json), "ab"));
+    EXPECT_STREQ("{\"@\":\"ab\",\"+\":0,\"T|C16\":300,\"gE\":-1,\"L\":0}", json);
+    EXPECT_FALSE(ss.changedValue());
+    // Now only the changed value is flagged.
+    ss.put(V0p2_SENSOR_TAG_F("L"), 5);
+    const uint8_t l = ss.writeCompact(buf, sizeof(buf), true);
+    OTV0P2BASE::CompactStatsDecoder d(buf, l);
+    ASSERT_TRUE(d.isValid());
+    EXPECT_EQ(4, d.size());
+    OTV0P2BASE::CompactStatsEntry e;
+    uint8_t nChanged = 0;
+    while(d.next(e))
+        {
+        if(!e.changed) { continue; }
+        ++nChanged;
+        EXPECT_STREQ("L", e.key);
+        EXPECT_EQ(5, e.value);
+        }
+    EXPECT_EQ(1, nChanged);
+    // Too small a buffer is rejected.
+    EXPECT_EQ(0, ss.writeCompact(buf, 4));
+}
+
+// Check that malformed bodies are rejected.
+TEST(CompactStats,DecodeMalformed)
+{
+    const struct { uint8_t len; uint8_t bytes[8]; } bad[] =
+        {
+        { 0, { } }, // Empty.
+        { 1, { '{' } }, // JSON.
+        { 1, { 0xb1 } }, // Missing entry.
+        { 2, { 0xb0, 0 } }, // Trailing byte.
+        { 3, { 0xb1, 3, 0 } }, // Missing bitmap.
+        { 4, { 0xb1, 3, 0, 2 } }, // Unused bitmap bit set.
+        { 4, { 0xb1, 200, 0, 0 } }, // Unknown table ID.
+        { 4, { 0xb1, 3, 0x80, 0 } }, // Truncated varint.
+        { 6, { 0xb1, 3, 0x80, 0x80, 0x80, 0 } }, // Over-long varint.
+        { 6, { 0xb1, 3, 0x80, 0x80, 0x04, 0 } }, // Out-of-range varint.
+        { 5, { 0xb1, 0xff, 0, 0, 0 } }, // Empty explicit key.
+        { 6, { 0xb1, 0xff, 1, '"', 0, 0 } }, // Unsafe explicit key.
+        { 5, { 0xb1, 0xff, 3, 'a', 0 } }, // Explicit key overruns.
+        };
+    for(const auto &b : bad)
+        {
+        OTV0P2BASE::CompactStatsDecoder d(b.bytes, b.len);
+        EXPECT_FALSE(d.isValid()) << int(b.len) << " " << int(b.bytes[1]);
+        EXPECT_EQ(0, d.size());
+        OTV0P2BASE::CompactStatsEntry e;
+        EXPECT_FALSE(d.next(e));
+        char json[16];
+        EXPECT_EQ(0, OTV0P2BASE::compactStatsToJSON(b.bytes, b.len, json, sizeof(json)));
+        }
+    // Minimal valid bodies.
+    const uint8_t empty[] = { 0xb0 };
+    char json[16];
+    EXPECT_EQ(2, OTV0P2BASE::compactStatsToJSON(empty, sizeof(empty), json, sizeof(json)));
+    EXPECT_STREQ("{}", json);
+    const uint8_t one[] = { 0xb1, 0xff, 2, 'g', 'E', 0x03, 1 };
+    EXPECT_EQ(9, OTV0P2BASE::compactStatsToJSON(one, sizeof(one), json, sizeof(json)));
+    EXPECT_STREQ("{\"gE\":-2}", json);
+    // Output that would fill the buffer fails.
+    EXPECT_EQ(0, OTV0P2BASE::compactStatsToJSON(one, sizeof(one), json, 10));
+    EXPECT_EQ(9, OTV0P2BASE::compactStatsToJSON(one, sizeof(one), json, 11));
+}
+
+// Check that compact stats re-expanded as JSON match writeJSON() for the same stats and updates,
+// where all fields fit in both, including the side-effects on later output.
+TEST(CompactStats,RoundTripEquivalence)
+{
+    static const char * const keys[] = { "T|C16", "H|%", "L", "B|cV", "occ|%", "vac|h", "v|%", "tT|C", "O", "gE" };
+    static const uint8_t nKeys = sizeof(keys) / sizeof(keys[0]);
+    OTV0P2BASE::SimpleStatsRotation<8> ssJSON, ssCompact;
+    OTV0P2BASE::SimpleStatsRotationBase * const all[] = { &ssJSON, &ssCompact };
+    for(int round = 0; round < 2000; ++round)
+        {
+        // Apply the same random updates to both.
+        const uint8_t nUpdates = OTV0P2BASE::randRNG8() & 7;
+        for(uint8_t u = 0; u < nUpdates; ++u)
+            {
+            const char * const k = keys[OTV0P2BASE::randRNG8() % nKeys];
+            const uint8_t r = OTV0P2BASE::randRNG8();
+            const int16_t v = (r & 0x80) ? int16_t((OTV0P2BASE::randRNG8() << 8) | OTV0P2BASE::randRNG8()) : int16_t(r & 0xf);
+            const bool lowPri = (0 != (r & 0x40));
+            const bool rem = (0 == (r & 0x30));
+            for(OTV0P2BASE::SimpleStatsRotationBase *ss : all) { if(rem) { ss->remove(k); } else { ss->put(k, v, lowPri); } }
+            }
+        const bool count = OTV0P2BASE::randRNG8NextBoolean();
+        const bool noID = (0 == (OTV0P2BASE::randRNG8() & 7));
+        for(OTV0P2BASE::SimpleStatsRotationBase *ss : all)
+            { ss->enableCount(count); ss->setID(noID ? V0p2_SENSOR_TAG_F("") : V0p2_SENSOR_TAG_F("cdfb")); }
+        const bool maximise = OTV0P2BASE::randRNG8NextBoolean();
+        const bool suppress = (0 == (OTV0P2BASE::randRNG8() & 3));
+        // Large enough buffers that every field always fits.
+        uint8_t bJSON[255], bCompact[255];
+        char bExpanded[255];
+        const uint8_t lJSON = ssJSON.writeJSON(bJSON, sizeof(bJSON), 0, maximise, suppress);
+        const uint8_t lCompact = ssCompact.writeCompact(bCompact, sizeof(bCompact), maximise, suppress);
+        ASSERT_NE(0, lJSON) << round;
+        ASSERT_NE(0, lCompact) << round;
+        ASSERT_GT(lJSON, lCompact) << round;
+        const uint8_t lExpanded = OTV0P2BASE::compactStatsToJSON(bCompact, lCompact, bExpanded, sizeof(bExpanded), noID ? NULL : "cdfb");
+        ASSERT_EQ(lJSON, lExpanded) << round;
+        ASSERT_STREQ((const char *)bJSON, bExpanded) << round;
+        ASSERT_EQ(ssJSON.changedValue(), ssCompact.changedValue()) << round;
+        }
+}
+
+// Check that more stats fit in a secure frame body in compact form than as JSON.
+TEST(CompactStats,MoreStatsPerFrame)
+{
+    OTV0P2BASE::SimpleStatsRotation<8> ssJSON, ssCompact;
+    OTV0P2BASE::SimpleStatsRotationBase * const all[] = { &ssJSON, &ssCompact };
+    for(OTV0P2BASE::SimpleStatsRotationBase *ss : all)
+        {
+        ss->setID(V0p2_SENSOR_TAG_F(""));
+        ss->put(V0p2_SENSOR_TAG_F("T|C16"), 331);
+        ss->put(V0p2_SENSOR_TAG_F("H|%"), 58);
+        ss->put(V0p2_SENSOR_TAG_F("L"), 143);
+        ss->put(V0p2_SENSOR_TAG_F("B|cV"), 256, true);
+        ss->put(V0p2_SENSOR_TAG_F("v|%"), 35);
+        ss->put(V0p2_SENSOR_TAG_F("tT|C"), 19);
+        ss->put(V0p2_SENSOR_TAG_F("vac|h"), 12, true);
+        ss->put(V0p2_SENSOR_TAG_F("occ|%"), 0);
+        }
+    // JSON as limited for a secure frame.
+    uint8_t bJSON[OTV0P2BASE::MSG_JSON_MAX_LENGTH_SECURE + 2];
+    ASSERT_NE(0, ssJSON.writeJSON(bJSON, sizeof(bJSON), 0, true));
+    uint8_t nJSON = 0;
+    for(const uint8_t *p = bJSON; '\0' != *p; ++p) { if(':' == *p) { ++nJSON; } }
+    uint8_t bCompact[OTV0P2BASE::MSG_COMPACT_STATS_MAX_LENGTH_SECURE];
+    const uint8_t lCompact = ssCompact.writeCompact(bCompact, sizeof(bCompact), true);
+    OTV0P2BASE::CompactStatsDecoder d(bCompact, lCompact);
+    ASSERT_TRUE(d.isValid());
+    EXPECT_EQ(8, d.size());
+    EXPECT_GT(d.size(), 2 * nJSON);
+}
@@ -0,0 +1,190 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * OTV0P2BASE JSON log replay tests.
+ */
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include <OTV0p2Base.h>
+#include <utility/OTV0P2BASE_JSONLogReplay.h>
+
+
+// Sink that records everything it sees as text, eg "08T09:33 L=134;".
+class RecordingSink final : public OTV0P2BASE::JSONLogNodeSink
+    {
+    public:
+        std::string seen;
+        int records = 0;
+        virtual void record(const OTV0P2BASE::JSONLogTime &) override { ++records; }
+        virtual void value(const OTV0P2BASE::JSONLogTime &t, const char *key, int32_t v) override
+            {
+            char b[64];
+            snprintf(b, sizeof(b), "%02dT%02d:%02d %s=%d;", t.day, t.hour, t.minute, key, int(v));
+            seen += b;
+            }
+    };
+
+// Gives each node its own RecordingSink, ignoring node "IGNORED".
+class RecordingFactory final : public OTV0P2BASE::JSONLogSinkFactory
+    {
+    public:
+        RecordingSink a, b;
+        int calls = 0;
+        virtual OTV0P2BASE::JSONLogNodeSink *sinkForNode(const char *id) override
+            {
+            ++calls;
+            if(0 == strcmp(id, "A1")) { return(&a); }
+            if(0 == strcmp(id, "B2")) { return(&b); }
+            return(NULL);
+            }
+    };
+
+// Check parsing and demultiplexing of individual lines.
+TEST(JSONLogReplay,processLine)
+{
+    RecordingFactory f;
+    OTV0P2BASE::JSONLogReplay r(f);
+    char l1[] = "2016-10-08T09:33:12Z A1 {\"@\":\"A1\",\"+\":1,\"L\":134,\"T|C16\":-5}";
+    EXPECT_TRUE(r.processLine(l1));
+    char l2[] = "2016-10-08T09:34:00Z B2 {\"@\":\"B2\",\"L\":7,\"H|%\":62.5,\"b\":true}\r";
+    EXPECT_TRUE(r.processLine(l2));
+    char l3[] = "2016-10-09T23:59:59Z A1 {\"L\":0}";
+    EXPECT_TRUE(r.processLine(l3));
+    char l4[] = "2016-10-09T23:59:59Z IGNORED {\"L\":0}";
+    EXPECT_TRUE(r.processLine(l4));
+    char l5[] = "2016-10-09T23:59:59Z IGNORED {}";
+    EXPECT_TRUE(r.processLine(l5));
+    char blank[] = " \r";
+    EXPECT_FALSE(r.processLine(blank));
+    EXPECT_EQ("08T09:33 +=1;08T09:33 L=134;08T09:33 T|C16=-5;09T23:59 L=0;", f.a.seen);
+    EXPECT_EQ(2, f.a.records);
+    EXPECT_EQ("08T09:34 L=7;", f.b.seen);
+    EXPECT_EQ(3, f.calls);
+    EXPECT_EQ(3U, r.nodesSeen());
+    EXPECT_EQ(6U, r.linesRead);
+    EXPECT_EQ(5U, r.linesAccepted);
+    EXPECT_EQ(0U, r.linesRejected);
+}
+
+// Check that malformed lines are rejected without any values being passed on.
+TEST(JSONLogReplay,rejects)
+{
+    static const char *const bad[] =
+        {
+        "2016-10-08T09:33:12Z A1",                                  // No JSON.
+        "2016-10-08T09:33:12Z {\"L\":1}",                           // No ID.
+        "2016-10-08 09:33:12Z A1 {\"L\":1}",                        // Bad timestamp.
+        "2016-13-08T09:33:12Z A1 {\"L\":1}",                        // Bad month.
+        "2016-10-08T09:33:12Z A1 {\"L\":1",                         // Unterminated.
+        "2016-10-08T09:33:12Z A1 {\"L\":1}}",                       // Trailing junk.
+        "2016-10-08T09:33:12Z A1 {\"L\":1,\"x\":\"\t\"}",           // Control character.
+        "2016-10-08T09:33:12Z A1 {\"L\":1,\"ZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZ\":2}", // Too long.
+        "2016-10-08T09:33:12Z A1 {\"L\" 1}",                        // Missing colon.
+        "2016-10-08T09:33:12Z A1 {L:1}",                            // Unquoted key.
+        };
+    RecordingFactory f;
+    OTV0P2BASE::JSONLogReplay r(f);
+    for(const char *b : bad)
+        {
+        char line[128];
+        strcpy(line, b);
+        EXPECT_FALSE(r.processLine(line)) << b;
+        }
+    EXPECT_EQ(sizeof(bad)/sizeof(bad[0]), r.linesRejected);
+    EXPECT_EQ(0U, r.linesAccepted);
+    EXPECT_EQ(0, f.a.records);
+    EXPECT_EQ(0, f.calls);
+    // Non-integer and out-of-range values are skipped but the line is valid.
+    char l[] = "2016-10-08T09:33:12Z A1 {\"a\":1e3,\"b\":2147483648,\"c\":-2147483648}";
+    EXPECT_TRUE(r.processLine(l));
+    EXPECT_EQ("08T09:33 c=-2147483648;", f.a.seen);
+}
+
+// Check streaming from a file, including lines spanning read chunks,
+// an over-long line and an unterminated final line.
+TEST(JSONLogReplay,replay)
+{
+    FILE *const tf = tmpfile();
+    ASSERT_TRUE(NULL != tf);
+    const int lines = 20000;
+    for(int i = 0; i < lines; ++i)
+        {
+        fprintf(tf, "2016-10-%02dT%02d:%02d:00Z %s {\"+\":%d,\"L\":%d}\n",
+            1 + (i / 1440) % 28, (i / 60) % 24, i % 60, (i & 1) ? "A1" : "B2", i & 15, i % 200);
+        if(1000 == i)
+            {
+            // A line too long for the read buffer, which is skipped.
+            for(size_t j = 0; j < OTV0P2BASE::JSONLogReplay::readBufSize + 10; ++j) { fputc('x', tf); }
+            fputc('\n', tf);
+            }
+        }
+    fputs("2016-10-08T09:33:12Z A1 {\"L\":999}", tf);
+    rewind(tf);
+    OTV0P2BASE::JSONLogKeyTimelines tl("L");
+    OTV0P2BASE::JSONLogReplay r(tl);
+    EXPECT_TRUE(r.replay(tf));
+    fclose(tf);
+    EXPECT_EQ(uint32_t(lines + 2), r.linesRead);
+    EXPECT_EQ(uint32_t(lines + 1), r.linesAccepted);
+    EXPECT_EQ(1U, r.linesRejected);
+    EXPECT_EQ(2U, tl.size());
+    const OTV0P2BASE::JSONLogKeyTimelines::Timeline *const a = tl.getTimeline("A1");
+    const OTV0P2BASE::JSONLogKeyTimelines::Timeline *const b = tl.getTimeline("B2");
+    ASSERT_TRUE((NULL != a) && (NULL != b));
+    EXPECT_TRUE(NULL == tl.getTimeline("C3"));
+    ASSERT_EQ(size_t(lines / 2 + 1), a->size());
+    ASSERT_EQ(size_t(lines / 2), b->size());
+    for(int i = 0; i < lines; ++i)
+        {
+        const OTV0P2BASE::JSONLogKeyTimelines::Sample &s = (i & 1) ? (*a)[i / 2] : (*b)[i / 2];
+        ASSERT_EQ(i % 200, s.v) << i;
+        ASSERT_EQ(i % 60, s.t.minute) << i;
+        ASSERT_EQ((i / 60) % 24, s.t.hour) << i;
+        }
+    EXPECT_EQ(999, a->back().v);
+    EXPECT_EQ(9, a->back().t.hour);
+}
+
+// Check that a single node can be selected.
+TEST(JSONLogReplay,singleNode)
+{
+    FILE *const tf = tmpfile();
+    ASSERT_TRUE(NULL != tf);
+    fputs("2016-10-08T00:12:30Z 91ACF3CFF388D4E0 {\"L\":3}\n"
+          "2016-10-08T00:12:31Z 96F0CED3B4E690E8 {\"L\":134}\n"
+          "2016-10-08T00:16:30Z 91ACF3CFF388D4E0 {\"L\":4,\"O\":1}\n", tf);
+    rewind(tf);
+    OTV0P2BASE::JSONLogKeyTimelines tl("L", "96F0CED3B4E690E8");
+    OTV0P2BASE::JSONLogReplay r(tl);
+    EXPECT_TRUE(r.replay(tf));
+    fclose(tf);
+    EXPECT_EQ(2U, r.nodesSeen());
+    EXPECT_EQ(1U, tl.size());
+    const OTV0P2BASE::JSONLogKeyTimelines::Timeline *const t = tl.getTimeline("96F0CED3B4E690E8");
+    ASSERT_TRUE(NULL != t);
+    ASSERT_EQ(1U, t->size());
+    EXPECT_EQ(134, (*t)[0].v);
+    EXPECT_EQ(31, (*t)[0].t.second);
+    // Missing files are reported.
+    EXPECT_FALSE(r.replay("/nonexistent/file.json"));
+}
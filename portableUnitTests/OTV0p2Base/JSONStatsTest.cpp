@@ -174,6 +174,86 @@ TEST(JSONStats,JSONForTX)
 //  AssertIsTrue(quickValidateRawSimpleJSONMessage(buf));
   }
 
+// Check that the single-pass writeJSONForTX() gives byte-identical output, CRC and side-effects
+// to writeJSON() then adjustJSONMsgForTXAndComputeCRC().
+TEST(JSONStats,WriterEquivalence)
+{
+    static const char * const keys[] = { "T|C16", "H|%", "L", "B|cV", "occ|%", "vac|h", "v|%", "tT|C", "O", "gE" };
+    static const uint8_t nKeys = sizeof(keys) / sizeof(keys[0]);
+    OTV0P2BASE::SimpleStatsRotation<8> ssRef, ssTX;
+    OTV0P2BASE::SimpleStatsRotationBase * const all[] = { &ssRef, &ssTX };
+    for(OTV0P2BASE::SimpleStatsRotationBase *ss : all) { ss->setID(V0p2_SENSOR_TAG_F("cdfb")); }
+    for(int round = 0; round < 2000; ++round)
+        {
+        // Apply the same random updates to both.
+        const uint8_t nUpdates = OTV0P2BASE::randRNG8() & 7;
+        for(uint8_t u = 0; u < nUpdates; ++u)
+            {
+            const char * const k = keys[OTV0P2BASE::randRNG8() % nKeys];
+            const uint8_t r = OTV0P2BASE::randRNG8();
+            const int16_t v = (r & 0x80) ? int16_t((OTV0P2BASE::randRNG8() << 8) | OTV0P2BASE::randRNG8()) : int16_t(r & 0xf);
+            const bool lowPri = (0 != (r & 0x40));
+            const bool rem = (0 == (r & 0x30));
+            for(OTV0P2BASE::SimpleStatsRotationBase *ss : all) { if(rem) { ss->remove(k); } else { ss->put(k, v, lowPri); } }
+            }
+        const bool count = OTV0P2BASE::randRNG8NextBoolean();
+        const bool noID = (0 == (OTV0P2BASE::randRNG8() & 7));
+        for(OTV0P2BASE::SimpleStatsRotationBase *ss : all)
+            { ss->enableCount(count); ss->setID(noID ? V0p2_SENSOR_TAG_F("") : V0p2_SENSOR_TAG_F("cdfb")); }
+        const bool maximise = OTV0P2BASE::randRNG8NextBoolean();
+        const bool suppress = (0 == (OTV0P2BASE::randRNG8() & 3));
+        // Mostly normal-sized buffers, sometimes small or larger than allowed for TX.
+        const uint8_t bufSize = (0 == (OTV0P2BASE::randRNG8() & 3)) ? uint8_t(10 + (OTV0P2BASE::randRNG8() % 56)) : uint8_t(OTV0P2BASE::MSG_JSON_MAX_LENGTH + 2);
+        uint8_t bRef[OTV0P2BASE::MSG_JSON_ABS_MAX_LENGTH + 16], bTX[sizeof(bRef)];
+        const uint8_t lRef = ssRef.writeJSON(bRef, bufSize, 0, maximise, suppress);
+        uint8_t crcTX;
+        const uint8_t lTX = ssTX.writeJSONForTX(bTX, bufSize, 0, crcTX, maximise, suppress);
+        ASSERT_EQ(lRef, lTX) << round;
+        ASSERT_EQ(ssRef.changedValue(), ssTX.changedValue()) << round;
+        const uint8_t crcRef = OTV0P2BASE::adjustJSONMsgForTXAndComputeCRC((char *)bRef);
+        ASSERT_EQ(crcRef, crcTX) << round << " " << (const char *)bRef;
+        if(0 != lRef) { ASSERT_EQ(0, memcmp(bRef, bTX, lRef + 1)) << round; }
+        }
+}
+
+// Test cached key slots, including after remove() has moved stats around.
+TEST(JSONStats,KeySlots)
+{
+    OTV0P2BASE::SimpleStatsRotation<3> ss;
+    ss.setID(V0p2_SENSOR_TAG_F(""));
+    static const char a[] = "a", b[] = "b", c[] = "c";
+    OTV0P2BASE::SimpleStatsRotationBase::KeySlot sa, sb, sc;
+    EXPECT_TRUE(ss.put(sa, a, 1));
+    EXPECT_TRUE(ss.put(sb, b, 2));
+    EXPECT_TRUE(ss.put(sc, c, 3));
+    EXPECT_EQ(0, sa.index);
+    EXPECT_EQ(1, sb.index);
+    EXPECT_EQ(2, sc.index);
+    EXPECT_EQ(3, ss.size());
+    // Full, so a new key fails; an invalid key always fails.
+    OTV0P2BASE::SimpleStatsRotationBase::KeySlot sd;
+    EXPECT_FALSE(ss.put(sd, "d", 4));
+    EXPECT_FALSE(ss.put(sd, NULL, 4));
+    // Removing "a" moves "c" into its place, leaving the slot for "c" stale.
+    EXPECT_TRUE(ss.remove(sa, a));
+    EXPECT_FALSE(ss.remove(sa, a));
+    EXPECT_EQ(2, ss.size());
+    EXPECT_TRUE(ss.put(sc, c, 33));
+    EXPECT_EQ(0, sc.index);
+    // Slot and plain updates of the same key are interchangeable.
+    EXPECT_TRUE(ss.put(V0p2_SENSOR_TAG_F("b"), 22));
+    EXPECT_TRUE(ss.put(sb, b, 222));
+    EXPECT_EQ(2, ss.size());
+    char buf[OTV0P2BASE::MSG_JSON_MAX_LENGTH + 2]; // Allow for trailing '\0' and spare byte.
+    EXPECT_EQ(16, ss.writeJSON((uint8_t*)buf, sizeof(buf), 0, true));
+    EXPECT_STREQ(buf, "{\"c\":33,\"b\":222}") << buf;
+    // A key with equal text but a different pointer is still found.
+    char a2[] = "c";
+    EXPECT_TRUE(ss.put(sa, a2, 34));
+    EXPECT_EQ(0, sa.index);
+    EXPECT_EQ(2, ss.size());
+}
+
 
 // Testing stats object sizing with placeholders.
 TEST(JSONStats,VariadicJSON0)
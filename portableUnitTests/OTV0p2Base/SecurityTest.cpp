@@ -0,0 +1,145 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * Driver for OTV0p2Base security support tests.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <OTV0p2Base.h>
+
+#include "OTV0P2BASE_Security.h"
+
+
+// Simple linear reference implementation of prefix look-up over an unsorted table,
+// as for the original EEPROM association table scan.
+static int8_t linearMatch(const uint8_t (*table)[OTV0P2BASE::OpenTRV_Node_ID_Bytes], const uint8_t n,
+                          const uint8_t startIndex, const uint8_t *prefix, const uint8_t prefixLen)
+    {
+    for(uint8_t i = startIndex; i < n; ++i)
+        { if((0 == prefixLen) || (0 == memcmp(table[i], prefix, prefixLen))) { return(int8_t(i)); } }
+    return(-1);
+    }
+
+// Make a valid-looking random node ID.
+static void randomID(uint8_t *id)
+    {
+    for(uint8_t i = 0; i < OTV0P2BASE::OpenTRV_Node_ID_Bytes; ++i)
+        { do { id[i] = 0x80 | uint8_t(random()); } while(!OTV0P2BASE::validIDByte(id[i])); }
+    }
+
+// Basic operation of the RAM node ID prefix index.
+TEST(NodeIDPrefixIndex,basics)
+{
+    OTV0P2BASE::NodeIDPrefixIndex<4> idx;
+    EXPECT_EQ(4, idx.getCapacity());
+    EXPECT_EQ(0, idx.size());
+    // Nothing to find when empty.
+    EXPECT_EQ(-1, idx.getNextMatchingNodeID(0, NULL, 0, NULL));
+    const uint8_t id0[] = { 0x88, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87 };
+    const uint8_t id1[] = { 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88 };
+    const uint8_t id2[] = { 0x88, 0x81, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99 };
+    EXPECT_TRUE(idx.add(id0, 0));
+    EXPECT_TRUE(idx.add(id1, 1));
+    EXPECT_TRUE(idx.add(id2, 2));
+    EXPECT_EQ(3, idx.size());
+    uint8_t out[OTV0P2BASE::OpenTRV_Node_ID_Bytes];
+    // Zero-length prefix matches in association order.
+    EXPECT_EQ(0, idx.getNextMatchingNodeID(0, NULL, 0, out));
+    EXPECT_EQ(0, memcmp(id0, out, sizeof(out)));
+    EXPECT_EQ(1, idx.getNextMatchingNodeID(1, NULL, 0, out));
+    EXPECT_EQ(0, memcmp(id1, out, sizeof(out)));
+    EXPECT_EQ(-1, idx.getNextMatchingNodeID(3, NULL, 0, out));
+    // Shared prefix.
+    EXPECT_EQ(0, idx.getNextMatchingNodeID(0, id0, 2, out));
+    EXPECT_EQ(2, idx.getNextMatchingNodeID(1, id0, 2, out));
+    EXPECT_EQ(0, memcmp(id2, out, sizeof(out)));
+    // Full-length match.
+    EXPECT_EQ(2, idx.getNextMatchingNodeID(0, id2, 8, NULL));
+    EXPECT_EQ(1, idx.getNextMatchingNodeID(0, id1, 1, NULL));
+    // No match.
+    const uint8_t nm[] = { 0x90 };
+    EXPECT_EQ(-1, idx.getNextMatchingNodeID(0, nm, 1, NULL));
+    // Bad arguments.
+    EXPECT_EQ(-1, idx.getNextMatchingNodeID(0, NULL, 1, NULL));
+    EXPECT_EQ(-1, idx.getNextMatchingNodeID(0, id0, 9, NULL));
+    EXPECT_FALSE(idx.add(NULL, 3));
+    // Duplicate IDs are allowed; fill to capacity.
+    EXPECT_TRUE(idx.add(id0, 3));
+    EXPECT_EQ(3, idx.getNextMatchingNodeID(1, id0, 8, NULL));
+    EXPECT_FALSE(idx.add(id1, 4));
+    idx.clear();
+    EXPECT_EQ(0, idx.size());
+    EXPECT_EQ(-1, idx.getNextMatchingNodeID(0, id0, 1, NULL));
+}
+
+// Check index against linear reference scan for random tables and prefixes.
+TEST(NodeIDPrefixIndex,matchesLinearScan)
+{
+    static const uint8_t maxN = 100;
+    uint8_t table[maxN][OTV0P2BASE::OpenTRV_Node_ID_Bytes];
+    for(int run = 0; run < 20; ++run)
+        {
+        OTV0P2BASE::NodeIDPrefixIndex<maxN> idx;
+        const uint8_t n = uint8_t(random() % (maxN + 1));
+        for(uint8_t i = 0; i < n; ++i)
+            {
+            randomID(table[i]);
+            // Force some shared prefixes.
+            if((i > 0) && (0 == (random() & 3))) { memcpy(table[i], table[random() % i], 1 + (random() & 7)); }
+            ASSERT_TRUE(idx.add(table[i], i));
+            }
+        for(int t = 0; t < 200; ++t)
+            {
+            uint8_t prefix[OTV0P2BASE::OpenTRV_Node_ID_Bytes];
+            if((0 != n) && (random() & 1)) { memcpy(prefix, table[random() % n], sizeof(prefix)); }
+            else { randomID(prefix); }
+            const uint8_t prefixLen = uint8_t(random() % 9);
+            const uint8_t start = uint8_t(random() % (maxN + 1));
+            uint8_t out[OTV0P2BASE::OpenTRV_Node_ID_Bytes];
+            const int8_t expected = linearMatch(table, n, start, prefix, prefixLen);
+            EXPECT_EQ(expected, idx.getNextMatchingNodeID(start, prefix, prefixLen, out));
+            if(expected >= 0) { EXPECT_EQ(0, memcmp(table[expected], out, sizeof(out))); }
+            }
+        }
+}
+
+// Rough relative timing of index vs linear scan for a large association table.
+// Not a pass/fail test, other than that results must agree.
+TEST(NodeIDPrefixIndex,speed)
+{
+    static const uint8_t n = 127;
+    static const int lookups = 10000;
+    uint8_t table[n][OTV0P2BASE::OpenTRV_Node_ID_Bytes];
+    OTV0P2BASE::NodeIDPrefixIndex<n> idx;
+    for(uint8_t i = 0; i < n; ++i) { randomID(table[i]); idx.add(table[i], i); }
+    int sumL = 0, sumI = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    for(int i = 0; i < lookups; ++i) { sumL += linearMatch(table, n, 0, table[i % n], 4); }
+    const auto t1 = std::chrono::steady_clock::now();
+    for(int i = 0; i < lookups; ++i) { sumI += idx.getNextMatchingNodeID(0, table[i % n], 4, NULL); }
+    const auto t2 = std::chrono::steady_clock::now();
+    EXPECT_EQ(sumL, sumI);
+    const double nsL = std::chrono::duration<double, std::nano>(t1 - t0).count() / lookups;
+    const double nsI = std::chrono::duration<double, std::nano>(t2 - t1).count() / lookups;
+    RecordProperty("linearNsPerLookup", int(nsL));
+    RecordProperty("indexNsPerLookup", int(nsI));
+}
@@ -0,0 +1,181 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Damon Hart-Davis 2016
+*/
+
+/*
+ * Driver for OTV0P2BASE_SensorScheduler tests.
+ */
+
+#include <stdint.h>
+#include <gtest/gtest.h>
+#include <OTV0p2Base.h>
+#include "OTV0P2BASE_SensorScheduler.h"
+
+
+namespace SST
+{
+// Simulated sub-cycle time and record of sleeps.
+static uint8_t subCycleTime;
+static uint8_t sleepCount;
+static uint8_t getSubCycleTime() { return(subCycleTime); }
+static bool sleepUntilSubCycleTime(const uint8_t t)
+    {
+    ++sleepCount;
+    if(t <= subCycleTime) { return(false); }
+    subCycleTime = t;
+    return(true);
+    }
+static void reset(const uint8_t t = 0) { subCycleTime = t; sleepCount = 0; }
+
+// Split-phase sensor mock with a fixed conversion time.
+// Records when it was started and collected.
+class SplitPhaseMock final : public OTV0P2BASE::SensorSplitPhase
+    {
+    public:
+        const uint16_t delayMs;
+        uint8_t starts = 0;
+        uint8_t finishes = 0;
+        uint8_t startedAt = 0;
+        uint8_t finishedAt = 0;
+        explicit SplitPhaseMock(const uint16_t d) : delayMs(d) { }
+        virtual uint16_t startRead() override { ++starts; startedAt = subCycleTime; return(delayMs); }
+        virtual void finishRead() override { ++finishes; finishedAt = subCycleTime; }
+    };
+
+// Split-phase sensor mock whose start fails (eg on an I2C error) while failStart is set.
+class FailingSplitPhaseMock final : public OTV0P2BASE::SensorSplitPhase
+    {
+    public:
+        bool failStart = true;
+        uint8_t starts = 0;
+        uint8_t finishes = 0;
+        virtual uint16_t startRead() override { ++starts; return(failStart ? startReadFailed : 0); }
+        virtual void finishRead() override { ++finishes; }
+    };
+
+typedef OTV0P2BASE::SensorScheduler<3, getSubCycleTime, sleepUntilSubCycleTime> Scheduler_t;
+}
+
+// Check that all due sensors are started together and collected after one sleep for the slowest.
+TEST(SensorScheduler,overlapsConversions)
+{
+    SST::reset(10);
+    SST::SplitPhaseMock fast(30), slow(94), instant(0);
+    SST::Scheduler_t s;
+    EXPECT_TRUE(s.add(fast, 60));
+    EXPECT_TRUE(s.add(slow, 60));
+    EXPECT_TRUE(s.add(instant, 60));
+    EXPECT_EQ(3, s.getSensorCount());
+    EXPECT_EQ(3, s.poll(2));
+    EXPECT_FALSE(s.isCollectPending());
+    EXPECT_EQ(1, SST::sleepCount);
+    // 94ms is 12.03 ticks of 7.8125ms, rounded up to 13, plus 1 for the current partial tick.
+    EXPECT_EQ(14, SST::Scheduler_t::msToTicks(94));
+    EXPECT_EQ(10 + 14, SST::subCycleTime);
+    for(const SST::SplitPhaseMock *m : { &fast, &slow, &instant })
+        {
+        EXPECT_EQ(1, m->starts);
+        EXPECT_EQ(1, m->finishes);
+        EXPECT_EQ(10, m->startedAt);
+        EXPECT_EQ(10 + 14, m->finishedAt);
+        }
+}
+
+// Check that the sleep is skipped when nothing needs to wait.
+TEST(SensorScheduler,noSleepIfNoDelay)
+{
+    SST::reset(100);
+    SST::SplitPhaseMock instant(0);
+    SST::Scheduler_t s;
+    EXPECT_TRUE(s.add(instant, 0));
+    EXPECT_EQ(1, s.poll(2));
+    EXPECT_EQ(1, s.poll(2));
+    EXPECT_EQ(0, SST::sleepCount);
+    EXPECT_EQ(2, instant.finishes);
+}
+
+// Check that each sensor is polled at its own interval.
+TEST(SensorScheduler,pollIntervals)
+{
+    SST::SplitPhaseMock every(5), four(5), minute(5);
+    SST::Scheduler_t s;
+    EXPECT_TRUE(s.add(every, 0));
+    EXPECT_TRUE(s.add(four, 4));
+    EXPECT_TRUE(s.add(minute, 60));
+    SST::SplitPhaseMock extra(5);
+    EXPECT_FALSE(s.add(extra, 0));
+    // Simulate two minutes of 2s cycles.
+    for(int i = 0; i < 60; ++i) { SST::reset(0); s.poll(2); }
+    EXPECT_EQ(60, every.finishes);
+    EXPECT_EQ(30, four.finishes);
+    EXPECT_EQ(2, minute.finishes);
+    EXPECT_EQ(0, extra.starts);
+}
+
+// Check that a conversion that would overrun the cycle is collected at the next poll.
+TEST(SensorScheduler,deferNearEndOfCycle)
+{
+    SST::reset(240);
+    SST::SplitPhaseMock slow(94), other(30);
+    SST::Scheduler_t s;
+    EXPECT_TRUE(s.add(slow, 4));
+    EXPECT_TRUE(s.add(other, 60));
+    EXPECT_EQ(0, s.poll(2));
+    EXPECT_TRUE(s.isCollectPending());
+    EXPECT_EQ(0, SST::sleepCount);
+    EXPECT_EQ(0, slow.finishes);
+    // Next cycle: the old readings are collected first, then nothing new is due.
+    SST::reset(0);
+    EXPECT_EQ(2, s.poll(2));
+    EXPECT_FALSE(s.isCollectPending());
+    EXPECT_EQ(1, slow.finishes);
+    EXPECT_EQ(1, other.finishes);
+    EXPECT_EQ(1, slow.starts);
+    // An explicit collect() with nothing pending does nothing.
+    EXPECT_EQ(0, s.collect());
+}
+
+// Check that a sensor whose start fails is not collected and does not delay the others.
+TEST(SensorScheduler,skipFailedStart)
+{
+    SST::reset(10);
+    SST::FailingSplitPhaseMock failing;
+    SST::SplitPhaseMock fast(30);
+    SST::Scheduler_t s;
+    EXPECT_TRUE(s.add(failing, 0));
+    EXPECT_TRUE(s.add(fast, 0));
+    EXPECT_EQ(1, s.poll(2));
+    EXPECT_FALSE(s.isCollectPending());
+    EXPECT_EQ(1, failing.starts);
+    EXPECT_EQ(0, failing.finishes);
+    EXPECT_EQ(1, fast.finishes);
+    // Slept only for the working sensor, not for the failed start's (invalid) delay.
+    EXPECT_EQ(1, SST::sleepCount);
+    EXPECT_EQ(10 + SST::Scheduler_t::msToTicks(30), SST::subCycleTime);
+    // With only a failing sensor due, nothing is collected or slept for.
+    SST::Scheduler_t s1;
+    EXPECT_TRUE(s1.add(failing, 0));
+    SST::reset(10);
+    EXPECT_EQ(0, s1.poll(2));
+    EXPECT_FALSE(s1.isCollectPending());
+    EXPECT_EQ(0, SST::sleepCount);
+    EXPECT_EQ(0, failing.finishes);
+    // Once the sensor recovers it is collected as normal.
+    failing.failStart = false;
+    EXPECT_EQ(1, s1.poll(2));
+    EXPECT_EQ(1, failing.finishes);
+}